@@ -0,0 +1,452 @@
+// CpuTest - math kernel throughput and thread tuning
+//
+// The kernels run on the instruction set the engine selects, on an L1
+// resident batch and on one far larger than the last level cache: the
+// first shows the compute speed, the second whether the kernel is
+// bound by the memory. The thread pool is then tuned on the same
+// operations: the worker count and the smallest arrays worth splitting.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+
+// Elements of the L1 resident batch
+#define PROFILE_CACHE_COUNT		256
+
+// Elements processed per measurement, the small batches are repeated to reach it
+#define PROFILE_WORK			( 1u << 22 )
+
+// Timed measurements of a batch, the best one counts
+#define PROFILE_TRIES			3
+
+// Floats per vertex, the size of VERTEX
+#define PROFILE_STRIDE			8
+
+// A parallel call has to be this much faster than one thread to be worth it
+#define PROFILE_MT_GAIN			1.1
+
+// A worker count within this much of the fastest one is as good
+#define PROFILE_MT_TOLERANCE	1.05
+
+// Smallest and largest arrays of the threshold measurement
+#define PROFILE_MT_MIN			1024
+#define PROFILE_MT_MAX			( 1u << 18 )
+
+
+// Arrays shared by the operations, allocated for the large batch
+typedef struct KERNELDATA
+{
+	float			*pVertices;		// PROFILE_STRIDE floats per vertex
+	float			*pAngles;
+	float			*pSin;
+	float			*pCos;
+	KPMatrix		*pMatrices;
+	KPTRS			*pTRS;
+	KPSPHERE		*pSpheres;
+	KPAABB			*pBoxes;
+	unsigned char	*pStates;
+	UINT			*pPixels;
+	KPSOASTREAM		Stream;			// x, y, z of the vertices in separate arrays, in pVertices
+	KPPlane			Frustum[6];
+	KPMatrix		mTransform;
+	UINT			nCount;			// Elements of the large batch
+} KERNELDATA;
+
+// An operation processes nCount elements of the arrays
+typedef void (*KERNELOP)(KERNELDATA *pData, UINT nCount);
+
+
+// Operations ////
+//////////////////
+
+static void OpPoints(KERNELDATA *pData, UINT nCount)
+{
+	pData->mTransform.TransformPoints(pData->pVertices, PROFILE_STRIDE * sizeof(float),
+									  pData->pVertices, PROFILE_STRIDE * sizeof(float), nCount);
+}
+
+static void OpPointStreams(KERNELDATA *pData, UINT nCount)
+{
+	pData->mTransform.TransformPoints(pData->Stream, pData->Stream, nCount);
+}
+
+static void OpNormalize(KERNELDATA *pData, UINT nCount)
+{
+	KPNormalizeArray(pData->pVertices + 3, PROFILE_STRIDE * sizeof(float), nCount, KPPRECISION_REFINED);
+}
+
+static void OpNormalizeStreams(KERNELDATA *pData, UINT nCount)
+{
+	KPNormalizeArray(pData->Stream, nCount, KPPRECISION_REFINED);
+}
+
+static void OpMultiply(KERNELDATA *pData, UINT nCount)
+{
+	pData->mTransform.MultiplyArray(pData->pMatrices, pData->pMatrices, nCount);
+}
+
+static void OpSinCos(KERNELDATA *pData, UINT nCount)
+{
+	KPSinCosArray(pData->pAngles, pData->pSin, pData->pCos, nCount, KPPRECISION_REFINED);
+}
+
+static void OpTRS(KERNELDATA *pData, UINT nCount)
+{
+	KPBuildTRSMatrices(pData->pTRS, pData->pMatrices, nCount);
+}
+
+static void OpSpheres(KERNELDATA *pData, UINT nCount)
+{
+	KPClassifySpheres(pData->Frustum, 6, pData->pSpheres, pData->pStates, nCount);
+}
+
+static void OpBoxes(KERNELDATA *pData, UINT nCount)
+{
+	KPClassifyBoxes(pData->Frustum, 6, pData->pBoxes, pData->pStates, nCount);
+}
+
+static void OpColorKey(KERNELDATA *pData, UINT nCount)
+{
+	KPReplaceColor(pData->pPixels, nCount, 0xFFFF00FF, 0x00000000);
+}
+
+// The timed kernels, by their registry names
+static const struct
+{
+	const char	*chKernel;
+	KERNELOP	pfnOp;
+	double		dBytes;		// Bytes read and written per element
+} g_Ops[] =
+{
+	{ "transform strided",	OpPoints,			24.0 },
+	{ "transform stream",	OpPointStreams,		24.0 },
+	{ "normalize strided",	OpNormalize,		24.0 },
+	{ "normalize stream",	OpNormalizeStreams,	24.0 },
+	{ "matrix multiply",	OpMultiply,			128.0 },
+	{ "sincos",				OpSinCos,			12.0 },
+	{ "TRS matrices",		OpTRS,				sizeof(KPTRS) + sizeof(KPMatrix) },
+	{ "cull spheres",		OpSpheres,			sizeof(KPSPHERE) + 1.0 },
+	{ "cull boxes",			OpBoxes,			sizeof(KPAABB) + 1.0 },
+	{ "replace color",		OpColorKey,			8.0 },
+};
+
+
+static float RandomFloat(float fMin, float fMax)
+{
+	return fMin + ( fMax - fMin ) * ( (float)rand() / (float)RAND_MAX );
+}
+
+// Allocates and fills the arrays, every value stays in range when an operation is repeated on its own output
+static bool CreateData(KERNELDATA *pData, UINT nCount)
+{
+	pData->nCount		= nCount;
+	pData->pVertices	= (float*)KPAlignedAlloc( (size_t)nCount * PROFILE_STRIDE * sizeof(float) );
+	pData->pAngles		= (float*)KPAlignedAlloc( (size_t)nCount * sizeof(float) );
+	pData->pSin			= (float*)KPAlignedAlloc( (size_t)nCount * sizeof(float) );
+	pData->pCos			= (float*)KPAlignedAlloc( (size_t)nCount * sizeof(float) );
+	pData->pMatrices	= (KPMatrix*)KPAlignedAlloc( (size_t)nCount * sizeof(KPMatrix) );
+	pData->pTRS			= (KPTRS*)KPAlignedAlloc( (size_t)nCount * sizeof(KPTRS) );
+	pData->pSpheres		= (KPSPHERE*)KPAlignedAlloc( (size_t)nCount * sizeof(KPSPHERE) );
+	pData->pBoxes		= (KPAABB*)KPAlignedAlloc( (size_t)nCount * sizeof(KPAABB) );
+	pData->pStates		= (unsigned char*)KPAlignedAlloc(nCount);
+	pData->pPixels		= (UINT*)KPAlignedAlloc( (size_t)nCount * sizeof(UINT) );
+
+	if ( !pData->pVertices || !pData->pAngles || !pData->pSin || !pData->pCos || !pData->pMatrices ||
+		 !pData->pTRS || !pData->pSpheres || !pData->pBoxes || !pData->pStates || !pData->pPixels )
+		return false;
+
+	pData->Stream.pX	= pData->pVertices;
+	pData->Stream.pY	= pData->pVertices + nCount;
+	pData->Stream.pZ	= pData->pVertices + (size_t)nCount * 2;
+
+	srand(13);
+
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		float *v = pData->pVertices + (size_t)i * PROFILE_STRIDE;
+
+		for ( int k = 0; k < PROFILE_STRIDE; ++k )
+			v[k] = RandomFloat(-10.0f, 10.0f);
+
+		pData->pAngles[i] = RandomFloat(-10.0f, 10.0f);
+		pData->pPixels[i] = ( rand() & 1 ) ? 0xFFFF00FF : 0xFF000000 | (UINT)rand();
+		pData->pMatrices[i].Identity();
+
+		KPTRS &t = pData->pTRS[i];
+		t.vcScale.Set(1.0f, 2.0f, 1.0f);
+		t.qRotation.FromAxisAngle(KPVector(v[0], v[1], v[2]), v[3]);
+		t.vcPosition.Set(v[4], v[5], v[6]);
+
+		KPSPHERE &s = pData->pSpheres[i];
+		s.x = v[0] * 10.0f;		s.y = v[1] * 10.0f;		s.z = v[2] * 10.0f;		s.fRadius = 2.0f;
+
+		KPAABB &b = pData->pBoxes[i];
+		b.vcMin[0] = s.x - 1.0f;	b.vcMin[1] = s.y - 1.0f;	b.vcMin[2] = s.z - 1.0f;
+		b.vcMax[0] = s.x + 1.0f;	b.vcMax[1] = s.y + 1.0f;	b.vcMax[2] = s.z + 1.0f;
+	}
+
+	// A rotation, applying it again and again keeps the points at the same distance
+	pData->mTransform.RotateY(0.01f);
+
+	// A 90 degree frustum along the z axis, outward normals
+	static const float fPlanes[6][4] =
+	{
+		{ -1.0f,  0.0f, -1.0f,	  0.0f },
+		{  1.0f,  0.0f, -1.0f,	  0.0f },
+		{  0.0f,  1.0f, -1.0f,	  0.0f },
+		{  0.0f, -1.0f, -1.0f,	  0.0f },
+		{  0.0f,  0.0f, -1.0f,	  1.0f },
+		{  0.0f,  0.0f,  1.0f, -100.0f },
+	};
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		KPPlane &p = pData->Frustum[i];
+
+		p.m_vcNormal.Set(fPlanes[i][0], fPlanes[i][1], fPlanes[i][2]);
+		p.m_vcNormal.Normalize();
+		p.m_fDistance = fPlanes[i][3];
+	}
+
+	return true;
+}
+
+static void ReleaseData(KERNELDATA *pData)
+{
+	g_fSink = g_fSink + ( pData->pSin ? pData->pSin[0] : 0.0f ) + ( pData->pStates ? pData->pStates[0] : 0 );
+
+	KPAlignedFree(pData->pVertices);
+	KPAlignedFree(pData->pAngles);
+	KPAlignedFree(pData->pSin);
+	KPAlignedFree(pData->pCos);
+	KPAlignedFree(pData->pMatrices);
+	KPAlignedFree(pData->pTRS);
+	KPAlignedFree(pData->pSpheres);
+	KPAlignedFree(pData->pBoxes);
+	KPAlignedFree(pData->pStates);
+	KPAlignedFree(pData->pPixels);
+}
+
+// Nanoseconds per element of an operation on batches of nCount, the best of the tries
+static double TimeOp(KERNELOP pfnOp, KERNELDATA *pData, UINT nCount)
+{
+	UINT	nPasses	= ( PROFILE_WORK + nCount - 1 ) / nCount;
+	double	dBest	= 1e30;
+
+	// Warm up, the large batch is evicted from the caches by the previous one anyway
+	pfnOp(pData, nCount);
+
+	for ( int t = 0; t < PROFILE_TRIES; ++t )
+	{
+		double dStart = ProfileTime();
+
+		for ( UINT p = 0; p < nPasses; ++p )
+			pfnOp(pData, nCount);
+
+		double dTime = ProfileTime() - dStart;
+
+		if ( dTime < dBest )
+			dBest = dTime;
+	}
+
+	return dBest * 1e9 / ( (double)nPasses * nCount );
+}
+
+// Index of a registered kernel, KPGetNumKernels() if there is none of the name
+static UINT FindKernel(const char *chName)
+{
+	UINT k = 0;
+
+	while ( k < KPGetNumKernels() && strcmp( KPGetKernelName(k), chName ) != 0 )
+		++k;
+
+	return k;
+}
+
+// Elements of the large batch, the largest array (the matrices) takes half of the DRAM buffer size
+static UINT LargeCount(const KPHWPROFILE *pProfile)
+{
+	return (UINT)( ProfileDramSize(pProfile) / 2 / sizeof(KPMatrix) );
+}
+
+
+// MeasureKernels ////
+//////////////////////
+//
+// One thread: the arrays are not split, so the timings are the speed of the
+// kernels themselves.
+void MeasureKernels(KPHWPROFILE *pProfile)
+{
+	KERNELDATA	data;
+	UINT		nLarge = LargeCount(pProfile);
+
+	if ( !CreateData(&data, nLarge) )
+	{
+		printf("\nNot enough memory for the kernel measurements\n");
+		ReleaseData(&data);
+		return;
+	}
+
+	UINT nMatrix = KPGetParallelThreshold(KPJOB_MATRIX);
+	UINT nVector = KPGetParallelThreshold(KPJOB_VECTOR);
+
+	KPSetParallelThreshold(KPJOB_MATRIX, 0xFFFFFFFF);
+	KPSetParallelThreshold(KPJOB_VECTOR, 0xFFFFFFFF);
+
+	printf("\nkernels, one thread (%u and %u elements)\n", PROFILE_CACHE_COUNT, nLarge);
+	printf("\t%-20s %-7s %10s %10s %10s %10s\n", "kernel", "isa", "L1 ns", "DRAM ns", "L1 GB/s", "DRAM GB/s");
+
+	pProfile->numKernels = 0;
+
+	for ( int o = 0; o < (int)( sizeof(g_Ops) / sizeof(g_Ops[0]) ) && pProfile->numKernels < KPMAX_PROFILE_KERNELS; ++o )
+	{
+		KPKERNELTIMING	*pTiming = &pProfile->Kernels[pProfile->numKernels++];
+		UINT			nKernel	 = FindKernel(g_Ops[o].chKernel);
+		KPISA			Isa		 = ( nKernel < KPGetNumKernels() ) ? KPGetKernelISA(nKernel, KPGetISA()) : KPGetISA();
+
+		double dCache  = TimeOp(g_Ops[o].pfnOp, &data, PROFILE_CACHE_COUNT);
+		double dMemory = TimeOp(g_Ops[o].pfnOp, &data, nLarge);
+
+		pTiming->chName[0] = pTiming->chISA[0] = 0;
+		strncat(pTiming->chName, g_Ops[o].chKernel, sizeof(pTiming->chName) - 1);
+		strncat(pTiming->chISA, KPGetISAName(Isa), sizeof(pTiming->chISA) - 1);
+
+		pTiming->fCacheNs		= (float)dCache;
+		pTiming->fMemoryNs		= (float)dMemory;
+		pTiming->fCacheGBps		= (float)( g_Ops[o].dBytes / dCache );
+		pTiming->fMemoryGBps	= (float)( g_Ops[o].dBytes / dMemory );
+
+		printf("\t%-20s %-7s %10.2f %10.2f %10.2f %10.2f\n", pTiming->chName, pTiming->chISA,
+			   pTiming->fCacheNs, pTiming->fMemoryNs, pTiming->fCacheGBps, pTiming->fMemoryGBps);
+	}
+
+	KPSetParallelThreshold(KPJOB_MATRIX, nMatrix);
+	KPSetParallelThreshold(KPJOB_VECTOR, nVector);
+
+	ReleaseData(&data);
+
+} // ! MeasureKernels
+
+
+// Threshold ////
+/////////////////
+//
+// The smallest array where the split call is faster than one thread by
+// PROFILE_MT_GAIN, on that size and on the next one too, so a single lucky
+// timing does not set it. 0xFFFFFFFF if splitting never pays off.
+static UINT Threshold(KPJOBCLASS Class, KERNELOP pfnOp, KERNELDATA *pData)
+{
+	bool bPrevious = false;
+
+	for ( UINT nCount = PROFILE_MT_MIN; nCount <= PROFILE_MT_MAX && nCount <= pData->nCount; nCount *= 2 )
+	{
+		KPSetParallelThreshold(Class, 0xFFFFFFFF);
+		double dSingle = TimeOp(pfnOp, pData, nCount);
+
+		KPSetParallelThreshold(Class, nCount);
+		double dSplit = TimeOp(pfnOp, pData, nCount);
+
+		bool bFaster = ( dSingle >= dSplit * PROFILE_MT_GAIN );
+
+		printf("\t%8u:\t%.3f ns\t%.3f ns\n", nCount, dSingle, dSplit);
+
+		if ( bFaster && bPrevious )
+			return nCount / 2;
+
+		bPrevious = bFaster;
+	}
+
+	return 0xFFFFFFFF;
+}
+
+
+// MeasureThreads ////
+//////////////////////
+//
+// The worker count is the smallest one within PROFILE_MT_TOLERANCE of the
+// fastest on the large batch of a memory bound and a compute bound kernel,
+// more threads than that only fight for the memory bus. The thresholds are
+// measured with that many workers.
+void MeasureThreads(KPHWPROFILE *pProfile)
+{
+	UINT nThreads = pProfile->numLogicalCores;
+
+	printf("\nthreads\n");
+
+	if ( nThreads <= 1 )
+	{
+		printf("\tOne hardware thread, no workers, the default thresholds are kept\n");
+		pProfile->numWorkers = 0;
+		return;
+	}
+
+	KERNELDATA	data;
+	UINT		nLarge = LargeCount(pProfile);
+
+	if ( !CreateData(&data, nLarge) )
+	{
+		printf("\tNot enough memory for the thread measurements\n");
+		ReleaseData(&data);
+		return;
+	}
+
+	// Worker counts: powers of two, the cores and the hardware threads
+	UINT	nWorkers[32];
+	UINT	numCounts = 0;
+	UINT	nCores = ( pProfile->numPhysicalCores > 0 && pProfile->numPhysicalCores < nThreads ) ? pProfile->numPhysicalCores : nThreads;
+
+	for ( UINT w = 0; w < nThreads - 1 && numCounts < 30; w = w ? w * 2 : 1 )
+		nWorkers[numCounts++] = w;
+
+	if ( nCores < nThreads )
+		nWorkers[numCounts++] = nCores - 1;
+
+	nWorkers[numCounts++] = nThreads - 1;
+
+	double	dTimes[32];
+	double	dBest = 1e30;
+
+	for ( UINT i = 0; i < numCounts; ++i )
+	{
+		KPShutdownWorkers();
+		KPSetNumWorkers(nWorkers[i]);
+
+		dTimes[i] = TimeOp(OpPointStreams, &data, nLarge) + TimeOp(OpMultiply, &data, nLarge / 2);
+
+		if ( dTimes[i] < dBest )
+			dBest = dTimes[i];
+
+		printf("\t%u workers:\t%.3f ns\n", nWorkers[i], dTimes[i]);
+	}
+
+	pProfile->numWorkers = nThreads - 1;
+
+	for ( UINT i = numCounts; i-- > 0; )
+	{
+		if ( dTimes[i] <= dBest * PROFILE_MT_TOLERANCE && nWorkers[i] < pProfile->numWorkers )
+			pProfile->numWorkers = nWorkers[i];
+	}
+
+	KPShutdownWorkers();
+	KPSetNumWorkers(pProfile->numWorkers);
+
+	if ( pProfile->numWorkers > 0 )
+	{
+		printf("\tmatrix threshold, one thread and split\n");
+		pProfile->nMatrixThreshold = Threshold(KPJOB_MATRIX, OpMultiply, &data);
+
+		printf("\tvector threshold, one thread and split\n");
+		pProfile->nVectorThreshold = Threshold(KPJOB_VECTOR, OpPointStreams, &data);
+	}
+
+	KPSetParallelThreshold(KPJOB_MATRIX, pProfile->nMatrixThreshold);
+	KPSetParallelThreshold(KPJOB_VECTOR, pProfile->nVectorThreshold);
+
+	printf("\tworkers %u, matrix threshold %d, vector threshold %d\n", pProfile->numWorkers,
+		   (int)pProfile->nMatrixThreshold, (int)pProfile->nVectorThreshold);
+
+	ReleaseData(&data);
+
+} // ! MeasureThreads
@@ -1,85 +1,203 @@
+// CpuTest - prints what GetCPUInfo finds and profiles the hardware
+//
+// Links the KP3D library of the engine, so it shows what the engine sees
+// and measures the kernels the engine runs.
+//
+// CpuTest [--flags] [--profile file]
+//	--flags		only prints the CPU information
+//	--profile	writes the measured hardware profile, the engine loads
+//				it at startup (KPHardware.json in the working directory
+//				or the file in KPENGINE_PROFILE), see KPProfile.h
+//
+// Do not run it on a busy machine, the other processes slow down the
+// measurements and the profile is tuned for the machine they leave.
+//
+// Linux: g++ -O2 -o CpuTest main.cpp memory.cpp kernels.cpp ../KP3D/*.cpp -lpthread
+
 #include <stdio.h>
-#include <vector>
-#include <algorithm>
+#include <string.h>
+
+#include "profiler.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+// Size of a VERTEX of the render device in bytes
+#define PROFILE_VERTEX_SIZE		32
+
+volatile float g_fSink = 0.0f;
+
+struct FEATURENAME
+{
+	DWORD		Flag;
+	const char	*Name;
+};
+
+static const FEATURENAME g_Features[] =
+{
+	{ CPU_FEATURE_MMX,		"_CPU_FEATURE_MMX" },
+	{ CPU_FEATURE_SSE,		"_CPU_FEATURE_SSE" },
+	{ CPU_FEATURE_SSE2,		"_CPU_FEATURE_SSE2" },
+	{ CPU_FEATURE_SSE3,		"_CPU_FEATURE_SSE3" },
+	{ CPU_FEATURE_SSSE3,	"_CPU_FEATURE_SSSE3" },
+	{ CPU_FEATURE_SSE41,	"_CPU_FEATURE_SSE41" },
+	{ CPU_FEATURE_SSE42,	"_CPU_FEATURE_SSE42" },
+	{ CPU_FEATURE_3DNOW,	"_CPU_FEATURE_3DNOW" },
+	{ CPU_FEATURE_3DNOWEX,	"_CPU_FEATURE_3DNOWEX" },
+	{ CPU_FEATURE_MMXEX,	"_CPU_FEATURE_MMXEX" },
+	{ CPU_FEATURE_AVX,		"_CPU_FEATURE_AVX" },
+	{ CPU_FEATURE_AVX2,		"_CPU_FEATURE_AVX2" },
+	{ CPU_FEATURE_FMA,		"_CPU_FEATURE_FMA" },
+	{ CPU_FEATURE_F16C,		"_CPU_FEATURE_F16C" },
+	{ CPU_FEATURE_AVX512F,	"_CPU_FEATURE_AVX512F" },
+	{ CPU_FEATURE_AVX512DQ,	"_CPU_FEATURE_AVX512DQ" },
+	{ CPU_FEATURE_AVX512CD,	"_CPU_FEATURE_AVX512CD" },
+	{ CPU_FEATURE_AVX512BW,	"_CPU_FEATURE_AVX512BW" },
+	{ CPU_FEATURE_AVX512VL,	"_CPU_FEATURE_AVX512VL" },
+	{ CPU_FEATURE_XSAVE,	"_CPU_FEATURE_XSAVE" },
+};
 
-#include "kp_cpuid.h"
+void expand(DWORD avail, DWORD mask)
+{
+	for ( unsigned int i = 0; i < sizeof(g_Features) / sizeof(g_Features[0]); ++i )
+	{
+		if ( mask & g_Features[i].Flag )
+			printf("\t%s\t%s\n", avail & g_Features[i].Flag ? "yes" : "no", g_Features[i].Name);
+	}
+}
 
-void expand(unsigned long avail, unsigned long mask)
+// ProfileTime ////
+double ProfileTime(void)
 {
-    if (mask & CPU_FEATURE_MMX) {
-        printf("\t%s\t_CPU_FEATURE_MMX\n",   avail & CPU_FEATURE_MMX ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSE) {
-        printf("\t%s\t_CPU_FEATURE_SSE\n",   avail & CPU_FEATURE_SSE ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSE2) {
-        printf("\t%s\t_CPU_FEATURE_SSE2\n",  avail & CPU_FEATURE_SSE2 ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSE3) {
-        printf("\t%s\t_CPU_FEATURE_SSE3\n",  avail & CPU_FEATURE_SSE3 ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSSE3) {
-        printf("\t%s\t_CPU_FEATURE_SSSE3\n", avail & CPU_FEATURE_SSSE3 ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSE41) {
-        printf("\t%s\t_CPU_FEATURE_SSE41\n", avail & CPU_FEATURE_SSE41 ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_SSE42) {
-        printf("\t%s\t_CPU_FEATURE_SSE42\n", avail & CPU_FEATURE_SSE42 ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_3DNOW) {
-        printf("\t%s\t_CPU_FEATURE_3DNOW\n", avail & CPU_FEATURE_3DNOW ? "yes" : "no");
-    }
-	if (mask & CPU_FEATURE_3DNOWEX) {
-        printf("\t%s\t_CPU_FEATURE_3DNOWEX\n", avail & CPU_FEATURE_3DNOWEX ? "yes" : "no");
-    }
-    if (mask & CPU_FEATURE_MMXEX) {
-        printf("\t%s\t_CPU_FEATURE_MMXEX\n", avail & CPU_FEATURE_MMXEX ? "yes" : "no");
-    }
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
 }
 
-template <class T> const T amax( const T a, const T b )
+// The CPU fields of the profile, cache sizes the OS does not tell are guessed
+static void ProfileCPU(const CPUINFO *pInfo, KPHWPROFILE *pProfile)
 {
-	return (b<a)?a:b;
+	sprintf(pProfile->chCPU, "%.63s", pInfo->modelName);
+	strncat(pProfile->chISA, KPGetISAName( KPGetISA() ), sizeof(pProfile->chISA) - 1);
+
+	pProfile->numLogicalCores	= pInfo->numLogicalCores > 0 ? pInfo->numLogicalCores : 1;
+	pProfile->numPhysicalCores	= pInfo->numPhysicalCores > 0 ? pInfo->numPhysicalCores : 1;
+	pProfile->L1DataSize		= pInfo->L1DataSize > 0 ? pInfo->L1DataSize : PROFILE_L1_SIZE;
+	pProfile->L2Size			= pInfo->L2Size > 0 ? pInfo->L2Size : PROFILE_L2_SIZE;
+	pProfile->L3Size			= pInfo->L3Size > 0 ? pInfo->L3Size : 0;
+	pProfile->CacheLineSize		= pInfo->CacheLineSize > 0 ? pInfo->CacheLineSize : 64;
 }
 
-template <class T> const T amax( const T a, const T b, const T c )
+// Vertex Caches ////
+/////////////////////
+//
+// The vertices of a dynamic vertex cache are collected and rebased on the
+// CPU before the cache is drawn, a cache of half the L2 cache is written
+// and flushed without evicting the models it is filled from. The indices
+// keep the 3 to 2 ratio of the defaults, both are limited by the 16 bit
+// indices.
+static void ChooseCacheSizes(KPHWPROFILE *pProfile)
 {
-	std::vector<T> sortMe;
-	sortMe.resize(3);
-	
-	sortMe[0] = a;
-	sortMe[1] = b;
-	sortMe[2] = c;
+	UINT nVertices = pProfile->L2Size * 1024 / 2 / PROFILE_VERTEX_SIZE;
 
-	std::sort(sortMe.begin(), sortMe.end() );
+	if ( nVertices < 1024 )		nVertices = 1024;
+	if ( nVertices > 65535 )	nVertices = 65535;
 
-	return sortMe[2];
+	UINT nIndices = nVertices * 3 / 2;
+
+	if ( nIndices > 65535 )		nIndices = 65535;
+
+	pProfile->nCacheVertices	= nVertices;
+	pProfile->nCacheIndices		= nIndices;
+
+	printf("\nvertex caches\n\t%u vertices, %u indices\n", nVertices, nIndices);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
-	/*
-	CPUINFO info;
-	
-	GetCPUInfo(&info);
+	CPUINFO		info;
+	bool		bMeasure	= true;
+	const char	*chProfile	= NULL;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( strcmp(argv[i], "--flags") == 0 )
+			bMeasure = false;
+		else if ( strcmp(argv[i], "--profile") == 0 && i + 1 < argc )
+			chProfile = argv[++i];
+		else
+		{
+			printf("usage: %s [--flags] [--profile file]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if ( !GetCPUInfo(&info) )
+	{
+		printf("GetCPUInfo failed\n");
+		return 1;
+	}
 
 	printf("v_name:\t\t%s\n", info.vendorName);
 	printf("model:\t\t%s\n", info.modelName);
-    printf("family:\t\t%d\n", info.Family);
-    printf("model:\t\t%d\n", info.Model);
-    printf("stepping:\t%d\n", info.Stepping);
-	printf("feature:\t%08x\n", info.Feature);
-    expand(info.Feature, info.Checks);
-	printf("os_support:\t%08x\n", info.OS_Support);
-    expand(info.OS_Support, info.Checks);
-    printf("checks:\t\t%08x\n", info.Checks);
-	*/
-
-	printf("test %d",amax(5,2,7) );
-	printf("\n\nPress ENTER to exit. ");
-
-	getchar();
-	return 1;
-
-}
\ No newline at end of file
+	printf("family:\t\t%d\n", info.Family);
+	printf("model:\t\t%d\n", info.Model);
+	printf("stepping:\t%d\n", info.Stepping);
+	printf("feature:\t%08lx\n", info.Feature);
+	expand(info.Feature, info.Checks);
+	printf("os_support:\t%08lx\n", info.OS_Support);
+	expand(info.OS_Support, info.Checks);
+	printf("checks:\t\t%08lx\n", info.Checks);
+	printf("xcr0:\t\t%08lx\n", info.XCR0);
+
+	printf("packages:\t%d\n", info.numPackages);
+	printf("cores:\t\t%d physical, %d logical\n", info.numPhysicalCores, info.numLogicalCores);
+	printf("L1:\t\t%d KB data, %d KB code\n", info.L1DataSize, info.L1CodeSize);
+	printf("L2:\t\t%d KB\n", info.L2Size);
+	printf("L3:\t\t%d KB\n", info.L3Size);
+	printf("cache line:\t%d bytes\n", info.CacheLineSize);
+
+	if ( !bMeasure )
+		return 0;
+
+	KPHWPROFILE profile;
+
+	KPDefaultHWProfile(&profile);
+	ProfileCPU(&info, &profile);
+
+	printf("\nkernels:\t%s\n", profile.chISA);
+
+	MeasureMemory(&profile);
+	MeasureKernels(&profile);
+	MeasureThreads(&profile);
+	ChooseCacheSizes(&profile);
+
+	KPShutdownWorkers();
+
+	if ( chProfile )
+	{
+		if ( !KPSaveHWProfile(chProfile, &profile) )
+		{
+			printf("\nCould not write %s\n", chProfile);
+			return 1;
+		}
+
+		printf("\nprofile written to %s\n", chProfile);
+	}
+
+	return 0;
+}
@@ -0,0 +1,245 @@
+// CpuTest - memory bandwidth and cache latency
+//
+// The bandwidth is measured on a buffer far larger than the last level
+// cache, sequentially, so the hardware prefetchers run at full speed:
+// that is what the array kernels see on large batches. The latency is
+// measured by chasing pointers in a random cycle through the cache lines
+// of buffers of growing size, every load depends on the previous one.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "profiler.h"
+
+// Number of timed passes over the bandwidth buffer, the best one counts
+#define PROFILE_PASSES		5
+
+// Loads timed on every buffer size of the latency measurement
+#define PROFILE_CHASE_STEPS	( 1u << 21 )
+
+// Smallest buffer of the latency measurement
+#define PROFILE_CHASE_MIN	( 4u << 10 )
+
+// Bytes read by one job of the parallel read
+#define PROFILE_READ_CHUNK	( 1u << 20 )
+
+
+// xorshift64, rand() has only 15 bits on some runtimes
+static unsigned long long g_nRandom = 88172645463325252ull;
+
+static unsigned long long Random(void)
+{
+	g_nRandom ^= g_nRandom << 13;
+	g_nRandom ^= g_nRandom >> 7;
+	g_nRandom ^= g_nRandom << 17;
+
+	return g_nRandom;
+}
+
+
+// ProfileDramSize ////
+size_t ProfileDramSize(const KPHWPROFILE *pProfile)
+{
+	size_t nMin  = (size_t)pProfile->L3Size * 1024 * 4;
+	size_t nSize = PROFILE_DRAM_SIZE;
+
+	while ( nSize < nMin && nSize < PROFILE_DRAM_MAX )
+		nSize *= 2;
+
+	return nSize;
+}
+
+
+// Bandwidth ////
+/////////////////
+
+// Sums the buffer, four sums keep four loads in flight
+static unsigned long long ReadBuffer(const unsigned long long *p, size_t n)
+{
+	unsigned long long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	for ( size_t i = 0; i + 4 <= n; i += 4 )
+	{
+		s0 += p[i];
+		s1 += p[i + 1];
+		s2 += p[i + 2];
+		s3 += p[i + 3];
+	}
+
+	return s0 + s1 + s2 + s3;
+}
+
+// Parameters of the parallel read
+typedef struct READJOB
+{
+	const char			*pBuffer;
+	unsigned long long	*pSums;		// One per chunk
+} READJOB;
+
+static void ReadJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	READJOB *pJob = (READJOB*)pParam;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const unsigned long long *p = (const unsigned long long*)( pJob->pBuffer + (size_t)i * PROFILE_READ_CHUNK );
+
+		pJob->pSums[i] = ReadBuffer(p, PROFILE_READ_CHUNK / sizeof(unsigned long long));
+	}
+}
+
+// Returns the best GB/s of the passes, bytes read and written per pass
+static double Bandwidth(double dSeconds, size_t nBytes)
+{
+	return dSeconds > 0.0 ? (double)nBytes / dSeconds * 1e-9 : 0.0;
+}
+
+static void MeasureBandwidth(char *pBuffer, size_t nSize, KPHWPROFILE *pProfile)
+{
+	double				dRead = 1e30, dWrite = 1e30, dCopy = 1e30, dReadAll = 1e30;
+	unsigned long long	nSum = 0;
+
+	UINT				numChunks = (UINT)( nSize / PROFILE_READ_CHUNK );
+	unsigned long long	*pSums = new unsigned long long[numChunks];
+	READJOB				job = { pBuffer, pSums };
+
+	for ( int p = 0; p < PROFILE_PASSES; ++p )
+	{
+		double dStart = ProfileTime();
+		memset(pBuffer, p, nSize);
+		double dTime = ProfileTime() - dStart;
+		if ( dTime < dWrite ) dWrite = dTime;
+
+		dStart = ProfileTime();
+		nSum += ReadBuffer( (const unsigned long long*)pBuffer, nSize / sizeof(unsigned long long) );
+		dTime = ProfileTime() - dStart;
+		if ( dTime < dRead ) dRead = dTime;
+
+		dStart = ProfileTime();
+		memcpy(pBuffer, pBuffer + nSize / 2, nSize / 2);
+		dTime = ProfileTime() - dStart;
+		if ( dTime < dCopy ) dCopy = dTime;
+
+		dStart = ProfileTime();
+		KPParallelFor(numChunks, 1, ReadJob, &job);
+		dTime = ProfileTime() - dStart;
+		if ( dTime < dReadAll ) dReadAll = dTime;
+
+		nSum += pSums[0];
+	}
+
+	pProfile->fReadGBps		= (float)Bandwidth(dRead, nSize);
+	pProfile->fWriteGBps	= (float)Bandwidth(dWrite, nSize);
+	pProfile->fCopyGBps		= (float)Bandwidth(dCopy, nSize);
+	pProfile->fReadAllGBps	= (float)Bandwidth(dReadAll, (size_t)numChunks * PROFILE_READ_CHUNK);
+
+	g_fSink = g_fSink + (float)( nSum & 0xFF );
+	delete [] pSums;
+
+	printf("\nbandwidth (%u MB)\n", (UINT)( nSize >> 20 ));
+	printf("\tread:\t\t%.2f GB/s\n", pProfile->fReadGBps);
+	printf("\twrite:\t\t%.2f GB/s\n", pProfile->fWriteGBps);
+	printf("\tcopy:\t\t%.2f GB/s\n", pProfile->fCopyGBps);
+	printf("\tread, %u threads:\t%.2f GB/s\n", KPGetNumThreads(), pProfile->fReadAllGBps);
+}
+
+
+// Latency ////
+///////////////
+
+// Nanoseconds of a dependent load in a random cycle through the lines of nSize bytes
+static double ChaseLatency(char *pBuffer, size_t nSize, UINT nLine)
+{
+	size_t nNodes = nSize / nLine;
+	size_t *pOrder = new size_t[nNodes];
+
+	// Sattolo's algorithm, a random permutation that is a single cycle
+	for ( size_t i = 0; i < nNodes; ++i )
+		pOrder[i] = i;
+
+	for ( size_t i = nNodes - 1; i > 0; --i )
+	{
+		size_t j = (size_t)( Random() % i );
+		size_t t = pOrder[i];
+
+		pOrder[i] = pOrder[j];
+		pOrder[j] = t;
+	}
+
+	for ( size_t i = 0; i < nNodes; ++i )
+		*(void**)( pBuffer + pOrder[i] * nLine ) = pBuffer + pOrder[ ( i + 1 ) % nNodes ] * nLine;
+
+	delete [] pOrder;
+
+	void **p = (void**)pBuffer;
+
+	// Warm up, loads the buffer into the caches it fits in
+	for ( size_t i = 0; i < nNodes && i < PROFILE_CHASE_STEPS; ++i )
+		p = (void**)*p;
+
+	double dStart = ProfileTime();
+
+	for ( UINT i = 0; i < PROFILE_CHASE_STEPS; i += 8 )
+	{
+		p = (void**)*p;		p = (void**)*p;		p = (void**)*p;		p = (void**)*p;
+		p = (void**)*p;		p = (void**)*p;		p = (void**)*p;		p = (void**)*p;
+	}
+
+	double dNs = ( ProfileTime() - dStart ) * 1e9 / PROFILE_CHASE_STEPS;
+
+	g_fSink = g_fSink + (float)( (size_t)p & 1 );
+
+	return dNs;
+}
+
+// The latency of a cache level is the one of the largest buffer that fits in half of it
+static void MeasureLatency(char *pBuffer, size_t nMaxSize, KPHWPROFILE *pProfile)
+{
+	size_t	nL1		= (size_t)pProfile->L1DataSize * 1024;
+	size_t	nL2		= (size_t)pProfile->L2Size * 1024;
+	size_t	nL3		= (size_t)pProfile->L3Size * 1024;
+	UINT	nLine	= pProfile->CacheLineSize ? pProfile->CacheLineSize : 64;
+
+	printf("\nlatency\n");
+
+	for ( size_t nSize = PROFILE_CHASE_MIN; nSize <= nMaxSize; nSize *= 2 )
+	{
+		float fNs = (float)ChaseLatency(pBuffer, nSize, nLine);
+
+		if ( nSize <= nL1 / 2 )
+			pProfile->fLatencyL1 = fNs;
+		else if ( nSize <= nL2 / 2 )
+			pProfile->fLatencyL2 = fNs;
+		else if ( nL3 > nL2 && nSize > nL2 * 2 && nSize <= nL3 / 2 )
+			pProfile->fLatencyL3 = fNs;
+
+		pProfile->fLatencyDRAM = fNs;
+
+		if ( nSize < ( 1u << 20 ) )
+			printf("\t%6u KB:\t%.2f ns\n", (UINT)( nSize >> 10 ), fNs);
+		else
+			printf("\t%6u MB:\t%.2f ns\n", (UINT)( nSize >> 20 ), fNs);
+	}
+
+	printf("\tL1 %.2f ns, L2 %.2f ns, L3 %.2f ns, DRAM %.2f ns\n",
+		   pProfile->fLatencyL1, pProfile->fLatencyL2, pProfile->fLatencyL3, pProfile->fLatencyDRAM);
+}
+
+
+// MeasureMemory ////
+void MeasureMemory(KPHWPROFILE *pProfile)
+{
+	size_t	nSize	= ProfileDramSize(pProfile);
+	char	*pBuffer = (char*)KPAlignedAlloc(nSize);
+
+	if ( !pBuffer )
+	{
+		printf("\nNot enough memory for the %u MB buffer of the memory measurements\n", (UINT)( nSize >> 20 ));
+		return;
+	}
+
+	MeasureBandwidth(pBuffer, nSize, pProfile);
+	MeasureLatency(pBuffer, nSize, pProfile);
+
+	KPAlignedFree(pBuffer);
+}
@@ -0,0 +1,42 @@
+// CpuTest - hardware profiler
+//
+// Measures the memory, the caches, the math kernels and the thread pool
+// of the machine, the results are collected in a KPHWPROFILE.
+
+#ifndef CPUTEST_PROFILER_H
+#define CPUTEST_PROFILER_H
+
+#include "../KP3D/KP3D.h"
+#include "../KP3D/KPCPU.h"
+#include "../KP3D/KPMemory.h"
+#include "../KP3D/KPProfile.h"
+
+// Smallest buffer of the DRAM measurements, used when there is no L3 cache or it is small
+#define PROFILE_DRAM_SIZE	( 64u << 20 )
+
+// Largest buffer of the DRAM measurements, for the virtual machines reporting the L3 of the host
+#define PROFILE_DRAM_MAX	( 1u << 30 )
+
+// Cache sizes in KB used when the OS does not tell them
+#define PROFILE_L1_SIZE		32
+#define PROFILE_L2_SIZE		256
+
+// Keeps the optimizer from removing the measured code
+extern volatile float g_fSink;
+
+//! Returns the time elapsed since an arbitrary point in seconds
+double	ProfileTime(void);
+
+//! Returns a buffer size in bytes that is four times the last level cache, at most PROFILE_DRAM_MAX
+size_t	ProfileDramSize(const KPHWPROFILE *pProfile);
+
+//! Measures the bandwidth of one and all the threads and the load latency of every cache level
+void	MeasureMemory(KPHWPROFILE *pProfile);
+
+//! Times the math kernels on the selected instruction set, one thread
+void	MeasureKernels(KPHWPROFILE *pProfile);
+
+//! Chooses the worker count and the parallel thresholds
+void	MeasureThreads(KPHWPROFILE *pProfile);
+
+#endif // ! CPUTEST_PROFILER_H
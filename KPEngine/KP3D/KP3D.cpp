@@ -4,18 +4,76 @@
  *	KPEngine Source code 
  *	Kovacs Peter - July 2009
  *
- *  File: KP.h
+ *  File: KP3D.cpp
  *  Description: KPEngine Math Library implementation
  *				 - SSE Support check
- *				 - Some templates for finding max/min of 2 and 3 
+ *				 - Array kernel selection
+ *				 - Kernel registry
  *
  *****************************************************************
 */
 
 #include "KP3D.h"
+#include "KPSIMD.h"
+#include "KPCPU.h"
+
+#include <stdlib.h>		// getenv()
+#include <string.h>		// strcmp()
+#include <ctype.h>		// tolower()
+
+// Best instruction set the compiler targets, every CPU running the build has it
+#if defined(KP_AVX512) && defined(__AVX512F__)
+	#define KPISA_BUILD	KPISA_AVX512
+#elif defined(KP_AVX2) && defined(__AVX2__)
+	#define KPISA_BUILD	KPISA_AVX2
+#elif defined(KP_AVX_STATIC)
+	#define KPISA_BUILD	KPISA_AVX
+#elif defined(KP_SSE41) && defined(__SSE4_1__)
+	#define KPISA_BUILD	KPISA_SSE41
+#elif defined(KP_SSE_STATIC) && defined(KP_SSE2) && ( defined(_M_X64) || defined(__SSE2__) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+	#define KPISA_BUILD	KPISA_SSE
+#else
+	#define KPISA_BUILD	KPISA_SCALAR
+#endif
+
+// Best instruction set the build has kernels for
+#if defined(KP_AVX512)
+	#define KPISA_COMPILED	KPISA_AVX512
+#elif defined(KP_AVX2)
+	#define KPISA_COMPILED	KPISA_AVX2
+#elif defined(KP_AVX)
+	#define KPISA_COMPILED	KPISA_AVX
+#elif defined(KP_SSE41)
+	#define KPISA_COMPILED	KPISA_SSE41
+#elif defined(KP_SSE)
+	#define KPISA_COMPILED	KPISA_SSE
+#else
+	#define KPISA_COMPILED	KPISA_SCALAR
+#endif
+
+// Maximum number of registered kernel tables
+#define KPMAX_KERNELS	32
+
+// A registered kernel table
+typedef struct KPKERNELENTRY
+{
+	const char		*chName;		// Name in the reports
+	const void		*pTable;		// KPISA_COUNT function pointers
+	KPKERNELISAFN	pfnISA;			// Tells the level of the kernel of a table entry
+} KPKERNELENTRY;
 
 // GLOBALS ////
-bool g_bSSE = false;		// SSE Support, we don't need more for now
+//
+// Constant initialized, so they are valid before any constructor runs
+KPISA g_ISA		= KPISA_BUILD;		// Instruction set of the array kernels
+KPISA g_MaxISA	= KPISA_BUILD;		// Best instruction set the build and the CPU can run
+
+static KPKERNELENTRY	g_Kernels[KPMAX_KERNELS];
+static UINT				g_numKernels = 0;
+
+// Names of the instruction sets, KPISA order
+static const char *g_chISAName[KPISA_COUNT] = { "scalar", "SSE2", "SSE4.1", "AVX", "AVX2", "AVX-512" };
+
 
 // IsSSESupported Function ////
 ///////////////////////////////
@@ -27,57 +85,186 @@ bool IsSSESupported(void)
 	CPUINFO info;
 
 	if ( ! GetCPUInfo(&info) )
-		g_bSSE = false;
+		return false;
+
+	// if SSE is supported by both OS & CPU
+	return ( (info.Feature & CPU_FEATURE_SSE) && (info.OS_Support & CPU_FEATURE_SSE) );
+
+} // ! IsSSESupported()
+
+
+// Kernel Selection ////
+////////////////////////
+
+#ifdef KP_SSE
+
+// KPGetCPUISA ////
+///////////////////
+//
+// Best level the CPU and the OS support. OS_Support has the AVX flags only
+// if the OS saves the registers, see GetCPUInfo.
+static KPISA KPGetCPUISA(void)
+{
+	CPUINFO info;
+
+	if ( ! GetCPUInfo(&info) )
+		return KPISA_SCALAR;
+
+	DWORD dwFlags = info.Feature & info.OS_Support;
+
+	if ( ( dwFlags & ( CPU_FEATURE_SSE | CPU_FEATURE_SSE2 ) ) != ( CPU_FEATURE_SSE | CPU_FEATURE_SSE2 ) )
+		return KPISA_SCALAR;
+
+	if ( ! ( dwFlags & CPU_FEATURE_SSE41 ) )
+		return KPISA_SSE;
+
+	if ( ! ( dwFlags & CPU_FEATURE_AVX ) )
+		return KPISA_SSE41;
+
+	if ( ! ( dwFlags & CPU_FEATURE_AVX2 ) )
+		return KPISA_AVX;
 
-	else
+	if ( ! ( dwFlags & CPU_FEATURE_AVX512F ) )
+		return KPISA_AVX2;
+
+	return KPISA_AVX512;
+} // ! KPGetCPUISA
+
+
+// KPParseISA ////
+///////////////////
+//
+// The level named by chName, case, '.', '-' and '_' do not matter:
+// "SSE4.1", "sse41" and "Sse4_1" are all KPISA_SSE41.
+static bool KPParseISA(const char *chName, KPISA *pIsa)
+{
+	char chKey[16];
+	UINT n = 0;
+
+	for ( ; *chName && n + 1 < sizeof(chKey); ++chName )
 	{
-		if ( (info.Feature & CPU_FEATURE_SSE) && (info.OS_Support & CPU_FEATURE_SSE) )	// if SSE is supported by both OS & CPU
-			g_bSSE = true;
-		else
-			g_bSSE = false;
+		if ( *chName != '.' && *chName != '-' && *chName != '_' )
+			chKey[n++] = (char)tolower( (unsigned char)*chName );
 	}
 
-	return g_bSSE;
-} // ! IsSSESupported()
+	chKey[n] = 0;
 
-// Min / Max ////
-/////////////////
+	static const char *chKeys[KPISA_COUNT] = { "scalar", "sse2", "sse41", "avx", "avx2", "avx512" };
 
-template <class T> const T KPMax( const T a, const T b )
+	for ( int i = 0; i < KPISA_COUNT; ++i )
+	{
+		if ( strcmp(chKey, chKeys[i]) == 0 )
+		{
+			*pIsa = (KPISA)i;
+			return true;
+		}
+	}
+
+	// SSE alone means the SSE kernels too
+	if ( strcmp(chKey, "sse") == 0 )
+	{
+		*pIsa = KPISA_SSE;
+		return true;
+	}
+
+	return false;
+} // ! KPParseISA
+
+
+// KPResolveISA ////
+////////////////////
+//
+// Asks the CPU once when the library is loaded, until then the kernels of
+// the build level run, which are always correct. A level the build has no
+// kernels for gets the ones of the level below it, see KPSIMD.h.
+static bool KPResolveISA(void)
 {
-	return (b<a)?a:b;
+	KPISA Isa = KPGetCPUISA();
+
+	if ( Isa > KPISA_COMPILED )
+		Isa = KPISA_COMPILED;
+
+	if ( Isa < KPISA_BUILD )
+		Isa = KPISA_BUILD;
+
+	g_ISA = g_MaxISA = Isa;
+
+	// Forced lower level, e.g. KPENGINE_ISA=sse2 to compare the kernels.
+	// An unknown name or a level above the maximum is ignored.
+	const char	*chForced = getenv("KPENGINE_ISA");
+	KPISA		Forced;
+
+	if ( chForced && KPParseISA(chForced, &Forced) && Forced <= g_MaxISA )
+		g_ISA = Forced;
+
+	return true;
 }
 
-template <class T> const T KPMax( const T a, const T b, const T c )
+static bool g_bISAResolved = KPResolveISA();
+
+#endif // ! KP_SSE
+
+KPISA KPGetISA(void)
 {
-	std::vector<T> sortMe;
-	sortMe.resize(3);
-	
-	sortMe[0] = a;
-	sortMe[1] = b;
-	sortMe[2] = c;
+	return g_ISA;
+}
 
-	std::sort(sortMe.begin(), sortMe.end() );
+KPISA KPGetMaxISA(void)
+{
+	return g_MaxISA;
+}
 
-	return sortMe[2];
+bool KPSetISA(KPISA Isa)
+{
+	if ( Isa < KPISA_SCALAR || Isa > g_MaxISA )
+		return false;
+
+	g_ISA = Isa;
+
+	return true;
 }
 
-template <class T> const T KPMin( const T a, const T b )
+
+const char *KPGetISAName(KPISA Isa)
 {
-	return (b>a)?a:b;
+	if ( Isa < KPISA_SCALAR || Isa >= KPISA_COUNT )
+		return "unknown";
+
+	return g_chISAName[Isa];
 }
 
-template <class T> const T KPMin( const T a, const T b, const T c )
+
+// Kernel Registry ////
+///////////////////////
+
+bool KPRegisterKernel(const char *chName, const void *pTable, KPKERNELISAFN pfnISA)
 {
-	std::vector<T> sortMe;
-	sortMe.resize(3);
-	
-	sortMe[0] = a;
-	sortMe[1] = b;
-	sortMe[2] = c;
+	if ( g_numKernels == KPMAX_KERNELS )
+		return false;
 
-	std::sort(sortMe.begin(), sortMe.end() );
+	KPKERNELENTRY *pEntry = &g_Kernels[g_numKernels++];
 
-	return sortMe[0];
+	pEntry->chName	= chName;
+	pEntry->pTable	= pTable;
+	pEntry->pfnISA	= pfnISA;
+
+	return true;
 }
 
+UINT KPGetNumKernels(void)
+{
+	return g_numKernels;
+}
+
+const char *KPGetKernelName(UINT nKernel)
+{
+	return ( nKernel < g_numKernels ) ? g_Kernels[nKernel].chName : NULL;
+}
+
+KPISA KPGetKernelISA(UINT nKernel, KPISA Isa)
+{
+	if ( nKernel >= g_numKernels || Isa < KPISA_SCALAR || Isa >= KPISA_COUNT )
+		return KPISA_SCALAR;
+
+	return g_Kernels[nKernel].pfnISA(g_Kernels[nKernel].pTable, Isa);
+}
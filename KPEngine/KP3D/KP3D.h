@@ -8,7 +8,13 @@
  *  Description: KPEngine Math Library Declarations
  *				 - Vector 4D
  *				 - Matrix 4D
+ *				 - Sine and cosine
+ *				 - Pixel and index arrays
+ *				 - Quaternion
  *				 - Plane
+ *				 - Frustum classification
+ *				 - Polygon clipping
+ *				 - Ray/triangle intersection
  *
  *****************************************************************
 */
@@ -24,11 +30,104 @@
 #include <algorithm>
 #include "KPCPU.h"
 
+// Export Specifier ////
+//
+// Only the heavy routines are exported, the small operations are inline
+// (KPInline.h), a DLL linking the library compiles them into its own code.
+#ifdef _MSC_VER
+	#define KP3D_API __declspec( dllexport )
+#else
+	#define KP3D_API
+#endif
+
+// Constant Expression Specifier ////
+//
+// Constructors and pure functions of constants can be evaluated at compile
+// time by the C++11 compilers, the older ones see plain inline functions.
+#if __cplusplus >= 201103L || ( defined(_MSC_VER) && _MSC_VER >= 1900 )
+	#define KP_CONSTEXPR constexpr
+#else
+	#define KP_CONSTEXPR
+#endif
+
+// Alignment Specifier ////
+#ifdef _MSC_VER
+	#define KP_ALIGN(n) __declspec( align(n) )
+#else
+	#define KP_ALIGN(n) __attribute__( (aligned(n)) )
+#endif
+
+// Types ////
+typedef unsigned int UINT;
+
+//! Instruction sets of the array kernels
+/*!
+	A kernel without a variant for a level runs its variant of the next
+	lower one, see KPGetKernelISA.
+*/
+typedef enum KPISA
+{
+	KPISA_SCALAR = 0,		//!< Plain C++ code
+	KPISA_SSE,				//!< 4 wide SSE and SSE2 kernels
+	KPISA_SSE41,			//!< SSE4.1 kernels, blends
+	KPISA_AVX,				//!< 8 wide AVX kernels
+	KPISA_AVX2,				//!< AVX2 kernels, 256 bit integer operations
+	KPISA_AVX512,			//!< 16 wide AVX-512F kernels
+	KPISA_COUNT
+} KPISA;
+
+//! Accuracy of the approximated functions
+/*!
+	The error bounds of the levels are given at the functions taking them,
+	e.g. sines of KPPRECISION_FAST are within 2e-6, normals within 4e-4.
+*/
+typedef enum KPPRECISION
+{
+	KPPRECISION_FAST = 0,	//!< Shortest polynomials and hardware estimates
+	KPPRECISION_REFINED,	//!< Error within a few ULP, still without library calls or divisions
+	KPPRECISION_EXACT		//!< Correctly rounded square roots and divisions, the C library functions
+} KPPRECISION;
+
 // Forward Declarations ////
-bool IsSSESupported(void);	//!< Initializes the CPU and checks SIMD support.
+bool	IsSSESupported(void);	//!< Checks SIMD support of the CPU and the OS, the kernels are selected without calling it.
+KPISA	KPGetISA(void);			//!< Returns the instruction set of the array kernels, the best one available by default.
+KPISA	KPGetMaxISA(void);		//!< Returns the best instruction set the build and the CPU can run.
+
+//! Selects the kernels of the array operations
+/*!
+	The kernels are selected once, when the library is loaded: the best
+	instruction set the build and the CPU (GetCPUInfo) can run, or the one
+	named by the KPENGINE_ISA environment variable if that is lower
+	(scalar, sse2, sse4.1, avx, avx2, avx512). There is no need to call it
+	other than to compare or to rule out kernels.
+	Do not call it while other threads use the library.
+	The single vector operations are selected at compile time, see KPKernels.h.
+	\param [in] Isa instruction set of the kernels
+	\return false if the build or the CPU cannot run Isa, the selection is not changed then
+*/
+bool	KPSetISA(KPISA Isa);
+
+//! Returns the name of an instruction set, e.g. "SSE4.1"
+const char *KPGetISAName(KPISA Isa);
+
+// Kernel registry, for the reports: every array operation registers its
+// table of kernels under a name when the library is loaded
+
+UINT		KPGetNumKernels(void);				//!< Returns the number of registered kernels.
+const char	*KPGetKernelName(UINT nKernel);		//!< Returns the name of a registered kernel, e.g. "transform stream".
+
+//! Returns the instruction set of the variant of a kernel that runs when Isa is selected
+/*!
+	\param [in] nKernel index of the kernel, below KPGetNumKernels()
+	\param [in] Isa selected instruction set, e.g. KPGetISA()
+	\return Isa if the kernel has a variant for it, the next lower level it has one for otherwise
+*/
+KPISA		KPGetKernelISA(UINT nKernel, KPISA Isa);
 
 class KPVector;
 class KPMatrix;
+class KPMatrixA;
+class KPQuaternion;
 class KPPlane;
 class KPPolygon;
 
@@ -48,23 +147,22 @@ class KPPolygon;
 
 // Maximum/Minimum Search ////
 //////////////////////////////
-
-template <class T> const T KPMax( const T a, const T b );
-template <class T> const T KPMax( const T a, const T b, const T c );
-template <class T> const T KPMin( const T a, const T b );
-template <class T> const T KPMin( const T a, const T b, const T c );
+//
+// KPMax(a, b), KPMax(a, b, c), KPMin(a, b) and KPMin(a, b, c) are
+// constant expression templates, see KPInline.h.
 
 //! 4 Dimensional Vector Class
 
 //! The 4th dimension is mostly only needed
 //! for compatibilty with 4x4 matrices.
-class __declspec( dllexport ) KPVector
+//! Every method is inline, see KPInline.h.
+class KPVector
 {
 public:
 	float x, y, z, w;							// Vector coordinates
 
 	//! Default constructor
-	KPVector(void) { x=0.0f, y=0.0f, z=0.0f, w=1.0f; }
+	KP_CONSTEXPR KPVector(void) : x(0.0f), y(0.0f), z(0.0f), w(1.0f) { }
 
 	//! Constructor that takes three floating point coordinates
 	/*!
@@ -72,7 +170,7 @@ public:
 		\param [in] _y floating point value specifying the Y coordinate of the vector
 		\param [in] _z floating point value specifying the Z coordinate of the vector
 	*/
-	KPVector(float _x, float _y, float _z) { x = _x, y = _y, z = _z, w = 1.0f; }
+	KP_CONSTEXPR KPVector(float _x, float _y, float _z) : x(_x), y(_y), z(_z), w(1.0f) { }
 
 	////
 	// Member Functions
@@ -85,40 +183,54 @@ public:
 		\param [in] _z floating point value specifying the Z coordinate of the vector
 		\param [in] _w floating point value specifying the W coordinate of the vector. This is 1.0f by default.
 	*/
-	inline void		Set(float _x, float _y, float _z, float _w = 1.0f);
+	void	Set(float _x, float _y, float _z, float _w = 1.0f);
 
 	//! Negates the vector.
-	inline void		Negate(void);
+	void	Negate(void);
 
 	//! Normalizes the vector
-	inline void		Normalize(void);
+	/*!
+		Divides by the correctly rounded length, the same as Normalize(KPPRECISION_EXACT).
+		The null vector is left as it is.
+	*/
+	void	Normalize(void);
+
+	//! Normalizes the vector with the given accuracy
+	/*!
+		KPPRECISION_FAST multiplies by the reciprocal square root estimate of the CPU,
+		its relative error is below 4e-4. KPPRECISION_REFINED improves the estimate by
+		a Newton-Raphson step, to within 5e-7. Without SSE both are the exact reciprocal.
+		Vectors with a squared length below FLT_MIN are left as they are.
+		\param [in] Precision accuracy, see KPPRECISION
+	*/
+	void	Normalize(KPPRECISION Precision);
 
 	//! Calculates the difference of two vectors
 	/*!
 		\param [in] v1 KPVector object specifying the fist vector
 		\param [in] v2 KPVector object specifying the second vector
 	*/
-	inline void		Difference(const KPVector &v1, const KPVector &v2);
+	void	Difference(const KPVector &v1, const KPVector &v2);
 
 	//! Calculates the cross product of two vectors
 	/*!
 		\param [in] v1 KPVector object specifying the fist vector
 		\param [in] v2 KPVector object specifying the second vector
 	*/
-	inline void		Cross(const KPVector &v1, const KPVector &v2);
+	void	Cross(const KPVector &v1, const KPVector &v2);
 
 	//! Calculates the length of the vector
-	inline float	GetLength(void);
+	float	GetLength(void);
 
 	//! Calculates the squared length of the vector
-	inline float	GetSqaredLength(void) const;
+	KP_CONSTEXPR float GetSqaredLength(void) const { return (x*x + y*y + z*z); }
 
 	//! Calculates the angle between two vectors.
 	/*!
 		\param [in] v KPVector object specifying the vector
 		\return floating point value specifying the angle in radian.
 	*/
-	inline float	AngleWith(KPVector &v);
+	float	AngleWith(KPVector &v);
 	
 	// Operator Overloads ////
 	KPVector operator  + (const KPVector &v) const;	//!< Vector addition
@@ -137,8 +249,61 @@ public:
 }; // ! KPVector class
 
 
+//! Structure of arrays view of a vector stream
+
+//! The coordinates of the i-th vector are pX[i], pY[i] and pZ[i].
+typedef struct KPSOASTREAM
+{
+	float *pX;									//!< X coordinates
+	float *pY;									//!< Y coordinates
+	float *pZ;									//!< Z coordinates
+} KPSOASTREAM;
+
+
+// Vector Arrays ////
+/////////////////////
+
+//! Normalizes an array of vectors in place
+/*!
+	Reads and writes the x, y, z coordinates at the pointer and steps by nStride bytes,
+	e.g. the normals of a VERTEX array after loading or skinning:
+		KPNormalizeArray(pVertices[0].vcNormal, sizeof(VERTEX), n, KPPRECISION_REFINED);
+	The SIMD kernels normalize 4 vectors at once, each of them gets the same result as
+	KPVector::Normalize(Precision) of an SSE build. With a stride of at least 16 bytes the
+	float after z is read and written back unchanged, other threads must not write it during
+	the call. Arrays of at least 16384 vectors (KPJOB_VECTOR threshold) are split between the
+	worker threads.
+	\param [in,out] pVectors pointer to the x coordinate of the first vector, y and z have to follow it
+	\param [in] nStride distance of two vectors in bytes
+	\param [in] nCount number of vectors
+	\param [in] Precision accuracy, see KPVector::Normalize(KPPRECISION)
+*/
+void KPNormalizeArray(float *pVectors, UINT nStride, UINT nCount, KPPRECISION Precision);
+
+//! Normalizes SoA vector streams in place
+void KPNormalizeArray(const KPSOASTREAM &Stream, UINT nCount, KPPRECISION Precision);
+
+
+//! Classes of 4x4 matrices
+
+//! The fast paths of KPMatrix are chosen by the class of the matrix.
+//! Row vector convention: the 4th column of an affine matrix is (0, 0, 0, 1).
+typedef enum KPMATRIXTYPE
+{
+	KPMT_GENERAL,		//!< Any matrix, e.g. projections
+	KPMT_AFFINE,		//!< Rotation, scaling, shearing and translation
+	KPMT_RIGID			//!< Orthonormal rotation and translation only
+} KPMATRIXTYPE;
+
+// Largest difference from 0 or 1 of the dot products of the upper 3x3 rows of a rigid matrix
+#define KPMATRIX_RIGID_EPSILON	1e-5f
+
+
 //! 4x4 Matrix Class
-class __declspec( dllexport ) KPMatrix
+
+//! The element access, Identity, Translate, TransposeOf and the operators
+//! are inline, see KPInline.h.
+class KPMatrix
 {
 public:
 	// Elements of the matrix: _RC, where R= Row and C= Column
@@ -152,32 +317,32 @@ public:
 	KPMatrix(void) { }
 
 	//! Makes an identity matrix from the matrix
-	inline void Identity(void);
+	void Identity(void);
 
 	//! Creates a rotation matrix around the X axis
 	/*!
 		\param [in] angle floating point value specifying the angle of rotation in radian.
 	*/
-	inline void RotateX(float angle);									// Rotation matrix around X axis
+	KP3D_API void RotateX(float angle);											// Rotation matrix around X axis
 
 	//! Creates a rotation matrix around the Y axis
 	/*!
 		\param [in] angle floating point value specifying the angle of rotation in radian
 	*/
-	inline void RotateY(float angle);									// Rotation matrix around Y axis
+	KP3D_API void RotateY(float angle);											// Rotation matrix around Y axis
 
 	//! Creates a rotation matrix around the Z axis
 	/*!
 		\param [in] angle floating point value specifying the angle of rotation in radian
 	*/
-	inline void RotateZ(float angle);									// Rotation matrix around Z axis
+	KP3D_API void RotateZ(float angle);											// Rotation matrix around Z axis
 
 	//! Creates a rotation matrix around an arbitrary axis
 	/*!
 		\param [in] aV KPVector object specifying the axis vector we want to rotate around.
 		\param [in] angle floating point value specifying the angle of rotation in radian
 	*/
-	inline void Rotate(KPVector aV, float angle);						// Rotation matrix around arbitrary axis
+	KP3D_API void Rotate(KPVector aV, float angle);								// Rotation matrix around arbitrary axis
 
 	//! Creates a translation matrix. It represents movement in space.
 	/*!
@@ -185,36 +350,369 @@ public:
 		\param [in] distY floating point value specifying the amount of movement on the Y axis
 		\param [in] distZ floating point value specifying the amount of movement on the Z axis
 	*/
-	inline void Translate(float distX, float distY, float distZ);		// Translation matrix (movement)
+	void Translate(float distX, float distY, float distZ);				// Translation matrix (movement)
+
+	//! Creates a scale * rotation * translation matrix, the usual world matrix of an object
+	/*!
+		Cheaper than multiplying the scaling, rotation and translation matrices together,
+		and needs no trigonometric functions.
+		\param [in] vcScale KPVector object specifying the scale along the X, Y and Z axes
+		\param [in] qRotation unit KPQuaternion object specifying the rotation
+		\param [in] vcPosition KPVector object specifying the translation
+	*/
+	void ScaleRotateTranslate(const KPVector &vcScale, const KPQuaternion &qRotation, const KPVector &vcPosition);
 
 	//! Transpositioin of a matrix
 	/*!
 		\param [in] m KPMatrix object we want to calculate the transposition of.
 	*/
-	inline void TransposeOf(const KPMatrix &m);							// Transposition of the matrix
+	void TransposeOf(const KPMatrix &m);								// Transposition of the matrix
 
 	//! Inverse of a matrix
 	/*!
 		\param [in] m KPMatrix object we want to calcualte the inverse of.
 	*/
-	inline void InverseOf(const KPMatrix &m);							// Inverse of matrix
+	KP3D_API void InverseOf(const KPMatrix &m);									// Inverse of matrix
+
+	//! Inverse of a matrix of a known class
+	/*!
+		A rigid inverse is the transposed rotation and the rotated negative
+		translation, an affine inverse is a 3x3 inverse and the same translation,
+		only the general inverse runs the full 4x4 cofactor expansion.
+		InverseOf(m) detects the class with GetType() and calls this.
+		\param [in] m KPMatrix object we want to calcualte the inverse of.
+		\param [in] Type class of m, it has to be right, it is not checked.
+	*/
+	KP3D_API void InverseOf(const KPMatrix &m, KPMATRIXTYPE Type);
+
+	//! Returns true if the 4th column of the matrix is exactly (0, 0, 0, 1)
+	/*!
+		Transforming points by an affine matrix does not need the division by w.
+	*/
+	bool IsAffine(void) const { return _14 == 0.0f && _24 == 0.0f && _34 == 0.0f && _44 == 1.0f; }
+
+	//! Detects the class of the matrix
+	/*!
+		Costs 4 compares for a general matrix and 6 three component dot
+		products for an affine one, much less than a general inverse.
+		The rows of the rotation part of a rigid matrix have to be
+		orthonormal within KPMATRIX_RIGID_EPSILON, which is true for every
+		product of the Rotate* and Translate matrices.
+	*/
+	KP3D_API KPMATRIXTYPE GetType(void) const;
 
 	//! Matrix multiplication by another matrix
 	KPMatrix operator * (const KPMatrix &m) const;
 
+	//! Multiplies an array of matrices by this matrix
+	/*!
+		pOut[i] = pIn[i] * (*this), e.g. the world*view*projection matrices of many objects:
+			mViewProj.MultiplyArray(pWorlds, pWorldViewProjs, numObjects);
+		Arrays of at least 8192 matrices (KPJOB_MATRIX threshold) are split between the worker threads.
+		\param [in] pIn array of the left hand side matrices
+		\param [out] pOut array of the results, it can be pIn
+		\param [in] nCount number of matrices
+	*/
+	KP3D_API void MultiplyArray(const KPMatrix *pIn, KPMatrix *pOut, UINT nCount) const;
+
 	//! Matrix multiplication by vector
 	KPVector operator * (const KPVector &v) const;
 
+	// Array Transformations ////
+	//
+	// The strided versions read and write the x, y, z coordinates at the
+	// given pointers and step by the given number of bytes, so VERTEX and
+	// LVERTEX arrays can be transformed in place or into another array:
+	//		mWorld.TransformPoints(&pVertices[0].x, sizeof(VERTEX), &pVertices[0].x, sizeof(VERTEX), n);
+	// Only the three coordinates are written, the rest of the vertex is left untouched.
+	// Arrays of at least 16384 vectors (KPJOB_VECTOR threshold) are split between the worker threads.
+
+	//! Transforms an array of points, including the division by w
+	/*!
+		The division is skipped if IsAffine() is true.
+		\param [in] pIn pointer to the x coordinate of the first point, y and z have to follow it
+		\param [in] nInStride distance of two input points in bytes
+		\param [out] pOut pointer to the x coordinate of the first output point, it can be pIn
+		\param [in] nOutStride distance of two output points in bytes
+		\param [in] nCount number of points
+	*/
+	KP3D_API void TransformPoints(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const;
+
+	//! Transforms an array of points by an affine matrix, skipping the division by w
+	/*!
+		The 4th column of the matrix is ignored, it is assumed to be (0, 0, 0, 1).
+		\param [in] pIn pointer to the x coordinate of the first point, y and z have to follow it
+		\param [in] nInStride distance of two input points in bytes
+		\param [out] pOut pointer to the x coordinate of the first output point, it can be pIn
+		\param [in] nOutStride distance of two output points in bytes
+		\param [in] nCount number of points
+	*/
+	KP3D_API void TransformAffine(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const;
+
+	//! Transforms an array of direction vectors by the upper 3x3 part of the matrix
+	/*!
+		The results are not normalized. For matrices with non-uniform scaling
+		use the transposed inverse of the matrix.
+		\param [in] pIn pointer to the x coordinate of the first vector, y and z have to follow it
+		\param [in] nInStride distance of two input vectors in bytes
+		\param [out] pOut pointer to the x coordinate of the first output vector, it can be pIn
+		\param [in] nOutStride distance of two output vectors in bytes
+		\param [in] nCount number of vectors
+	*/
+	KP3D_API void TransformNormals(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const;
+
+	//! Transforms SoA point streams, including the division by w
+	KP3D_API void TransformPoints(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const;
+
+	//! Transforms SoA point streams by an affine matrix, skipping the division by w
+	KP3D_API void TransformAffine(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const;
+
+	//! Transforms SoA direction vector streams by the upper 3x3 part of the matrix
+	KP3D_API void TransformNormals(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const;
+
 }; // ! KPMatrix class
 
 
+//! 4x4 Matrix with 32 byte aligned storage
+
+//! Same layout as KPMatrix and D3DMATRIX, so it can be cast to both of them.
+//! The SIMD code can use aligned loads and stores on it, and no row of it
+//! crosses a cache line. Objects created with new are aligned too, the
+//! containers need KPAlignedArray or KPAlignedAllocator, see KPMemory.h.
+class KP_ALIGN(32) KPMatrixA : public KPMatrix
+{
+public:
+	//! Constructor
+	KPMatrixA(void) { }
+
+	//! Constructor that copies a KPMatrix
+	KPMatrixA(const KPMatrix &m) : KPMatrix(m) { }
+
+	//! Copies a KPMatrix
+	KPMatrixA &operator = (const KPMatrix &m) { KPMatrix::operator = (m); return *this; }
+
+	//! Matrix multiplication by another aligned matrix
+	KPMatrixA operator * (const KPMatrixA &m) const;
+
+	// Aligned heap allocation
+	KP3D_API static void *operator new	(size_t nSize);
+	KP3D_API static void *operator new[] (size_t nSize);
+	KP3D_API static void  operator delete   (void *p);
+	KP3D_API static void  operator delete[] (void *p);
+
+}; // ! KPMatrixA class
+
+
+// Sine and Cosine ////
+///////////////////////
+
+//! Axis of the rotation matrices of KPBuildRotations
+typedef enum KPAXIS
+{
+	KPAXIS_X = 0,
+	KPAXIS_Y,
+	KPAXIS_Z
+} KPAXIS;
+
+//! Sine and cosine of an angle, KPPRECISION_REFINED
+/*!
+	The rotation builders of KPMatrix use it. Angles beyond +-8192 radians
+	are left to the C library, the argument reduction would lose precision.
+	\param [in] fAngle angle in radian
+	\param [out] pSin receives the sine
+	\param [out] pCos receives the cosine
+*/
+void KPSinCos(float fAngle, float *pSin, float *pCos);
+
+//! Sines and cosines of an array of angles
+/*!
+	4 (SSE) or 8 (AVX) angles at once, with the same results as the scalar path.
+	\param [in] pAngles angles in radian
+	\param [out] pSin array receiving the sines
+	\param [out] pCos array receiving the cosines
+	\param [in] nCount number of angles
+	\param [in] Precision accuracy, see KPPRECISION
+*/
+void KPSinCosArray(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision);
+
+//! Builds rotation matrices around one axis from an array of angles
+/*!
+	pOut[i].RotateX/Y/Z(pAngles[i]), with the sines and cosines computed by
+	the SIMD kernels. Arrays of at least 8192 angles (KPJOB_MATRIX threshold) are split between the
+	worker threads.
+	\param [in] pAngles angles in radian
+	\param [in] Axis axis of the rotations
+	\param [out] pOut array of the matrices
+	\param [in] nCount number of angles
+*/
+void KPBuildRotations(const float *pAngles, KPAXIS Axis, KPMatrix *pOut, UINT nCount);
+
+
+// Pixels ////
+//////////////
+
+//! Replaces the pixels of one color by another
+/*!
+	Used for the color keys of the textures: 4 (SSE2) or 8 (AVX2) pixels
+	are compared at once.
+	\param [in,out] pPixels 32 bit pixels, any channel order
+	\param [in] nCount number of pixels
+	\param [in] nKey color to replace
+	\param [in] nColor new color of the pixels of nKey
+*/
+void KPReplaceColor(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor);
+
+//! Limits the alpha channel of A8R8G8B8 pixels
+/*!
+	\param [in,out] pPixels pixels, alpha in the top byte
+	\param [in] nCount number of pixels
+	\param [in] Alpha largest alpha value, larger ones are lowered to it
+*/
+void KPLimitAlpha(UINT *pPixels, UINT nCount, unsigned char Alpha);
+
+
+// Indices ////
+///////////////
+
+//! Adds an offset to 16-bit indices
+/*!
+	Used by the dynamic vertex caches to move the indices of a batch after
+	the vertices already cached: 8 (SSE2) or 16 (AVX2) indices at once.
+	The sums wrap around at 16 bits. pIn and pOut can be the same array.
+	\param [in] pIn indices
+	\param [out] pOut pIn[i] + nOffset
+	\param [in] nCount number of indices
+	\param [in] nOffset value added to every index
+*/
+void KPRebaseIndices(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset);
+
+//! Fills an array with consecutive 16-bit indices
+/*!
+	\param [out] pOut nFirst + i
+	\param [in] nCount number of indices
+	\param [in] nFirst first index
+*/
+void KPSequenceIndices(unsigned short *pOut, UINT nCount, UINT nFirst);
+
+
+//! Quaternion Class
+
+//! Represents a rotation around the unit axis a by the angle t as
+//! (x, y, z, w) = (a * sin(t/2), cos(t/2)). The rotations have the
+//! same direction as the ones of KPMatrix::RotateX/Y/Z, and the product
+//! follows the row vector convention of KPMatrix: q1 * q2 rotates by q1
+//! first, then by q2, so (q1 * q2) gives the matrix m1 * m2.
+class KPQuaternion
+{
+public:
+	float x, y, z, w;							// Quaternion elements
+
+	//! Default constructor, creates the identity rotation
+	KP_CONSTEXPR KPQuaternion(void) : x(0.0f), y(0.0f), z(0.0f), w(1.0f) { }
+
+	//! Constructor that takes the four elements
+	KP_CONSTEXPR KPQuaternion(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) { }
+
+	////
+	// Member Functions
+	////
+
+	//! Assigns new values to the elements of the quaternion
+	void	Set(float _x, float _y, float _z, float _w);
+
+	//! Makes the identity rotation from the quaternion
+	void	Identity(void);
+
+	//! Conjugates the quaternion, for unit quaternions this is the inverse rotation
+	void	Conjugate(void);
+
+	//! Normalizes the quaternion
+	void	Normalize(void);
+
+	//! Calculates the length of the quaternion
+	float	GetLength(void) const;
+
+	//! Creates a rotation around an arbitrary axis
+	/*!
+		\param [in] vcAxis KPVector object specifying the axis, it is normalized if it is not a unit vector
+		\param [in] fAngle floating point value specifying the angle of rotation in radian
+	*/
+	KP3D_API void	FromAxisAngle(const KPVector &vcAxis, float fAngle);
+
+	//! Retrieves the axis and the angle of the rotation
+	/*!
+		\param [out] vcAxis unit axis of the rotation, the X axis for the identity rotation
+		\param [out] fAngle angle of the rotation in radian, between 0 and 2*pi
+	*/
+	KP3D_API void	GetAxisAngle(KPVector &vcAxis, float &fAngle) const;
+
+	//! Creates the quaternion from the rotation part of a matrix
+	/*!
+		\param [in] m KPMatrix object, its upper 3x3 part has to be a rotation without scaling
+	*/
+	KP3D_API void	FromMatrix(const KPMatrix &m);
+
+	//! Creates a rotation matrix from the quaternion
+	/*!
+		The quaternion has to be a unit quaternion.
+		\param [out] m KPMatrix object receiving the rotation, its translation is zeroed
+	*/
+	KP3D_API void	GetMatrix(KPMatrix &m) const;
+
+	//! Normalized linear interpolation of two rotations along the shorter arc
+	/*!
+		Cheaper than Slerp, but the angular speed is not constant. Good enough for
+		keys close to each other, e.g. animation keyframes.
+		\param [in] q0 rotation at t = 0
+		\param [in] q1 rotation at t = 1
+		\param [in] t interpolation parameter between 0 and 1
+	*/
+	void	Nlerp(const KPQuaternion &q0, const KPQuaternion &q1, float t);
+
+	//! Spherical linear interpolation of two unit quaternions along the shorter arc
+	/*!
+		Constant angular speed. Uses a polynomial approximation of the
+		sin((1-t)a)/sin(a) and sin(ta)/sin(a) weights instead of acos and sin,
+		accurate to a few float ULPs.
+		\param [in] q0 rotation at t = 0
+		\param [in] q1 rotation at t = 1
+		\param [in] t interpolation parameter between 0 and 1
+	*/
+	KP3D_API void	Slerp(const KPQuaternion &q0, const KPQuaternion &q1, float t);
+
+	// Operator Overloads ////
+	KPQuaternion operator  * (const KPQuaternion &q) const;	//!< Concatenation, rotates by this first
+	void		 operator *= (const KPQuaternion &q);		//!< Concatenation, rotates by this first
+
+}; // ! KPQuaternion class
+
+
+//! Scale, rotation and translation of an object
+typedef struct KPTRS
+{
+	KPVector		vcScale;			//!< Scale along the X, Y and Z axes
+	KPQuaternion	qRotation;			//!< Unit quaternion
+	KPVector		vcPosition;			//!< Translation
+} KPTRS;
+
+//! Builds the world matrices of many objects
+/*!
+	pOut[i].ScaleRotateTranslate(pIn[i].vcScale, pIn[i].qRotation, pIn[i].vcPosition)
+	Arrays of at least 8192 objects (KPJOB_MATRIX threshold) are split between the worker threads.
+	\param [in] pIn array of the transformations
+	\param [out] pOut array of the matrices
+	\param [in] nCount number of objects
+*/
+void KPBuildTRSMatrices(const KPTRS *pIn, KPMatrix *pOut, UINT nCount);
+
+
 //! Plane Class
 /*!
 	Plane: V * N + d = 0,	 where V is a vector to a point on the plane, 
 							 N is the normal of the plane and
 							 d is distance from world origin.
 */
-class __declspec( dllexport ) KPPlane
+class KPPlane
 {
 
 public:
@@ -231,7 +729,7 @@ public:
 		\param [in] vcNormal KPVector object specifying the normal vector of the plane.
 		\param [in] vcPoint KPVector object specifying a point on the plane.
 	*/
-	inline void Set(const KPVector &vcNormal, const KPVector &vcPoint);						// Calculate the distance
+	void Set(const KPVector &vcNormal, const KPVector &vcPoint);						// Calculate the distance
 
 	//! Specify the plane using a normal vector, a point on the plane and the distance from the origin
 	/*!
@@ -239,7 +737,7 @@ public:
 		\param [in] vcPoint KPVector object specifying a point on the plane.
 		\param [in] fDistance floating point value specifying the distance from the origin.
 	*/
-	inline void Set(const KPVector &vcNormal, const KPVector &vcPoint, float fDistance);	// Specify the distance
+	void Set(const KPVector &vcNormal, const KPVector &vcPoint, float fDistance);		// Specify the distance
 
 	//! Specify the plane using three vectors
 	/*!
@@ -247,8 +745,373 @@ public:
 		\param [in] v1 KPVector object specifying the second vector.
 		\param [in] v2 KPVector object specifying the third vector.
 	*/
-	inline void Set(const KPVector &v0, const KPVector &v1, const KPVector &v2);			// Define the plane with 3 vectors
+	void Set(const KPVector &v0, const KPVector &v1, const KPVector &v2);				// Define the plane with 3 vectors
 
 }; // ! KPPlane Class
 
+
+// Frustum Classification ////
+//////////////////////////////
+
+// Maximum number of planes of a classification call, 6 for a view frustum
+#define KPMAX_CULL_PLANES	8
+
+//! Bounding sphere, 16 bytes so the SIMD kernels load it at once
+typedef struct KPSPHERE
+{
+	float	x, y, z;			//!< Center
+	float	fRadius;			//!< Radius
+} KPSPHERE;
+
+//! Axis aligned bounding box
+typedef struct KPAABB
+{
+	float	vcMin[3];			//!< Minimum x, y, z
+	float	vcMax[3];			//!< Maximum x, y, z
+} KPAABB;
+
+//! Classifies bounding spheres against a convex volume
+/*!
+	The normals of the planes point outward, like the ones of KPRenderDevice::GetFrustum,
+	a point is outside if it is in front of any plane: N * V + d > 0.
+	Writes KPCULLED if the sphere is outside, KPCLIPPED if it intersects a plane, KPVISIBLE
+	if it is inside. Arrays of at least 16384 objects (KPJOB_VECTOR threshold) are split between the worker threads.
+	\param [in] pPlanes planes of the volume, e.g. the view frustum
+	\param [in] nPlanes number of planes, at most KPMAX_CULL_PLANES
+	\param [in] pSpheres array of the spheres
+	\param [out] pStates array receiving one state per sphere
+	\param [in] nCount number of spheres
+	\return false if nPlanes is 0 or larger than KPMAX_CULL_PLANES
+*/
+bool KPClassifySpheres(const KPPlane *pPlanes, UINT nPlanes, const KPSPHERE *pSpheres, unsigned char *pStates, UINT nCount);
+
+//! Classifies axis aligned bounding boxes against a convex volume
+/*!
+	The same as KPClassifySpheres, for boxes. Only the corner nearest to and the one
+	farthest from every plane are tested (the n- and p-vertices), which is exact.
+	\param [in] pPlanes planes of the volume, e.g. the view frustum
+	\param [in] nPlanes number of planes, at most KPMAX_CULL_PLANES
+	\param [in] pBoxes array of the boxes
+	\param [out] pStates array receiving one state per box
+	\param [in] nCount number of boxes
+	\return false if nPlanes is 0 or larger than KPMAX_CULL_PLANES
+*/
+bool KPClassifyBoxes(const KPPlane *pPlanes, UINT nPlanes, const KPAABB *pBoxes, unsigned char *pStates, UINT nCount);
+
+// Bounding Volumes ////
+////////////////////////
+
+//! Axis Aligned Bounding Box Class
+/*!
+	Adds the construction and the operations to KPAABB, an array of KPAabb can
+	be passed to KPClassifyBoxes. An empty box has its minimum above its maximum,
+	it contains nothing and merging it changes nothing.
+	The small methods are inline, see KPInline.h.
+*/
+class KP3D_API KPAabb : public KPAABB
+{
+public:
+	//! Default constructor, an empty box
+	KPAabb(void) { Reset(); }
+
+	//! Constructor that takes the corners
+	KPAabb(const KPVector &vcMin, const KPVector &vcMax) { Set(vcMin, vcMax); }
+
+	//! Makes the box empty
+	void	Reset(void);
+
+	//! Sets the corners
+	void	Set(const KPVector &vcMin, const KPVector &vcMax);
+
+	//! Returns true if the box contains nothing
+	bool	IsEmpty(void) const;
+
+	//! Computes the bounds of strided positions, e.g. of a VERTEX array
+	/*!
+		The SIMD kernels reduce 4 (SSE) or 8 (AVX) positions per instruction, arrays of at
+		least 16384 positions (KPJOB_VECTOR threshold) are split between the worker threads.
+		The NaN coordinates are ignored, the box of no positions is empty.
+		\param [in] pPositions x, y, z position of the first vertex
+		\param [in] nStride distance of two vertices in bytes
+		\param [in] nCount number of vertices
+	*/
+	void	Compute(const float *pPositions, UINT nStride, UINT nCount);
+
+	//! Grows the box to contain a point
+	void	Add(const KPVector &v);
+
+	//! Grows the box to contain another one
+	void	Merge(const KPAABB &b);
+
+	//! Sets the box to the bounds of a box transformed by an affine matrix
+	/*!
+		J. Arvo: Transforming Axis-Aligned Bounding Boxes. The result is the
+		smallest box containing the transformed corners of b, b can be this box.
+		\param [in] b box to transform
+		\param [in] m affine matrix, row vector convention
+	*/
+	void	Transform(const KPAABB &b, const KPMatrix &m);
+
+	//! Returns the center of the box
+	KPVector GetCenter(void) const;
+
+	//! Returns the half sizes of the box along the axes
+	KPVector GetExtents(void) const;
+
+	//! Returns true if the point is in the box or on its faces
+	bool	Contains(const KPVector &v) const;
+
+	//! Returns true if the boxes overlap or touch
+	bool	Intersects(const KPAABB &b) const;
+
+	//! Intersects a ray with the box, by the slabs of the axes
+	/*!
+		\param [in] vcOrigin origin of the ray
+		\param [in] vcDirection direction of the ray
+		\param [out] pfDistance receives the distance of the entry point in lengths of the direction, 0 if the origin is in the box, can be NULL
+		\return false if the ray misses the box
+	*/
+	bool	IntersectRay(const KPVector &vcOrigin, const KPVector &vcDirection, float *pfDistance) const;
+
+}; // ! KPAabb class
+
+
+//! Bounding Sphere Class
+/*!
+	Adds the construction and the operations to KPSPHERE, an array of KPSphere
+	can be passed to KPClassifySpheres. An empty sphere has a negative radius.
+	The small methods are inline, see KPInline.h.
+*/
+class KP3D_API KPSphere : public KPSPHERE
+{
+public:
+	//! Default constructor, an empty sphere
+	KPSphere(void) { Reset(); }
+
+	//! Constructor that takes the center and the radius
+	KPSphere(const KPVector &vcCenter, float _fRadius) { Set(vcCenter, _fRadius); }
+
+	//! Makes the sphere empty
+	void	Reset(void);
+
+	//! Sets the center and the radius
+	void	Set(const KPVector &vcCenter, float _fRadius);
+
+	//! Returns true if the sphere contains nothing
+	bool	IsEmpty(void) const;
+
+	//! Computes a tight sphere around strided positions, e.g. of a VERTEX array
+	/*!
+		J. Ritter: An Efficient Bounding Sphere. The initial sphere spans the two
+		positions farthest apart along the longest axis of the bounding box, and it
+		is grown over the positions. The sphere around the center of the bounding
+		box is computed too, the smaller one is kept; it is never larger than the
+		sphere around the box, and usually 5-20% larger than the smallest one.
+		\param [in] pPositions x, y, z position of the first vertex
+		\param [in] nStride distance of two vertices in bytes
+		\param [in] nCount number of vertices
+	*/
+	void	Compute(const float *pPositions, UINT nStride, UINT nCount);
+
+	//! Sets the sphere around a box, its center is the center of the box
+	void	Set(const KPAABB &b);
+
+	//! Grows the sphere to contain another one, the result is the smallest sphere containing both
+	void	Merge(const KPSPHERE &s);
+
+	//! Sets the sphere to the bounds of a sphere transformed by an affine matrix
+	/*!
+		The radius is scaled by the longest axis of the matrix, so the result
+		contains the transformed sphere for non uniform scales too.
+		\param [in] s sphere to transform, can be this sphere
+		\param [in] m affine matrix, row vector convention
+	*/
+	void	Transform(const KPSPHERE &s, const KPMatrix &m);
+
+	//! Returns the center of the sphere
+	KPVector GetCenter(void) const;
+
+	//! Returns true if the point is in the sphere or on its surface
+	bool	Contains(const KPVector &v) const;
+
+	//! Returns true if the spheres overlap or touch
+	bool	Intersects(const KPSPHERE &s) const;
+
+}; // ! KPSphere class
+
+// Polygon Clipping ////
+////////////////////////
+
+//! Polygon Class
+/*!
+	Convex polygon, clipped by planes with the Sutherland-Hodgman algorithm.
+	The part behind a plane is kept, N * V + d <= 0, the side KPClassifySpheres
+	counts as inside, so the planes of KPRenderDevice::GetFrustum clip to the view.
+	The point arrays only grow, a polygon reused for clipping many polygons stops
+	allocating once it is large enough.
+*/
+class KP3D_API KPPolygon
+{
+public:
+	//! Constructor
+	KPPolygon(void);
+
+	//! Destructor
+	~KPPolygon(void);
+
+	//! Copies the points of the polygon
+	/*!
+		\param [in] pPoints array of the points, in order around the polygon
+		\param [in] nNumPoints number of points
+		\return false if out of memory
+	*/
+	bool	Set(const KPVector *pPoints, UINT nNumPoints);
+
+	//! Makes room for a number of points, so Set and Clip do not allocate below it
+	/*!
+		Clipping by one plane can add a point, a polygon of n points clipped by
+		m planes needs room for 2 * (n + m) points.
+		\param [in] nMaxPoints number of points
+		\return false if out of memory
+	*/
+	bool	Reserve(UINT nMaxPoints);
+
+	//! Returns the number of points, 0 if the polygon was clipped away
+	UINT	GetNumPoints(void) const { return m_NumPoints; }
+
+	//! Returns the points of the polygon
+	const KPVector *GetPoints(void) const { return m_pPoints; }
+
+	//! Classifies the polygon against a plane
+	/*!
+		\param [in] plane the plane
+		\return KPFRONT, KPBACK, KPPLANAR if all the points are on the plane, or KPCLIPPED
+	*/
+	int		Classify(const KPPlane &plane) const;
+
+	//! Clips away the part of the polygon in front of a plane
+	/*!
+		\param [in] plane the plane
+		\return false if out of memory
+	*/
+	bool	Clip(const KPPlane &plane);
+
+	//! Clips away the part of the polygon in front of any of the planes
+	/*!
+		\param [in] pPlanes array of the planes, e.g. the view frustum
+		\param [in] nPlanes number of planes
+		\return false if out of memory
+	*/
+	bool	Clip(const KPPlane *pPlanes, UINT nPlanes);
+
+private:
+	KPVector	*m_pPoints;			// Points of the polygon
+	KPVector	*m_pScratch;		// Output of the next clipping, swapped with m_pPoints
+	float		*m_pfDist;			// Distances of the points from the plane being clipped by
+	UINT		m_NumPoints;		// Number of points
+	UINT		m_nMaxPoints;		// Size of the arrays
+
+	// Not copyable
+	KPPolygon(const KPPolygon &);
+	KPPolygon &operator = (const KPPolygon &);
+
+}; // ! KPPolygon class
+
+//! Clips a list of triangles against a convex volume
+/*!
+	The triangles are classified against the planes first, the ones inside are copied,
+	the ones outside are dropped and only the ones crossing a plane are clipped by
+	KPPolygon::Clip, their remains are written as triangle fans.
+	\param [in] pPlanes planes of the volume, normals pointing outward, e.g. the view frustum
+	\param [in] nPlanes number of planes, at most KPMAX_CULL_PLANES
+	\param [in] pTriangles vertices of the triangles, 3 per triangle
+	\param [in] nTriangles number of triangles
+	\param [out] pOut array receiving the vertices of the clipped triangles, 3 per triangle
+	\param [in] nMaxOut number of triangles pOut has room for, nTriangles * (nPlanes + 1) is always enough
+	\param [out] pNumOut receives the number of triangles written
+	\param [in,out] Scratch polygon the clipping is done in, keep it between the calls to avoid allocations
+	\return false if nPlanes is 0 or larger than KPMAX_CULL_PLANES, pOut was too small or out of memory
+*/
+bool KPClipTriangles(const KPPlane *pPlanes, UINT nPlanes, const KPVector *pTriangles, UINT nTriangles,
+					 KPVector *pOut, UINT nMaxOut, UINT *pNumOut, KPPolygon &Scratch);
+
+// Ray Intersection ////
+////////////////////////
+
+// Number of triangles in a packet of KPPickMesh
+#define KPPICK_PACKET	8
+
+//! Closest hit of a ray
+typedef struct KPRAYHIT
+{
+	float	fDistance;			//!< Distance along the ray, in lengths of the direction vector
+	float	u, v;				//!< Barycentric coordinates of the hit, the point is (1 - u - v) * V0 + u * V1 + v * V2
+	UINT	nTriangle;			//!< Index of the triangle
+} KPRAYHIT;
+
+//! Triangles of a packet in SoA form, the first vertex and the two edges from it
+
+//! 32 bytes per row, the SIMD kernels load the rows with aligned loads
+//! from the cache line aligned storage of KPPickMesh.
+typedef struct KPTRIPACKET
+{
+	float	v0[3][KPPICK_PACKET];
+	float	e1[3][KPPICK_PACKET];
+	float	e2[3][KPPICK_PACKET];
+} KPTRIPACKET;
+
+//! Pick Mesh Class
+/*!
+	Triangles of static geometry prepared for ray intersection tests.
+	The triangles are stored in packets of KPPICK_PACKET in SoA form, the SIMD
+	kernels test a ray against 4 (SSE) or 8 (AVX) of them per instruction with
+	the Moller-Trumbore algorithm. Both sides of the triangles are hit.
+*/
+class KP3D_API KPPickMesh
+{
+public:
+	//! Constructor
+	KPPickMesh(void);
+
+	//! Destructor
+	~KPPickMesh(void);
+
+	//! Builds the packets from an indexed triangle list
+	/*!
+		\param [in] pPositions x, y, z position of the first vertex
+		\param [in] nStride distance of two vertices in bytes
+		\param [in] pIndices 3 indices per triangle, NULL if the vertices are not indexed
+		\param [in] nTriangles number of triangles
+		\return false if out of memory
+	*/
+	bool	Create(const float *pPositions, UINT nStride, const unsigned short *pIndices, UINT nTriangles);
+
+	//! Returns the number of triangles
+	UINT	GetNumTriangles(void) const { return m_numTriangles; }
+
+	//! Finds the closest triangle hit by a ray
+	/*!
+		Hits closer than EPSILON to the origin are ignored, the ray does not hit the
+		triangle it starts from.
+		\param [in] vcOrigin origin of the ray, in the space of the positions
+		\param [in] vcDirection direction of the ray
+		\param [out] pHit receives the closest hit
+		\return false if the ray hits nothing
+	*/
+	bool	Intersect(const KPVector &vcOrigin, const KPVector &vcDirection, KPRAYHIT *pHit) const;
+
+private:
+	KPTRIPACKET	*m_pPackets;		// Triangles, the last packet is padded with degenerate ones
+	UINT		m_numPackets;		// Number of packets
+	UINT		m_numTriangles;		// Number of triangles
+
+	// Not copyable
+	KPPickMesh(const KPPickMesh &);
+	KPPickMesh &operator = (const KPPickMesh &);
+
+}; // ! KPPickMesh class
+
+// The inline operations need the complete classes
+#include "KPInline.h"
+
 #endif // ! KP3D_H
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPAnimation.cpp
+ *  Description: KPEngine skeletal animation implementation
+ *				 - Skeleton
+ *				 - Keyframe sampling
+ *				 - Matrix palette
+ *				 - Parallel character skinning
+ *
+ *****************************************************************
+*/
+
+#include "KPAnimation.h"
+#include "KPJobs.h"
+
+
+// KPSkeleton ////
+//////////////////
+
+KPSkeleton::KPSkeleton(void)
+{
+	m_pBones	= NULL;
+	m_numBones	= 0;
+}
+
+KPSkeleton::~KPSkeleton(void)
+{
+	if ( m_pBones )
+	{
+		delete [] m_pBones;
+		m_pBones = NULL;
+	}
+}
+
+
+// Create ////
+bool KPSkeleton::Create(UINT numBones, const KPBONE *pBones)
+{
+	if ( numBones == 0 || numBones > KPMAX_BONES || !pBones )
+		return false;
+
+	// The palette is computed in one pass from the root to the leaves
+	for ( UINT i = 0; i < numBones; ++i )
+	{
+		if ( pBones[i].nParent >= (int)i )
+			return false;
+	}
+
+	KPBONE *pNewBones = new KPBONE[numBones];
+	if ( !pNewBones )
+		return false;
+
+	for ( UINT i = 0; i < numBones; ++i )
+		pNewBones[i] = pBones[i];
+
+	if ( m_pBones )
+		delete [] m_pBones;
+
+	m_pBones	= pNewBones;
+	m_numBones	= numBones;
+
+	return true;
+
+} // ! Create
+
+
+// Sample ////
+//////////////
+void KPSkeleton::Sample(const KPANIMATION &Anim, float fTime, KPMatrix *pLocal) const
+{
+	// Bring the time into the clip
+	if ( Anim.bLoop && Anim.fDuration > 0.0f )
+	{
+		fTime = fmodf(fTime, Anim.fDuration);
+		if ( fTime < 0.0f )
+			fTime += Anim.fDuration;
+	}
+	else if ( fTime > Anim.fDuration )
+		fTime = Anim.fDuration;
+
+	if ( fTime < 0.0f )
+		fTime = 0.0f;
+
+	for ( UINT i = 0; i < m_numBones; ++i )
+	{
+		const KPBONETRACK	&Track	= Anim.pTracks[i];
+		const KPKEYFRAME	*pKeys	= Track.pKeys;
+
+		// Binary search for the last key not after fTime
+		UINT nLow = 0, nHigh = Track.numKeys - 1;
+
+		while ( nLow < nHigh )
+		{
+			UINT nMid = ( nLow + nHigh + 1 ) / 2;
+
+			if ( pKeys[nMid].fTime <= fTime )
+				nLow = nMid;
+			else
+				nHigh = nMid - 1;
+		}
+
+		const KPKEYFRAME &Key0 = pKeys[nLow];
+
+		// Before the first, after the last or exactly at a key
+		if ( nLow + 1 >= Track.numKeys || fTime <= Key0.fTime )
+		{
+			KPVector vcScale(Key0.fScale, Key0.fScale, Key0.fScale);
+
+			pLocal[i].ScaleRotateTranslate(vcScale, Key0.qRotation, Key0.vcPosition);
+			continue;
+		}
+
+		const KPKEYFRAME &Key1 = pKeys[nLow + 1];
+
+		float			t = ( fTime - Key0.fTime ) / ( Key1.fTime - Key0.fTime );
+		float			fScale = Key0.fScale + t * ( Key1.fScale - Key0.fScale );
+		KPVector		vcScale(fScale, fScale, fScale);
+		KPVector		vcPosition = Key0.vcPosition + ( Key1.vcPosition - Key0.vcPosition ) * t;
+		KPQuaternion	qRotation;
+
+		qRotation.Nlerp(Key0.qRotation, Key1.qRotation, t);
+
+		pLocal[i].ScaleRotateTranslate(vcScale, qRotation, vcPosition);
+
+	} // ! for bones
+
+} // ! Sample
+
+
+// CalcPalette ////
+///////////////////
+void KPSkeleton::CalcPalette(const KPMatrix *pLocal, const KPMatrix &mWorld, KPMatrix *pPalette) const
+{
+	// Model to world space transformation of every bone, the parents are
+	// already done when a child needs them, so pPalette can be pLocal
+	for ( UINT i = 0; i < m_numBones; ++i )
+	{
+		int nParent = m_pBones[i].nParent;
+
+		if ( nParent < 0 )
+			pPalette[i] = pLocal[i] * mWorld;
+		else
+			pPalette[i] = pLocal[i] * pPalette[nParent];
+	}
+
+	// Bring the bind pose vertices into bone space first
+	for ( UINT i = 0; i < m_numBones; ++i )
+		pPalette[i] = m_pBones[i].mInvBindPose * pPalette[i];
+
+} // ! CalcPalette
+
+
+// KPSkinCharacters ////
+////////////////////////
+
+static void KPSkinCharacterJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	KPSKINJOB *pJobs = (KPSKINJOB*)pParam;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		KPSKINJOB &Job = pJobs[i];
+
+		if ( Job.pSkeleton )
+		{
+			Job.pSkeleton->Sample(*Job.pAnimation, Job.fTime, Job.pPalette);
+			Job.pSkeleton->CalcPalette(Job.pPalette, Job.mWorld, Job.pPalette);
+		}
+
+		KPSkinVertices(Job.pVertices, Job.pPalette, Job.pOut, Job.nOutStride, Job.numVertices);
+	}
+}
+
+void KPSkinCharacters(KPSKINJOB *pJobs, UINT nJobs)
+{
+	// One character per chunk, the characters are large enough to be worth a thread each
+	KPParallelFor(nJobs, 1, KPSkinCharacterJob, pJobs);
+}
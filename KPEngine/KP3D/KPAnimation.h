@@ -0,0 +1,177 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPAnimation.h
+ *  Description: KPEngine skeletal animation
+ *				 - Bone hierarchy
+ *				 - Keyframed animation clips
+ *				 - Matrix palette computation
+ *				 - Linear blend skinning
+ *
+ *****************************************************************
+*/
+
+#ifndef KPANIMATION_H
+#define KPANIMATION_H
+
+#include "KP3D.h"
+
+// Maximum number of bones influencing a vertex
+#define KPMAX_INFLUENCES	4
+
+// Maximum number of bones in a skeleton, bone indices are stored in a byte
+#define KPMAX_BONES			256
+
+
+//! Bone of a skeleton
+typedef struct KPBONE
+{
+	int			nParent;			//!< Index of the parent bone, -1 for the root. Parents have to come before their children.
+	KPMatrix	mInvBindPose;		//!< Inverse of the model space transformation of the bone in the bind pose
+} KPBONE;
+
+
+//! Key of a bone track
+typedef struct KPKEYFRAME
+{
+	float		fTime;				//!< Time of the key in seconds
+	KPQuaternion qRotation;		//!< Rotation relative to the parent bone
+	KPVector	vcPosition;			//!< Translation relative to the parent bone
+	float		fScale;				//!< Uniform scale
+} KPKEYFRAME;
+
+
+//! Keys of one bone
+typedef struct KPBONETRACK
+{
+	UINT		numKeys;			//!< Number of keys, at least 1
+	KPKEYFRAME	*pKeys;				//!< Keys sorted by time
+} KPBONETRACK;
+
+
+//! Animation clip
+typedef struct KPANIMATION
+{
+	float		fDuration;			//!< Length of the clip in seconds
+	bool		bLoop;				//!< Wrap the time around instead of clamping it
+	UINT		numTracks;			//!< Number of tracks, one for every bone of the skeleton
+	KPBONETRACK	*pTracks;			//!< Tracks, in the same order as the bones
+} KPANIMATION;
+
+
+//! Skinned vertex
+
+//! The first 8 floats have the layout of VERTEX, the skinning writes
+//! them to the output with the position and the normal skinned.
+typedef struct KPSKINVERTEX
+{
+	float			x, y, z;						//!< Bind pose position
+	float			vcNormal[3];					//!< Bind pose normal
+	float			tu, tv;							//!< Texture coordinates
+	unsigned char	nBones[KPMAX_INFLUENCES];		//!< Palette indices of the influencing bones
+	float			fWeights[KPMAX_INFLUENCES];		//!< Weights in decreasing order, their sum is 1, the unused ones are 0
+} KPSKINVERTEX;
+
+
+//! Skeleton Class
+
+//! Stores the bone hierarchy, it is not changed by the animation,
+//! so many characters can share one skeleton from many threads.
+class KP3D_API KPSkeleton
+{
+public:
+	//! Constructor
+	KPSkeleton(void);
+
+	//! Destructor
+	~KPSkeleton(void);
+
+	//! Copies the bones of the skeleton
+	/*!
+		\param [in] numBones number of bones, at most KPMAX_BONES
+		\param [in] pBones array of the bones, parents first
+		\return false if the number of bones is invalid, a bone comes before its parent or out of memory
+	*/
+	bool	Create(UINT numBones, const KPBONE *pBones);
+
+	//! Returns the number of bones
+	UINT	GetNumBones(void) const { return m_numBones; }
+
+	//! Samples an animation clip
+	/*!
+		Interpolates the keys around fTime linearly, the rotations with
+		normalized quaternion lerp.
+		\param [in] Anim animation clip, it has to have a track for every bone
+		\param [in] fTime time in seconds, wrapped around or clamped to the clip
+		\param [out] pLocal array of GetNumBones() matrices receiving the transformations relative to the parents
+	*/
+	void	Sample(const KPANIMATION &Anim, float fTime, KPMatrix *pLocal) const;
+
+	//! Computes the skinning matrix palette
+	/*!
+		palette[i] = inverse bind pose[i] * local[i] * local[parent] * ... * local[root] * world
+		\param [in] pLocal transformations relative to the parents, e.g. from Sample
+		\param [in] mWorld world matrix of the character, the skinned vertices are in world space
+		\param [out] pPalette array of GetNumBones() matrices, it can be pLocal
+	*/
+	void	CalcPalette(const KPMatrix *pLocal, const KPMatrix &mWorld, KPMatrix *pPalette) const;
+
+private:
+	KPBONE	*m_pBones;				// Bones, parents first
+	UINT	m_numBones;				// Number of bones
+
+	// Not copyable
+	KPSkeleton(const KPSkeleton &);
+	KPSkeleton &operator = (const KPSkeleton &);
+
+}; // ! KPSkeleton class
+
+
+//! Skinning of one character
+typedef struct KPSKINJOB
+{
+	// Animation, skipped if pSkeleton is NULL and the palette is already filled in
+	const KPSkeleton	*pSkeleton;		//!< Skeleton of the character
+	const KPANIMATION	*pAnimation;	//!< Animation clip to sample
+	float				fTime;			//!< Time in the clip
+	KPMatrix			mWorld;			//!< World matrix of the character
+
+	KPMatrix			*pPalette;		//!< Matrix palette, one matrix per bone
+
+	// Skinning
+	const KPSKINVERTEX	*pVertices;		//!< Bind pose vertices
+	UINT				numVertices;	//!< Number of vertices
+	void				*pOut;			//!< Output vertices, e.g. from KPVertexCacheManager::Reserve
+	UINT				nOutStride;		//!< Distance of two output vertices in bytes, at least 32
+
+} KPSKINJOB;
+
+
+//! Skins an array of vertices by a matrix palette
+/*!
+	Blends the palette matrices of the bones by the weights of the vertex and
+	transforms the position and the normal by it, the normal is renormalized.
+	Writes 8 floats per vertex: position, normal and the copied texture coordinates,
+	the layout of VERTEX.
+	\param [in] pVertices bind pose vertices
+	\param [in] pPalette matrix palette, e.g. from KPSkeleton::CalcPalette
+	\param [out] pOut output vertices
+	\param [in] nOutStride distance of two output vertices in bytes
+	\param [in] nCount number of vertices
+*/
+void KPSkinVertices(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, void *pOut, UINT nOutStride, UINT nCount);
+
+//! Animates and skins a list of characters on the worker threads
+/*!
+	Every job is one chunk of work: sampling the animation, computing the
+	palette and skinning the vertices. The output pointers may point into
+	locked vertex buffers, the function returns when every job is done.
+	\param [in,out] pJobs array of jobs
+	\param [in] nJobs number of jobs
+*/
+void KPSkinCharacters(KPSKINJOB *pJobs, UINT nJobs);
+
+#endif // ! KPANIMATION_H
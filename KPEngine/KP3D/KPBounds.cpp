@@ -0,0 +1,529 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPBounds.cpp
+ *  Description: KPEngine bounding volumes
+ *				 - Bounding box kernels of strided positions
+ *				 - Ritter bounding spheres
+ *				 - Transformation and merging of the volumes
+ *
+ *				 The small operations are inline, see KPInline.h.
+ *
+ *****************************************************************
+*/
+
+#include <float.h>
+#include "KP3D.h"
+#include "KPKernels.h"
+#include "KPPacket.h"
+#include "KPJobs.h"
+
+// Largest number of partial boxes of a parallel KPAabb::Compute, they are merged by the calling thread
+#define KPBOUNDS_MAX_CHUNKS		64
+
+// Relative slack of the computed sphere radii, the squared distances are rounded
+#define KPSPHERE_SLACK			( 4.0f * FLT_EPSILON )
+
+
+// Bounding Box Kernels ////
+////////////////////////////
+//
+// Every kernel grows the box it gets by the positions nBegin..nEnd. The
+// SIMD kernels transpose 4 (8) strided positions into x, y, z registers like
+// the array normalization, and keep a minimum and a maximum per lane.
+// MINPS and MAXPS return their second operand if the first one is NaN, so
+// the position is the first operand: the NaN coordinates are skipped like
+// by the comparisons of the scalar kernel. The minimum and the maximum are
+// exact, every kernel gives the same box.
+
+// Parameters of a KPAabb::Compute call, passed to the worker threads
+typedef struct KPBOUNDSJOB
+{
+	const float		*pPositions;
+	UINT			nStride;
+	UINT			nCount;
+
+	// Parallel call, one box per chunk of nChunk positions
+	UINT			nChunk;
+	KPAABB			*pBoxes;
+
+} KPBOUNDSJOB;
+
+
+// Scalar Kernel ////
+static void KPBoundsStridedScalar(const KPBOUNDSJOB *pJob, UINT nBegin, UINT nEnd, KPAABB *pBox)
+{
+	const char *p = (const char*)pJob->pPositions + (size_t)nBegin * pJob->nStride;
+
+	for ( UINT i = nBegin; i < nEnd; ++i, p += pJob->nStride )
+	{
+		const float *f = (const float*)p;
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			if ( f[k] < pBox->vcMin[k] ) pBox->vcMin[k] = f[k];
+			if ( f[k] > pBox->vcMax[k] ) pBox->vcMax[k] = f[k];
+		}
+	}
+}
+
+
+#ifdef KP_SSE
+
+// SSE Kernel ////
+//////////////////
+
+// Grows the box by the lanes of the minimum and maximum registers of an axis
+static inline void KPBoundsReduceSSE(__m128 mn, __m128 mx, int nAxis, KPAABB *pBox)
+{
+	mn = _mm_min_ps( mn, _mm_movehl_ps(mn, mn) );
+	mn = _mm_min_ss( mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(1, 1, 1, 1)) );
+	mx = _mm_max_ps( mx, _mm_movehl_ps(mx, mx) );
+	mx = _mm_max_ss( mx, _mm_shuffle_ps(mx, mx, _MM_SHUFFLE(1, 1, 1, 1)) );
+
+	pBox->vcMin[nAxis] = _mm_cvtss_f32(mn);
+	pBox->vcMax[nAxis] = _mm_cvtss_f32(mx);
+}
+
+static void KPBoundsStridedSSE(const KPBOUNDSJOB *pJob, UINT nBegin, UINT nEnd, KPAABB *pBox)
+{
+	const char	*p		 = (const char*)pJob->pPositions + (size_t)nBegin * pJob->nStride;
+	UINT		nStride	 = pJob->nStride;
+	UINT		i		 = nBegin;
+
+	if ( i + 4 <= nEnd )
+	{
+		__m128 mnX = _mm_set1_ps(pBox->vcMin[0]), mxX = _mm_set1_ps(pBox->vcMax[0]);
+		__m128 mnY = _mm_set1_ps(pBox->vcMin[1]), mxY = _mm_set1_ps(pBox->vcMax[1]);
+		__m128 mnZ = _mm_set1_ps(pBox->vcMin[2]), mxZ = _mm_set1_ps(pBox->vcMax[2]);
+		__m128 x, y, z;
+
+		for ( ; i + 4 <= nEnd; i += 4 )
+		{
+			KPSSEGather(p, nStride, x, y, z);
+
+			mnX = _mm_min_ps(x, mnX);	mxX = _mm_max_ps(x, mxX);
+			mnY = _mm_min_ps(y, mnY);	mxY = _mm_max_ps(y, mxY);
+			mnZ = _mm_min_ps(z, mnZ);	mxZ = _mm_max_ps(z, mxZ);
+
+			p += nStride * 4;
+		}
+
+		KPBoundsReduceSSE(mnX, mxX, 0, pBox);
+		KPBoundsReduceSSE(mnY, mxY, 1, pBox);
+		KPBoundsReduceSSE(mnZ, mxZ, 2, pBox);
+	}
+
+	// The last 0-3 positions
+	KPBoundsStridedScalar(pJob, i, nEnd, pBox);
+}
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernel ////
+//////////////////
+
+static void KPBoundsStridedAVX(const KPBOUNDSJOB *pJob, UINT nBegin, UINT nEnd, KPAABB *pBox)
+{
+	const char	*p		 = (const char*)pJob->pPositions + (size_t)nBegin * pJob->nStride;
+	UINT		nStride	 = pJob->nStride;
+	UINT		i		 = nBegin;
+
+	if ( i + 8 <= nEnd )
+	{
+		__m256 mnX = _mm256_set1_ps(pBox->vcMin[0]), mxX = _mm256_set1_ps(pBox->vcMax[0]);
+		__m256 mnY = _mm256_set1_ps(pBox->vcMin[1]), mxY = _mm256_set1_ps(pBox->vcMax[1]);
+		__m256 mnZ = _mm256_set1_ps(pBox->vcMin[2]), mxZ = _mm256_set1_ps(pBox->vcMax[2]);
+
+		for ( ; i + 8 <= nEnd; i += 8 )
+		{
+			__m128 x, y, z, x1, y1, z1;
+
+			KPSSEGather(p,				 nStride, x,  y,  z);
+			KPSSEGather(p + nStride * 4, nStride, x1, y1, z1);
+
+			__m256 X = KPAVX_JOIN(x, x1);
+			__m256 Y = KPAVX_JOIN(y, y1);
+			__m256 Z = KPAVX_JOIN(z, z1);
+
+			mnX = _mm256_min_ps(X, mnX);	mxX = _mm256_max_ps(X, mxX);
+			mnY = _mm256_min_ps(Y, mnY);	mxY = _mm256_max_ps(Y, mxY);
+			mnZ = _mm256_min_ps(Z, mnZ);	mxZ = _mm256_max_ps(Z, mxZ);
+
+			p += nStride * 8;
+		}
+
+		// The lanes hold no NaN, the order of the operands does not matter any more
+		KPBoundsReduceSSE( _mm_min_ps( _mm256_castps256_ps128(mnX), _mm256_extractf128_ps(mnX, 1) ),
+						   _mm_max_ps( _mm256_castps256_ps128(mxX), _mm256_extractf128_ps(mxX, 1) ), 0, pBox );
+		KPBoundsReduceSSE( _mm_min_ps( _mm256_castps256_ps128(mnY), _mm256_extractf128_ps(mnY, 1) ),
+						   _mm_max_ps( _mm256_castps256_ps128(mxY), _mm256_extractf128_ps(mxY, 1) ), 1, pBox );
+		KPBoundsReduceSSE( _mm_min_ps( _mm256_castps256_ps128(mnZ), _mm256_extractf128_ps(mnZ, 1) ),
+						   _mm_max_ps( _mm256_castps256_ps128(mxZ), _mm256_extractf128_ps(mxZ, 1) ), 2, pBox );
+	}
+
+	// The last 0-7 positions
+	KPBoundsStridedSSE(pJob, i, nEnd, pBox);
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#endif // ! KP_SSE
+
+
+typedef void (*KPBOUNDSKERNEL)(const KPBOUNDSJOB *pJob, UINT nBegin, UINT nEnd, KPAABB *pBox);
+
+static const KPBOUNDSKERNEL g_pfnBoundsStrided[KPISA_COUNT] = KPISA_TABLE(KPBoundsStrided);
+KPISA_REGISTER(g_pfnBoundsStrided, "bounds strided");
+
+// Computes the boxes of the chunks nBegin..nEnd
+static void KPBoundsJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	const KPBOUNDSJOB *pJob = (const KPBOUNDSJOB*)pParam;
+
+	for ( UINT c = nBegin; c < nEnd; ++c )
+	{
+		UINT	nFirst	= c * pJob->nChunk;
+		UINT	nLast	= KPMin( nFirst + pJob->nChunk, pJob->nCount );
+		KPAabb	box;
+
+		g_pfnBoundsStrided[g_ISA](pJob, nFirst, nLast, &box);
+
+		pJob->pBoxes[c] = box;
+	}
+}
+
+
+// KPAabb ////
+//////////////
+
+// KPAabb::Compute ////
+void KPAabb::Compute(const float *pPositions, UINT nStride, UINT nCount)
+{
+	KPBOUNDSJOB job = { pPositions, nStride, nCount, 0, NULL };
+
+	Reset();
+
+	if ( nCount < KPGetParallelThreshold(KPJOB_VECTOR) )
+	{
+		g_pfnBoundsStrided[g_ISA](&job, 0, nCount, this);
+		return;
+	}
+
+	// A reduction: every chunk gets its own box, at most KPBOUNDS_MAX_CHUNKS of them
+	KPAABB	Boxes[KPBOUNDS_MAX_CHUNKS];
+	UINT	nChunk		= KPMax( KPGetParallelGrain(KPJOB_VECTOR), ( nCount + KPBOUNDS_MAX_CHUNKS - 1 ) / KPBOUNDS_MAX_CHUNKS );
+	UINT	numChunks	= ( nCount + nChunk - 1 ) / nChunk;
+
+	job.nChunk	= nChunk;
+	job.pBoxes	= Boxes;
+
+	KPParallelFor(numChunks, 1, KPBoundsJob, &job);
+
+	for ( UINT c = 0; c < numChunks; ++c )
+		Merge(Boxes[c]);
+} // ! KPAabb::Compute
+
+
+// KPAabb::Transform ////
+/////////////////////////
+//
+// Every element of the matrix scales one axis of the box into one of the
+// result, the smaller of the two products goes to the minimum:
+//
+//	min[j] = m._4j + sum_i min( m._ij * min[i], m._ij * max[i] )
+void KPAabb::Transform(const KPAABB &b, const KPMatrix &m)
+{
+	if ( b.vcMin[0] > b.vcMax[0] || b.vcMin[1] > b.vcMax[1] || b.vcMin[2] > b.vcMax[2] )
+	{
+		Reset();
+		return;
+	}
+
+	const float *f = &m._11;
+	float		fMin[3], fMax[3];
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		fMin[j] = fMax[j] = f[12 + j];
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			float e0 = f[i*4 + j] * b.vcMin[i];
+			float e1 = f[i*4 + j] * b.vcMax[i];
+
+			fMin[j] += KPMin(e0, e1);
+			fMax[j] += KPMax(e0, e1);
+		}
+	}
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		vcMin[j] = fMin[j];
+		vcMax[j] = fMax[j];
+	}
+} // ! KPAabb::Transform
+
+
+// KPAabb::IntersectRay ////
+////////////////////////////
+//
+// The ray enters the slab of an axis at ( min - o ) / d and leaves it at
+// ( max - o ) / d, or the other way around for a negative direction. It hits
+// the box if the last entry is before the first exit, and the exit is not
+// behind the origin. A ray parallel to a slab hits it only from inside.
+bool KPAabb::IntersectRay(const KPVector &vcOrigin, const KPVector &vcDirection, float *pfDistance) const
+{
+	if ( IsEmpty() )
+		return false;
+
+	const float o[3] = { vcOrigin.x, vcOrigin.y, vcOrigin.z };
+	const float d[3] = { vcDirection.x, vcDirection.y, vcDirection.z };
+	float		fNear = -FLT_MAX, fFar = FLT_MAX;
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( d[i] == 0.0f )
+		{
+			if ( o[i] < vcMin[i] || o[i] > vcMax[i] )
+				return false;
+
+			continue;
+		}
+
+		float t0 = ( vcMin[i] - o[i] ) / d[i];
+		float t1 = ( vcMax[i] - o[i] ) / d[i];
+
+		if ( t0 > t1 )
+		{
+			float t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+
+		if ( t0 > fNear ) fNear = t0;
+		if ( t1 < fFar ) fFar = t1;
+
+		if ( fNear > fFar )
+			return false;
+	}
+
+	if ( fFar < 0.0f )
+		return false;
+
+	if ( pfDistance )
+		*pfDistance = ( fNear > 0.0f ) ? fNear : 0.0f;
+
+	return true;
+} // ! KPAabb::IntersectRay
+
+
+// KPSphere ////
+////////////////
+
+// KPMaxDistanceSq ////
+// Largest squared distance of the positions from two points, 4 positions at a time
+static void KPMaxDistanceSq(const float *pPositions, UINT nStride, UINT nCount,
+							const KPVector &vc0, const KPVector &vc1, float *pfMax0, float *pfMax1)
+{
+	const char			*p	= (const char*)pPositions;
+	KPVector4x			c0(vc0), c1(vc1);
+	KPVector4x::FLOATS	m0	= KPLanes4::Set1(0.0f);
+	KPVector4x::FLOATS	m1	= KPLanes4::Set1(0.0f);
+	UINT				i	= 0;
+
+	// The distances first, a NaN distance keeps the maximum
+	for ( ; i + 4 <= nCount; i += 4, p += nStride * 4 )
+	{
+		KPVector4x v;
+
+		v.Gather( (const float*)p, nStride );
+
+		KPVector4x d0 = v - c0;
+		KPVector4x d1 = v - c1;
+
+		m0 = KPLanes4::Max(d0 * d0, m0);
+		m1 = KPLanes4::Max(d1 * d1, m1);
+	}
+
+	float f0[4], f1[4];
+
+	KPLanes4::Store(f0, m0);
+	KPLanes4::Store(f1, m1);
+
+	*pfMax0 = KPMax( KPMax(f0[0], f0[1]), KPMax(f0[2], f0[3]) );
+	*pfMax1 = KPMax( KPMax(f1[0], f1[1]), KPMax(f1[2], f1[3]) );
+
+	for ( ; i < nCount; ++i, p += nStride )
+	{
+		const float *f = (const float*)p;
+		KPVector	v(f[0], f[1], f[2]);
+		KPVector	d0 = v - vc0;
+		KPVector	d1 = v - vc1;
+		float		fD0 = d0 * d0, fD1 = d1 * d1;
+
+		if ( fD0 > *pfMax0 ) *pfMax0 = fD0;
+		if ( fD1 > *pfMax1 ) *pfMax1 = fD1;
+	}
+} // ! KPMaxDistanceSq
+
+
+// KPSphere::Compute ////
+/////////////////////////
+//
+// Ritter's pass grows the sphere whenever a position is outside: the new
+// sphere touches the far side of the old one and the position,
+//
+//	r' = ( r + d ) / 2,  c' = c + ( p - c ) * ( r' - r ) / d
+//
+// The radius of the result is the distance of the farthest position from
+// the center, so the rounding of the growing steps can not leave a position
+// outside.
+void KPSphere::Compute(const float *pPositions, UINT nStride, UINT nCount)
+{
+	KPAabb box;
+
+	box.Compute(pPositions, nStride, nCount);
+
+	if ( box.IsEmpty() )
+	{
+		Reset();
+		return;
+	}
+
+	// The longest axis of the box, and a position on each of its faces
+	KPVector vcExtents	= box.GetExtents();
+	int		 nAxis		= ( vcExtents.y > vcExtents.x ) ? 1 : 0;
+
+	if ( vcExtents.z > ( nAxis ? vcExtents.y : vcExtents.x ) )
+		nAxis = 2;
+
+	const char	*p	  = (const char*)pPositions;
+	const float *pLo  = NULL;
+	const float *pHi  = NULL;
+
+	for ( UINT i = 0; i < nCount && !( pLo && pHi ); ++i, p += nStride )
+	{
+		const float *f = (const float*)p;
+
+		if ( !pLo && f[nAxis] == box.vcMin[nAxis] ) pLo = f;
+		if ( !pHi && f[nAxis] == box.vcMax[nAxis] ) pHi = f;
+	}
+
+	KPVector vcCenter	= box.GetCenter();
+	float	 fRadius	= 0.0f;
+
+	if ( pLo && pHi )
+	{
+		KPVector vcLo(pLo[0], pLo[1], pLo[2]);
+		KPVector vcHi(pHi[0], pHi[1], pHi[2]);
+		KPVector vcSpan = vcHi - vcLo;
+
+		vcCenter = ( vcLo + vcHi ) * 0.5f;
+		fRadius	 = vcSpan.GetLength() * 0.5f;
+	}
+
+	// Ritter's pass
+	float fRadiusSq = fRadius * fRadius;
+
+	p = (const char*)pPositions;
+
+	for ( UINT i = 0; i < nCount; ++i, p += nStride )
+	{
+		const float *f	= (const float*)p;
+		KPVector	d	= KPVector(f[0], f[1], f[2]) - vcCenter;
+		float		fSq	= d * d;
+
+		if ( fSq > fRadiusSq )
+		{
+			float fDistance	= sqrtf(fSq);
+			float fNew		= ( fRadius + fDistance ) * 0.5f;
+
+			vcCenter += d * ( ( fNew - fRadius ) / fDistance );
+			fRadius	  = fNew;
+			fRadiusSq = fRadius * fRadius;
+		}
+	}
+
+	// The exact radius around Ritter's center and around the center of the box
+	float	 fMaxRitter, fMaxBox;
+	KPVector vcBox = box.GetCenter();
+
+	KPMaxDistanceSq(pPositions, nStride, nCount, vcCenter, vcBox, &fMaxRitter, &fMaxBox);
+
+	if ( fMaxBox < fMaxRitter )
+	{
+		vcCenter   = vcBox;
+		fMaxRitter = fMaxBox;
+	}
+
+	Set( vcCenter, sqrtf(fMaxRitter) * ( 1.0f + KPSPHERE_SLACK ) );
+} // ! KPSphere::Compute
+
+
+// KPSphere::Merge ////
+///////////////////////
+//
+// If neither sphere contains the other one, the result touches both on the
+// line of their centers:
+//
+//	r = ( d + r0 + r1 ) / 2,  c = c0 + ( c1 - c0 ) * ( r - r0 ) / d
+void KPSphere::Merge(const KPSPHERE &s)
+{
+	if ( s.fRadius < 0.0f )
+		return;
+
+	if ( IsEmpty() )
+	{
+		Set( KPVector(s.x, s.y, s.z), s.fRadius );
+		return;
+	}
+
+	KPVector d		  = KPVector(s.x, s.y, s.z) - GetCenter();
+	float	 fDistance = d.GetLength();
+
+	// One contains the other
+	if ( fDistance + s.fRadius <= fRadius )
+		return;
+
+	if ( fDistance + fRadius <= s.fRadius )
+	{
+		Set( KPVector(s.x, s.y, s.z), s.fRadius );
+		return;
+	}
+
+	float fNew = ( fDistance + fRadius + s.fRadius ) * 0.5f;
+
+	Set( GetCenter() + d * ( ( fNew - fRadius ) / fDistance ), fNew );
+} // ! KPSphere::Merge
+
+
+// KPSphere::Transform ////
+///////////////////////////
+//
+// The rows of the matrix are the images of the axes, the longest one
+// scales the radius.
+void KPSphere::Transform(const KPSPHERE &s, const KPMatrix &m)
+{
+	if ( s.fRadius < 0.0f )
+	{
+		Reset();
+		return;
+	}
+
+	float fScaleSq = KPMax( m._11*m._11 + m._12*m._12 + m._13*m._13,
+							m._21*m._21 + m._22*m._22 + m._23*m._23,
+							m._31*m._31 + m._32*m._32 + m._33*m._33 );
+
+	float fX = s.x*m._11 + s.y*m._21 + s.z*m._31 + m._41;
+	float fY = s.x*m._12 + s.y*m._22 + s.z*m._32 + m._42;
+	float fZ = s.x*m._13 + s.y*m._23 + s.z*m._33 + m._43;
+
+	Set( KPVector(fX, fY, fZ), s.fRadius * sqrtf(fScaleSq) * ( 1.0f + KPSPHERE_SLACK ) );
+} // ! KPSphere::Transform
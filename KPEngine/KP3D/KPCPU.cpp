@@ -4,20 +4,135 @@
  *	KPEngine Source code 
  *	Kovacs Peter - July 2009
  *
- *  File: KP.h
+ *  File: KPCPU.cpp
  *  Description: KPEngine Cpu reckognition implementation
  *				 - CPU vendor mapping
  *				 - SIMD support check
+ *				 - Cache and core topology
  *
  *****************************************************************
 */
 
-#include <windows.h>	// for memset()
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "KPCPU.h"
 
+#ifdef _MSC_VER
+	#include <windows.h>
+	#include <intrin.h>		// __cpuid(), __cpuidex(), _xgetbv()
+#else
+	#include <cpuid.h>		// __cpuid(), __cpuid_count()
+	#include <unistd.h>		// sysconf()
+
+	// The secure CRT string functions are Microsoft only
+	#define strcpy_s(dst, size, src) strcpy((dst), (src))
+#endif
+
+// The 32-bit MSVC build can probe the instructions with inline assembly,
+// the x64 compiler and GCC/Clang do not support it.
+#if defined(_MSC_VER) && defined(_M_IX86)
+	#define KP_CPU_ASM
+#endif
+
+
+// KPCpuid Function
+///////////////////
+//
+// Executes the CPUID instruction with the given function number,
+// and stores the EAX, EBX, ECX, EDX registers in pRegs.
+static void KPCpuid(DWORD dwFunction, DWORD *pRegs)
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, (int)dwFunction);
+#else
+	unsigned int regs[4];
+	__cpuid(dwFunction, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+	for ( int i = 0; i < 4; ++i )
+		pRegs[i] = (DWORD)regs[i];
+}
+
+// KPCpuidEx Function
+/////////////////////
+//
+// CPUID with a sub-function number in ECX, needed by function 7.
+// The x64 compiler of VS2008 has no way to set ECX, the registers
+// are 0 there, so the features of function 7 are not detected.
+static void KPCpuidEx(DWORD dwFunction, DWORD dwSubFunction, DWORD *pRegs)
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1600
+	int regs[4];
+	__cpuidex(regs, (int)dwFunction, (int)dwSubFunction);
+
+	for ( int i = 0; i < 4; ++i )
+		pRegs[i] = (DWORD)regs[i];
+#elif defined(KP_CPU_ASM)
+	__asm {
+		mov esi, pRegs
+		mov eax, dwFunction
+		mov ecx, dwSubFunction
+		cpuid
+		mov [esi],	  eax
+		mov [esi+4],  ebx
+		mov [esi+8],  ecx
+		mov [esi+12], edx
+	}
+#elif defined(_MSC_VER)
+	(void)dwFunction;
+	(void)dwSubFunction;
+	memset(pRegs, 0, 4 * sizeof(DWORD));
+#else
+	unsigned int regs[4];
+	__cpuid_count(dwFunction, dwSubFunction, regs[0], regs[1], regs[2], regs[3]);
+
+	for ( int i = 0; i < 4; ++i )
+		pRegs[i] = (DWORD)regs[i];
+#endif
+}
+
+// KPGetXCR0 Function
+/////////////////////
+//
+// Reads the register states enabled by the OS with XGETBV, only valid
+// if CPUID reports OSXSAVE. The instruction is emitted as bytes for the
+// assemblers that do not know it.
+static DWORD KPGetXCR0(void)
+{
+#if defined(_MSC_VER) && _MSC_FULL_VER >= 160040219	// VS2010 SP1
+	return (DWORD)_xgetbv(0);
+#elif defined(KP_CPU_ASM)
+	DWORD dwXCR0;
+
+	__asm {
+		xor ecx, ecx
+		_emit 0x0f		// xgetbv
+		_emit 0x01
+		_emit 0xd0
+		mov dwXCR0, eax
+	}
+
+	return dwXCR0;
+#elif defined(_MSC_VER)
+	return 0;
+#else
+	unsigned int nLow, nHigh;
+
+	__asm__ __volatile__ ( ".byte 0x0f, 0x01, 0xd0" : "=a" (nLow), "=d" (nHigh) : "c" (0) );	// xgetbv
+
+	return (DWORD)nLow;
+#endif
+}
+
 // Check whether the CPU supports the CPUID instruction
 bool CPUID_Chk(void)
 {
+#ifndef KP_CPU_ASM
+	// Every x86-64 CPU has the CPUID instruction
+	return true;
+#else
 	__try {
 		_asm {
 			xor eax,	eax		// Set EAX to 0
@@ -32,6 +147,7 @@ bool CPUID_Chk(void)
 		return false;
 	}
 	return true;
+#endif
 } // ! CPUID_Chk()
 
 // SIMD_OS_Support_Chk Function
@@ -39,8 +155,18 @@ bool CPUID_Chk(void)
 //
 // Checks whether the OS Supports the SIMD instruction
 // Returns true if the OS supports it, false if doesn't.
+// dwFeature is one of the MMX, 3DNow! and SSE CPU_FEATURE flags,
+// the AVX families are checked with XGETBV by GetCPUInfo.
 bool SIMD_OS_Support_Chk(DWORD dwFeature)
 {
+	if ( dwFeature & ( CPU_FEATURES_AVX | CPU_FEATURES_AVX512 | CPU_FEATURE_XSAVE ) )
+		return false;
+
+#ifndef KP_CPU_ASM
+	// x86-64 operating systems always save the MMX and SSE register states,
+	// there is no way to execute a test instruction without inline assembly.
+	return true;
+#else
 	__try
 	{
 
@@ -81,6 +207,7 @@ bool SIMD_OS_Support_Chk(DWORD dwFeature)
 			__asm {
 				pcmpgtq xmm1, xmm2	// Try to execute SSE4.2 instruction
 			}
+			break;
 
 		case CPU_FEATURE_3DNOW:
 			__asm {
@@ -128,6 +255,7 @@ bool SIMD_OS_Support_Chk(DWORD dwFeature)
 	} // ! except
 
 	return true;
+#endif
 
 }	// ! SIMD_OS_Support_Chk
 
@@ -333,11 +461,228 @@ void MapCpuName( int family, int model, const char* vendorName, char* modelName
 		strcpy_s(modelName, sizeof(CPU_UNKNOWN), CPU_UNKNOWN);
 }
 
+// Topology ////
+////////////////
+
+#if defined(__linux__)
+
+// Maximum number of logical processors looked at
+#define KPMAX_CPUS	1024
+
+// KPReadSysfs Function
+//
+// Reads the number at the beginning of a sysfs file, sizes with
+// a K or M suffix are returned in KB. Returns false if the file
+// does not exist.
+static bool KPReadSysfs(const char *chPath, int *pValue)
+{
+	FILE *pFile = fopen(chPath, "r");
+	char  chSuffix = 0;
+
+	if ( !pFile )
+		return false;
+
+	int n = fscanf(pFile, "%d%c", pValue, &chSuffix);
+	fclose(pFile);
+
+	if ( n < 1 )
+		return false;
+
+	if ( chSuffix == 'M' )
+		*pValue *= 1024;
+
+	return true;
+}
+
+// KPGetTopology Function
+/////////////////////////
+//
+// The caches of the first processor and the distinct package and
+// core ids of the online ones, offline processors have no topology.
+static void KPGetTopology(CPUINFO *info)
+{
+	char chPath[128];
+	char chType[32];
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		int nLevel, nSize, nLine;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+		if ( !KPReadSysfs(chPath, &nLevel) )
+			break;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		if ( !KPReadSysfs(chPath, &nSize) )
+			continue;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", i);
+		if ( KPReadSysfs(chPath, &nLine) )
+			info->CacheLineSize = nLine;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+		FILE *pFile = fopen(chPath, "r");
+		chType[0] = '\0';
+		if ( pFile )
+		{
+			if ( fscanf(pFile, "%31s", chType) != 1 )
+				chType[0] = '\0';
+			fclose(pFile);
+		}
+
+		if ( nLevel == 1 && strcmp(chType, "Instruction") == 0 )
+			info->L1CodeSize = nSize;
+		else if ( nLevel == 1 )
+			info->L1DataSize = nSize;
+		else if ( nLevel == 2 )
+			info->L2Size = nSize;
+		else if ( nLevel == 3 )
+			info->L3Size = nSize;
+	}
+
+	// Distinct cores found so far, on the stack: GetCPUInfo may run on several threads at once
+	int nPackages[KPMAX_CPUS], nCores[KPMAX_CPUS];
+	long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+
+	if ( numCpus > KPMAX_CPUS )
+		numCpus = KPMAX_CPUS;
+
+	for ( long c = 0; c < numCpus; ++c )
+	{
+		int nPackage, nCore, i;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu%ld/topology/physical_package_id", c);
+		if ( !KPReadSysfs(chPath, &nPackage) )
+			continue;
+
+		sprintf(chPath, "/sys/devices/system/cpu/cpu%ld/topology/core_id", c);
+		if ( !KPReadSysfs(chPath, &nCore) )
+			continue;
+
+		++info->numLogicalCores;
+
+		for ( i = 0; i < info->numPhysicalCores; ++i )
+			if ( nPackages[i] == nPackage && nCores[i] == nCore )
+				break;
+
+		if ( i < info->numPhysicalCores )
+			continue;
+
+		for ( i = 0; i < info->numPhysicalCores; ++i )
+			if ( nPackages[i] == nPackage )
+				break;
+
+		if ( i == info->numPhysicalCores )
+			++info->numPackages;
+
+		nPackages[info->numPhysicalCores] = nPackage;
+		nCores[info->numPhysicalCores]	  = nCore;
+		++info->numPhysicalCores;
+	}
+
+	if ( info->numLogicalCores == 0 )
+	{
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		info->numLogicalCores = ( n > 0 ) ? (int)n : 0;
+	}
+}
+
+#elif defined(_WIN32)
+
+// KPGetTopology Function
+/////////////////////////
+//
+// Windows XP SP3 and later describe the cores and the caches with
+// GetLogicalProcessorInformation, the processors of one core are
+// the bits of its mask.
+static void KPGetTopology(CPUINFO *info)
+{
+	DWORD dwSize = 0;
+
+	GetLogicalProcessorInformation(NULL, &dwSize);
+	if ( GetLastError() != ERROR_INSUFFICIENT_BUFFER )
+		return;
+
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *pInfo = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(dwSize);
+	if ( !pInfo )
+		return;
+
+	if ( GetLogicalProcessorInformation(pInfo, &dwSize) )
+	{
+		DWORD numInfo = dwSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+
+		for ( DWORD i = 0; i < numInfo; ++i )
+		{
+			switch ( pInfo[i].Relationship )
+			{
+			case RelationProcessorCore:
+				++info->numPhysicalCores;
+				for ( ULONG_PTR mask = pInfo[i].ProcessorMask; mask; mask &= mask - 1 )
+					++info->numLogicalCores;
+				break;
+
+			case RelationProcessorPackage:
+				++info->numPackages;
+				break;
+
+			case RelationCache:
+				{
+					const CACHE_DESCRIPTOR &Cache = pInfo[i].Cache;
+					int nSize = (int)( Cache.Size / 1024 );
+
+					info->CacheLineSize = Cache.LineSize;
+
+					if ( Cache.Level == 1 && Cache.Type == CacheInstruction )
+						info->L1CodeSize = nSize;
+					else if ( Cache.Level == 1 )
+						info->L1DataSize = nSize;
+					else if ( Cache.Level == 2 )
+						info->L2Size = nSize;
+					else if ( Cache.Level == 3 )
+						info->L3Size = nSize;
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	free(pInfo);
+}
+
+#else
+
+static void KPGetTopology(CPUINFO *)
+{
+}
+
+#endif
+
+
+// KPSetFeature Function
+////////////////////////
+//
+// Sets a feature flag if the CPU has it, and its OS support flag if
+// the OS saves the registers of the feature
+static void KPSetFeature(CPUINFO *info, bool bCPU, DWORD dwFeature, bool bOS)
+{
+	if ( !bCPU )
+		return;
+
+	info->Feature |= dwFeature;
+
+	if ( bOS )
+		info->OS_Support |= dwFeature;
+}
+
+
 // GetCPUInfo Function
 //////////////////////
 //
-// This function uses inline assembly CPUID instructions
-// for processor recognition.
+// This function uses the CPUID instruction through the
+// compiler intrinsics for processor recognition.
 // Asks for a pointer to a CPUINFO structure
 // Returns 0 on error, 1 on success
 int GetCPUInfo(CPUINFO *info)
@@ -349,6 +694,8 @@ int GetCPUInfo(CPUINFO *info)
 	DWORD dwFeaturesEDX	= 0;
 	DWORD dwFeaturesECX	= 0;
 	DWORD dwExt			= 0;
+	DWORD dwMaxFunction	= 0;
+	DWORD dwFeatures7EBX = 0;
 
 	// Zero out info
 	memset(info, 0, sizeof(CPUINFO));
@@ -357,39 +704,38 @@ int GetCPUInfo(CPUINFO *info)
 	if ( !CPUID_Chk() )
 		return 0;
 
-	_asm {
-
-		// Get the CPU Vendor string
-		xor	eax, eax	// Same as mov eax, 0 just in 1 cycle
-		CPUID			// Calls Function(0), 00h
+	DWORD regs[4];		// EAX, EBX, ECX, EDX
 
-		// EBX,EDX,ECX contains the Vendor String in this order
-		// We copy the 4 bytes of each register into info->vendorName.
-		mov esi,	 pchVendor	// pointer to info->vendorName
-		mov [esi],	 ebx
-		mov [esi+4], edx
-		mov [esi+8], ecx
-
-		// Get the CPU Signature and Standart Features flags
-		mov eax, 1
-		CPUID
-		mov dwSignature,	eax
-		mov dwFeaturesEDX,	edx
-		mov dwFeaturesECX,	ecx
-	} // ! asm
+	// Get the CPU Vendor string
+	// EBX,EDX,ECX contains the Vendor String in this order
+	// We copy the 4 bytes of each register into info->vendorName.
+	KPCpuid(0, regs);
+	dwMaxFunction = regs[0];
+	memcpy(pchVendor,	  &regs[1], 4);
+	memcpy(pchVendor + 4, &regs[3], 4);
+	memcpy(pchVendor + 8, &regs[2], 4);
 
+	// Get the CPU Signature and Standart Features flags
+	KPCpuid(1, regs);
+	dwSignature		= regs[0];
+	dwFeaturesEDX	= regs[3];
+	dwFeaturesECX	= regs[2];
 
 	pchVendor = NULL;
 
+	// Get the Structured Extended Feature Flags, AVX2 and AVX-512
+	if ( dwMaxFunction >= 7 )
+	{
+		KPCpuidEx(7, 0, regs);
+		dwFeatures7EBX = regs[1];
+	}
+
 	// Get AMD Specific Extended CPU Informations
 	if( strncmp(info->vendorName, "AuthenticAMD", 12) == 0 )
 	{
-		__asm {
-
-			mov eax,	80000001h			// Get the Extended Feature Flags from EDX
-			CPUID
-			mov dwExt,	edx
-		}
+		// Get the Extended Feature Flags from EDX
+		KPCpuid(0x80000001, regs);
+		dwExt = regs[3];
 	} // ! AuthenticAMD Section
 
 
@@ -401,7 +747,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_MMX;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_MMX) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_MMX) )
 			info->OS_Support |= CPU_FEATURE_MMX;
 	}
 
@@ -410,7 +756,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSE;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_SSE) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSE) )
 			info->OS_Support |= CPU_FEATURE_SSE;
 	}
 
@@ -419,7 +765,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSE2;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_SSE2) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSE2) )
 			info->OS_Support |= CPU_FEATURE_SSE2;
 	}
 
@@ -428,7 +774,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSE3;
 
-		if ( SIMD_OS_Support_Chk(ECX_FF_SSE3) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSE3) )
 			info->OS_Support |= CPU_FEATURE_SSE3;
 	}
 
@@ -437,7 +783,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSSE3;
 
-		if ( SIMD_OS_Support_Chk(ECX_FF_SSSE3) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSSE3) )
 			info->OS_Support |= CPU_FEATURE_SSSE3;
 	}
 
@@ -446,7 +792,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSE41;
 
-		if ( SIMD_OS_Support_Chk(ECX_FF_SSE41) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSE41) )
 			info->OS_Support |= CPU_FEATURE_SSE41;
 	}
 
@@ -455,7 +801,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_SSE42;
 
-		if ( SIMD_OS_Support_Chk(ECX_FF_SSE42) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_SSE42) )
 			info->OS_Support |= CPU_FEATURE_SSE42;
 	}
 
@@ -464,7 +810,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_3DNOW;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_3DNOW) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_3DNOW) )
 			info->OS_Support |= CPU_FEATURE_3DNOW;
 	}
 
@@ -473,7 +819,7 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_3DNOWEX;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_3DNOWEX) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_3DNOWEX) )
 			info->OS_Support |= CPU_FEATURE_3DNOWEX;
 	}
 
@@ -482,11 +828,48 @@ int GetCPUInfo(CPUINFO *info)
 	{
 		info->Feature |= CPU_FEATURE_MMXEX;
 
-		if ( SIMD_OS_Support_Chk(EDX_FF_MMXEX) )
+		if ( SIMD_OS_Support_Chk(CPU_FEATURE_MMXEX) )
 			info->OS_Support |= CPU_FEATURE_MMXEX;
 	}
 
 
+	// XSAVE and the register states the OS saves ////
+	// AVX code only runs if the OS saves the YMM registers, and
+	// AVX-512 code if it saves the opmask and the ZMM registers too
+	KPSetFeature(info, (dwFeaturesECX & ECX_FF_XSAVE) != 0, CPU_FEATURE_XSAVE, (dwFeaturesECX & ECX_FF_OSXSAVE) != 0);
+
+	if ( dwFeaturesECX & ECX_FF_OSXSAVE )
+		info->XCR0 = KPGetXCR0();
+
+	bool bAVXState		= ( info->XCR0 & (XCR0_SSE | XCR0_AVX) ) == (XCR0_SSE | XCR0_AVX);
+	bool bAVX512State	= bAVXState && ( info->XCR0 & XCR0_AVX512 ) == XCR0_AVX512;
+
+	// AVX, AVX2, FMA, F16C ////
+	KPSetFeature(info, (dwFeaturesECX & ECX_FF_AVX) != 0,		CPU_FEATURE_AVX,  bAVXState);
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX2) != 0,	CPU_FEATURE_AVX2, bAVXState);
+	KPSetFeature(info, (dwFeaturesECX & ECX_FF_FMA) != 0,		CPU_FEATURE_FMA,  bAVXState);
+	KPSetFeature(info, (dwFeaturesECX & ECX_FF_F16C) != 0,		CPU_FEATURE_F16C, bAVXState);
+
+	// AVX-512 ////
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX512F) != 0,  CPU_FEATURE_AVX512F,  bAVX512State);
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX512DQ) != 0, CPU_FEATURE_AVX512DQ, bAVX512State);
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX512CD) != 0, CPU_FEATURE_AVX512CD, bAVX512State);
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX512BW) != 0, CPU_FEATURE_AVX512BW, bAVX512State);
+	KPSetFeature(info, (dwFeatures7EBX & EBX_FF7_AVX512VL) != 0, CPU_FEATURE_AVX512VL, bAVX512State);
+
+	// Caches and cores ////
+	KPGetTopology(info);
+
+	if ( info->numLogicalCores < 1 )
+		info->numLogicalCores = 1;
+
+	if ( info->numPhysicalCores < 1 )
+		info->numPhysicalCores = info->numLogicalCores;
+
+	if ( info->numPackages < 1 )
+		info->numPackages = 1;
+
+
 	// Retrieve CPU Family, Model & Stepping
 	// Map them to CPU Model Names
 	if (info)
@@ -494,17 +877,45 @@ int GetCPUInfo(CPUINFO *info)
 	info->Stepping	= dwSignature & 0xF;			// Zero everything except the 4 Stepping bits
 
 	info->Model		= (dwSignature >> 4) & 0xF;		// Get rid of the stepping bits and zero everything but the model number
-	if (info->Model == 15)
-		info->Model |= (dwSignature >> 12) & 0xF;	// Extended Model ( >> by 12, this way we have 4 extra 0000 bits at the beginning)
+	info->Family	= (dwSignature >> 8) & 0xF;		// Get rid of stepping + model number and zero evrything except family code
 
-	info->Family		= (dwSignature >> 8) & 0xF; // Get rid of stepping + model number and zero evrything except family code
-	if (info->Family == 15)
-		info->Family |= (dwSignature >> 16) & 0xF;	// Extended Family ( >> by 16, to have 4 extra 0000 bits at the beginning )
+	// The Extended Model (bits 16-19) is the high nibble of the model of families 6 and 15,
+	// the Extended Family (bits 20-27) is added to family 15
+	if ( info->Family == 6 || info->Family == 15 )
+		info->Model += ( (dwSignature >> 16) & 0xF ) << 4;
+
+	if ( info->Family == 15 )
+		info->Family += (dwSignature >> 20) & 0xFF;
 
 	info->vendorName[MAX_VNAME_LEN-1] = '\0';		// Add the string ending '\0'
 
 	MapCpuName(info->Family, info->Model, info->vendorName, info->modelName);
 
+	// The table only knows the older CPUs, the newer ones tell their name
+	// through the Processor Brand String functions
+	KPCpuid(0x80000000, regs);
+	if ( strncmp(info->modelName, "Unknown", 7) == 0 && regs[0] >= 0x80000004 )
+	{
+		char chBrand[49];
+
+		for ( DWORD i = 0; i < 3; ++i )
+		{
+			KPCpuid(0x80000002 + i, regs);
+
+			// 4 bytes each, DWORD is 8 bytes long on 64-bit Linux
+			for ( int r = 0; r < 4; ++r )
+				memcpy(chBrand + 16 * i + 4 * r, &regs[r], 4);
+		}
+		chBrand[48] = '\0';
+
+		const char *pchBrand = chBrand;
+		while ( *pchBrand == ' ' )
+			++pchBrand;
+
+		if ( *pchBrand )
+			strcpy_s(info->modelName, MAX_MNAME_LEN, pchBrand);
+	}
+
 	info->Checks =	CPU_FEATURE_MMX		|
 					CPU_FEATURE_SSE		|
 					CPU_FEATURE_SSE2	|	
@@ -514,7 +925,10 @@ int GetCPUInfo(CPUINFO *info)
 					CPU_FEATURE_SSE42	|	
 					CPU_FEATURE_3DNOW	|	
 					CPU_FEATURE_3DNOWEX	|
-					CPU_FEATURE_MMXEX;	
+					CPU_FEATURE_MMXEX	|
+					CPU_FEATURE_XSAVE	|
+					CPU_FEATURES_AVX	|
+					CPU_FEATURES_AVX512;
 
 	} // ! if
 
@@ -6,6 +6,8 @@
  *
  *  File: KPCPU.h
  *  Description: KPEngine CPU reckognition and SIMD support
+ *				 - SIMD features of the CPU and the OS
+ *				 - Cache sizes and core counts
  *
  *****************************************************************
 */
@@ -24,6 +26,20 @@
 #define CPU_FEATURE_3DNOW	0x0080  //!< 3DNow! flag
 #define CPU_FEATURE_3DNOWEX 0x0100	//!< AMD extensions to 3DNow! flag
 #define CPU_FEATURE_MMXEX	0x0200  //!< AMD extensions to MMX flag
+#define CPU_FEATURE_AVX		0x0400	//!< Advanced Vector Extensions flag
+#define CPU_FEATURE_AVX2	0x0800	//!< Advanced Vector Extensions 2 flag
+#define CPU_FEATURE_FMA		0x1000	//!< Fused multiply-add (FMA3) flag
+#define CPU_FEATURE_F16C	0x2000	//!< Half precision conversion flag
+#define CPU_FEATURE_AVX512F	0x4000	//!< AVX-512 Foundation flag
+#define CPU_FEATURE_AVX512DQ 0x8000	//!< AVX-512 Doubleword and Quadword flag
+#define CPU_FEATURE_AVX512CD 0x10000 //!< AVX-512 Conflict Detection flag
+#define CPU_FEATURE_AVX512BW 0x20000 //!< AVX-512 Byte and Word flag
+#define CPU_FEATURE_AVX512VL 0x40000 //!< AVX-512 Vector Length extensions flag
+#define CPU_FEATURE_XSAVE	0x80000	//!< XSAVE flag, in OS_Support: the OS enabled it (OSXSAVE)
+
+//! The features of the AVX and the AVX-512 families
+#define CPU_FEATURES_AVX	( CPU_FEATURE_AVX | CPU_FEATURE_AVX2 | CPU_FEATURE_FMA | CPU_FEATURE_F16C )
+#define CPU_FEATURES_AVX512	( CPU_FEATURE_AVX512F | CPU_FEATURE_AVX512DQ | CPU_FEATURE_AVX512CD | CPU_FEATURE_AVX512BW | CPU_FEATURE_AVX512VL )
 
 // Length of the CPU vendor name
 #define MAX_VNAME_LEN		13
@@ -44,11 +60,26 @@ typedef struct PROCESSOR_INFORMATION
 	DWORD Feature;						//!< DWORD bitfield of the SIMD features supported by the CPU
 	DWORD OS_Support;					//!< DWORD bitfield of the SIMP features supported by the Operating System
 	DWORD Checks;						//!< DWORD bitfield mask of all the SIMD features that were tested.
+	DWORD XCR0;							//!< Register states the OS saves on a context switch (XGETBV), 0 without OSXSAVE
+
+	// Topology, 0 where the OS does not tell
+	int numLogicalCores;				//!< Hardware threads online, at least 1
+	int numPhysicalCores;				//!< Cores, at least 1
+	int numPackages;					//!< Processor packages (sockets)
+	int L1DataSize;						//!< L1 data cache of a core in KB
+	int L1CodeSize;						//!< L1 instruction cache of a core in KB
+	int L2Size;							//!< L2 cache in KB
+	int L3Size;							//!< L3 cache in KB, one instance, shared by the cores of a package or a core complex
+	int CacheLineSize;					//!< Cache line size in bytes
 
 } CPUINFO;
 
 //! Retrieves the SIMD features supported by the CPU
 /*!
+	The features are read by CPUID. The AVX and AVX-512 features are only
+	set in OS_Support if the OS saves their registers, see XCR0. The cache
+	sizes and the core counts come from sysfs on Linux and from
+	GetLogicalProcessorInformation on Windows.
 	\param [out] info pointer to a CPUINFO structure the function can fill with the results
 	\return 1 if successful
 	\return 0 upon error
@@ -65,6 +96,25 @@ int  GetCPUInfo(CPUINFO *info);
 #define ECX_FF_SSSE3	0x00000200  // 9th bit
 #define ECX_FF_SSE41	0x00080000	// 19th bit
 #define ECX_FF_SSE42	0x00100000	// 20th bit - GenuineIntel Only!
+#define ECX_FF_FMA		0x00001000	// 12th bit
+#define ECX_FF_XSAVE	0x04000000	// 26th bit
+#define ECX_FF_OSXSAVE	0x08000000	// 27th bit - the OS enabled XSAVE and XGETBV
+#define ECX_FF_AVX		0x10000000	// 28th bit
+#define ECX_FF_F16C		0x20000000	// 29th bit
+
+// CPUID Structured Extended Feature Flags in the EBX Register ////
+// Have to call CPUID with EAX set to 7 and ECX set to 0
+#define EBX_FF7_AVX2		0x00000020	// 5th bit
+#define EBX_FF7_AVX512F		0x00010000	// 16th bit
+#define EBX_FF7_AVX512DQ	0x00020000	// 17th bit
+#define EBX_FF7_AVX512CD	0x10000000	// 28th bit
+#define EBX_FF7_AVX512BW	0x40000000	// 30th bit
+#define EBX_FF7_AVX512VL	0x80000000	// 31st bit
+
+// XCR0 Register State Bits ////
+#define XCR0_SSE		0x00000002	// XMM registers
+#define XCR0_AVX		0x00000004	// Upper halves of the YMM registers
+#define XCR0_AVX512		0x000000E0	// Opmask registers, upper halves of ZMM0-15, ZMM16-31
 
 // CPUID SIMD Feature Flags Values in the EDX Register on AMD ////
 // These are part of the Extended Feature Identifiers only on AMD
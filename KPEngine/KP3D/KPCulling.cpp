@@ -0,0 +1,444 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPCulling.cpp
+ *  Description: KPEngine frustum classification kernels
+ *				 - Bounding spheres
+ *				 - Axis aligned bounding boxes
+ *
+ *				 The planes are stored in SoA form, the normal
+ *				 x, y, z and the distances in 4 arrays. The SIMD
+ *				 kernels test 4 (SSE) or 8 (AVX) objects against
+ *				 one plane per instruction.
+ *
+ *				 Large arrays are split between the worker threads.
+ *
+ *****************************************************************
+*/
+
+#include "KP3D.h"
+#include "KPSIMD.h"
+#include "KPJobs.h"
+
+
+// Planes in SoA form
+typedef struct KPCULLPLANES
+{
+	float	nx[KPMAX_CULL_PLANES];
+	float	ny[KPMAX_CULL_PLANES];
+	float	nz[KPMAX_CULL_PLANES];
+	float	d[KPMAX_CULL_PLANES];
+	UINT	nPlanes;
+} KPCULLPLANES;
+
+// Parameters of a classification call, passed to the worker threads
+typedef struct KPCULLJOB
+{
+	const KPCULLPLANES	*pPlanes;
+	const KPSPHERE		*pSpheres;		// NULL for boxes
+	const KPAABB		*pBoxes;
+	unsigned char		*pStates;
+} KPCULLJOB;
+
+
+// Scalar Kernels ////
+//////////////////////
+//
+// Distances are evaluated as ((nx*x + ny*y) + nz*z) + d, like the SIMD
+// kernels, so the states are the same on every path.
+
+static void KPClassifySpheresScalar(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const KPSPHERE	&s		 = pJob->pSpheres[i];
+		unsigned char	nState	 = KPVISIBLE;
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			float fDist = P.nx[p]*s.x + P.ny[p]*s.y + P.nz[p]*s.z + P.d[p];
+
+			if ( fDist > s.fRadius )
+			{
+				nState = KPCULLED;
+				break;
+			}
+
+			if ( fDist > -s.fRadius )
+				nState = KPCLIPPED;
+		}
+
+		pJob->pStates[i] = nState;
+	}
+}
+
+static void KPClassifyBoxesScalar(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const KPAABB	&b		 = pJob->pBoxes[i];
+		unsigned char	nState	 = KPVISIBLE;
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			// The n-vertex is the corner farthest behind the plane, the p-vertex the one farthest in front
+			bool bX = ( P.nx[p] > 0.0f ), bY = ( P.ny[p] > 0.0f ), bZ = ( P.nz[p] > 0.0f );
+
+			float fNear = P.nx[p] * ( bX ? b.vcMin[0] : b.vcMax[0] )
+						+ P.ny[p] * ( bY ? b.vcMin[1] : b.vcMax[1] )
+						+ P.nz[p] * ( bZ ? b.vcMin[2] : b.vcMax[2] ) + P.d[p];
+
+			if ( fNear > 0.0f )
+			{
+				nState = KPCULLED;
+				break;
+			}
+
+			float fFar	= P.nx[p] * ( bX ? b.vcMax[0] : b.vcMin[0] )
+						+ P.ny[p] * ( bY ? b.vcMax[1] : b.vcMin[1] )
+						+ P.nz[p] * ( bZ ? b.vcMax[2] : b.vcMin[2] ) + P.d[p];
+
+			if ( fFar > 0.0f )
+				nState = KPCLIPPED;
+		}
+
+		pJob->pStates[i] = nState;
+	}
+}
+
+
+#ifdef KP_SSE
+
+// SSE Kernels ////
+///////////////////
+//
+// Four objects at once, transposed into x, y, z registers, against one plane
+// per step. Every object sees the same plane, so the choice between the
+// minimum and the maximum of the boxes is made once per plane, not per object.
+// The loop stops as soon as all four objects are outside. The objects after
+// the last group of four are left to the scalar kernel.
+
+// Writes the states of the objects from the masks of the planes they are in
+// front of / intersect, bit i for object i
+static inline void KPCullStates(unsigned char *pStates, int nObjects, int nOutside, int nIntersect)
+{
+	for ( int i = 0; i < nObjects; ++i )
+	{
+		if ( nOutside & (1 << i) )
+			pStates[i] = KPCULLED;
+		else
+			pStates[i] = ( nIntersect & (1 << i) ) ? KPCLIPPED : KPVISIBLE;
+	}
+}
+
+static void KPClassifySpheresSSE(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+	UINT i;
+
+	for ( i = nBegin; i + 4 <= nEnd; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps( &pJob->pSpheres[i].x );
+		__m128 y = _mm_loadu_ps( &pJob->pSpheres[i + 1].x );
+		__m128 z = _mm_loadu_ps( &pJob->pSpheres[i + 2].x );
+		__m128 r = _mm_loadu_ps( &pJob->pSpheres[i + 3].x );
+
+		_MM_TRANSPOSE4_PS(x, y, z, r);
+
+		__m128 nr		 = _mm_xor_ps( r, _mm_set1_ps(-0.0f) );
+		__m128 outside	 = _mm_setzero_ps();
+		__m128 intersect = _mm_setzero_ps();
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			__m128 fDist = _mm_add_ps( _mm_add_ps( _mm_add_ps(
+								_mm_mul_ps( _mm_set1_ps(P.nx[p]), x ),
+								_mm_mul_ps( _mm_set1_ps(P.ny[p]), y ) ),
+								_mm_mul_ps( _mm_set1_ps(P.nz[p]), z ) ), _mm_set1_ps(P.d[p]) );
+
+			outside	  = _mm_or_ps( outside,	  _mm_cmpgt_ps(fDist, r) );
+			intersect = _mm_or_ps( intersect, _mm_cmpgt_ps(fDist, nr) );
+
+			if ( _mm_movemask_ps(outside) == 0xF )
+				break;
+		}
+
+		KPCullStates( pJob->pStates + i, 4, _mm_movemask_ps(outside), _mm_movemask_ps(intersect) );
+	}
+
+	KPClassifySpheresScalar(pJob, i, nEnd);
+}
+
+static void KPClassifyBoxesSSE(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+	UINT i;
+
+	for ( i = nBegin; i + 4 <= nEnd; i += 4 )
+	{
+		// The first four and the last four floats of the boxes, both loads stay inside the box
+		__m128 minX = _mm_loadu_ps( &pJob->pBoxes[i].vcMin[0] );
+		__m128 minY = _mm_loadu_ps( &pJob->pBoxes[i + 1].vcMin[0] );
+		__m128 minZ = _mm_loadu_ps( &pJob->pBoxes[i + 2].vcMin[0] );
+		__m128 maxX = _mm_loadu_ps( &pJob->pBoxes[i + 3].vcMin[0] );
+		__m128 t	= _mm_loadu_ps( &pJob->pBoxes[i].vcMin[2] );
+		__m128 u	= _mm_loadu_ps( &pJob->pBoxes[i + 1].vcMin[2] );
+		__m128 maxY = _mm_loadu_ps( &pJob->pBoxes[i + 2].vcMin[2] );
+		__m128 maxZ = _mm_loadu_ps( &pJob->pBoxes[i + 3].vcMin[2] );
+
+		_MM_TRANSPOSE4_PS(minX, minY, minZ, maxX);
+		_MM_TRANSPOSE4_PS(t, u, maxY, maxZ);
+
+		__m128 vcMin[3]	 = { minX, minY, minZ };
+		__m128 vcMax[3]	 = { maxX, maxY, maxZ };
+		__m128 zero		 = _mm_setzero_ps();
+		__m128 outside	 = zero;
+		__m128 intersect = zero;
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			// See KPClassifyBoxesScalar
+			bool bX = ( P.nx[p] > 0.0f ), bY = ( P.ny[p] > 0.0f ), bZ = ( P.nz[p] > 0.0f );
+
+			__m128 nx = _mm_set1_ps(P.nx[p]);
+			__m128 ny = _mm_set1_ps(P.ny[p]);
+			__m128 nz = _mm_set1_ps(P.nz[p]);
+			__m128 d  = _mm_set1_ps(P.d[p]);
+
+			__m128 fNear = _mm_add_ps( _mm_add_ps( _mm_add_ps(
+								_mm_mul_ps( nx, bX ? vcMin[0] : vcMax[0] ),
+								_mm_mul_ps( ny, bY ? vcMin[1] : vcMax[1] ) ),
+								_mm_mul_ps( nz, bZ ? vcMin[2] : vcMax[2] ) ), d );
+
+			__m128 fFar	 = _mm_add_ps( _mm_add_ps( _mm_add_ps(
+								_mm_mul_ps( nx, bX ? vcMax[0] : vcMin[0] ),
+								_mm_mul_ps( ny, bY ? vcMax[1] : vcMin[1] ) ),
+								_mm_mul_ps( nz, bZ ? vcMax[2] : vcMin[2] ) ), d );
+
+			outside	  = _mm_or_ps( outside,	  _mm_cmpgt_ps(fNear, zero) );
+			intersect = _mm_or_ps( intersect, _mm_cmpgt_ps(fFar,  zero) );
+
+			if ( _mm_movemask_ps(outside) == 0xF )
+				break;
+		}
+
+		KPCullStates( pJob->pStates + i, 4, _mm_movemask_ps(outside), _mm_movemask_ps(intersect) );
+	}
+
+	KPClassifyBoxesScalar(pJob, i, nEnd);
+}
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernels ////
+///////////////////
+//
+// Eight objects at once, objects i..i+3 in the lower and i+4..i+7 in the
+// upper half of the registers. The shuffles of the transposition work on
+// the two halves separately, so it is two 4x4 transpositions side by side.
+
+static inline void KPAVXTranspose4(__m256 &a, __m256 &b, __m256 &c, __m256 &d)
+{
+	__m256 t0 = _mm256_unpacklo_ps(a, b);
+	__m256 t1 = _mm256_unpacklo_ps(c, d);
+	__m256 t2 = _mm256_unpackhi_ps(a, b);
+	__m256 t3 = _mm256_unpackhi_ps(c, d);
+
+	a = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	b = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	c = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	d = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Loads 4 floats of object i into the lower and of object i + 4 into the upper half
+static inline __m256 KPAVXLoadPair(const float *pLow, const float *pHigh)
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps(pLow) ), _mm_loadu_ps(pHigh), 1 );
+}
+
+static void KPClassifySpheresAVX(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+	const KPSPHERE	   *s = pJob->pSpheres;
+	UINT i;
+
+	for ( i = nBegin; i + 8 <= nEnd; i += 8 )
+	{
+		__m256 x = KPAVXLoadPair( &s[i].x,	   &s[i + 4].x );
+		__m256 y = KPAVXLoadPair( &s[i + 1].x, &s[i + 5].x );
+		__m256 z = KPAVXLoadPair( &s[i + 2].x, &s[i + 6].x );
+		__m256 r = KPAVXLoadPair( &s[i + 3].x, &s[i + 7].x );
+
+		KPAVXTranspose4(x, y, z, r);
+
+		__m256 nr		 = _mm256_xor_ps( r, _mm256_set1_ps(-0.0f) );
+		__m256 outside	 = _mm256_setzero_ps();
+		__m256 intersect = _mm256_setzero_ps();
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			__m256 fDist = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+								_mm256_mul_ps( _mm256_set1_ps(P.nx[p]), x ),
+								_mm256_mul_ps( _mm256_set1_ps(P.ny[p]), y ) ),
+								_mm256_mul_ps( _mm256_set1_ps(P.nz[p]), z ) ), _mm256_set1_ps(P.d[p]) );
+
+			outside	  = _mm256_or_ps( outside,	 _mm256_cmp_ps(fDist, r,  _CMP_GT_OQ) );
+			intersect = _mm256_or_ps( intersect, _mm256_cmp_ps(fDist, nr, _CMP_GT_OQ) );
+
+			if ( _mm256_movemask_ps(outside) == 0xFF )
+				break;
+		}
+
+		KPCullStates( pJob->pStates + i, 8, _mm256_movemask_ps(outside), _mm256_movemask_ps(intersect) );
+	}
+
+	KPClassifySpheresSSE(pJob, i, nEnd);
+}
+
+static void KPClassifyBoxesAVX(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPCULLPLANES &P = *pJob->pPlanes;
+	const KPAABB	   *b = pJob->pBoxes;
+	UINT i;
+
+	for ( i = nBegin; i + 8 <= nEnd; i += 8 )
+	{
+		// See KPClassifyBoxesSSE
+		__m256 minX = KPAVXLoadPair( &b[i].vcMin[0],	 &b[i + 4].vcMin[0] );
+		__m256 minY = KPAVXLoadPair( &b[i + 1].vcMin[0], &b[i + 5].vcMin[0] );
+		__m256 minZ = KPAVXLoadPair( &b[i + 2].vcMin[0], &b[i + 6].vcMin[0] );
+		__m256 maxX = KPAVXLoadPair( &b[i + 3].vcMin[0], &b[i + 7].vcMin[0] );
+		__m256 t	= KPAVXLoadPair( &b[i].vcMin[2],	 &b[i + 4].vcMin[2] );
+		__m256 u	= KPAVXLoadPair( &b[i + 1].vcMin[2], &b[i + 5].vcMin[2] );
+		__m256 maxY = KPAVXLoadPair( &b[i + 2].vcMin[2], &b[i + 6].vcMin[2] );
+		__m256 maxZ = KPAVXLoadPair( &b[i + 3].vcMin[2], &b[i + 7].vcMin[2] );
+
+		KPAVXTranspose4(minX, minY, minZ, maxX);
+		KPAVXTranspose4(t, u, maxY, maxZ);
+
+		__m256 vcMin[3]	 = { minX, minY, minZ };
+		__m256 vcMax[3]	 = { maxX, maxY, maxZ };
+		__m256 zero		 = _mm256_setzero_ps();
+		__m256 outside	 = zero;
+		__m256 intersect = zero;
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			bool bX = ( P.nx[p] > 0.0f ), bY = ( P.ny[p] > 0.0f ), bZ = ( P.nz[p] > 0.0f );
+
+			__m256 nx = _mm256_set1_ps(P.nx[p]);
+			__m256 ny = _mm256_set1_ps(P.ny[p]);
+			__m256 nz = _mm256_set1_ps(P.nz[p]);
+			__m256 d  = _mm256_set1_ps(P.d[p]);
+
+			__m256 fNear = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+								_mm256_mul_ps( nx, bX ? vcMin[0] : vcMax[0] ),
+								_mm256_mul_ps( ny, bY ? vcMin[1] : vcMax[1] ) ),
+								_mm256_mul_ps( nz, bZ ? vcMin[2] : vcMax[2] ) ), d );
+
+			__m256 fFar	 = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+								_mm256_mul_ps( nx, bX ? vcMax[0] : vcMin[0] ),
+								_mm256_mul_ps( ny, bY ? vcMax[1] : vcMin[1] ) ),
+								_mm256_mul_ps( nz, bZ ? vcMax[2] : vcMin[2] ) ), d );
+
+			outside	  = _mm256_or_ps( outside,	 _mm256_cmp_ps(fNear, zero, _CMP_GT_OQ) );
+			intersect = _mm256_or_ps( intersect, _mm256_cmp_ps(fFar,  zero, _CMP_GT_OQ) );
+
+			if ( _mm256_movemask_ps(outside) == 0xFF )
+				break;
+		}
+
+		KPCullStates( pJob->pStates + i, 8, _mm256_movemask_ps(outside), _mm256_movemask_ps(intersect) );
+	}
+
+	KPClassifyBoxesSSE(pJob, i, nEnd);
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#endif // ! KP_SSE
+
+
+// KPCullJob ////
+/////////////////
+//
+// Classifies the [nBegin, nEnd) range of a call by the kernel of the
+// selected instruction set, this is what the worker threads run
+typedef void (*KPCULLKERNEL)(const KPCULLJOB *pJob, UINT nBegin, UINT nEnd);
+
+static const KPCULLKERNEL g_pfnClassifySpheres[KPISA_COUNT]	= KPISA_TABLE(KPClassifySpheres);
+static const KPCULLKERNEL g_pfnClassifyBoxes[KPISA_COUNT]	= KPISA_TABLE(KPClassifyBoxes);
+KPISA_REGISTER(g_pfnClassifySpheres,	"cull spheres");
+KPISA_REGISTER(g_pfnClassifyBoxes,	"cull boxes");
+
+static void KPCullJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	const KPCULLJOB *pJob = (const KPCULLJOB*)pParam;
+
+	if ( pJob->pSpheres )
+		g_pfnClassifySpheres[g_ISA](pJob, nBegin, nEnd);
+	else
+		g_pfnClassifyBoxes[g_ISA](pJob, nBegin, nEnd);
+}
+
+
+// KPClassify ////
+//////////////////
+//
+// Converts the planes into SoA form and runs the call, on the worker threads
+// if the array is large enough
+static bool KPClassify(const KPPlane *pPlanes, UINT nPlanes, KPCULLJOB *pJob, UINT nCount)
+{
+	KPCULLPLANES planes;
+
+	if ( nPlanes == 0 || nPlanes > KPMAX_CULL_PLANES )
+		return false;
+
+	for ( UINT p = 0; p < nPlanes; ++p )
+	{
+		planes.nx[p] = pPlanes[p].m_vcNormal.x;
+		planes.ny[p] = pPlanes[p].m_vcNormal.y;
+		planes.nz[p] = pPlanes[p].m_vcNormal.z;
+		planes.d[p]	 = pPlanes[p].m_fDistance;
+	}
+
+	planes.nPlanes	= nPlanes;
+	pJob->pPlanes	= &planes;
+
+	if ( nCount >= KPGetParallelThreshold(KPJOB_VECTOR) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_VECTOR), KPCullJob, pJob);
+	else
+		KPCullJob(0, nCount, pJob);
+
+	return true;
+}
+
+bool KPClassifySpheres(const KPPlane *pPlanes, UINT nPlanes, const KPSPHERE *pSpheres, unsigned char *pStates, UINT nCount)
+{
+	KPCULLJOB job	= {};
+
+	job.pSpheres	= pSpheres;
+	job.pStates		= pStates;
+
+	return KPClassify(pPlanes, nPlanes, &job, nCount);
+}
+
+bool KPClassifyBoxes(const KPPlane *pPlanes, UINT nPlanes, const KPAABB *pBoxes, unsigned char *pStates, UINT nCount)
+{
+	KPCULLJOB job	= {};
+
+	job.pBoxes		= pBoxes;
+	job.pStates		= pStates;
+
+	return KPClassify(pPlanes, nPlanes, &job, nCount);
+}
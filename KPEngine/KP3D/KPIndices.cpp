@@ -0,0 +1,147 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPIndices.cpp
+ *  Description: KPEngine index kernels
+ *				 - Rebasing 16-bit indices
+ *				 - Consecutive 16-bit indices
+ *
+ *				 The dynamic vertex caches append the indices of
+ *				 every batch after the vertices already cached, so
+ *				 each index is moved by the same offset. Here 8
+ *				 (SSE2) or 16 (AVX2) indices are written at once.
+ *
+ *****************************************************************
+*/
+
+#include "KP3D.h"
+#include "KPSIMD.h"
+
+
+// Scalar Kernels ////
+//////////////////////
+
+static void KPRebaseIndicesScalar(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+		pOut[i] = (unsigned short)( pIn[i] + nOffset );
+}
+
+static void KPSequenceIndicesScalar(unsigned short *pOut, UINT nCount, UINT nFirst)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+		pOut[i] = (unsigned short)( nFirst + i );
+}
+
+
+#ifdef KP_SSE
+
+// SSE2 Kernels ////
+////////////////////
+//
+// The additions wrap around at 16 bits like the scalar ones.
+
+static void KPRebaseIndicesSSE(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset)
+{
+	UINT i = 0;
+
+#ifdef KP_SSE2
+	__m128i offset = _mm_set1_epi16( (short)nOffset );
+
+	for ( ; i + 8 <= nCount; i += 8 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)( pIn + i ) );
+
+		_mm_storeu_si128( (__m128i*)( pOut + i ), _mm_add_epi16(v, offset) );
+	}
+#endif
+
+	KPRebaseIndicesScalar(pIn + i, pOut + i, nCount - i, nOffset);
+}
+
+static void KPSequenceIndicesSSE(unsigned short *pOut, UINT nCount, UINT nFirst)
+{
+	UINT i = 0;
+
+#ifdef KP_SSE2
+	__m128i v	 = _mm_add_epi16( _mm_set1_epi16( (short)nFirst ), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7) );
+	__m128i step = _mm_set1_epi16(8);
+
+	for ( ; i + 8 <= nCount; i += 8 )
+	{
+		_mm_storeu_si128( (__m128i*)( pOut + i ), v );
+		v = _mm_add_epi16(v, step);
+	}
+#endif
+
+	KPSequenceIndicesScalar(pOut + i, nCount - i, nFirst + i);
+}
+
+#endif // ! KP_SSE
+
+
+#ifdef KP_AVX2
+KP_TARGET_AVX2_BEGIN
+
+// AVX2 Kernels ////
+////////////////////
+
+static void KPRebaseIndicesAVX2(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset)
+{
+	__m256i offset = _mm256_set1_epi16( (short)nOffset );
+	UINT	i	   = 0;
+
+	for ( ; i + 16 <= nCount; i += 16 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( pIn + i ) );
+
+		_mm256_storeu_si256( (__m256i*)( pOut + i ), _mm256_add_epi16(v, offset) );
+	}
+
+	KPRebaseIndicesScalar(pIn + i, pOut + i, nCount - i, nOffset);
+}
+
+static void KPSequenceIndicesAVX2(unsigned short *pOut, UINT nCount, UINT nFirst)
+{
+	__m256i v	 = _mm256_add_epi16( _mm256_set1_epi16( (short)nFirst ),
+									 _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15) );
+	__m256i step = _mm256_set1_epi16(16);
+	UINT	i	 = 0;
+
+	for ( ; i + 16 <= nCount; i += 16 )
+	{
+		_mm256_storeu_si256( (__m256i*)( pOut + i ), v );
+		v = _mm256_add_epi16(v, step);
+	}
+
+	KPSequenceIndicesScalar(pOut + i, nCount - i, nFirst + i);
+}
+
+KP_TARGET_AVX2_END
+#endif // ! KP_AVX2
+
+
+typedef void (*KPREBASEKERNEL)(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset);
+typedef void (*KPSEQUENCEKERNEL)(unsigned short *pOut, UINT nCount, UINT nFirst);
+
+static const KPREBASEKERNEL g_pfnRebaseIndices[KPISA_COUNT]		= KPISA_TABLE_INT(KPRebaseIndices);
+static const KPSEQUENCEKERNEL g_pfnSequenceIndices[KPISA_COUNT]	= KPISA_TABLE_INT(KPSequenceIndices);
+KPISA_REGISTER(g_pfnRebaseIndices,		"rebase indices");
+KPISA_REGISTER(g_pfnSequenceIndices,	"sequence indices");
+
+
+// KPRebaseIndices ////
+void KPRebaseIndices(const unsigned short *pIn, unsigned short *pOut, UINT nCount, UINT nOffset)
+{
+	g_pfnRebaseIndices[g_ISA](pIn, pOut, nCount, nOffset);
+}
+
+
+// KPSequenceIndices ////
+void KPSequenceIndices(unsigned short *pOut, UINT nCount, UINT nFirst)
+{
+	g_pfnSequenceIndices[g_ISA](pOut, nCount, nFirst);
+}
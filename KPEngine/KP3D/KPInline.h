@@ -0,0 +1,566 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPInline.h
+ *  Description: KPEngine Math Library inline implementations
+ *				 - Maximum / Minimum search
+ *				 - Vector 4D
+ *				 - Small matrix, quaternion and plane operations
+ *				 - Small bounding box and sphere operations
+ *
+ *				 Included at the end of KP3D.h. These used to
+ *				 be defined in the .cpp files, so every dot
+ *				 product in a loader or culling loop was a call
+ *				 into the library, and the methods declared
+ *				 inline there could not be called at all from
+ *				 outside their own file. Here the compiler sees
+ *				 them and inlines them into the loops of the
+ *				 callers. The heavy routines stay in the library.
+ *
+ *****************************************************************
+*/
+
+#ifndef KPINLINE_H
+#define KPINLINE_H
+
+#include "KP3D.h"
+#include "KPKernels.h"
+
+
+// Maximum/Minimum Search ////
+//////////////////////////////
+
+template <class T> inline KP_CONSTEXPR const T KPMax( const T a, const T b )
+{
+	return (b<a)?a:b;
+}
+
+template <class T> inline KP_CONSTEXPR const T KPMax( const T a, const T b, const T c )
+{
+	return KPMax( KPMax(a, b), c );
+}
+
+template <class T> inline KP_CONSTEXPR const T KPMin( const T a, const T b )
+{
+	return (b>a)?a:b;
+}
+
+template <class T> inline KP_CONSTEXPR const T KPMin( const T a, const T b, const T c )
+{
+	return KPMin( KPMin(a, b), c );
+}
+
+
+// KPVector ////
+////////////////
+
+// KPVector::Set Method ////
+inline void KPVector::Set(float _x, float _y, float _z, float _w)
+{
+	x = _x;
+	y = _y;
+	z = _z;
+	w = _w;
+}
+
+
+// KPVector::Negate ////
+inline void KPVector::Negate(void)
+{
+	x = -x;
+	y = -y;
+	z = -z;
+}
+
+
+// KPVector::Difference ////
+inline void KPVector::Difference(const KPVector &v1, const KPVector &v2)
+{
+	x = v2.x - v1.x;
+	y = v2.y - v1.y;
+	z = v2.z - v1.z;
+	w = 1.0f;
+}
+
+
+// KPVector::GetLength ////
+///////////////////////////
+//
+// Determining a Vectors magnitude(length) involves a square root operation
+// which is considerably slow.
+//
+// We take advantage of SIMD instructions here when the compiler targets
+// them, see KPKernels.h.
+//
+// Math: v.Length = sqtr(x*x + y*y + x*x)
+inline float KPVector::GetLength(void)
+{
+	return KPOps::Length(*this);
+}
+
+
+// KPVector::Normalize ////
+///////////////////////////
+//
+// Normalized vectors are vectors in the same direction
+// but with the legth 1.
+//
+// Math: norm(x) = x / magnitude(x)
+inline void KPVector::Normalize(void)
+{
+	KPOps::Normalize(*this);
+}
+
+// See KPScalarOps::Normalize and KPSSEOps::Normalize for the precisions
+inline void KPVector::Normalize(KPPRECISION Precision)
+{
+	KPOps::Normalize(*this, Precision);
+}
+
+
+// KPVector::Cross ////
+///////////////////////
+//
+// Calculates the cross product from two vectors
+// Math: Too long to explain :P See KPScalarOps::Cross
+inline void KPVector::Cross(const KPVector &v1, const KPVector &v2)
+{
+	KPOps::Cross(*this, v1, v2);	// Sets w to 1 regardless of v1.w and v2.w
+}
+
+
+// KPVector::AngleWith ////
+///////////////////////////
+//
+// Calculates the angle between two vectors
+// Math: acos(v1.v2 / |v1| * |v2|) in rads
+inline float KPVector::AngleWith(KPVector &v)
+{
+	return (float)acos( ( (*this) * v) / ( this->GetLength() * v.GetLength() ) );
+}
+
+
+// KPVector Operator Overloads ////
+///////////////////////////////////
+
+// The arithmetic operators only touch the x, y, z coordinates, the results
+// of the binary operators have w = 1 like any freshly constructed vector.
+
+inline KPVector KPVector::operator +(const KPVector &v) const
+{
+	KPVector vcReturn;
+	KPOps::Add(vcReturn, *this, v);
+	return vcReturn;
+}
+
+inline void KPVector::operator +=(const KPVector &v)
+{
+	KPOps::Add(*this, *this, v);
+}
+
+inline KPVector KPVector::operator -(const KPVector &v) const
+{
+	KPVector vcReturn;
+	KPOps::Sub(vcReturn, *this, v);
+	return vcReturn;
+}
+
+inline void KPVector::operator -=(const KPVector &v)
+{
+	KPOps::Sub(*this, *this, v);
+}
+
+inline KPVector KPVector::operator *(const float f) const
+{
+	KPVector vcReturn;
+	KPOps::Scale(vcReturn, *this, f);
+	return vcReturn;
+}
+
+inline void KPVector::operator *=(const float f)
+{
+	KPOps::Scale(*this, *this, f);
+}
+
+inline void KPVector::operator /=(const float f)
+{
+	KPOps::Divide(*this, *this, f);
+}
+
+inline float KPVector::operator *(const KPVector &v) const
+{
+	return KPOps::Dot(*this, v);
+}
+
+inline KPVector KPVector::operator *(const KPMatrix &m) const
+{
+	KPVector vcReturn;
+	KPOps::Transform(vcReturn, *this, m);
+	return vcReturn;
+}
+
+
+// KPMatrix ////
+////////////////
+
+// KPMatrix::Identity ////
+inline void KPMatrix::Identity(void)
+{
+	float *f = (float*)&this->_11;		// Create a pointer that points at the very first element of the matrix
+	memset(f, 0, sizeof(KPMatrix));		// Fills the whole matrix with 0s.
+	_11 = _22 = _33 = _44 = 1.0f;		// Set the values on the main diagonal to 1
+}
+
+
+// KPMatrix::Translate ////
+inline void KPMatrix::Translate(float distX, float distY, float distZ)
+{
+	_41	= distX;
+	_42 = distY;
+	_43 = distZ;
+}
+
+
+// KPMatrix::TransposeOf ////
+/////////////////////////////
+//
+// It reflects the A matrix by its main diagonal (starts from the top left)
+inline void KPMatrix::TransposeOf(const KPMatrix &m)
+{
+	_11 = m._11;
+	_12 = m._21;
+	_13 = m._31;
+	_14 = m._41;
+
+	_21 = m._12;
+	_22 = m._22;
+	_23 = m._32;
+	_24 = m._42;
+
+	_31 = m._13;
+	_32 = m._23;
+	_33 = m._33;
+	_34 = m._43;
+
+	_41 = m._14;
+	_42 = m._24;
+	_43 = m._34;
+	_44 = m._44;
+}
+
+
+// KPMatrix::ScaleRotateTranslate ////
+//////////////////////////////////////
+//
+// The rows of the rotation scaled by the scale factors, then the translation:
+//
+//	sx * r0		0
+//	sy * r1		0
+//	sz * r2		0
+//	position	1
+inline void KPMatrix::ScaleRotateTranslate(const KPVector &vcScale, const KPQuaternion &qRotation, const KPVector &vcPosition)
+{
+	KPOps::ScaleRotateTranslate(*this, vcScale, qRotation, vcPosition);
+}
+
+
+// KPMatrix Operator Overloads ////
+///////////////////////////////////
+
+inline KPMatrix KPMatrix::operator *(const KPMatrix &m) const
+{
+	KPMatrix result;
+
+	KPOps::Multiply(result, *this, m, false);
+
+	return result;
+}
+
+
+inline KPVector KPMatrix::operator *(const KPVector &v) const
+{
+	KPVector result;
+
+	result.x = v.x * _11 + v.y * _21 + v.z * _31 + _41;
+	result.y = v.x * _12 + v.y * _22 + v.z * _32 + _42;
+	result.z = v.x * _13 + v.y * _23 + v.z * _33 + _43;
+	result.w = v.x * _14 + v.y * _24 + v.z * _34 + _44;
+
+	// Dividing by 1 would not change anything, this is always the case
+	// for affine matrices, skip the divisions
+	if ( result.w == 1.0f )
+		return result;
+
+	// At this point vcReturn.w has some value, but we want it to be 1.0f
+	// we have to scale the matrix down by vcReturn.w for this
+
+	result.x /= result.w;
+	result.y /= result.w;
+	result.z /= result.w;
+	result.w = 1.0f;
+
+	return result;
+}
+
+
+// KPMatrixA::operator * ////
+// Both operands and the result are aligned
+inline KPMatrixA KPMatrixA::operator *(const KPMatrixA &m) const
+{
+	KPMatrixA result;
+
+	KPOps::Multiply(result, *this, m, true);
+
+	return result;
+}
+
+
+// KPQuaternion ////
+////////////////////
+
+// KPQuaternion::Set ////
+inline void KPQuaternion::Set(float _x, float _y, float _z, float _w)
+{
+	x = _x;
+	y = _y;
+	z = _z;
+	w = _w;
+}
+
+
+// KPQuaternion::Identity ////
+inline void KPQuaternion::Identity(void)
+{
+	x = y = z = 0.0f;
+	w = 1.0f;
+}
+
+
+// KPQuaternion::Conjugate ////
+inline void KPQuaternion::Conjugate(void)
+{
+	x = -x;
+	y = -y;
+	z = -z;
+}
+
+
+// KPQuaternion::GetLength ////
+inline float KPQuaternion::GetLength(void) const
+{
+	return sqrtf(x*x + y*y + z*z + w*w);
+}
+
+
+// KPQuaternion::Normalize ////
+inline void KPQuaternion::Normalize(void)
+{
+	float fLength = GetLength();
+
+	if ( fLength != 0.0f )
+	{
+		x /= fLength;
+		y /= fLength;
+		z /= fLength;
+		w /= fLength;
+	}
+}
+
+
+// KPQuaternion::Nlerp ////
+inline void KPQuaternion::Nlerp(const KPQuaternion &q0, const KPQuaternion &q1, float t)
+{
+	KPOps::Nlerp(*this, q0, q1, t);
+}
+
+
+// KPQuaternion Operator Overloads ////
+///////////////////////////////////////
+//
+// r * q is the Hamilton product q r, which rotates by r first:
+//
+//	x = qw*rx + qx*rw + qy*rz - qz*ry
+//	y = qw*ry - qx*rz + qy*rw + qz*rx
+//	z = qw*rz + qx*ry - qy*rx + qz*rw
+//	w = qw*rw - qx*rx - qy*ry - qz*rz
+inline KPQuaternion KPQuaternion::operator *(const KPQuaternion &q) const
+{
+	KPQuaternion result;
+
+	KPOps::Multiply(result, *this, q);
+
+	return result;
+}
+
+inline void KPQuaternion::operator *=(const KPQuaternion &q)
+{
+	*this = *this * q;
+}
+
+
+// KPPlane ////
+///////////////
+
+inline void KPPlane::Set(const KPVector &vcNormal, const KPVector &vcPoint)
+{
+	m_fDistance = - ( vcNormal * vcPoint );
+	m_vcNormal	= vcNormal;
+	m_vcPoint	= vcPoint;
+}
+
+inline void KPPlane::Set(const KPVector &vcNormal, const KPVector &vcPoint, float fDistance)
+{
+	m_fDistance = fDistance;
+	m_vcNormal	= vcNormal;
+	m_vcPoint	= vcPoint;
+}
+
+inline void KPPlane::Set(const KPVector &v0, const KPVector &v1, const KPVector &v2)
+{
+	KPVector vcEdge1 = v1 - v0;
+	KPVector vcEdge2 = v2 - v0;
+
+	m_vcNormal.Cross(vcEdge1, vcEdge2);
+	m_vcNormal.Normalize();
+
+	// Any point would do, we pick v0; distance = - Normal * Point
+
+	m_fDistance = - ( m_vcNormal * v0 );
+
+	m_vcPoint	= v0;
+}
+
+
+// KPAabb ////
+//////////////
+
+// KPAabb::Reset ////
+// FLT_MAX instead of infinity, a box of infinite positions is not empty
+inline void KPAabb::Reset(void)
+{
+	vcMin[0] = vcMin[1] = vcMin[2] = FLT_MAX;
+	vcMax[0] = vcMax[1] = vcMax[2] = -FLT_MAX;
+}
+
+inline void KPAabb::Set(const KPVector &_vcMin, const KPVector &_vcMax)
+{
+	vcMin[0] = _vcMin.x;	vcMin[1] = _vcMin.y;	vcMin[2] = _vcMin.z;
+	vcMax[0] = _vcMax.x;	vcMax[1] = _vcMax.y;	vcMax[2] = _vcMax.z;
+}
+
+inline bool KPAabb::IsEmpty(void) const
+{
+	return ( vcMin[0] > vcMax[0] || vcMin[1] > vcMax[1] || vcMin[2] > vcMax[2] );
+}
+
+
+// KPAabb::Add ////
+// The comparisons are false for NaN, like the ones of the SIMD kernels
+inline void KPAabb::Add(const KPVector &v)
+{
+	const float f[3] = { v.x, v.y, v.z };
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( f[i] < vcMin[i] ) vcMin[i] = f[i];
+		if ( f[i] > vcMax[i] ) vcMax[i] = f[i];
+	}
+}
+
+inline void KPAabb::Merge(const KPAABB &b)
+{
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( b.vcMin[i] < vcMin[i] ) vcMin[i] = b.vcMin[i];
+		if ( b.vcMax[i] > vcMax[i] ) vcMax[i] = b.vcMax[i];
+	}
+}
+
+inline KPVector KPAabb::GetCenter(void) const
+{
+	return KPVector( ( vcMin[0] + vcMax[0] ) * 0.5f, ( vcMin[1] + vcMax[1] ) * 0.5f, ( vcMin[2] + vcMax[2] ) * 0.5f );
+}
+
+inline KPVector KPAabb::GetExtents(void) const
+{
+	return KPVector( ( vcMax[0] - vcMin[0] ) * 0.5f, ( vcMax[1] - vcMin[1] ) * 0.5f, ( vcMax[2] - vcMin[2] ) * 0.5f );
+}
+
+inline bool KPAabb::Contains(const KPVector &v) const
+{
+	return ( v.x >= vcMin[0] && v.x <= vcMax[0] &&
+			 v.y >= vcMin[1] && v.y <= vcMax[1] &&
+			 v.z >= vcMin[2] && v.z <= vcMax[2] );
+}
+
+// An empty box has a minimum above its maximum, it intersects nothing
+inline bool KPAabb::Intersects(const KPAABB &b) const
+{
+	return ( vcMin[0] <= b.vcMax[0] && vcMax[0] >= b.vcMin[0] && b.vcMin[0] <= b.vcMax[0] && vcMin[0] <= vcMax[0] &&
+			 vcMin[1] <= b.vcMax[1] && vcMax[1] >= b.vcMin[1] && b.vcMin[1] <= b.vcMax[1] && vcMin[1] <= vcMax[1] &&
+			 vcMin[2] <= b.vcMax[2] && vcMax[2] >= b.vcMin[2] && b.vcMin[2] <= b.vcMax[2] && vcMin[2] <= vcMax[2] );
+}
+
+
+// KPSphere ////
+////////////////
+
+inline void KPSphere::Reset(void)
+{
+	x = y = z = 0.0f;
+	fRadius = -1.0f;
+}
+
+inline void KPSphere::Set(const KPVector &vcCenter, float _fRadius)
+{
+	x		= vcCenter.x;
+	y		= vcCenter.y;
+	z		= vcCenter.z;
+	fRadius	= _fRadius;
+}
+
+inline bool KPSphere::IsEmpty(void) const
+{
+	return ( fRadius < 0.0f );
+}
+
+// The half diagonal of the box
+inline void KPSphere::Set(const KPAABB &b)
+{
+	if ( b.vcMin[0] > b.vcMax[0] || b.vcMin[1] > b.vcMax[1] || b.vcMin[2] > b.vcMax[2] )
+	{
+		Reset();
+		return;
+	}
+
+	KPVector vcMin(b.vcMin[0], b.vcMin[1], b.vcMin[2]);
+	KPVector vcMax(b.vcMax[0], b.vcMax[1], b.vcMax[2]);
+	KPVector vcExtents = ( vcMax - vcMin ) * 0.5f;
+
+	Set( ( vcMax + vcMin ) * 0.5f, vcExtents.GetLength() );
+}
+
+inline KPVector KPSphere::GetCenter(void) const
+{
+	return KPVector(x, y, z);
+}
+
+inline bool KPSphere::Contains(const KPVector &v) const
+{
+	float dx = v.x - x, dy = v.y - y, dz = v.z - z;
+
+	return ( fRadius >= 0.0f && dx*dx + dy*dy + dz*dz <= fRadius*fRadius );
+}
+
+inline bool KPSphere::Intersects(const KPSPHERE &s) const
+{
+	float dx = s.x - x, dy = s.y - y, dz = s.z - z;
+	float fSum = fRadius + s.fRadius;
+
+	return ( fRadius >= 0.0f && s.fRadius >= 0.0f && dx*dx + dy*dy + dz*dz <= fSum*fSum );
+}
+
+#endif // ! KPINLINE_H
@@ -0,0 +1,339 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPIntersect.cpp
+ *  Description: KPEngine ray/triangle intersection
+ *				 - Pick mesh packets
+ *				 - Moller-Trumbore kernels
+ *
+ *				 T. Moller, B. Trumbore: Fast, Minimum Storage
+ *				 Ray/Triangle Intersection
+ *
+ *				 The ray is broadcast, the triangles of a packet
+ *				 are tested side by side. Only the packets with a
+ *				 hit closer than the closest one so far leave the
+ *				 SIMD registers.
+ *
+ *****************************************************************
+*/
+
+#include <float.h>
+#include <string.h>		// memset
+#include "KP3D.h"
+#include "KPSIMD.h"
+#include "KPMemory.h"
+
+
+// Scalar Kernel ////
+/////////////////////
+//
+// The SIMD kernels evaluate the same expressions in the same order, so
+// every path finds the same triangle at the same distance.
+//
+//	P = D x E2,  det = E1 * P,  T = O - V0
+//	u = ( T * P ) / det,  Q = T x E1,  v = ( D * Q ) / det,  t = ( E2 * Q ) / det
+
+static void KPIntersectPacketsScalar(const KPTRIPACKET *pPackets, UINT nPackets, const KPVector &o, const KPVector &d, KPRAYHIT *pHit)
+{
+	const float fEpsilon = (float)EPSILON;
+
+	for ( UINT n = 0; n < nPackets; ++n )
+	{
+		const KPTRIPACKET &P = pPackets[n];
+
+		for ( UINT j = 0; j < KPPICK_PACKET; ++j )
+		{
+			float e1x = P.e1[0][j], e1y = P.e1[1][j], e1z = P.e1[2][j];
+			float e2x = P.e2[0][j], e2y = P.e2[1][j], e2z = P.e2[2][j];
+
+			float px  = d.y*e2z - d.z*e2y;
+			float py  = d.z*e2x - d.x*e2z;
+			float pz  = d.x*e2y - d.y*e2x;
+			float det = e1x*px + e1y*py + e1z*pz;
+
+			// The ray is parallel to the triangle, or the triangle is degenerate
+			if ( det > -fEpsilon && det < fEpsilon )
+				continue;
+
+			float inv = 1.0f / det;
+			float tx  = o.x - P.v0[0][j];
+			float ty  = o.y - P.v0[1][j];
+			float tz  = o.z - P.v0[2][j];
+			float u	  = ( tx*px + ty*py + tz*pz ) * inv;
+
+			if ( u < 0.0f || u > 1.0f )
+				continue;
+
+			float qx  = ty*e1z - tz*e1y;
+			float qy  = tz*e1x - tx*e1z;
+			float qz  = tx*e1y - ty*e1x;
+			float v	  = ( d.x*qx + d.y*qy + d.z*qz ) * inv;
+
+			if ( v < 0.0f || u + v > 1.0f )
+				continue;
+
+			float t	  = ( e2x*qx + e2y*qy + e2z*qz ) * inv;
+
+			if ( t > fEpsilon && t < pHit->fDistance )
+			{
+				pHit->fDistance = t;
+				pHit->u			= u;
+				pHit->v			= v;
+				pHit->nTriangle = n * KPPICK_PACKET + j;
+			}
+		}
+	}
+}
+
+
+// Takes the hits of a packet in triangle order, like the scalar kernel
+static void KPTakeHits(int nMask, const float *pT, const float *pU, const float *pV, UINT nFirst, KPRAYHIT *pHit)
+{
+	for ( int j = 0; nMask; ++j, nMask >>= 1 )
+	{
+		if ( ( nMask & 1 ) && pT[j] < pHit->fDistance )
+		{
+			pHit->fDistance = pT[j];
+			pHit->u			= pU[j];
+			pHit->v			= pV[j];
+			pHit->nTriangle = nFirst + j;
+		}
+	}
+}
+
+
+#ifdef KP_SSE
+
+// SSE Kernel ////
+//////////////////
+//
+// A packet in two halves of four triangles, the packets are aligned by
+// KPPickMesh::Create
+
+static void KPIntersectPacketsSSE(const KPTRIPACKET *pPackets, UINT nPackets, const KPVector &o, const KPVector &d, KPRAYHIT *pHit)
+{
+	__m128 ox	= _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+	__m128 dx	= _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	__m128 eps	= _mm_set1_ps( (float)EPSILON );
+	__m128 zero = _mm_setzero_ps();
+	__m128 one	= _mm_set1_ps(1.0f);
+	__m128 sign = _mm_set1_ps(-0.0f);
+
+	for ( UINT n = 0; n < nPackets; ++n )
+	{
+		const KPTRIPACKET &P = pPackets[n];
+
+		for ( int h = 0; h < KPPICK_PACKET; h += 4 )
+		{
+			__m128 e1x = _mm_load_ps(&P.e1[0][h]), e1y = _mm_load_ps(&P.e1[1][h]), e1z = _mm_load_ps(&P.e1[2][h]);
+			__m128 e2x = _mm_load_ps(&P.e2[0][h]), e2y = _mm_load_ps(&P.e2[1][h]), e2z = _mm_load_ps(&P.e2[2][h]);
+
+			__m128 px  = _mm_sub_ps( _mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y) );
+			__m128 py  = _mm_sub_ps( _mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z) );
+			__m128 pz  = _mm_sub_ps( _mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x) );
+			__m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py) ), _mm_mul_ps(e1z, pz) );
+
+			__m128 hit = _mm_cmpge_ps( _mm_andnot_ps(sign, det), eps );
+
+			if ( _mm_movemask_ps(hit) == 0 )
+				continue;
+
+			__m128 inv = _mm_div_ps(one, det);
+			__m128 tx  = _mm_sub_ps( ox, _mm_load_ps(&P.v0[0][h]) );
+			__m128 ty  = _mm_sub_ps( oy, _mm_load_ps(&P.v0[1][h]) );
+			__m128 tz  = _mm_sub_ps( oz, _mm_load_ps(&P.v0[2][h]) );
+			__m128 u   = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(tx, px), _mm_mul_ps(ty, py) ), _mm_mul_ps(tz, pz) ), inv );
+
+			hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one) ) );
+
+			if ( _mm_movemask_ps(hit) == 0 )
+				continue;
+
+			__m128 qx  = _mm_sub_ps( _mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y) );
+			__m128 qy  = _mm_sub_ps( _mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z) );
+			__m128 qz  = _mm_sub_ps( _mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x) );
+			__m128 v   = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy) ), _mm_mul_ps(dz, qz) ), inv );
+			__m128 t   = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy) ), _mm_mul_ps(e2z, qz) ), inv );
+
+			hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps(v, zero), _mm_cmple_ps( _mm_add_ps(u, v), one ) ) );
+			hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpgt_ps(t, eps), _mm_cmplt_ps( t, _mm_set1_ps(pHit->fDistance) ) ) );
+
+			int nMask = _mm_movemask_ps(hit);
+
+			if ( nMask )
+			{
+				float fT[4], fU[4], fV[4];
+
+				_mm_storeu_ps(fT, t);
+				_mm_storeu_ps(fU, u);
+				_mm_storeu_ps(fV, v);
+
+				KPTakeHits(nMask, fT, fU, fV, n * KPPICK_PACKET + h, pHit);
+			}
+		}
+	}
+}
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernel ////
+//////////////////
+//
+// A whole packet at once
+
+static void KPIntersectPacketsAVX(const KPTRIPACKET *pPackets, UINT nPackets, const KPVector &o, const KPVector &d, KPRAYHIT *pHit)
+{
+	__m256 ox	= _mm256_set1_ps(o.x), oy = _mm256_set1_ps(o.y), oz = _mm256_set1_ps(o.z);
+	__m256 dx	= _mm256_set1_ps(d.x), dy = _mm256_set1_ps(d.y), dz = _mm256_set1_ps(d.z);
+	__m256 eps	= _mm256_set1_ps( (float)EPSILON );
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one	= _mm256_set1_ps(1.0f);
+	__m256 sign = _mm256_set1_ps(-0.0f);
+
+	for ( UINT n = 0; n < nPackets; ++n )
+	{
+		const KPTRIPACKET &P = pPackets[n];
+
+		__m256 e1x = _mm256_load_ps(P.e1[0]), e1y = _mm256_load_ps(P.e1[1]), e1z = _mm256_load_ps(P.e1[2]);
+		__m256 e2x = _mm256_load_ps(P.e2[0]), e2y = _mm256_load_ps(P.e2[1]), e2z = _mm256_load_ps(P.e2[2]);
+
+		__m256 px  = _mm256_sub_ps( _mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y) );
+		__m256 py  = _mm256_sub_ps( _mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z) );
+		__m256 pz  = _mm256_sub_ps( _mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x) );
+		__m256 det = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py) ), _mm256_mul_ps(e1z, pz) );
+
+		__m256 hit = _mm256_cmp_ps( _mm256_andnot_ps(sign, det), eps, _CMP_GE_OQ );
+
+		if ( _mm256_movemask_ps(hit) == 0 )
+			continue;
+
+		__m256 inv = _mm256_div_ps(one, det);
+		__m256 tx  = _mm256_sub_ps( ox, _mm256_load_ps(P.v0[0]) );
+		__m256 ty  = _mm256_sub_ps( oy, _mm256_load_ps(P.v0[1]) );
+		__m256 tz  = _mm256_sub_ps( oz, _mm256_load_ps(P.v0[2]) );
+		__m256 u   = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py) ), _mm256_mul_ps(tz, pz) ), inv );
+
+		hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ) ) );
+
+		if ( _mm256_movemask_ps(hit) == 0 )
+			continue;
+
+		__m256 qx  = _mm256_sub_ps( _mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y) );
+		__m256 qy  = _mm256_sub_ps( _mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z) );
+		__m256 qz  = _mm256_sub_ps( _mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x) );
+		__m256 v   = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy) ), _mm256_mul_ps(dz, qz) ), inv );
+		__m256 t   = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy) ), _mm256_mul_ps(e2z, qz) ), inv );
+
+		hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps( _mm256_add_ps(u, v), one, _CMP_LE_OQ ) ) );
+		hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps(t, eps, _CMP_GT_OQ), _mm256_cmp_ps( t, _mm256_set1_ps(pHit->fDistance), _CMP_LT_OQ ) ) );
+
+		int nMask = _mm256_movemask_ps(hit);
+
+		if ( nMask )
+		{
+			float fT[8], fU[8], fV[8];
+
+			_mm256_storeu_ps(fT, t);
+			_mm256_storeu_ps(fU, u);
+			_mm256_storeu_ps(fV, v);
+
+			KPTakeHits(nMask, fT, fU, fV, n * KPPICK_PACKET, pHit);
+		}
+	}
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#endif // ! KP_SSE
+
+
+typedef void (*KPINTERSECTKERNEL)(const KPTRIPACKET *pPackets, UINT nPackets, const KPVector &o, const KPVector &d, KPRAYHIT *pHit);
+
+static const KPINTERSECTKERNEL g_pfnIntersectPackets[KPISA_COUNT] = KPISA_TABLE(KPIntersectPackets);
+KPISA_REGISTER(g_pfnIntersectPackets, "ray packets");
+
+
+// KPPickMesh ////
+//////////////////
+
+KPPickMesh::KPPickMesh(void)
+{
+	m_pPackets		= NULL;
+	m_numPackets	= 0;
+	m_numTriangles	= 0;
+}
+
+KPPickMesh::~KPPickMesh(void)
+{
+	KPAlignedFree(m_pPackets);
+	m_pPackets = NULL;
+}
+
+
+// Create ////
+bool KPPickMesh::Create(const float *pPositions, UINT nStride, const unsigned short *pIndices, UINT nTriangles)
+{
+	UINT		numPackets	= ( nTriangles + KPPICK_PACKET - 1 ) / KPPICK_PACKET;
+	KPTRIPACKET *pPackets	= NULL;
+
+	if ( numPackets )
+	{
+		// Aligned to a cache line, the rows of a packet can be loaded with aligned loads
+		pPackets = (KPTRIPACKET*)KPAlignedAlloc(numPackets * sizeof(KPTRIPACKET));
+		if ( !pPackets )
+			return false;
+
+		// The padding triangles are degenerate, their determinant is 0
+		memset(pPackets, 0, numPackets * sizeof(KPTRIPACKET));
+	}
+
+	for ( UINT i = 0; i < nTriangles; ++i )
+	{
+		KPTRIPACKET &P = pPackets[i / KPPICK_PACKET];
+		UINT		j  = i % KPPICK_PACKET;
+		const float *v[3];
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			UINT nVertex = pIndices ? pIndices[3*i + k] : 3*i + k;
+
+			v[k] = (const float*)( (const char*)pPositions + nVertex * nStride );
+		}
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			P.v0[c][j] = v[0][c];
+			P.e1[c][j] = v[1][c] - v[0][c];
+			P.e2[c][j] = v[2][c] - v[0][c];
+		}
+	}
+
+	KPAlignedFree(m_pPackets);
+
+	m_pPackets		= pPackets;
+	m_numPackets	= numPackets;
+	m_numTriangles	= nTriangles;
+
+	return true;
+
+} // ! Create
+
+
+// Intersect ////
+bool KPPickMesh::Intersect(const KPVector &vcOrigin, const KPVector &vcDirection, KPRAYHIT *pHit) const
+{
+	pHit->fDistance = FLT_MAX;
+	pHit->u			= 0.0f;
+	pHit->v			= 0.0f;
+	pHit->nTriangle = 0;
+
+	g_pfnIntersectPackets[g_ISA](m_pPackets, m_numPackets, vcOrigin, vcDirection, pHit);
+
+	return ( pHit->fDistance < FLT_MAX );
+}
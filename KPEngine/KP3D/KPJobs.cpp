@@ -0,0 +1,411 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPJobs.cpp
+ *  Description: KPEngine worker thread pool implementation
+ *
+ *				 The pool is created on the first parallel call.
+ *				 Every call splits its index range into chunks,
+ *				 the workers are woken up through a counting
+ *				 semaphore, one token per worker, and they take
+ *				 chunks by incrementing a shared counter until
+ *				 there are none left. The last worker to finish
+ *				 signals the calling thread, which processes
+ *				 chunks in the meantime too.
+ *
+ *****************************************************************
+*/
+
+#include "KPJobs.h"
+#include "KPMemory.h"		// KP_CACHE_LINE
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <process.h>	// _beginthreadex()
+
+	typedef HANDLE		KPTHREAD;
+	typedef HANDLE		KPSEMAPHORE;
+#else
+	#include <pthread.h>
+	#include <semaphore.h>
+	#include <unistd.h>		// sysconf()
+	#include <sched.h>		// sched_yield()
+	#include <errno.h>
+
+	typedef pthread_t	KPTHREAD;
+	typedef sem_t		KPSEMAPHORE;
+#endif
+
+// Maximum number of worker threads
+#define KPMAX_WORKERS		64
+
+// Smallest array split between the workers, by work class
+static UINT g_nThreshold[KPJOB_COUNT] = { KPDEFAULT_MATRIX_THRESHOLD, KPDEFAULT_VECTOR_THRESHOLD };
+
+
+// Pool State ////
+//////////////////
+
+static struct KPWORKERPOOL
+{
+	KPTHREAD		Threads[KPMAX_WORKERS];	// Worker threads
+	KPSEMAPHORE		semStart;				// One token wakes up one worker
+	KPSEMAPHORE		semDone;				// Signaled by the last worker finishing a call
+	UINT			numWorkers;				// Number of running worker threads
+	UINT			numRequested;			// Number of workers set by KPSetNumWorkers
+	bool			bRequested;				// KPSetNumWorkers was called
+	bool			bRunning;				// The threads are created
+	volatile bool	bQuit;					// Tells the workers to exit
+
+	volatile long	nBusy;					// 1 while a parallel call is in progress
+
+	// The current call, only read by the workers
+	KPJOBFUNC		pfnJob;
+	void			*pParam;
+	UINT			nCount;
+	UINT			nGrain;
+	long			numChunks;
+
+	// The counters are incremented by every worker, on cache lines of
+	// their own they do not take the line of the fields above away from
+	// the other workers on every chunk
+	char			Pad0[KP_CACHE_LINE];
+	volatile long	nNextChunk;				// Next chunk to take
+	char			Pad1[KP_CACHE_LINE];
+	volatile long	nActive;				// Workers that have not finished the call yet
+	char			Pad2[KP_CACHE_LINE];
+
+} g_Pool = {};
+
+
+// Atomic Operations ////
+/////////////////////////
+
+// Returns the incremented value
+static long KPAtomicIncrement(volatile long *p)
+{
+#ifdef _WIN32
+	return InterlockedIncrement(p);
+#else
+	return __sync_add_and_fetch(p, 1);
+#endif
+}
+
+// Returns the decremented value
+static long KPAtomicDecrement(volatile long *p)
+{
+#ifdef _WIN32
+	return InterlockedDecrement(p);
+#else
+	return __sync_sub_and_fetch(p, 1);
+#endif
+}
+
+// Sets *p to nExchange if it is nComparand, returns the original value
+static long KPAtomicCompareExchange(volatile long *p, long nExchange, long nComparand)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(p, nExchange, nComparand);
+#else
+	return __sync_val_compare_and_swap(p, nComparand, nExchange);
+#endif
+}
+
+
+// Semaphores ////
+//////////////////
+
+static void KPSemCreate(KPSEMAPHORE *pSem)
+{
+#ifdef _WIN32
+	*pSem = CreateSemaphore(NULL, 0, KPMAX_WORKERS, NULL);
+#else
+	sem_init(pSem, 0, 0);
+#endif
+}
+
+static void KPSemDestroy(KPSEMAPHORE *pSem)
+{
+#ifdef _WIN32
+	CloseHandle(*pSem);
+#else
+	sem_destroy(pSem);
+#endif
+}
+
+static void KPSemPost(KPSEMAPHORE *pSem, UINT nCount)
+{
+#ifdef _WIN32
+	ReleaseSemaphore(*pSem, (LONG)nCount, NULL);
+#else
+	for ( UINT i = 0; i < nCount; ++i )
+		sem_post(pSem);
+#endif
+}
+
+static void KPSemWait(KPSEMAPHORE *pSem)
+{
+#ifdef _WIN32
+	WaitForSingleObject(*pSem, INFINITE);
+#else
+	// Signals can interrupt the wait
+	while ( sem_wait(pSem) != 0 && errno == EINTR )
+		;
+#endif
+}
+
+
+// KPRunChunks ////
+///////////////////
+//
+// Takes chunks of the current call until there are none left
+static void KPRunChunks(void)
+{
+	for (;;)
+	{
+		long nChunk = KPAtomicIncrement(&g_Pool.nNextChunk) - 1;
+		if ( nChunk >= g_Pool.numChunks )
+			break;
+
+		UINT nBegin = (UINT)nChunk * g_Pool.nGrain;
+		UINT nEnd	= nBegin + g_Pool.nGrain;
+		if ( nEnd > g_Pool.nCount || nEnd < nBegin )
+			nEnd = g_Pool.nCount;
+
+		g_Pool.pfnJob(nBegin, nEnd, g_Pool.pParam);
+	}
+} // ! KPRunChunks
+
+
+// Worker Thread ////
+/////////////////////
+
+#ifdef _WIN32
+static unsigned __stdcall KPWorkerProc(void *)
+#else
+static void *KPWorkerProc(void *)
+#endif
+{
+	for (;;)
+	{
+		KPSemWait(&g_Pool.semStart);
+
+		if ( g_Pool.bQuit )
+			break;
+
+		KPRunChunks();
+
+		// The last worker lets the calling thread return
+		if ( KPAtomicDecrement(&g_Pool.nActive) == 0 )
+			KPSemPost(&g_Pool.semDone, 1);
+	}
+
+	return 0;
+} // ! KPWorkerProc
+
+
+// KPGetNumProcessors ////
+static UINT KPGetNumProcessors(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (UINT)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return ( n > 0 ) ? (UINT)n : 1;
+#endif
+}
+
+
+// KPGetRequestedWorkers ////
+// Returns the number of worker threads the pool is going to create
+static UINT KPGetRequestedWorkers(void)
+{
+	UINT nWorkers = g_Pool.numRequested;
+
+	if ( ! g_Pool.bRequested || nWorkers == KPDEFAULT_WORKERS )
+		nWorkers = KPGetNumProcessors() - 1;
+
+	if ( nWorkers > KPMAX_WORKERS )
+		nWorkers = KPMAX_WORKERS;
+
+	return nWorkers;
+}
+
+
+// KPStartWorkers ////
+//////////////////////
+//
+// Creates the worker threads, the caller must own the pool (nBusy)
+static void KPStartWorkers(void)
+{
+	UINT nWorkers = KPGetRequestedWorkers();
+
+	KPSemCreate(&g_Pool.semStart);
+	KPSemCreate(&g_Pool.semDone);
+
+	g_Pool.bQuit		= false;
+	g_Pool.numWorkers	= 0;
+
+	for ( UINT i = 0; i < nWorkers; ++i )
+	{
+#ifdef _WIN32
+		g_Pool.Threads[i] = (HANDLE)_beginthreadex(NULL, 0, KPWorkerProc, NULL, 0, NULL);
+		if ( g_Pool.Threads[i] == 0 )
+			break;
+#else
+		if ( pthread_create(&g_Pool.Threads[i], NULL, KPWorkerProc, NULL) != 0 )
+			break;
+#endif
+		++g_Pool.numWorkers;
+	}
+
+	g_Pool.bRunning = true;
+
+} // ! KPStartWorkers
+
+
+// KPParallelFor ////
+/////////////////////
+void KPParallelFor(UINT nCount, UINT nGrain, KPJOBFUNC pfnJob, void *pParam)
+{
+	if ( nCount == 0 )
+		return;
+
+	if ( nGrain == 0 )
+		nGrain = 1;
+
+	long numChunks = (long)( (nCount - 1) / nGrain ) + 1;
+
+	// Not worth waking anybody up, or somebody else is using the pool
+	if ( numChunks == 1 || KPAtomicCompareExchange(&g_Pool.nBusy, 1, 0) != 0 )
+	{
+		pfnJob(0, nCount, pParam);
+		return;
+	}
+
+	if ( ! g_Pool.bRunning )
+		KPStartWorkers();
+
+	// Only wake up as many workers as there are chunks left for them
+	UINT nWorkers = g_Pool.numWorkers;
+	if ( (long)nWorkers > numChunks - 1 )
+		nWorkers = (UINT)( numChunks - 1 );
+
+	if ( nWorkers == 0 )
+	{
+		pfnJob(0, nCount, pParam);
+	}
+	else
+	{
+		g_Pool.pfnJob		= pfnJob;
+		g_Pool.pParam		= pParam;
+		g_Pool.nCount		= nCount;
+		g_Pool.nGrain		= nGrain;
+		g_Pool.numChunks	= numChunks;
+		g_Pool.nNextChunk	= 0;
+		g_Pool.nActive		= (long)nWorkers;
+
+		// Posting the semaphore is a full memory barrier,
+		// the workers see the call parameters set above.
+		KPSemPost(&g_Pool.semStart, nWorkers);
+
+		KPRunChunks();
+
+		KPSemWait(&g_Pool.semDone);
+	}
+
+	KPAtomicCompareExchange(&g_Pool.nBusy, 0, 1);
+
+} // ! KPParallelFor
+
+
+// KPSetNumWorkers ////
+void KPSetNumWorkers(UINT nWorkers)
+{
+	if ( ! g_Pool.bRunning )
+	{
+		g_Pool.numRequested	= nWorkers;
+		g_Pool.bRequested	= true;
+	}
+}
+
+
+// KPGetNumThreads ////
+UINT KPGetNumThreads(void)
+{
+	if ( g_Pool.bRunning )
+		return g_Pool.numWorkers + 1;
+
+	return KPGetRequestedWorkers() + 1;
+}
+
+
+// KPSetParallelThreshold ////
+void KPSetParallelThreshold(KPJOBCLASS Class, UINT nCount)
+{
+	if ( Class < KPJOB_COUNT )
+		g_nThreshold[Class] = nCount;
+}
+
+
+// KPGetParallelThreshold ////
+UINT KPGetParallelThreshold(KPJOBCLASS Class)
+{
+	return ( Class < KPJOB_COUNT ) ? g_nThreshold[Class] : 0xFFFFFFFF;
+}
+
+
+// KPGetParallelGrain ////
+UINT KPGetParallelGrain(KPJOBCLASS Class)
+{
+	UINT nGrain = KPGetParallelThreshold(Class) / 4;
+
+	return nGrain ? nGrain : 1;
+}
+
+
+// KPShutdownWorkers ////
+/////////////////////////
+void KPShutdownWorkers(void)
+{
+	// Wait for the running call to finish
+	while ( KPAtomicCompareExchange(&g_Pool.nBusy, 1, 0) != 0 )
+	{
+#ifdef _WIN32
+		Sleep(0);
+#else
+		sched_yield();
+#endif
+	}
+
+	if ( g_Pool.bRunning )
+	{
+		g_Pool.bQuit = true;
+		KPSemPost(&g_Pool.semStart, g_Pool.numWorkers);
+
+		for ( UINT i = 0; i < g_Pool.numWorkers; ++i )
+		{
+#ifdef _WIN32
+			WaitForSingleObject(g_Pool.Threads[i], INFINITE);
+			CloseHandle(g_Pool.Threads[i]);
+#else
+			pthread_join(g_Pool.Threads[i], NULL);
+#endif
+		}
+
+		KPSemDestroy(&g_Pool.semStart);
+		KPSemDestroy(&g_Pool.semDone);
+
+		g_Pool.numWorkers	= 0;
+		g_Pool.bRunning		= false;
+		g_Pool.bQuit		= false;
+	}
+
+	KPAtomicCompareExchange(&g_Pool.nBusy, 0, 1);
+
+} // ! KPShutdownWorkers
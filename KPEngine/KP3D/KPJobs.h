@@ -0,0 +1,97 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPJobs.h
+ *  Description: KPEngine worker thread pool
+ *				 - Parallel for loop over index ranges
+ *				 - Thresholds of the parallel array operations
+ *
+ *****************************************************************
+*/
+
+#ifndef KPJOBS_H
+#define KPJOBS_H
+
+// Types ////
+typedef unsigned int UINT;
+
+// Worker count meaning "one less than the logical processors"
+#define KPDEFAULT_WORKERS			0xFFFFFFFF
+
+// Default parallel thresholds, a matrix is about four times the work of a vector
+#define KPDEFAULT_MATRIX_THRESHOLD	8192
+#define KPDEFAULT_VECTOR_THRESHOLD	16384
+
+//! Work classes of the array operations, each has its own parallel threshold
+typedef enum KPJOBCLASS
+{
+	KPJOB_MATRIX,		//!< Matrices are built or multiplied: matrix products, TRS and rotation matrices
+	KPJOB_VECTOR,		//!< Vectors or bounding volumes: transforms, normalization, culling
+	KPJOB_COUNT
+} KPJOBCLASS;
+
+//! Job function called by the worker threads
+/*!
+	\param [in] nBegin first index of the range the job has to process
+	\param [in] nEnd one past the last index of the range
+	\param [in] pParam user data passed to KPParallelFor
+*/
+typedef void (*KPJOBFUNC)(UINT nBegin, UINT nEnd, void *pParam);
+
+
+//! Processes the [0, nCount) index range on the worker threads
+/*!
+	The range is split into chunks of nGrain indices, the worker threads and
+	the calling thread take chunks until all of them are done. The function
+	returns when the whole range is processed.
+
+	If the pool is already busy (the call was made from inside a job or from
+	another thread at the same time) or the range is not larger than one chunk,
+	the job runs on the calling thread.
+
+	\param [in] nCount number of indices to process
+	\param [in] nGrain minimum number of indices one job call processes
+	\param [in] pfnJob job function
+	\param [in] pParam user data passed to the job function
+*/
+void KPParallelFor(UINT nCount, UINT nGrain, KPJOBFUNC pfnJob, void *pParam);
+
+//! Sets the number of worker threads
+/*!
+	Has to be called before the first KPParallelFor call or after KPShutdownWorkers.
+	\param [in] nWorkers number of worker threads besides the calling thread,
+						 KPDEFAULT_WORKERS (0xFFFFFFFF) uses one less than the number of logical processors.
+*/
+void KPSetNumWorkers(UINT nWorkers);
+
+//! Returns the number of threads processing a KPParallelFor call, including the calling thread
+UINT KPGetNumThreads(void);
+
+//! Sets the smallest array the operations of a work class split between the worker threads
+/*!
+	The defaults are KPDEFAULT_MATRIX_THRESHOLD and KPDEFAULT_VECTOR_THRESHOLD, a
+	hardware profile (KPApplyHWProfile) sets the ones measured on the machine.
+	One job processes a quarter of the threshold. Do not call it while other
+	threads use the library.
+	\param [in] Class work class
+	\param [in] nCount number of elements, 0xFFFFFFFF never splits the arrays
+*/
+void KPSetParallelThreshold(KPJOBCLASS Class, UINT nCount);
+
+//! Returns the smallest array the operations of a work class split between the worker threads
+UINT KPGetParallelThreshold(KPJOBCLASS Class);
+
+//! Returns the number of elements one job of a work class processes
+UINT KPGetParallelGrain(KPJOBCLASS Class);
+
+//! Stops and releases the worker threads
+/*!
+	Must not be called from DllMain or from a static destructor, the
+	threads can not exit while the loader lock is held.
+*/
+void KPShutdownWorkers(void);
+
+#endif // ! KPJOBS_H
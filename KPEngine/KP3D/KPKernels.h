@@ -0,0 +1,625 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPKernels.h
+ *  Description: KPEngine Math Library single operation kernels
+ *				 - Scalar and SSE implementations of the vector,
+ *				   matrix and quaternion operations
+ *				 - Compile time selection between them
+ *
+ *****************************************************************
+*/
+
+// Outside the guard: KP3D.h includes this file back through KPInline.h,
+// which needs it complete
+#include "KP3D.h"
+
+#ifndef KPKERNELS_H
+#define KPKERNELS_H
+
+#include <string.h>		// memcpy, memset
+#include <float.h>		// FLT_MIN
+#include "KPSIMD.h"
+
+/*
+	A single vector operation takes a few nanoseconds, a runtime feature
+	check or an indirect call would cost about as much as the operation
+	itself, and it would keep the compiler from inlining it. So every
+	operation has a scalar (KPScalarOps) and an SSE (KPSSEOps) version,
+	and KPOps is the one the compiler targets (KP_SSE_STATIC). The class
+	operators call KPOps, there is no branch left in them.
+
+	The array kernels call the version of their own instruction set
+	directly, and the benchmark compares the two versions by name.
+
+	Only the x, y, z coordinates of the vector results are written, except
+	where noted. The results can be one of the operands, except where noted.
+*/
+
+
+// Slerp Coefficients ////
+//////////////////////////
+//
+// D. Eberly: A Fast and Accurate Algorithm for Computing SLERP
+//
+// With x = cos(a), the slerp weight sin(t*a)/sin(a) is the series
+//		t * (1 + b1*(1 + b2*(1 + ...)))		bi = (u[i]*t^2 - v[i]) * (x - 1)
+//		u[i] = 1 / (i*(2i + 1)),  v[i] = i / (2i + 1)
+// The series is cut after 16 terms, the last term is scaled to make up for
+// the missing ones. The error of the weights is below 3.1e-8 for angles up
+// to pi/2, which is all we need as the shorter arc is interpolated.
+#define KPSLERP_TERMS	16
+#define KPSLERP_MU		1.917f
+
+static const float g_fSlerpU[KPSLERP_TERMS] =
+{
+	1.0f/(1*3),   1.0f/(2*5),   1.0f/(3*7),   1.0f/(4*9),
+	1.0f/(5*11),  1.0f/(6*13),  1.0f/(7*15),  1.0f/(8*17),
+	1.0f/(9*19),  1.0f/(10*21), 1.0f/(11*23), 1.0f/(12*25),
+	1.0f/(13*27), 1.0f/(14*29), 1.0f/(15*31), KPSLERP_MU/(16*33)
+};
+
+static const float g_fSlerpV[KPSLERP_TERMS] =
+{
+	1.0f/3,   2.0f/5,   3.0f/7,   4.0f/9,
+	5.0f/11,  6.0f/13,  7.0f/15,  8.0f/17,
+	9.0f/19,  10.0f/21, 11.0f/23, 12.0f/25,
+	13.0f/27, 14.0f/29, 15.0f/31, KPSLERP_MU*16/33
+};
+
+
+// KPSetRotation ////
+/////////////////////
+//
+// Writes a right handed rotation around a world axis from its sine and
+// cosine, every element is written once, there is no memset before.
+static inline void KPSetRotation(KPMatrix &m, KPAXIS Axis, float fSin, float fCos)
+{
+	m._14 = m._24 = m._34 = 0.0f;
+	m._41 = m._42 = m._43 = 0.0f;
+	m._44 = 1.0f;
+
+	switch ( Axis )
+	{
+	case KPAXIS_X:
+		m._11 = 1.0f;	m._12 = 0.0f;	m._13 = 0.0f;
+		m._21 = 0.0f;	m._22 = fCos;	m._23 = fSin;
+		m._31 = 0.0f;	m._32 = -fSin;	m._33 = fCos;
+		break;
+
+	case KPAXIS_Y:
+		m._11 = fCos;	m._12 = 0.0f;	m._13 = -fSin;
+		m._21 = 0.0f;	m._22 = 1.0f;	m._23 = 0.0f;
+		m._31 = fSin;	m._32 = 0.0f;	m._33 = fCos;
+		break;
+
+	default:
+		m._11 = fCos;	m._12 = fSin;	m._13 = 0.0f;
+		m._21 = -fSin;	m._22 = fCos;	m._23 = 0.0f;
+		m._31 = 0.0f;	m._32 = 0.0f;	m._33 = 1.0f;
+		break;
+	}
+}
+
+
+// KPScalarOps ////
+///////////////////
+
+struct KPScalarOps
+{
+	static inline void Add(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		r.x = a.x + b.x;
+		r.y = a.y + b.y;
+		r.z = a.z + b.z;
+	}
+
+	static inline void Sub(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		r.x = a.x - b.x;
+		r.y = a.y - b.y;
+		r.z = a.z - b.z;
+	}
+
+	static inline void Scale(KPVector &r, const KPVector &a, float f)
+	{
+		r.x = a.x * f;
+		r.y = a.y * f;
+		r.z = a.z * f;
+	}
+
+	static inline void Divide(KPVector &r, const KPVector &a, float f)
+	{
+		r.x = a.x / f;
+		r.y = a.y / f;
+		r.z = a.z / f;
+	}
+
+	static inline float Dot(const KPVector &a, const KPVector &b)
+	{
+		return a.x*b.x + a.y*b.y + a.z*b.z;
+	}
+
+	static inline float Length(const KPVector &a)
+	{
+		return sqrtf(a.x*a.x + a.y*a.y + a.z*a.z);
+	}
+
+	// The null vector is left as it is
+	static inline void Normalize(KPVector &v)
+	{
+		float fLength = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
+
+		if ( fLength != 0.0f )
+		{
+			v.x /= fLength;
+			v.y /= fLength;
+			v.z /= fLength;
+		}
+	}
+
+	// Plain C++ has no reciprocal square root estimate, every precision gets
+	// the correctly rounded reciprocal, only the null vector test differs
+	static inline void Normalize(KPVector &v, KPPRECISION Precision)
+	{
+		if ( Precision == KPPRECISION_EXACT )
+		{
+			Normalize(v);
+			return;
+		}
+
+		float fSqLength = v.x*v.x + v.y*v.y + v.z*v.z;
+
+		if ( fSqLength >= FLT_MIN )
+		{
+			float fInv = 1.0f / sqrtf(fSqLength);
+
+			v.x *= fInv;
+			v.y *= fInv;
+			v.z *= fInv;
+		}
+	}
+
+	// r = a x b, r.w = 1, r cannot be an operand
+	static inline void Cross(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		r.x = a.y * b.z - a.z * b.y;
+		r.y = a.z * b.x - a.x * b.z;
+		r.z = a.x * b.y - a.y * b.x;
+		r.w = 1.0f;
+	}
+
+	// r = v * m divided by w, skipped for affine matrices, r.w = 1, r cannot be v
+	static inline void Transform(KPVector &r, const KPVector &v, const KPMatrix &m)
+	{
+		r.x = v.x*m._11 + v.y*m._21 + v.z*m._31 + m._41;
+		r.y = v.x*m._12 + v.y*m._22 + v.z*m._32 + m._42;
+		r.z = v.x*m._13 + v.y*m._23 + v.z*m._33 + m._43;
+		r.w = v.x*m._14 + v.y*m._24 + v.z*m._34 + m._44;
+
+		// Dividing by 1 would not change anything, this is always the case
+		// for affine matrices, skip the divisions
+		if ( r.w == 1.0f )
+			return;
+
+		r.x /= r.w;
+		r.y /= r.w;
+		r.z /= r.w;
+		r.w  = 1.0f;
+	}
+
+	// r = a * b, bAligned tells if all three are 16 byte aligned
+	static inline void Multiply(KPMatrix &r, const KPMatrix &a, const KPMatrix &b, bool bAligned)
+	{
+		const float *pA = &a._11;
+		const float *pB = &b._11;
+		float		fResult[16];
+
+		(void)bAligned;
+
+		for ( unsigned int i = 0; i < 4; ++i )		// Row Number
+		{
+			for ( unsigned int j = 0; j < 4; ++j )  // Column Number
+			{
+				//			  Row * Column
+				fResult[4*i+j] = pA[4*i]   * pB[j]			// First element of row * first element of column (NOTE: 4 floats = 1 row)
+							   + pA[4*i+1] * pB[j+4]		// Second element of row * second element of column
+							   + pA[4*i+2] * pB[j+8]		// third element of row * third element of column
+							   + pA[4*i+3] * pB[j+12];		// fourth element of row * fourth element of column
+			}
+		}
+
+		memcpy(&r._11, fResult, sizeof(fResult));
+	}
+
+	// r = p * q, see KPQuaternion::operator *, r cannot be an operand
+	static inline void Multiply(KPQuaternion &r, const KPQuaternion &p, const KPQuaternion &q)
+	{
+		r.x = q.w*p.x + q.x*p.w + q.y*p.z - q.z*p.y;
+		r.y = q.w*p.y - q.x*p.z + q.y*p.w + q.z*p.x;
+		r.z = q.w*p.z + q.x*p.y - q.y*p.x + q.z*p.w;
+		r.w = q.w*p.w - q.x*p.x - q.y*p.y - q.z*p.z;
+	}
+
+	static inline void Nlerp(KPQuaternion &r, const KPQuaternion &q0, const KPQuaternion &q1, float t)
+	{
+		float fDot  = q0.x*q1.x + q0.y*q1.y + q0.z*q1.z + q0.w*q1.w;
+		float fSign = ( fDot < 0.0f ) ? -1.0f : 1.0f;
+
+		r.x = q0.x + t * ( fSign * q1.x - q0.x );
+		r.y = q0.y + t * ( fSign * q1.y - q0.y );
+		r.z = q0.z + t * ( fSign * q1.z - q0.z );
+		r.w = q0.w + t * ( fSign * q1.w - q0.w );
+
+		float fLength = sqrtf(r.x*r.x + r.y*r.y + r.z*r.z + r.w*r.w);
+
+		r.x /= fLength;
+		r.y /= fLength;
+		r.z /= fLength;
+		r.w /= fLength;
+	}
+
+	// The weights are the series in the Slerp Coefficients section for t and 1 - t
+	static inline void Slerp(KPQuaternion &r, const KPQuaternion &q0, const KPQuaternion &q1, float t)
+	{
+		float d		= 1.0f - t;
+		float fDot  = q0.x*q1.x + q0.y*q1.y + q0.z*q1.z + q0.w*q1.w;
+		float fSign = 1.0f;
+
+		if ( fDot < 0.0f )
+		{
+			fDot  = -fDot;
+			fSign = -1.0f;
+		}
+
+		float xm1  = fDot - 1.0f;
+		float sqT  = t * t;
+		float sqD  = d * d;
+		float fT   = 1.0f;
+		float fD   = 1.0f;
+
+		for ( int i = KPSLERP_TERMS - 1; i >= 0; --i )
+		{
+			fT = 1.0f + ( ( g_fSlerpU[i] * sqT - g_fSlerpV[i] ) * xm1 ) * fT;
+			fD = 1.0f + ( ( g_fSlerpU[i] * sqD - g_fSlerpV[i] ) * xm1 ) * fD;
+		}
+
+		fT *= t;
+		fD *= d;
+
+		r.x = q0.x * fD + ( fSign * q1.x ) * fT;
+		r.y = q0.y * fD + ( fSign * q1.y ) * fT;
+		r.z = q0.z * fD + ( fSign * q1.z ) * fT;
+		r.w = q0.w * fD + ( fSign * q1.w ) * fT;
+	}
+
+	// Rotation part of the matrix of a unit quaternion.
+	// Row vectors, the same rotation direction as KPMatrix::RotateX/Y/Z:
+	//
+	//	1 - 2(yy + zz)	2(xy + wz)		2(xz - wy)
+	//	2(xy - wz)		1 - 2(xx + zz)	2(yz + wx)
+	//	2(xz + wy)		2(yz - wx)		1 - 2(xx + yy)
+	static inline void QuatRows(const KPQuaternion &q, float *r0, float *r1, float *r2)
+	{
+		float x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+
+		float xx2 = q.x * x2, yy2 = q.y * y2, zz2 = q.z * z2;
+		float xy2 = q.x * y2, xz2 = q.x * z2, yz2 = q.y * z2;
+		float wx2 = q.w * x2, wy2 = q.w * y2, wz2 = q.w * z2;
+
+		r0[0] = ( 1.0f - yy2 ) - zz2;
+		r0[1] = xy2 + wz2;
+		r0[2] = xz2 - wy2;
+
+		r1[0] = xy2 - wz2;
+		r1[1] = ( 1.0f - xx2 ) - zz2;
+		r1[2] = yz2 + wx2;
+
+		r2[0] = xz2 + wy2;
+		r2[1] = yz2 - wx2;
+		r2[2] = ( 1.0f - xx2 ) - yy2;
+	}
+
+	// See KPMatrix::ScaleRotateTranslate
+	static inline void ScaleRotateTranslate(KPMatrix &m, const KPVector &vcScale, const KPQuaternion &q, const KPVector &vcPosition)
+	{
+		float r0[3], r1[3], r2[3];
+
+		QuatRows(q, r0, r1, r2);
+
+		m._11 = vcScale.x * r0[0];	m._12 = vcScale.x * r0[1];	m._13 = vcScale.x * r0[2];	m._14 = 0.0f;
+		m._21 = vcScale.y * r1[0];	m._22 = vcScale.y * r1[1];	m._23 = vcScale.y * r1[2];	m._24 = 0.0f;
+		m._31 = vcScale.z * r2[0];	m._32 = vcScale.z * r2[1];	m._33 = vcScale.z * r2[2];	m._34 = 0.0f;
+		m._41 = vcPosition.x;		m._42 = vcPosition.y;		m._43 = vcPosition.z;		m._44 = 1.0f;
+	}
+
+}; // ! KPScalarOps
+
+
+#ifdef KP_SSE
+
+// KPSSEOps ////
+////////////////
+//
+// Evaluated in the same order as KPScalarOps, see Precision in KPSIMD.h
+
+struct KPSSEOps
+{
+	static inline void Add(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		KPSSEStore3( r, _mm_add_ps( KPSSELoad(a), KPSSELoad(b) ) );
+	}
+
+	static inline void Sub(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		KPSSEStore3( r, _mm_sub_ps( KPSSELoad(a), KPSSELoad(b) ) );
+	}
+
+	static inline void Scale(KPVector &r, const KPVector &a, float f)
+	{
+		KPSSEStore3( r, _mm_mul_ps( KPSSELoad(a), _mm_set1_ps(f) ) );
+	}
+
+	static inline void Divide(KPVector &r, const KPVector &a, float f)
+	{
+		KPSSEStore3( r, _mm_div_ps( KPSSELoad(a), _mm_set1_ps(f) ) );
+	}
+
+	static inline float Dot(const KPVector &a, const KPVector &b)
+	{
+		return _mm_cvtss_f32( KPSSEDot3( KPSSELoad(a), KPSSELoad(b) ) );
+	}
+
+	// The dot product of the vector with itself ends up in every element
+	// of the register, a single scalar square root on the first one is enough
+	static inline float Length(const KPVector &a)
+	{
+		__m128 v = KPSSELoad(a);
+
+		return _mm_cvtss_f32( _mm_sqrt_ss( KPSSEDot3(v, v) ) );
+	}
+
+	// We divide instead of multiplying with the RSQRTPS approximation,
+	// that would only give us 12 bits of precision.
+	static inline void Normalize(KPVector &v)
+	{
+		__m128 a		= KPSSELoad(v);
+		__m128 length	= _mm_sqrt_ps( KPSSEDot3(a, a) );
+
+		// Check for NULL vector
+		if ( _mm_cvtss_f32(length) != 0.0f )
+			KPSSEStore3( v, _mm_div_ps(a, length) );
+	}
+
+	// RSQRTSS, refined by a Newton-Raphson step for KPPRECISION_REFINED.
+	// The estimate of 0 and of denormals is infinite, they are left alone.
+	static inline void Normalize(KPVector &v, KPPRECISION Precision)
+	{
+		if ( Precision == KPPRECISION_EXACT )
+		{
+			Normalize(v);
+			return;
+		}
+
+		__m128 a  = KPSSELoad(v);
+		__m128 sq = KPSSEDot3(a, a);
+
+		if ( _mm_cvtss_f32(sq) < FLT_MIN )
+			return;
+
+		__m128 r = _mm_rsqrt_ps(sq);
+
+		if ( Precision == KPPRECISION_REFINED )
+			r = KPSSERsqrtStep(sq, r);
+
+		KPSSEStore3( v, _mm_mul_ps(a, r) );
+	}
+
+	static inline void Cross(KPVector &r, const KPVector &a, const KPVector &b)
+	{
+		_mm_storeu_ps( &r.x, KPSSECross( KPSSELoad(a), KPSSELoad(b) ) );
+		r.w = 1.0f;
+	}
+
+	static inline void Transform(KPVector &r, const KPVector &v, const KPMatrix &m)
+	{
+		__m128 t = KPSSETransform( KPSSELoad(v), m );
+
+		// Divide all four elements by w, unless it is exactly 1 (affine matrix)
+		if ( ( _mm_movemask_ps( _mm_cmpeq_ps( t, _mm_set1_ps(1.0f) ) ) & 8 ) == 0 )
+			t = _mm_div_ps( t, KPSSE_SPLAT(t, 3) );
+
+		_mm_storeu_ps( &r.x, t );
+		r.w = 1.0f;
+	}
+
+	static inline void Multiply(KPMatrix &r, const KPMatrix &a, const KPMatrix &b, bool bAligned)
+	{
+		const float *pA = &a._11;
+		const float *pB = &b._11;
+		float		*pR = &r._11;
+
+#ifdef KP_AVX_STATIC
+		(void)bAligned;
+
+		// The rows of b in both halves of the registers, two rows of a at once
+		__m256 b1 = _mm256_broadcast_ps( (const __m128*)(pB) );
+		__m256 b2 = _mm256_broadcast_ps( (const __m128*)(pB + 4) );
+		__m256 b3 = _mm256_broadcast_ps( (const __m128*)(pB + 8) );
+		__m256 b4 = _mm256_broadcast_ps( (const __m128*)(pB + 12) );
+
+		__m256 r12 = KPAVXMatRows( _mm256_loadu_ps(pA),		b1, b2, b3, b4 );
+		__m256 r34 = KPAVXMatRows( _mm256_loadu_ps(pA + 8), b1, b2, b3, b4 );
+
+		_mm256_storeu_ps(pR,	 r12);
+		_mm256_storeu_ps(pR + 8, r34);
+#else
+		// The rows of b stay in registers for the four rows of a. The rows are
+		// independent, written out they overlap instead of waiting on the loop,
+		// and r is only written after both operands are read.
+		__m128 r1, r2, r3, r4;
+
+		if ( bAligned )
+		{
+			__m128 b1 = _mm_load_ps(pB), b2 = _mm_load_ps(pB + 4), b3 = _mm_load_ps(pB + 8), b4 = _mm_load_ps(pB + 12);
+
+			r1 = KPSSEMatRow( _mm_load_ps(pA),		b1, b2, b3, b4 );
+			r2 = KPSSEMatRow( _mm_load_ps(pA + 4),	b1, b2, b3, b4 );
+			r3 = KPSSEMatRow( _mm_load_ps(pA + 8),	b1, b2, b3, b4 );
+			r4 = KPSSEMatRow( _mm_load_ps(pA + 12),	b1, b2, b3, b4 );
+
+			_mm_store_ps(pR,	  r1);
+			_mm_store_ps(pR + 4,  r2);
+			_mm_store_ps(pR + 8,  r3);
+			_mm_store_ps(pR + 12, r4);
+		}
+		else
+		{
+			__m128 b1 = _mm_loadu_ps(pB), b2 = _mm_loadu_ps(pB + 4), b3 = _mm_loadu_ps(pB + 8), b4 = _mm_loadu_ps(pB + 12);
+
+			r1 = KPSSEMatRow( _mm_loadu_ps(pA),		 b1, b2, b3, b4 );
+			r2 = KPSSEMatRow( _mm_loadu_ps(pA + 4),	 b1, b2, b3, b4 );
+			r3 = KPSSEMatRow( _mm_loadu_ps(pA + 8),	 b1, b2, b3, b4 );
+			r4 = KPSSEMatRow( _mm_loadu_ps(pA + 12), b1, b2, b3, b4 );
+
+			_mm_storeu_ps(pR,	   r1);
+			_mm_storeu_ps(pR + 4,  r2);
+			_mm_storeu_ps(pR + 8,  r3);
+			_mm_storeu_ps(pR + 12, r4);
+		}
+#endif
+	}
+
+	// The columns of the product, the signs flipped by xor
+	static inline void Multiply(KPQuaternion &r, const KPQuaternion &p, const KPQuaternion &q)
+	{
+		__m128 a = _mm_loadu_ps(&p.x);
+		__m128 b = _mm_loadu_ps(&q.x);
+		__m128 s;
+
+		s = _mm_mul_ps( KPSSE_SPLAT(b, 3), a );
+		s = _mm_add_ps( s, _mm_mul_ps( KPSSE_SPLAT(b, 0),
+			_mm_xor_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 1, 2, 3)), _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f) ) ) );
+		s = _mm_add_ps( s, _mm_mul_ps( KPSSE_SPLAT(b, 1),
+			_mm_xor_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)), _mm_setr_ps(0.0f, 0.0f, -0.0f, -0.0f) ) ) );
+		s = _mm_add_ps( s, _mm_mul_ps( KPSSE_SPLAT(b, 2),
+			_mm_xor_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_setr_ps(-0.0f, 0.0f, 0.0f, -0.0f) ) ) );
+
+		_mm_storeu_ps(&r.x, s);
+	}
+
+	static inline void Nlerp(KPQuaternion &r, const KPQuaternion &q0, const KPQuaternion &q1, float t)
+	{
+		__m128 a = _mm_loadu_ps(&q0.x);
+		__m128 b = _mm_loadu_ps(&q1.x);
+
+		// q and -q are the same rotation, flip the sign of q1 for the shorter arc
+		__m128 sign = _mm_and_ps( _mm_cmplt_ps( KPSSEDot4(a, b), _mm_setzero_ps() ), _mm_set1_ps(-0.0f) );
+		b = _mm_xor_ps(b, sign);
+
+		__m128 v = _mm_add_ps( a, _mm_mul_ps( _mm_set1_ps(t), _mm_sub_ps(b, a) ) );
+		__m128 l = _mm_sqrt_ps( KPSSEDot4(v, v) );
+
+		// The length is 0 only if q1 = -q0 and t = 0.5, which the sign flip rules out
+		_mm_storeu_ps( &r.x, _mm_div_ps(v, l) );
+	}
+
+	static inline void Slerp(KPQuaternion &r, const KPQuaternion &q0, const KPQuaternion &q1, float t)
+	{
+		float  d	= 1.0f - t;
+		__m128 a	= _mm_loadu_ps(&q0.x);
+		__m128 b	= _mm_loadu_ps(&q1.x);
+		__m128 dot	= KPSSEDot4(a, b);
+
+		// Shorter arc: cos(a) = |dot|, flip the sign of q1 if dot < 0
+		__m128 sign	= _mm_and_ps( _mm_cmplt_ps( dot, _mm_setzero_ps() ), _mm_set1_ps(-0.0f) );
+		__m128 xm1	= _mm_sub_ps( _mm_xor_ps(dot, sign), _mm_set1_ps(1.0f) );
+
+		// Both series at once: t, 1 - t in the first two elements
+		__m128 td	= _mm_setr_ps(t, d, t, d);
+		__m128 sq	= _mm_mul_ps(td, td);
+		__m128 one	= _mm_set1_ps(1.0f);
+		__m128 f	= one;
+
+		for ( int i = KPSLERP_TERMS - 1; i >= 0; --i )
+		{
+			__m128 bi = _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( _mm_set1_ps(g_fSlerpU[i]), sq ), _mm_set1_ps(g_fSlerpV[i]) ), xm1 );
+			f = _mm_add_ps( one, _mm_mul_ps(bi, f) );
+		}
+
+		f = _mm_mul_ps(f, td);								// weight of q1, weight of q0
+
+		__m128 v = _mm_mul_ps( a, KPSSE_SPLAT(f, 1) );
+		v = _mm_add_ps( v, _mm_mul_ps( _mm_xor_ps(b, sign), KPSSE_SPLAT(f, 0) ) );
+
+		_mm_storeu_ps(&r.x, v);
+	}
+
+	// The three rows of the rotation matrix of a unit quaternion, the w elements are 0
+	static inline void QuatRows(__m128 q, __m128 &r0, __m128 &r1, __m128 &r2)
+	{
+		__m128 q2  = _mm_add_ps(q, q);							// 2x  2y  2z  2w
+		__m128 sq  = _mm_mul_ps(q, q2);							// xx2 yy2 zz2 ww2
+
+		// Main diagonal: (1 - yy2) - zz2, (1 - xx2) - zz2, (1 - xx2) - yy2
+		__m128 d   = _mm_sub_ps( _mm_set1_ps(1.0f), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 0, 0, 1)) );
+		d		   = _mm_sub_ps( d, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 1, 2, 2)) );
+
+		// Zero the w element of the diagonal
+		__m128 h   = _mm_shuffle_ps(d, _mm_setzero_ps(), _MM_SHUFFLE(0, 0, 2, 2));
+		d		   = _mm_shuffle_ps(d, h, _MM_SHUFFLE(2, 0, 1, 0));
+
+		// xz2 xy2 yz2 and wy2 wz2 wx2
+		__m128 v0  = _mm_mul_ps( _mm_shuffle_ps(q, q, _MM_SHUFFLE(3, 1, 0, 0)), _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 2, 1, 2)) );
+		__m128 v1  = _mm_mul_ps( KPSSE_SPLAT(q, 3), _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 0, 2, 1)) );
+
+		__m128 sum = _mm_add_ps(v0, v1);						// xz2+wy2 xy2+wz2 yz2+wx2
+		__m128 dif = _mm_sub_ps(v0, v1);						// xz2-wy2 xy2-wz2 yz2-wx2
+
+		__m128 t0  = _mm_shuffle_ps(sum, dif, _MM_SHUFFLE(1, 0, 2, 1));	// sum.y sum.z dif.x dif.y
+		__m128 t1  = _mm_shuffle_ps(sum, dif, _MM_SHUFFLE(2, 2, 0, 0));	// sum.x sum.x dif.z dif.z
+
+		__m128 a0  = _mm_shuffle_ps(d, t0, _MM_SHUFFLE(2, 0, 3, 0));	// d.x 0 sum.y dif.x
+		__m128 a1  = _mm_shuffle_ps(d, t0, _MM_SHUFFLE(1, 3, 3, 1));	// d.y 0 dif.y sum.z
+		__m128 a2  = _mm_shuffle_ps(d, t1, _MM_SHUFFLE(2, 0, 3, 2));	// d.z 0 sum.x dif.z
+
+		r0 = _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(1, 3, 2, 0));			// d.x	 sum.y dif.x 0
+		r1 = _mm_shuffle_ps(a1, a1, _MM_SHUFFLE(1, 3, 0, 2));			// dif.y d.y   sum.z 0
+		r2 = _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(1, 0, 3, 2));			// sum.x dif.z d.z	 0
+	}
+
+	static inline void ScaleRotateTranslate(KPMatrix &m, const KPVector &vcScale, const KPQuaternion &q, const KPVector &vcPosition)
+	{
+		__m128 r0, r1, r2;
+		__m128 s = KPSSELoad(vcScale);
+		__m128 p = KPSSELoad(vcPosition);
+
+		QuatRows( _mm_loadu_ps(&q.x), r0, r1, r2 );
+
+		// x y z 1
+		__m128 h = _mm_shuffle_ps( p, _mm_set1_ps(1.0f), _MM_SHUFFLE(0, 0, 2, 2) );
+		p		 = _mm_shuffle_ps( p, h, _MM_SHUFFLE(2, 0, 1, 0) );
+
+		_mm_storeu_ps( &m._11, _mm_mul_ps( KPSSE_SPLAT(s, 0), r0 ) );
+		_mm_storeu_ps( &m._21, _mm_mul_ps( KPSSE_SPLAT(s, 1), r1 ) );
+		_mm_storeu_ps( &m._31, _mm_mul_ps( KPSSE_SPLAT(s, 2), r2 ) );
+		_mm_storeu_ps( &m._41, p );
+	}
+
+}; // ! KPSSEOps
+
+#endif // ! KP_SSE
+
+
+// KPOps ////
+// The implementation the class operators use
+#ifdef KP_SSE_STATIC
+	typedef KPSSEOps	KPOps;
+#else
+	typedef KPScalarOps	KPOps;
+#endif
+
+#endif // ! KPKERNELS_H
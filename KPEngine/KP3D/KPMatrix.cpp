@@ -11,15 +11,12 @@
 */
 
 #include "KP3D.h"
+#include "KPKernels.h"
+#include "KPJobs.h"
+#include "KPMemory.h"
 #include <memory.h>
-
-// KPMatrix::Identity ////
-inline void KPMatrix::Identity(void)
-{
-	float *f = (float*)&this->_11;		// Create a pointer that points at the very first element of the matrix
-	memset(f, 0, sizeof(KPMatrix));		// Fills the whole matrix with 0s.
-	_11 = _22 = _33 = _44 = 1.0f;		// Set the values on the main diagonal to 1
-}
+#include <stdlib.h>
+#include <new>				// std::bad_alloc
 
 
 // KPMatrix::RotateX ////
@@ -29,10 +26,11 @@ inline void KPMatrix::Identity(void)
 //
 // NOTE: We use right handed system
 //		 To convert it to left handed system change change signs of all the sines
-inline void KPMatrix::RotateX(float angle)
+void KPMatrix::RotateX(float angle)
 {
-	float fSine		= sinf(angle);
-	float fCosine	= cosf(angle);
+	float fSine, fCosine;
+
+	KPSinCos(angle, &fSine, &fCosine);
 
 /*
 	 X		 Y		 Z		 Tr
@@ -41,18 +39,7 @@ inline void KPMatrix::RotateX(float angle)
 	0.0f    -Sin	Cos		0.0f
 	0.0f	0.0f	0.0f	1.0f
 */
-	float *f = (float*)&this->_11;		// Create a pointer that points at the very first element of the matrix
-	memset(f, 0, sizeof(KPMatrix));		// Fills the whole matrix with 0.0f.
-
-	_11 = _44 = 1.0f;					// X does not change because we rotate around it.
-										// The translation vector is irrelevant for the rotation, leave it as unit vector
-
-	_22 = fCosine;						// Rotated Y coordinates
-	_32 = -fSine;
-	
-	_23	= fSine;						// Rotated Z coordinates
-	_33	= fCosine;
-
+	KPSetRotation(*this, KPAXIS_X, fSine, fCosine);		// Every element once, no memset before
 }
 
 
@@ -63,10 +50,11 @@ inline void KPMatrix::RotateX(float angle)
 //
 // NOTE: We use right handed system
 //		 To convert it to left handed system change signs of all the sines
-inline void KPMatrix::RotateY(float angle)
+void KPMatrix::RotateY(float angle)
 {
-	float fSine		= sinf(angle);
-	float fCosine	= cosf(angle);
+	float fSine, fCosine;
+
+	KPSinCos(angle, &fSine, &fCosine);
 
 /*
 	 X		 Y		 Z		 Tr
@@ -75,17 +63,7 @@ inline void KPMatrix::RotateY(float angle)
 	Sin		0.0f	Cos		0.0f
 	0.0f	0.0f	0.0f	1.0f
 */
-	float *f = (float*)&this->_11;		// Create a pointer that points at the very first element of the matrix
-	memset(f, 0, sizeof(KPMatrix));		// Fills the whole matrix with 0.0f.
-
-	_22 = _44 = 1.0f;					// Y does not change because we rotate around it.
-										// The translation vector is irrelevant for the rotation, leave it as unit vector
-
-	_11 = fCosine;						// Rotated X coordinates
-	_31	= fSine;
-
-	_13	= -fSine;						// Rotated Z coordinates
-	_33 = fCosine;				
+	KPSetRotation(*this, KPAXIS_Y, fSine, fCosine);		// Every element once, no memset before
 }
 
 
@@ -96,10 +74,11 @@ inline void KPMatrix::RotateY(float angle)
 //
 // NOTE: We use right handed system
 //		 To convert it to left handed system change signs of all the sines
-inline void KPMatrix::RotateZ(float angle)
+void KPMatrix::RotateZ(float angle)
 {
-	float fSine		= sinf(angle);
-	float fCosine	= cosf(angle);
+	float fSine, fCosine;
+
+	KPSinCos(angle, &fSine, &fCosine);
 
 /*
 	 X		 Y		 Z		 Tr
@@ -108,18 +87,7 @@ inline void KPMatrix::RotateZ(float angle)
 	0.0f	0.0f	1.0f	0.0f
 	0.0f	0.0f	0.0f	1.0f
 */
-	float *f = (float*)&this->_11;		// Create a pointer that points at the very first element of the matrix
-	memset(f, 0, sizeof(KPMatrix));		// Fills the whole matrix with 0.0f.
-
-	_33 = _44 = 1.0f;					// Z does not change because we rotate around it.
-										// The translation vector is irrelevant for the rotation, leave it as unit vector
-
-	_11 = fCosine;						// Rotated X coordinates
-	_21	= -fSine;
-
-
-	_12	= fSine;						// Rotated Y coordinates
-	_22 = fCosine;				
+	KPSetRotation(*this, KPAXIS_Z, fSine, fCosine);		// Every element once, no memset before
 }
 
 
@@ -127,7 +95,7 @@ inline void KPMatrix::RotateZ(float angle)
 ////////////////////////
 //
 // Creates a rotation matrix around an arbitrary axis
-inline void KPMatrix::Rotate(KPVector aV, float angle)
+void KPMatrix::Rotate(KPVector aV, float angle)
 {
 /*
 
@@ -149,8 +117,9 @@ inline void KPMatrix::Rotate(KPVector aV, float angle)
 	-------------------------------------
 */
 
-	float fSine		= sinf(angle);
-	float fCosine	= cosf(angle);
+	float fSine, fCosine;
+
+	KPSinCos(angle, &fSine, &fCosine);
 	float fSum		= 1.0f - fCosine;
 
 	// Unit vectors magnitude should be 1. sqrt(1) = 1
@@ -180,99 +149,104 @@ inline void KPMatrix::Rotate(KPVector aV, float angle)
 } // ! KPMatrix::Rotate()
 
 
-// KPMatrix::Translate ////
-///////////////////////////
-inline void KPMatrix::Translate(float distX, float distY, float distZ)
+// KPDot3 ////
+// Dot product of the first three elements of two matrix rows
+static inline float KPDot3(const float *a, const float *b)
 {
-	_41	= distX;
-	_42 = distY;
-	_43 = distZ;
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
 }
 
 
-// KPMatrix::TransposeOf ////
-/////////////////////////////
-//
-// It reflects the A matrix by its main diagonal (starts from the top left)
-inline void KPMatrix::TransposeOf(const KPMatrix &m)
+// KPMatrix::GetType ////
+//////////////////////////
+KPMATRIXTYPE KPMatrix::GetType(void) const
 {
-	_11 = m._11;
-	_12 = m._21;
-	_13 = m._31;
-	_14 = m._41;
-
-	_21 = m._12;
-	_22 = m._22;
-	_23 = m._32;
-	_24 = m._42;
-
-	_31 = m._13;
-	_32 = m._23;
-	_33 = m._33;
-	_34 = m._43;
-
-	_41 = m._14;
-	_42 = m._24;
-	_43 = m._34;
-	_44 = m._44;
-}
+	if ( !IsAffine() )
+		return KPMT_GENERAL;
 
+	// The rows of the rotation part have to be orthonormal
+	if ( fabsf( KPDot3(&_11, &_11) - 1.0f ) > KPMATRIX_RIGID_EPSILON ||
+		 fabsf( KPDot3(&_21, &_21) - 1.0f ) > KPMATRIX_RIGID_EPSILON ||
+		 fabsf( KPDot3(&_31, &_31) - 1.0f ) > KPMATRIX_RIGID_EPSILON ||
+		 fabsf( KPDot3(&_11, &_21) ) > KPMATRIX_RIGID_EPSILON ||
+		 fabsf( KPDot3(&_11, &_31) ) > KPMATRIX_RIGID_EPSILON ||
+		 fabsf( KPDot3(&_21, &_31) ) > KPMATRIX_RIGID_EPSILON )
+		return KPMT_AFFINE;
 
-// KPMatrix Operator Overloads ////
-///////////////////////////////////
+	return KPMT_RIGID;
 
-KPMatrix KPMatrix::operator *(const KPMatrix &m) const
-{
-	KPMatrix result;
+} // ! KPMatrix::GetType()
 
-	// Pointers at the first float value of the matrices : _11
-	float *pThis	= (float*)this;
-	float *pM		= (float*)&m;
-	float *pResult	= (float*)&result;
-
-	memset(pResult, 0, sizeof(KPMatrix));		// Fill the whole result matrix with 0.0f
-
-	for ( unsigned int i = 0; i < 4; ++i )		// Row Number (uchar for 1 byte size)
-	{
-		for ( unsigned int j = 0; j < 4; ++j )  // Column Number (uchar for 1 byte size)
-		{
-		//	 Row + Column        Row          Col
-			pResult[4*i+j] += pThis[4*i]   * pM[j];		// First element of row * first element of column (NOTE: 4 is 4*floatsize ~= 4*4 = 16 bytes = 1 row)
-			pResult[4*i+j] += pThis[4*i+1] * pM[j+4];   // Second element of row * second element of column
-			pResult[4*i+j] += pThis[4*i+2] * pM[j+8];   // third element of row * third element of column
-			pResult[4*i+j] += pThis[4*i+3] * pM[j+12];  // fourth element of row * fourth element of column
-		}
-	}
 
-	return result;
+// KPMatrix::InverseOf ////
+///////////////////////////
+void KPMatrix::InverseOf(const KPMatrix &m)
+{
+	InverseOf( m, m.GetType() );
 }
 
 
-KPVector KPMatrix::operator *(const KPVector &v) const
+void KPMatrix::InverseOf(const KPMatrix &m, KPMATRIXTYPE Type)
 {
-	KPVector result;
-
-	result.x = v.x * _11 + v.y * _21 + v.z * _31 + _41;
-	result.y = v.x * _12 + v.y * _22 + v.z * _32 + _42;
-	result.z = v.x * _13 + v.y * _23 + v.z * _33 + _43;
-	result.w = v.x * _14 + v.y * _24 + v.z * _34 + _44;
+	/*
+	Affine matrices (row vectors: p' = p*A + t)
+	-------------------------------------------
+	inverse = | inverse(A)        0 |
+			  | -t * inverse(A)   1 |
+
+	Rigid: inverse(A) = transpose(A), because the rows are orthonormal.
+	Affine: inverse(A) = adj(A) / det(A), the columns of adj(A) are the
+			cross products of the row pairs, det(A) = r1 * (r2 x r3).
+	*/
+	if ( Type != KPMT_GENERAL )
+	{
+		float c[3][3];		// Columns of the inverse rotation part
+		float t[3] = { m._41, m._42, m._43 };
 
-	// At this point vcReturn.w has some value, but we want it to be 1.0f
-	// we have to scale the matrix down by vcReturn.w for this
+		if ( Type == KPMT_RIGID )
+		{
+			c[0][0] = m._11;  c[0][1] = m._12;  c[0][2] = m._13;
+			c[1][0] = m._21;  c[1][1] = m._22;  c[1][2] = m._23;
+			c[2][0] = m._31;  c[2][1] = m._32;  c[2][2] = m._33;
+		}
+		else
+		{
+			// r2 x r3, r3 x r1, r1 x r2
+			c[0][0] = m._22*m._33 - m._23*m._32;
+			c[0][1] = m._23*m._31 - m._21*m._33;
+			c[0][2] = m._21*m._32 - m._22*m._31;
+
+			c[1][0] = m._32*m._13 - m._33*m._12;
+			c[1][1] = m._33*m._11 - m._31*m._13;
+			c[1][2] = m._31*m._12 - m._32*m._11;
+
+			c[2][0] = m._12*m._23 - m._13*m._22;
+			c[2][1] = m._13*m._21 - m._11*m._23;
+			c[2][2] = m._11*m._22 - m._12*m._21;
+
+			float fDet = 1 / KPDot3(&m._11, c[0]);
+
+			for ( int i = 0; i < 3; ++i )
+			{
+				c[i][0] *= fDet;
+				c[i][1] *= fDet;
+				c[i][2] *= fDet;
+			}
+		}
 
-	result.x /= result.w;
-	result.y /= result.w;
-	result.z /= result.w;
-	result.w = 1.0f;
+		// m is not read any more, it can be this matrix
+		_11 = c[0][0];  _12 = c[1][0];  _13 = c[2][0];  _14 = 0.0f;
+		_21 = c[0][1];  _22 = c[1][1];  _23 = c[2][1];  _24 = 0.0f;
+		_31 = c[0][2];  _32 = c[1][2];  _33 = c[2][2];  _34 = 0.0f;
 
-	return result;
-}
+		_41 = -KPDot3(t, c[0]);
+		_42 = -KPDot3(t, c[1]);
+		_43 = -KPDot3(t, c[2]);
+		_44 = 1.0f;
 
+		return;
+	}
 
-// KPMatrix::InverseOf ////
-///////////////////////////
-inline void KPMatrix::InverseOf(const KPMatrix &m)
-{
 	/*
 	How to calculate inverse of NxN square matrix
 	---------------------------------------------
@@ -393,4 +367,177 @@ inline void KPMatrix::InverseOf(const KPMatrix &m)
 	this->_43 *= fDet;  
 	this->_44 *= fDet;
 
-} // ! KPMatrix::InverseOf()
\ No newline at end of file
+} // ! KPMatrix::InverseOf()
+
+
+// KPMatrix::MultiplyArray ////
+///////////////////////////////
+
+// Parameters of a MultiplyArray call, passed to the worker threads
+typedef struct KPMULTIPLYJOB
+{
+	const KPMatrix	*pMatrix;
+	const KPMatrix	*pIn;
+	KPMatrix		*pOut;
+} KPMULTIPLYJOB;
+
+// Array kernels, they multiply the [nBegin, nEnd) range of a call
+typedef void (*KPMULTIPLYKERNEL)(const KPMULTIPLYJOB *pJob, UINT nBegin, UINT nEnd);
+
+static void KPMultiplyArrayScalar(const KPMULTIPLYJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	for ( UINT i = nBegin; i < nEnd; ++i )
+		KPScalarOps::Multiply(pJob->pOut[i], pJob->pIn[i], *pJob->pMatrix, false);
+}
+
+#ifdef KP_SSE
+
+static void KPMultiplyArraySSE(const KPMULTIPLYJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPMatrix &m = *pJob->pMatrix;
+
+	__m128 b1 = _mm_loadu_ps(&m._11);
+	__m128 b2 = _mm_loadu_ps(&m._21);
+	__m128 b3 = _mm_loadu_ps(&m._31);
+	__m128 b4 = _mm_loadu_ps(&m._41);
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const float *pA = &pJob->pIn[i]._11;
+		float		*pR = &pJob->pOut[i]._11;
+
+		__m128 r1 = KPSSEMatRow( _mm_loadu_ps(pA),	   b1, b2, b3, b4 );
+		__m128 r2 = KPSSEMatRow( _mm_loadu_ps(pA + 4),  b1, b2, b3, b4 );
+		__m128 r3 = KPSSEMatRow( _mm_loadu_ps(pA + 8),  b1, b2, b3, b4 );
+		__m128 r4 = KPSSEMatRow( _mm_loadu_ps(pA + 12), b1, b2, b3, b4 );
+
+		_mm_storeu_ps(pR,	   r1);
+		_mm_storeu_ps(pR + 4,  r2);
+		_mm_storeu_ps(pR + 8,  r3);
+		_mm_storeu_ps(pR + 12, r4);
+	}
+}
+
+#endif // ! KP_SSE
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+static void KPMultiplyArrayAVX(const KPMULTIPLYJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPMatrix &m = *pJob->pMatrix;
+
+	// The rows of the right hand side matrix stay in registers
+	__m256 b1 = _mm256_broadcast_ps( (const __m128*)&m._11 );
+	__m256 b2 = _mm256_broadcast_ps( (const __m128*)&m._21 );
+	__m256 b3 = _mm256_broadcast_ps( (const __m128*)&m._31 );
+	__m256 b4 = _mm256_broadcast_ps( (const __m128*)&m._41 );
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const float *pA = &pJob->pIn[i]._11;
+		float		*pR = &pJob->pOut[i]._11;
+
+		__m256 r12 = KPAVXMatRows( _mm256_loadu_ps(pA),		b1, b2, b3, b4 );
+		__m256 r34 = KPAVXMatRows( _mm256_loadu_ps(pA + 8), b1, b2, b3, b4 );
+
+		_mm256_storeu_ps(pR,	 r12);
+		_mm256_storeu_ps(pR + 8, r34);
+	}
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#ifdef KP_AVX512
+KP_TARGET_AVX512_BEGIN
+
+// The whole left matrix in one register, the rows of the right one in all
+// four 128 bit lanes. See KPAVXMatRows.
+static void KPMultiplyArrayAVX512(const KPMULTIPLYJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	__m512 m  = _mm512_loadu_ps( &pJob->pMatrix->_11 );
+	__m512 b1 = _mm512_shuffle_f32x4( m, m, _MM_SHUFFLE(0, 0, 0, 0) );
+	__m512 b2 = _mm512_shuffle_f32x4( m, m, _MM_SHUFFLE(1, 1, 1, 1) );
+	__m512 b3 = _mm512_shuffle_f32x4( m, m, _MM_SHUFFLE(2, 2, 2, 2) );
+	__m512 b4 = _mm512_shuffle_f32x4( m, m, _MM_SHUFFLE(3, 3, 3, 3) );
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		__m512 a = _mm512_loadu_ps( &pJob->pIn[i]._11 );
+		__m512 r;
+
+		r = _mm512_mul_ps( _mm512_permute_ps( a, _MM_SHUFFLE(0, 0, 0, 0) ), b1 );
+#ifdef KP_FMA
+		r = _mm512_fmadd_ps( _mm512_permute_ps( a, _MM_SHUFFLE(1, 1, 1, 1) ), b2, r );
+		r = _mm512_fmadd_ps( _mm512_permute_ps( a, _MM_SHUFFLE(2, 2, 2, 2) ), b3, r );
+		r = _mm512_fmadd_ps( _mm512_permute_ps( a, _MM_SHUFFLE(3, 3, 3, 3) ), b4, r );
+#else
+		r = _mm512_add_ps( r, _mm512_mul_ps( _mm512_permute_ps( a, _MM_SHUFFLE(1, 1, 1, 1) ), b2 ) );
+		r = _mm512_add_ps( r, _mm512_mul_ps( _mm512_permute_ps( a, _MM_SHUFFLE(2, 2, 2, 2) ), b3 ) );
+		r = _mm512_add_ps( r, _mm512_mul_ps( _mm512_permute_ps( a, _MM_SHUFFLE(3, 3, 3, 3) ), b4 ) );
+#endif
+
+		_mm512_storeu_ps( &pJob->pOut[i]._11, r );
+	}
+}
+
+KP_TARGET_AVX512_END
+#endif // ! KP_AVX512
+
+static const KPMULTIPLYKERNEL g_pfnMultiplyArray[KPISA_COUNT] = KPISA_TABLE_AVX512(KPMultiplyArray);
+KPISA_REGISTER(g_pfnMultiplyArray, "matrix multiply");
+
+static void KPMultiplyJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	g_pfnMultiplyArray[g_ISA]( (const KPMULTIPLYJOB*)pParam, nBegin, nEnd );
+}
+
+
+void KPMatrix::MultiplyArray(const KPMatrix *pIn, KPMatrix *pOut, UINT nCount) const
+{
+	KPMULTIPLYJOB job;
+
+	// The right hand side matrix may be one of the outputs
+	KPMatrixA m = *this;
+
+	job.pMatrix = &m;
+	job.pIn		= pIn;
+	job.pOut	= pOut;
+
+	if ( nCount >= KPGetParallelThreshold(KPJOB_MATRIX) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_MATRIX), KPMultiplyJob, &job);
+	else
+		KPMultiplyJob(0, nCount, &job);
+
+} // ! KPMatrix::MultiplyArray()
+
+
+// KPMatrixA ////
+/////////////////
+
+// Aligned heap allocation, the CRT only guarantees 8 or 16 bytes
+void *KPMatrixA::operator new(size_t nSize)
+{
+	void *p = KPAlignedAlloc(nSize, KP_SIMD_ALIGN);
+
+	if ( !p )
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void *KPMatrixA::operator new[](size_t nSize)
+{
+	return KPMatrixA::operator new(nSize);
+}
+
+void KPMatrixA::operator delete(void *p)
+{
+	KPAlignedFree(p);
+}
+
+void KPMatrixA::operator delete[](void *p)
+{
+	KPMatrixA::operator delete(p);
+}
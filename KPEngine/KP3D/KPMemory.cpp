@@ -0,0 +1,74 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPMemory.cpp
+ *  Description: KPEngine aligned memory allocation
+ *
+ *****************************************************************
+*/
+
+#include "KPMemory.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#include <malloc.h>		// _aligned_malloc()
+#endif
+
+
+// KPAlignedAlloc ////
+void *KPAlignedAlloc(size_t nSize, size_t nAlign)
+{
+	void *p;
+
+	// Zero sized blocks are valid, they can be freed
+	if ( nSize == 0 )
+		nSize = 1;
+
+	if ( nAlign < sizeof(void*) )
+		nAlign = sizeof(void*);
+
+#ifdef _WIN32
+	p = _aligned_malloc(nSize, nAlign);
+#else
+	if ( posix_memalign(&p, nAlign, nSize) != 0 )
+		p = NULL;
+#endif
+
+	return p;
+}
+
+
+// KPAlignedRealloc ////
+/////////////////////////
+//
+// _aligned_realloc has no POSIX counterpart, the block is always moved.
+// The callers grow their arrays by large steps, so this is rare.
+void *KPAlignedRealloc(void *p, size_t nOldSize, size_t nNewSize, size_t nAlign)
+{
+	void *pNew = KPAlignedAlloc(nNewSize, nAlign);
+
+	if ( !pNew )
+		return NULL;
+
+	if ( p )
+	{
+		memcpy(pNew, p, nOldSize < nNewSize ? nOldSize : nNewSize);
+		KPAlignedFree(p);
+	}
+
+	return pNew;
+}
+
+
+// KPAlignedFree ////
+void KPAlignedFree(void *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
@@ -0,0 +1,252 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPMemory.h
+ *  Description: KPEngine aligned memory
+ *				 - Aligned allocation
+ *				 - Aligned array container
+ *				 - Aligned STL allocator
+ *				 - Cache line padding
+ *
+ *				 new[] and malloc only guarantee 8 or 16 bytes,
+ *				 so an array of vectors or vertices can start in
+ *				 the middle of a cache line and every AVX load of
+ *				 it can be split in two. The arrays of math types
+ *				 and vertices are allocated here instead, aligned
+ *				 to a cache line and padded to whole cache lines,
+ *				 so two arrays written by different threads never
+ *				 share one.
+ *
+ *****************************************************************
+*/
+
+#ifndef KPMEMORY_H
+#define KPMEMORY_H
+
+#include "KP3D.h"
+
+#include <stddef.h>		// size_t, ptrdiff_t
+#include <string.h>		// memcpy()
+#include <new>			// placement new, std::bad_alloc
+
+// Alignment of the SIMD arrays, the size of an AVX register
+#define KP_SIMD_ALIGN	32
+
+// Size of a cache line, the default alignment of the allocations
+#define KP_CACHE_LINE	64
+
+
+// Aligned Allocation ////
+//////////////////////////
+
+//! Allocates an aligned memory block
+/*!
+	\param [in] nSize size of the block in bytes
+	\param [in] nAlign alignment, power of 2, at least sizeof(void*)
+	\return the block or NULL if there is not enough memory, free it with KPAlignedFree
+*/
+KP3D_API void *KPAlignedAlloc(size_t nSize, size_t nAlign = KP_CACHE_LINE);
+
+//! Changes the size of an aligned memory block
+/*!
+	Works like realloc: the contents are kept up to the smaller size, and
+	on failure NULL is returned and the old block stays valid.
+	\param [in] p block from KPAlignedAlloc or NULL
+	\param [in] nOldSize size of the block in bytes
+	\param [in] nNewSize new size in bytes
+	\param [in] nAlign alignment of the new block
+	\return the new block or NULL if there is not enough memory
+*/
+KP3D_API void *KPAlignedRealloc(void *p, size_t nOldSize, size_t nNewSize, size_t nAlign = KP_CACHE_LINE);
+
+//! Frees a block of KPAlignedAlloc or KPAlignedRealloc, p can be NULL
+KP3D_API void KPAlignedFree(void *p);
+
+
+// Aligned Array ////
+/////////////////////
+
+//! Growable array with aligned storage
+
+//! For math types and vertex structures: the elements are moved with
+//! memcpy and never destructed. The storage starts on a cache line (or
+//! nAlign) boundary and is padded to whole cache lines, the padding counts
+//! into the capacity. The methods return false when out of memory, the
+//! array is unchanged then.
+template <class T, size_t nAlign = KP_CACHE_LINE> class KPAlignedArray
+{
+public:
+	//! Constructor, creates an empty array without storage
+	KPAlignedArray(void) : m_pData(NULL), m_nCount(0), m_nCapacity(0) { }
+
+	//! Destructor
+	~KPAlignedArray(void) { Release(); }
+
+	//! Makes room for nCapacity elements, the count is not changed
+	bool Reserve(UINT nCapacity)
+	{
+		if ( nCapacity <= m_nCapacity )
+			return true;
+
+		// Round the size up to whole cache lines, the rest of the last line is usable too
+		size_t nSize = ( (size_t)nCapacity * sizeof(T) + KP_CACHE_LINE - 1 ) & ~(size_t)( KP_CACHE_LINE - 1 );
+		T *pData = (T*)KPAlignedRealloc(m_pData, (size_t)m_nCount * sizeof(T), nSize, nAlign);
+
+		if ( !pData )
+			return false;
+
+		m_pData		= pData;
+		m_nCapacity	= (UINT)( nSize / sizeof(T) );
+
+		return true;
+	}
+
+	//! Sets the number of elements, the new ones are default constructed
+	bool Resize(UINT nCount)
+	{
+		if ( !Reserve(nCount) )
+			return false;
+
+		for ( UINT i = m_nCount; i < nCount; ++i )
+			::new (m_pData + i) T();
+
+		m_nCount = nCount;
+		return true;
+	}
+
+	//! Sets the number of elements, the new ones are not constructed
+	/*!
+		For trivially constructible types whose new elements are written right
+		after, e.g. by memcpy, where Resize would clear them first.
+	*/
+	bool SetCount(UINT nCount)
+	{
+		if ( !Reserve(nCount) )
+			return false;
+
+		m_nCount = nCount;
+		return true;
+	}
+
+	//! Appends an element, the capacity grows by half
+	/*!
+		t can be an element of the array, it is copied before the storage
+		is reallocated.
+	*/
+	bool PushBack(const T &t)
+	{
+		if ( m_nCount == m_nCapacity )
+		{
+			T tCopy(t);
+
+			if ( !Reserve( m_nCapacity + m_nCapacity / 2 + 1 ) )
+				return false;
+
+			::new (m_pData + m_nCount) T(tCopy);
+		}
+		else
+			::new (m_pData + m_nCount) T(t);
+
+		++m_nCount;
+		return true;
+	}
+
+	//! Empties the array, the storage is kept
+	void Clear(void) { m_nCount = 0; }
+
+	//! Empties the array and frees the storage
+	void Release(void)
+	{
+		KPAlignedFree(m_pData);
+		m_pData		= NULL;
+		m_nCount	= 0;
+		m_nCapacity	= 0;
+	}
+
+	T		*GetData(void)			{ return m_pData; }		//!< First element, NULL without storage
+	const T	*GetData(void) const	{ return m_pData; }		//!< First element, NULL without storage
+	UINT	GetCount(void) const	{ return m_nCount; }	//!< Number of elements
+	UINT	GetCapacity(void) const	{ return m_nCapacity; }	//!< Number of elements that fit in the storage
+	bool	IsEmpty(void) const		{ return m_nCount == 0; }
+
+	T		&operator [] (UINT i)		{ return m_pData[i]; }
+	const T	&operator [] (UINT i) const	{ return m_pData[i]; }
+
+private:
+	T		*m_pData;			// Storage
+	UINT	m_nCount;			// Number of elements
+	UINT	m_nCapacity;		// Number of elements the storage can hold
+
+	// Not copyable
+	KPAlignedArray(const KPAlignedArray &);
+	KPAlignedArray &operator = (const KPAlignedArray &);
+
+}; // ! KPAlignedArray class
+
+
+// Aligned STL Allocator ////
+/////////////////////////////
+
+//! Allocator for the STL containers, e.g. std::vector<KPMatrixA, KPAlignedAllocator<KPMatrixA> >
+
+//! The default allocator ignores the alignment of the types before C++17.
+//! Throws std::bad_alloc like the default one.
+template <class T, size_t nAlign = KP_CACHE_LINE> class KPAlignedAllocator
+{
+public:
+	typedef T			value_type;
+	typedef T			*pointer;
+	typedef const T		*const_pointer;
+	typedef T			&reference;
+	typedef const T		&const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template <class U> struct rebind { typedef KPAlignedAllocator<U, nAlign> other; };
+
+	KPAlignedAllocator(void) { }
+	template <class U> KPAlignedAllocator(const KPAlignedAllocator<U, nAlign> &) { }
+
+	pointer			address(reference r) const			{ return &r; }
+	const_pointer	address(const_reference r) const	{ return &r; }
+	size_type		max_size(void) const				{ return (size_type)-1 / sizeof(T); }
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		void *p = KPAlignedAlloc(n * sizeof(T), nAlign);
+
+		if ( !p && n )
+			throw std::bad_alloc();
+
+		return (pointer)p;
+	}
+
+	void deallocate(pointer p, size_type) { KPAlignedFree(p); }
+
+	void construct(pointer p, const T &t)	{ ::new (p) T(t); }
+	void destroy(pointer p)					{ p->~T(); }
+
+	bool operator == (const KPAlignedAllocator &) const { return true; }
+	bool operator != (const KPAlignedAllocator &) const { return false; }
+
+}; // ! KPAlignedAllocator class
+
+
+// Cache Line Padding ////
+//////////////////////////
+
+//! Value on its own cache line
+
+//! For data written by different threads, e.g. per thread counters: two
+//! of them in an array never share a cache line, so the threads do not
+//! take the line from each other on every write. Arrays of it have to be
+//! allocated by KPAlignedArray or be static, new[] does not align them.
+template <class T> struct KP_ALIGN(KP_CACHE_LINE) KPCachePadded
+{
+	T Value;
+};
+
+#endif // ! KPMEMORY_H
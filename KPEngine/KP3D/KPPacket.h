@@ -0,0 +1,807 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPPacket.h
+ *  Description: KPEngine Math Library vector packets
+ *				 - KPVector4x, KPVector8x: 4 and 8 vectors in
+ *				   structure of arrays registers
+ *				 - KPMatrix4x, KPMatrix8x: broadcast matrices
+ *				 - Gather and scatter of strided vertex arrays
+ *				   and SoA streams
+ *
+ *				 The array kernels are written once per
+ *				 instruction set with intrinsics. An algorithm
+ *				 written with the packets instead reads like
+ *				 KPVector code and runs 4 or 8 vectors wide.
+ *
+ *****************************************************************
+*/
+
+#ifndef KPPACKET_H
+#define KPPACKET_H
+
+#include "KP3D.h"
+#include "KPKernels.h"
+
+/*
+	A packet holds the x, y and z coordinates of 4 (8) vectors in three
+	registers, one vector per lane. Every operation of KPVector has a
+	packet version, evaluated in the same order per lane, so lane i of a
+	packet result is bit identical to the KPVector operation on vector i.
+
+	The lanes are a class of static operations (like KPScalarOps and
+	KPSSEOps for KPVector) chosen at compile time:
+	  KPVector4x - SSE registers when the compiler targets SSE
+				   (KP_SSE_STATIC), otherwise 4 floats.
+	  KPVector8x - AVX registers when the compiler targets AVX
+				   (KP_AVX_STATIC), otherwise two KPVector4x halves.
+	The packets are plain inline code of the caller's instruction set,
+	they are not dispatched at runtime like the array kernels.
+
+	Usage, the normals of a VERTEX array rotated by a matrix:
+
+		KPMatrix8x m(mRotation);
+
+		for ( UINT i = 0; i < n; i += KPVector8x::WIDTH )
+		{
+			KPVector8x v;
+
+			v.Gather(pVertices[i].vcNormal, sizeof(VERTEX), n - i);
+			v = v.TransformAffine(m);
+			v.Normalize(KPPRECISION_REFINED);
+			v.Scatter(pVertices[i].vcNormal, sizeof(VERTEX), n - i);
+		}
+*/
+
+
+// KPScalarLanes ////
+/////////////////////
+//
+// N floats, the lanes of the builds without SSE
+
+template <int N> struct KPScalarLanes
+{
+	enum { WIDTH = N };
+
+	struct REG	{ float f[N]; };
+	struct MASK	{ bool  b[N]; };
+
+	static inline REG Set1(float a)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = a;
+		return r;
+	}
+
+	static inline REG Load(const float *p)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = p[i];
+		return r;
+	}
+
+	static inline void Store(float *p, const REG &a)
+	{
+		for ( int i = 0; i < N; ++i ) p[i] = a.f[i];
+	}
+
+	static inline REG Add(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = a.f[i] + b.f[i];
+		return r;
+	}
+
+	static inline REG Sub(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = a.f[i] - b.f[i];
+		return r;
+	}
+
+	static inline REG Mul(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = a.f[i] * b.f[i];
+		return r;
+	}
+
+	static inline REG Div(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = a.f[i] / b.f[i];
+		return r;
+	}
+
+	static inline REG Sqrt(const REG &a)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = sqrtf(a.f[i]);
+		return r;
+	}
+
+	// Plain C++ has no estimate, both are the exact reciprocal like KPScalarOps::Normalize
+	static inline REG RsqrtFast(const REG &a)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = 1.0f / sqrtf(a.f[i]);
+		return r;
+	}
+
+	static inline REG RsqrtRefined(const REG &a)
+	{
+		return RsqrtFast(a);
+	}
+
+	// b where a is NaN, like MINPS and MAXPS
+	static inline REG Min(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = ( a.f[i] < b.f[i] ) ? a.f[i] : b.f[i];
+		return r;
+	}
+
+	static inline REG Max(const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = ( a.f[i] > b.f[i] ) ? a.f[i] : b.f[i];
+		return r;
+	}
+
+	static inline MASK Equal(const REG &a, const REG &b)
+	{
+		MASK m;
+		for ( int i = 0; i < N; ++i ) m.b[i] = ( a.f[i] == b.f[i] );
+		return m;
+	}
+
+	static inline MASK Less(const REG &a, const REG &b)
+	{
+		MASK m;
+		for ( int i = 0; i < N; ++i ) m.b[i] = ( a.f[i] < b.f[i] );
+		return m;
+	}
+
+	// a in the lanes of the mask, b in the rest
+	static inline REG Select(const MASK &m, const REG &a, const REG &b)
+	{
+		REG r;
+		for ( int i = 0; i < N; ++i ) r.f[i] = m.b[i] ? a.f[i] : b.f[i];
+		return r;
+	}
+
+	static inline void Gather(const float *p, UINT nStride, REG &x, REG &y, REG &z)
+	{
+		for ( int i = 0; i < N; ++i, p = (const float*)( (const char*)p + nStride ) )
+		{
+			x.f[i] = p[0];
+			y.f[i] = p[1];
+			z.f[i] = p[2];
+		}
+	}
+
+	static inline void Scatter(float *p, UINT nStride, const REG &x, const REG &y, const REG &z)
+	{
+		for ( int i = 0; i < N; ++i, p = (float*)( (char*)p + nStride ) )
+		{
+			p[0] = x.f[i];
+			p[1] = y.f[i];
+			p[2] = z.f[i];
+		}
+	}
+}; // ! KPScalarLanes
+
+
+// KPPairLanes ////
+///////////////////
+//
+// Two halves of a narrower lane class, the 8 wide lanes without AVX
+
+template <class L> struct KPPairLanes
+{
+	enum { WIDTH = L::WIDTH * 2 };
+
+	struct REG	{ typename L::REG  lo, hi; };
+	struct MASK	{ typename L::MASK lo, hi; };
+
+	static inline REG Pair(const typename L::REG &lo, const typename L::REG &hi)
+	{
+		REG r = { lo, hi };
+		return r;
+	}
+
+	// The masks of L can be its registers, they get their own name
+	static inline MASK PairMask(const typename L::MASK &lo, const typename L::MASK &hi)
+	{
+		MASK m = { lo, hi };
+		return m;
+	}
+
+	static inline REG  Set1(float a)						{ return Pair( L::Set1(a), L::Set1(a) ); }
+	static inline REG  Load(const float *p)					{ return Pair( L::Load(p), L::Load(p + L::WIDTH) ); }
+	static inline REG  Add(const REG &a, const REG &b)		{ return Pair( L::Add(a.lo, b.lo), L::Add(a.hi, b.hi) ); }
+	static inline REG  Sub(const REG &a, const REG &b)		{ return Pair( L::Sub(a.lo, b.lo), L::Sub(a.hi, b.hi) ); }
+	static inline REG  Mul(const REG &a, const REG &b)		{ return Pair( L::Mul(a.lo, b.lo), L::Mul(a.hi, b.hi) ); }
+	static inline REG  Div(const REG &a, const REG &b)		{ return Pair( L::Div(a.lo, b.lo), L::Div(a.hi, b.hi) ); }
+	static inline REG  Sqrt(const REG &a)					{ return Pair( L::Sqrt(a.lo), L::Sqrt(a.hi) ); }
+	static inline REG  RsqrtFast(const REG &a)				{ return Pair( L::RsqrtFast(a.lo), L::RsqrtFast(a.hi) ); }
+	static inline REG  RsqrtRefined(const REG &a)			{ return Pair( L::RsqrtRefined(a.lo), L::RsqrtRefined(a.hi) ); }
+	static inline REG  Min(const REG &a, const REG &b)		{ return Pair( L::Min(a.lo, b.lo), L::Min(a.hi, b.hi) ); }
+	static inline REG  Max(const REG &a, const REG &b)		{ return Pair( L::Max(a.lo, b.lo), L::Max(a.hi, b.hi) ); }
+	static inline MASK Equal(const REG &a, const REG &b)	{ return PairMask( L::Equal(a.lo, b.lo), L::Equal(a.hi, b.hi) ); }
+	static inline MASK Less(const REG &a, const REG &b)		{ return PairMask( L::Less(a.lo, b.lo), L::Less(a.hi, b.hi) ); }
+
+	static inline REG Select(const MASK &m, const REG &a, const REG &b)
+	{
+		return Pair( L::Select(m.lo, a.lo, b.lo), L::Select(m.hi, a.hi, b.hi) );
+	}
+
+	static inline void Store(float *p, const REG &a)
+	{
+		L::Store(p, a.lo);
+		L::Store(p + L::WIDTH, a.hi);
+	}
+
+	static inline void Gather(const float *p, UINT nStride, REG &x, REG &y, REG &z)
+	{
+		L::Gather(p, nStride, x.lo, y.lo, z.lo);
+		L::Gather( (const float*)( (const char*)p + nStride * L::WIDTH ), nStride, x.hi, y.hi, z.hi );
+	}
+
+	static inline void Scatter(float *p, UINT nStride, const REG &x, const REG &y, const REG &z)
+	{
+		L::Scatter(p, nStride, x.lo, y.lo, z.lo);
+		L::Scatter( (float*)( (char*)p + nStride * L::WIDTH ), nStride, x.hi, y.hi, z.hi );
+	}
+}; // ! KPPairLanes
+
+
+#ifdef KP_SSE
+
+// KPSSELanes ////
+//////////////////
+//
+// The estimates are the ones of KPSSEOps::Normalize, see KPSSERsqrtStep
+
+struct KPSSELanes
+{
+	enum { WIDTH = 4 };
+
+	typedef __m128 REG;
+	typedef __m128 MASK;
+
+	static inline REG  Set1(float a)				{ return _mm_set1_ps(a); }
+	static inline REG  Load(const float *p)			{ return _mm_loadu_ps(p); }
+	static inline void Store(float *p, REG a)		{ _mm_storeu_ps(p, a); }
+	static inline REG  Add(REG a, REG b)			{ return _mm_add_ps(a, b); }
+	static inline REG  Sub(REG a, REG b)			{ return _mm_sub_ps(a, b); }
+	static inline REG  Mul(REG a, REG b)			{ return _mm_mul_ps(a, b); }
+	static inline REG  Div(REG a, REG b)			{ return _mm_div_ps(a, b); }
+	static inline REG  Sqrt(REG a)					{ return _mm_sqrt_ps(a); }
+	static inline REG  RsqrtFast(REG a)				{ return _mm_rsqrt_ps(a); }
+	static inline REG  RsqrtRefined(REG a)			{ return KPSSERsqrtStep( a, _mm_rsqrt_ps(a) ); }
+	static inline REG  Min(REG a, REG b)			{ return _mm_min_ps(a, b); }
+	static inline REG  Max(REG a, REG b)			{ return _mm_max_ps(a, b); }
+	static inline MASK Equal(REG a, REG b)			{ return _mm_cmpeq_ps(a, b); }
+	static inline MASK Less(REG a, REG b)			{ return _mm_cmplt_ps(a, b); }
+
+	static inline REG Select(MASK m, REG a, REG b)
+	{
+		return _mm_or_ps( _mm_and_ps(m, a), _mm_andnot_ps(m, b) );
+	}
+
+	static inline void Gather(const float *p, UINT nStride, REG &x, REG &y, REG &z)
+	{
+		KPSSEGather( (const char*)p, nStride, x, y, z );
+	}
+
+	static inline void Scatter(float *p, UINT nStride, REG x, REG y, REG z)
+	{
+		KPSSEScatter( (char*)p, nStride, x, y, z );
+	}
+}; // ! KPSSELanes
+
+#endif // ! KP_SSE
+
+
+#ifdef KP_AVX_STATIC
+
+// KPAVXLanes ////
+//////////////////
+//
+// Only when the compiler targets AVX: the packets are inlined into code
+// that runs on every CPU, there is no target region around them.
+
+struct KPAVXLanes
+{
+	enum { WIDTH = 8 };
+
+	typedef __m256 REG;
+	typedef __m256 MASK;
+
+	static inline REG  Set1(float a)				{ return _mm256_set1_ps(a); }
+	static inline REG  Load(const float *p)			{ return _mm256_loadu_ps(p); }
+	static inline void Store(float *p, REG a)		{ _mm256_storeu_ps(p, a); }
+	static inline REG  Add(REG a, REG b)			{ return _mm256_add_ps(a, b); }
+	static inline REG  Sub(REG a, REG b)			{ return _mm256_sub_ps(a, b); }
+	static inline REG  Mul(REG a, REG b)			{ return _mm256_mul_ps(a, b); }
+	static inline REG  Div(REG a, REG b)			{ return _mm256_div_ps(a, b); }
+	static inline REG  Sqrt(REG a)					{ return _mm256_sqrt_ps(a); }
+	static inline REG  RsqrtFast(REG a)				{ return _mm256_rsqrt_ps(a); }
+	static inline REG  RsqrtRefined(REG a)			{ return KPAVXRsqrtStep( a, _mm256_rsqrt_ps(a) ); }
+	static inline REG  Min(REG a, REG b)			{ return _mm256_min_ps(a, b); }
+	static inline REG  Max(REG a, REG b)			{ return _mm256_max_ps(a, b); }
+	static inline MASK Equal(REG a, REG b)			{ return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	static inline MASK Less(REG a, REG b)			{ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static inline REG  Select(MASK m, REG a, REG b)	{ return _mm256_blendv_ps(b, a, m); }
+
+	// Two 4 vertex transposes, like the AVX array kernels
+	static inline void Gather(const float *p, UINT nStride, REG &x, REG &y, REG &z)
+	{
+		__m128 x0, y0, z0, x1, y1, z1;
+
+		KPSSEGather( (const char*)p, nStride, x0, y0, z0 );
+		KPSSEGather( (const char*)p + nStride * 4, nStride, x1, y1, z1 );
+
+		x = KPAVX_JOIN(x0, x1);
+		y = KPAVX_JOIN(y0, y1);
+		z = KPAVX_JOIN(z0, z1);
+	}
+
+	static inline void Scatter(float *p, UINT nStride, REG x, REG y, REG z)
+	{
+		KPSSEScatter( (char*)p, nStride, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z) );
+		KPSSEScatter( (char*)p + nStride * 4, nStride,
+					  _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1) );
+	}
+}; // ! KPAVXLanes
+
+#endif // ! KP_AVX_STATIC
+
+
+// KPLanes4, KPLanes8 ////
+// The lanes of the packets
+#ifdef KP_SSE_STATIC
+	typedef KPSSELanes					KPLanes4;
+#else
+	typedef KPScalarLanes<4>			KPLanes4;
+#endif
+
+#ifdef KP_AVX_STATIC
+	typedef KPAVXLanes					KPLanes8;
+#else
+	typedef KPPairLanes<KPLanes4>		KPLanes8;
+#endif
+
+
+template <class L> class KPMatrixPacket;
+
+//! Packet of vectors in structure of arrays registers
+
+//! Lane i of every result is the result of the KPVector operation on
+//! vector i, bit for bit. The w coordinate is not stored, it is 1 like
+//! in the results of the KPVector operators.
+template <class L> class KPVectorPacket
+{
+public:
+	typedef L					LANES;
+	typedef typename L::REG		FLOATS;					//!< One float per lane
+
+	enum { WIDTH = L::WIDTH };							//!< Number of vectors
+
+	FLOATS x, y, z;										// Vector coordinates
+
+	//! Default constructor, null vectors
+	KPVectorPacket(void) : x( L::Set1(0.0f) ), y( L::Set1(0.0f) ), z( L::Set1(0.0f) ) { }
+
+	//! Constructor that takes the coordinate registers
+	KPVectorPacket(const FLOATS &_x, const FLOATS &_y, const FLOATS &_z) : x(_x), y(_y), z(_z) { }
+
+	//! Constructor that copies a vector into every lane
+	explicit KPVectorPacket(const KPVector &v) : x( L::Set1(v.x) ), y( L::Set1(v.y) ), z( L::Set1(v.z) ) { }
+
+	////
+	// Loading and Storing
+	////
+
+	//! Loads strided vectors, e.g. the positions or the normals of a VERTEX array
+	/*!
+		With at least 16 bytes between the vectors 4 floats are read from every
+		vector, like KPNormalizeArray.
+		\param [in] p pointer to the x coordinate of the first vector, y and z have to follow it
+		\param [in] nStride distance of two vectors in bytes
+		\param [in] nCount number of vectors to load, the lanes above it are null vectors
+	*/
+	void	Gather(const float *p, UINT nStride, UINT nCount = WIDTH);
+
+	//! Stores the vectors of the lanes below nCount at the strided pointer, the rest of the vertices is untouched
+	void	Scatter(float *p, UINT nStride, UINT nCount = WIDTH) const;
+
+	//! Loads the vectors nIndex.. of SoA streams, the lanes from nCount are null vectors
+	void	Load(const KPSOASTREAM &Stream, UINT nIndex, UINT nCount = WIDTH);
+
+	//! Stores the vectors of the lanes below nCount into SoA streams from nIndex
+	void	Store(const KPSOASTREAM &Stream, UINT nIndex, UINT nCount = WIDTH) const;
+
+	//! Returns the vector of a lane
+	KPVector Get(UINT nLane) const;
+
+	////
+	// Member Functions, see KPVector
+	////
+
+	//! Negates the vectors
+	void	Negate(void);
+
+	//! Normalizes the vectors, the null vectors are left as they are
+	void	Normalize(void);
+
+	//! Normalizes the vectors with the given accuracy, see KPVector::Normalize(KPPRECISION)
+	void	Normalize(KPPRECISION Precision);
+
+	//! Calculates the differences v2 - v1
+	void	Difference(const KPVectorPacket &v1, const KPVectorPacket &v2);
+
+	//! Calculates the cross products of two packets
+	void	Cross(const KPVectorPacket &v1, const KPVectorPacket &v2);
+
+	//! Calculates the lengths of the vectors
+	FLOATS	GetLength(void) const;
+
+	//! Calculates the squared lengths of the vectors
+	FLOATS	GetSqaredLength(void) const;
+
+	// Operator Overloads ////
+	KPVectorPacket operator  + (const KPVectorPacket &v) const;		//!< Vector addition
+	void		   operator += (const KPVectorPacket &v);			//!< Vector addition
+
+	KPVectorPacket operator  - (const KPVectorPacket &v) const;		//!< Vector subtraction
+	void		   operator -= (const KPVectorPacket &v);			//!< Vector subtraction
+
+	KPVectorPacket operator  * (const float f)	const;				//!< Vector scaling
+	KPVectorPacket operator  * (const FLOATS &f) const;				//!< Vector scaling, one factor per lane
+	void		   operator *= (const float f);						//!< Vector scaling
+	void		   operator /= (const float f);						//!< Vector scaling
+
+	FLOATS		   operator  * (const KPVectorPacket &v) const;		//!< Dot Products of the lanes
+	KPVectorPacket operator  * (const KPMatrixPacket<L> &m) const;	//!< Vector * Matrix products, divided by w
+
+	//! Vector * Matrix products of an affine matrix, without the division by w
+	KPVectorPacket TransformAffine(const KPMatrixPacket<L> &m) const;
+
+}; // ! KPVectorPacket class
+
+
+//! Matrix broadcast into every lane of a packet
+
+//! The elements are splatted once, a vector * matrix product
+//! of a packet then needs no shuffles.
+template <class L> class KPMatrixPacket
+{
+public:
+	typedef typename L::REG		FLOATS;
+
+	FLOATS _11, _12, _13, _14;
+	FLOATS _21, _22, _23, _24;
+	FLOATS _31, _32, _33, _34;
+	FLOATS _41, _42, _43, _44;
+
+	//! Identity matrix
+	KPMatrixPacket(void) { KPMatrix m; m.Identity(); Set(m); }
+
+	//! Broadcasts a matrix
+	explicit KPMatrixPacket(const KPMatrix &m) { Set(m); }
+
+	//! Broadcasts a matrix
+	void	Set(const KPMatrix &m);
+
+}; // ! KPMatrixPacket class
+
+
+// Packet Types ////
+typedef KPVectorPacket<KPLanes4>	KPVector4x;
+typedef KPVectorPacket<KPLanes8>	KPVector8x;
+typedef KPMatrixPacket<KPLanes4>	KPMatrix4x;
+typedef KPMatrixPacket<KPLanes8>	KPMatrix8x;
+
+
+// KPVectorPacket ////
+//////////////////////
+
+// KPVectorPacket::Gather ////
+// A partial packet goes through a buffer, so the full ones need no checks in the lane code
+template <class L> inline void KPVectorPacket<L>::Gather(const float *p, UINT nStride, UINT nCount)
+{
+	if ( nCount >= WIDTH )
+	{
+		L::Gather(p, nStride, x, y, z);
+		return;
+	}
+
+	float fX[WIDTH] = { 0.0f }, fY[WIDTH] = { 0.0f }, fZ[WIDTH] = { 0.0f };
+
+	for ( UINT i = 0; i < nCount; ++i, p = (const float*)( (const char*)p + nStride ) )
+	{
+		fX[i] = p[0];
+		fY[i] = p[1];
+		fZ[i] = p[2];
+	}
+
+	x = L::Load(fX);
+	y = L::Load(fY);
+	z = L::Load(fZ);
+}
+
+
+// KPVectorPacket::Scatter ////
+template <class L> inline void KPVectorPacket<L>::Scatter(float *p, UINT nStride, UINT nCount) const
+{
+	if ( nCount >= WIDTH )
+	{
+		L::Scatter(p, nStride, x, y, z);
+		return;
+	}
+
+	float fX[WIDTH], fY[WIDTH], fZ[WIDTH];
+
+	L::Store(fX, x);
+	L::Store(fY, y);
+	L::Store(fZ, z);
+
+	for ( UINT i = 0; i < nCount; ++i, p = (float*)( (char*)p + nStride ) )
+	{
+		p[0] = fX[i];
+		p[1] = fY[i];
+		p[2] = fZ[i];
+	}
+}
+
+
+// KPVectorPacket::Load ////
+template <class L> inline void KPVectorPacket<L>::Load(const KPSOASTREAM &Stream, UINT nIndex, UINT nCount)
+{
+	if ( nCount >= WIDTH )
+	{
+		x = L::Load(Stream.pX + nIndex);
+		y = L::Load(Stream.pY + nIndex);
+		z = L::Load(Stream.pZ + nIndex);
+		return;
+	}
+
+	float fX[WIDTH] = { 0.0f }, fY[WIDTH] = { 0.0f }, fZ[WIDTH] = { 0.0f };
+
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		fX[i] = Stream.pX[nIndex + i];
+		fY[i] = Stream.pY[nIndex + i];
+		fZ[i] = Stream.pZ[nIndex + i];
+	}
+
+	x = L::Load(fX);
+	y = L::Load(fY);
+	z = L::Load(fZ);
+}
+
+
+// KPVectorPacket::Store ////
+template <class L> inline void KPVectorPacket<L>::Store(const KPSOASTREAM &Stream, UINT nIndex, UINT nCount) const
+{
+	if ( nCount >= WIDTH )
+	{
+		L::Store(Stream.pX + nIndex, x);
+		L::Store(Stream.pY + nIndex, y);
+		L::Store(Stream.pZ + nIndex, z);
+		return;
+	}
+
+	float fX[WIDTH], fY[WIDTH], fZ[WIDTH];
+
+	L::Store(fX, x);
+	L::Store(fY, y);
+	L::Store(fZ, z);
+
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		Stream.pX[nIndex + i] = fX[i];
+		Stream.pY[nIndex + i] = fY[i];
+		Stream.pZ[nIndex + i] = fZ[i];
+	}
+}
+
+
+// KPVectorPacket::Get ////
+template <class L> inline KPVector KPVectorPacket<L>::Get(UINT nLane) const
+{
+	float fX[WIDTH], fY[WIDTH], fZ[WIDTH];
+
+	L::Store(fX, x);
+	L::Store(fY, y);
+	L::Store(fZ, z);
+
+	return KPVector( fX[nLane], fY[nLane], fZ[nLane] );
+}
+
+
+// KPVectorPacket::Negate ////
+// -1 * x, which flips the sign of the zeros too, unlike 0 - x
+template <class L> inline void KPVectorPacket<L>::Negate(void)
+{
+	FLOATS m = L::Set1(-1.0f);
+
+	x = L::Mul(x, m);
+	y = L::Mul(y, m);
+	z = L::Mul(z, m);
+}
+
+
+// KPVectorPacket::Normalize ////
+//////////////////////////////////
+//
+// The lanes of the null vectors are divided by 1 instead of skipped, which
+// leaves them as they are like KPVector::Normalize does.
+template <class L> inline void KPVectorPacket<L>::Normalize(void)
+{
+	FLOATS fOne		= L::Set1(1.0f);
+	FLOATS fLength	= L::Sqrt( GetSqaredLength() );
+
+	fLength = L::Select( L::Equal( fLength, L::Set1(0.0f) ), fOne, fLength );
+
+	x = L::Div(x, fLength);
+	y = L::Div(y, fLength);
+	z = L::Div(z, fLength);
+}
+
+// Squared lengths below FLT_MIN are multiplied by 1, their estimate is infinite
+template <class L> inline void KPVectorPacket<L>::Normalize(KPPRECISION Precision)
+{
+	if ( Precision == KPPRECISION_EXACT )
+	{
+		Normalize();
+		return;
+	}
+
+	FLOATS fSqLength = GetSqaredLength();
+	FLOATS fInv		 = ( Precision == KPPRECISION_REFINED ) ? L::RsqrtRefined(fSqLength) : L::RsqrtFast(fSqLength);
+
+	fInv = L::Select( L::Less( fSqLength, L::Set1(FLT_MIN) ), L::Set1(1.0f), fInv );
+
+	x = L::Mul(x, fInv);
+	y = L::Mul(y, fInv);
+	z = L::Mul(z, fInv);
+}
+
+
+// KPVectorPacket::Difference ////
+template <class L> inline void KPVectorPacket<L>::Difference(const KPVectorPacket &v1, const KPVectorPacket &v2)
+{
+	x = L::Sub(v2.x, v1.x);
+	y = L::Sub(v2.y, v1.y);
+	z = L::Sub(v2.z, v1.z);
+}
+
+
+// KPVectorPacket::Cross ////
+// See KPScalarOps::Cross, the operands can be this packet
+template <class L> inline void KPVectorPacket<L>::Cross(const KPVectorPacket &v1, const KPVectorPacket &v2)
+{
+	FLOATS cx = L::Sub( L::Mul(v1.y, v2.z), L::Mul(v1.z, v2.y) );
+	FLOATS cy = L::Sub( L::Mul(v1.z, v2.x), L::Mul(v1.x, v2.z) );
+	FLOATS cz = L::Sub( L::Mul(v1.x, v2.y), L::Mul(v1.y, v2.x) );
+
+	x = cx;
+	y = cy;
+	z = cz;
+}
+
+
+// KPVectorPacket::GetLength ////
+template <class L> inline typename L::REG KPVectorPacket<L>::GetLength(void) const
+{
+	return L::Sqrt( GetSqaredLength() );
+}
+
+
+// KPVectorPacket::GetSqaredLength ////
+template <class L> inline typename L::REG KPVectorPacket<L>::GetSqaredLength(void) const
+{
+	return *this * *this;
+}
+
+
+// KPVectorPacket Operator Overloads ////
+//////////////////////////////////////////
+
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::operator +(const KPVectorPacket &v) const
+{
+	return KPVectorPacket( L::Add(x, v.x), L::Add(y, v.y), L::Add(z, v.z) );
+}
+
+template <class L> inline void KPVectorPacket<L>::operator +=(const KPVectorPacket &v)
+{
+	*this = *this + v;
+}
+
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::operator -(const KPVectorPacket &v) const
+{
+	return KPVectorPacket( L::Sub(x, v.x), L::Sub(y, v.y), L::Sub(z, v.z) );
+}
+
+template <class L> inline void KPVectorPacket<L>::operator -=(const KPVectorPacket &v)
+{
+	*this = *this - v;
+}
+
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::operator *(const float f) const
+{
+	return *this * L::Set1(f);
+}
+
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::operator *(const FLOATS &f) const
+{
+	return KPVectorPacket( L::Mul(x, f), L::Mul(y, f), L::Mul(z, f) );
+}
+
+template <class L> inline void KPVectorPacket<L>::operator *=(const float f)
+{
+	*this = *this * f;
+}
+
+template <class L> inline void KPVectorPacket<L>::operator /=(const float f)
+{
+	FLOATS d = L::Set1(f);
+
+	x = L::Div(x, d);
+	y = L::Div(y, d);
+	z = L::Div(z, d);
+}
+
+// Evaluated as (x + y) + z, like KPSSEDot3
+template <class L> inline typename L::REG KPVectorPacket<L>::operator *(const KPVectorPacket &v) const
+{
+	return L::Add( L::Add( L::Mul(x, v.x), L::Mul(y, v.y) ), L::Mul(z, v.z) );
+}
+
+
+// Vector * Matrix ////
+////////////////////////
+//
+// Evaluated as ((x*_1j + y*_2j) + z*_3j) + _4j, like KPSSETransform.
+// KPVector skips the division when w is exactly 1, dividing by 1 gives
+// the same result, so every lane is divided here.
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::operator *(const KPMatrixPacket<L> &m) const
+{
+	KPVectorPacket r = TransformAffine(m);
+
+	FLOATS w = L::Add( L::Add( L::Add( L::Mul(x, m._14), L::Mul(y, m._24) ), L::Mul(z, m._34) ), m._44 );
+
+	r.x = L::Div(r.x, w);
+	r.y = L::Div(r.y, w);
+	r.z = L::Div(r.z, w);
+
+	return r;
+}
+
+template <class L> inline KPVectorPacket<L> KPVectorPacket<L>::TransformAffine(const KPMatrixPacket<L> &m) const
+{
+	return KPVectorPacket( L::Add( L::Add( L::Add( L::Mul(x, m._11), L::Mul(y, m._21) ), L::Mul(z, m._31) ), m._41 ),
+						   L::Add( L::Add( L::Add( L::Mul(x, m._12), L::Mul(y, m._22) ), L::Mul(z, m._32) ), m._42 ),
+						   L::Add( L::Add( L::Add( L::Mul(x, m._13), L::Mul(y, m._23) ), L::Mul(z, m._33) ), m._43 ) );
+}
+
+
+// KPMatrixPacket ////
+//////////////////////
+
+// KPMatrixPacket::Set ////
+template <class L> inline void KPMatrixPacket<L>::Set(const KPMatrix &m)
+{
+	_11 = L::Set1(m._11);	_12 = L::Set1(m._12);	_13 = L::Set1(m._13);	_14 = L::Set1(m._14);
+	_21 = L::Set1(m._21);	_22 = L::Set1(m._22);	_23 = L::Set1(m._23);	_24 = L::Set1(m._24);
+	_31 = L::Set1(m._31);	_32 = L::Set1(m._32);	_33 = L::Set1(m._33);	_34 = L::Set1(m._34);
+	_41 = L::Set1(m._41);	_42 = L::Set1(m._42);	_43 = L::Set1(m._43);	_44 = L::Set1(m._44);
+}
+
+#endif // ! KPPACKET_H
@@ -0,0 +1,183 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPPixels.cpp
+ *  Description: KPEngine pixel kernels
+ *				 - Color key replacement
+ *				 - Alpha limiting
+ *
+ *				 The texture loader used to test the pixels one by
+ *				 one. Here 4 (SSE2) or 8 (AVX2) pixels are compared
+ *				 and written at once, without branches.
+ *
+ *****************************************************************
+*/
+
+#include "KP3D.h"
+#include "KPSIMD.h"
+
+
+// Scalar Kernels ////
+//////////////////////
+
+static void KPReplaceColorScalar(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		if ( pPixels[i] == nKey )
+			pPixels[i] = nColor;
+	}
+}
+
+static void KPLimitAlphaScalar(UINT *pPixels, UINT nCount, unsigned char Alpha)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		if ( ( pPixels[i] >> 24 ) > Alpha )
+			pPixels[i] = ( pPixels[i] & 0x00FFFFFF ) | ( (UINT)Alpha << 24 );
+	}
+}
+
+
+#ifdef KP_SSE
+
+// SSE2 Kernels ////
+////////////////////
+//
+// The alpha limit is a byte minimum: the alpha byte of the limit is Alpha,
+// the color bytes are 0xFF, so the colors are never changed.
+
+static void KPReplaceColorSSE(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor)
+{
+	UINT i = 0;
+
+#ifdef KP_SSE2
+	__m128i key	  = _mm_set1_epi32( (int)nKey );
+	__m128i color = _mm_set1_epi32( (int)nColor );
+
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)( pPixels + i ) );
+		__m128i m = _mm_cmpeq_epi32(v, key);
+
+		_mm_storeu_si128( (__m128i*)( pPixels + i ), _mm_or_si128( _mm_andnot_si128(m, v), _mm_and_si128(m, color) ) );
+	}
+#endif
+
+	KPReplaceColorScalar(pPixels + i, nCount - i, nKey, nColor);
+}
+
+static void KPLimitAlphaSSE(UINT *pPixels, UINT nCount, unsigned char Alpha)
+{
+	UINT i = 0;
+
+#ifdef KP_SSE2
+	__m128i limit = _mm_set1_epi32( (int)( ( (UINT)Alpha << 24 ) | 0x00FFFFFF ) );
+
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)( pPixels + i ) );
+
+		_mm_storeu_si128( (__m128i*)( pPixels + i ), _mm_min_epu8(v, limit) );
+	}
+#endif
+
+	KPLimitAlphaScalar(pPixels + i, nCount - i, Alpha);
+}
+
+#endif // ! KP_SSE
+
+
+#ifdef KP_SSE41
+KP_TARGET_SSE41_BEGIN
+
+// SSE4.1 Kernel ////
+/////////////////////
+//
+// One blend instead of the and, andnot, or of SSE2
+
+static void KPReplaceColorSSE41(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor)
+{
+	__m128i key	  = _mm_set1_epi32( (int)nKey );
+	__m128i color = _mm_set1_epi32( (int)nColor );
+	UINT	i	  = 0;
+
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)( pPixels + i ) );
+
+		_mm_storeu_si128( (__m128i*)( pPixels + i ), _mm_blendv_epi8( v, color, _mm_cmpeq_epi32(v, key) ) );
+	}
+
+	KPReplaceColorScalar(pPixels + i, nCount - i, nKey, nColor);
+}
+
+KP_TARGET_SSE41_END
+#endif // ! KP_SSE41
+
+
+#ifdef KP_AVX2
+KP_TARGET_AVX2_BEGIN
+
+// AVX2 Kernels ////
+////////////////////
+
+static void KPReplaceColorAVX2(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor)
+{
+	__m256i key	  = _mm256_set1_epi32( (int)nKey );
+	__m256i color = _mm256_set1_epi32( (int)nColor );
+	UINT	i	  = 0;
+
+	for ( ; i + 8 <= nCount; i += 8 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( pPixels + i ) );
+
+		_mm256_storeu_si256( (__m256i*)( pPixels + i ), _mm256_blendv_epi8( v, color, _mm256_cmpeq_epi32(v, key) ) );
+	}
+
+	KPReplaceColorScalar(pPixels + i, nCount - i, nKey, nColor);
+}
+
+static void KPLimitAlphaAVX2(UINT *pPixels, UINT nCount, unsigned char Alpha)
+{
+	__m256i limit = _mm256_set1_epi32( (int)( ( (UINT)Alpha << 24 ) | 0x00FFFFFF ) );
+	UINT	i	  = 0;
+
+	for ( ; i + 8 <= nCount; i += 8 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( pPixels + i ) );
+
+		_mm256_storeu_si256( (__m256i*)( pPixels + i ), _mm256_min_epu8(v, limit) );
+	}
+
+	KPLimitAlphaScalar(pPixels + i, nCount - i, Alpha);
+}
+
+KP_TARGET_AVX2_END
+#endif // ! KP_AVX2
+
+
+typedef void (*KPREPLACEKERNEL)(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor);
+typedef void (*KPALPHAKERNEL)(UINT *pPixels, UINT nCount, unsigned char Alpha);
+
+static const KPREPLACEKERNEL g_pfnReplaceColor[KPISA_COUNT]	= KPISA_TABLE_INT41(KPReplaceColor);
+static const KPALPHAKERNEL g_pfnLimitAlpha[KPISA_COUNT]		= KPISA_TABLE_INT(KPLimitAlpha);
+KPISA_REGISTER(g_pfnReplaceColor,	"replace color");
+KPISA_REGISTER(g_pfnLimitAlpha,		"limit alpha");
+
+
+// KPReplaceColor ////
+void KPReplaceColor(UINT *pPixels, UINT nCount, UINT nKey, UINT nColor)
+{
+	g_pfnReplaceColor[g_ISA](pPixels, nCount, nKey, nColor);
+}
+
+
+// KPLimitAlpha ////
+void KPLimitAlpha(UINT *pPixels, UINT nCount, unsigned char Alpha)
+{
+	g_pfnLimitAlpha[g_ISA](pPixels, nCount, Alpha);
+}
@@ -0,0 +1,401 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPPolygon.cpp
+ *  Description: KPEngine Polygon Class implementation
+ *				 - Sutherland-Hodgman clipping
+ *				 - Batched triangle clipping
+ *
+ *				 The distances of the points from the planes are
+ *				 evaluated by the SIMD kernels, 4 points at once,
+ *				 the classification and the clipping are scalar.
+ *				 Most triangles of a batch are entirely inside or
+ *				 outside the volume, only the few crossing a plane
+ *				 are clipped.
+ *
+ *****************************************************************
+*/
+
+#include <string.h>		// memcpy
+#include "KP3D.h"
+#include "KPSIMD.h"
+#include "KPMemory.h"
+
+// Number of triangles classified at once by KPClipTriangles
+#define KPCLIP_BATCH	64
+
+
+// Planes in SoA form
+typedef struct KPCLIPPLANES
+{
+	float	nx[KPMAX_CULL_PLANES];
+	float	ny[KPMAX_CULL_PLANES];
+	float	nz[KPMAX_CULL_PLANES];
+	float	d[KPMAX_CULL_PLANES];
+	UINT	nPlanes;
+} KPCLIPPLANES;
+
+
+// Scalar Kernels ////
+//////////////////////
+//
+// Distances are evaluated as ((nx*x + ny*y) + nz*z) + d, like the SIMD
+// kernels, so the results are the same on every path.
+
+// Distances of the points from the plane
+static void KPPlaneDistancesScalar(const KPPlane &plane, const KPVector *pPoints, UINT nCount, float *pDist)
+{
+	const KPVector &n = plane.m_vcNormal;
+
+	for ( UINT i = 0; i < nCount; ++i )
+		pDist[i] = n.x*pPoints[i].x + n.y*pPoints[i].y + n.z*pPoints[i].z + plane.m_fDistance;
+}
+
+#ifdef KP_SSE
+
+// SSE Kernels ////
+///////////////////
+//
+// Four points transposed into x, y, z registers, the w coordinates are
+// dropped.
+
+static void KPPlaneDistancesSSE(const KPPlane &plane, const KPVector *pPoints, UINT nCount, float *pDist)
+{
+	__m128 nx = _mm_set1_ps(plane.m_vcNormal.x);
+	__m128 ny = _mm_set1_ps(plane.m_vcNormal.y);
+	__m128 nz = _mm_set1_ps(plane.m_vcNormal.z);
+	__m128 d  = _mm_set1_ps(plane.m_fDistance);
+	UINT i;
+
+	for ( i = 0; i + 4 <= nCount; i += 4 )
+	{
+		__m128 x = KPSSELoad(pPoints[i]);
+		__m128 y = KPSSELoad(pPoints[i + 1]);
+		__m128 z = KPSSELoad(pPoints[i + 2]);
+		__m128 w = KPSSELoad(pPoints[i + 3]);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_storeu_ps( pDist + i, _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(nx, x), _mm_mul_ps(ny, y) ), _mm_mul_ps(nz, z) ), d ) );
+	}
+
+	KPPlaneDistancesScalar(plane, pPoints + i, nCount - i, pDist + i);
+}
+
+#endif // ! KP_SSE
+
+
+typedef void (*KPDISTANCEKERNEL)(const KPPlane &plane, const KPVector *pPoints, UINT nCount, float *pDist);
+
+static const KPDISTANCEKERNEL g_pfnPlaneDistances[KPISA_COUNT] = KPISA_TABLE_SSE(KPPlaneDistances);
+KPISA_REGISTER(g_pfnPlaneDistances,	"plane distances");
+
+
+// KPClassifyTriangles ////
+///////////////////////////
+//
+// KPCULLED if all three vertices are in front of a plane, KPCLIPPED if any
+// of them is in front of one. Scalar on every path: most triangles are
+// culled by one of the first planes, and a SIMD kernel testing four
+// triangles against every plane measured no faster.
+static void KPClassifyTriangles(const KPCLIPPLANES &P, const KPVector *pTriangles, UINT nCount, unsigned char *pStates)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		const KPVector	*v		= pTriangles + 3*i;
+		unsigned char	nState	= KPVISIBLE;
+
+		for ( UINT p = 0; p < P.nPlanes; ++p )
+		{
+			bool b0 = ( P.nx[p]*v[0].x + P.ny[p]*v[0].y + P.nz[p]*v[0].z + P.d[p] > 0.0f );
+			bool b1 = ( P.nx[p]*v[1].x + P.ny[p]*v[1].y + P.nz[p]*v[1].z + P.d[p] > 0.0f );
+			bool b2 = ( P.nx[p]*v[2].x + P.ny[p]*v[2].y + P.nz[p]*v[2].z + P.d[p] > 0.0f );
+
+			if ( b0 && b1 && b2 )
+			{
+				nState = KPCULLED;
+				break;
+			}
+
+			if ( b0 || b1 || b2 )
+				nState = KPCLIPPED;
+		}
+
+		pStates[i] = nState;
+	}
+}
+
+
+// KPPolygon ////
+/////////////////
+
+KPPolygon::KPPolygon(void)
+{
+	m_pPoints		= NULL;
+	m_pScratch		= NULL;
+	m_pfDist		= NULL;
+	m_NumPoints		= 0;
+	m_nMaxPoints	= 0;
+}
+
+KPPolygon::~KPPolygon(void)
+{
+	KPAlignedFree(m_pPoints);
+	KPAlignedFree(m_pScratch);
+	KPAlignedFree(m_pfDist);
+
+	m_pPoints	= NULL;
+	m_pScratch	= NULL;
+	m_pfDist	= NULL;
+}
+
+
+// Reserve ////
+///////////////
+//
+// The arrays are cache line aligned, the points are written before they
+// are read, so they are not constructed
+bool KPPolygon::Reserve(UINT nMaxPoints)
+{
+	if ( nMaxPoints <= m_nMaxPoints )
+		return true;
+
+	KPVector	*pPoints	= (KPVector*)KPAlignedAlloc(nMaxPoints * sizeof(KPVector));
+	KPVector	*pScratch	= (KPVector*)KPAlignedAlloc(nMaxPoints * sizeof(KPVector));
+	float		*pfDist		= (float*)KPAlignedAlloc(nMaxPoints * sizeof(float));
+
+	if ( !pPoints || !pScratch || !pfDist )
+	{
+		KPAlignedFree(pPoints);
+		KPAlignedFree(pScratch);
+		KPAlignedFree(pfDist);
+		return false;
+	}
+
+	if ( m_NumPoints )
+		memcpy(pPoints, m_pPoints, m_NumPoints * sizeof(KPVector));
+
+	KPAlignedFree(m_pPoints);
+	KPAlignedFree(m_pScratch);
+	KPAlignedFree(m_pfDist);
+
+	m_pPoints		= pPoints;
+	m_pScratch		= pScratch;
+	m_pfDist		= pfDist;
+	m_nMaxPoints	= nMaxPoints;
+
+	return true;
+
+} // ! Reserve
+
+
+// Set ////
+bool KPPolygon::Set(const KPVector *pPoints, UINT nNumPoints)
+{
+	m_NumPoints = 0;
+
+	if ( !Reserve(nNumPoints) )
+		return false;
+
+	if ( nNumPoints )
+		memcpy(m_pPoints, pPoints, nNumPoints * sizeof(KPVector));
+
+	m_NumPoints = nNumPoints;
+
+	return true;
+}
+
+
+// Classify ////
+int KPPolygon::Classify(const KPPlane &plane) const
+{
+	UINT nFront = 0, nBack = 0;
+
+	g_pfnPlaneDistances[g_ISA](plane, m_pPoints, m_NumPoints, m_pfDist);
+
+	for ( UINT i = 0; i < m_NumPoints; ++i )
+	{
+		if ( m_pfDist[i] > 0.0f )
+			++nFront;
+		else if ( m_pfDist[i] < 0.0f )
+			++nBack;
+	}
+
+	if ( nFront && nBack )
+		return KPCLIPPED;
+
+	if ( nFront )
+		return KPFRONT;
+
+	return nBack ? KPBACK : KPPLANAR;
+
+} // ! Classify
+
+
+// Clip ////
+////////////
+//
+// Sutherland-Hodgman: every edge keeps its start point if it is behind
+// the plane, and adds the intersection if it crosses the plane. Points
+// on the plane count as behind it, they are kept, and an edge ending on
+// the plane does not cross it, so no point is added twice.
+bool KPPolygon::Clip(const KPPlane &plane)
+{
+	if ( m_NumPoints == 0 )
+		return true;
+
+	// Every edge adds at most two points
+	if ( !Reserve(2 * m_NumPoints) )
+		return false;
+
+	g_pfnPlaneDistances[g_ISA](plane, m_pPoints, m_NumPoints, m_pfDist);
+
+	UINT nFront = 0;
+
+	for ( UINT i = 0; i < m_NumPoints; ++i )
+	{
+		if ( m_pfDist[i] > 0.0f )
+			++nFront;
+	}
+
+	// Entirely behind or in front, nothing to clip
+	if ( nFront == 0 )
+		return true;
+
+	if ( nFront == m_NumPoints )
+	{
+		m_NumPoints = 0;
+		return true;
+	}
+
+	UINT nOut = 0;
+
+	for ( UINT i = 0; i < m_NumPoints; ++i )
+	{
+		UINT			j	= ( i + 1 < m_NumPoints ) ? i + 1 : 0;
+		const KPVector	&a	= m_pPoints[i];
+		const KPVector	&b	= m_pPoints[j];
+		float			da	= m_pfDist[i];
+		float			db	= m_pfDist[j];
+
+		if ( da <= 0.0f )
+			m_pScratch[nOut++] = a;
+
+		if ( ( da < 0.0f && db > 0.0f ) || ( da > 0.0f && db < 0.0f ) )
+		{
+			float t = da / ( da - db );
+
+			m_pScratch[nOut++].Set( a.x + ( b.x - a.x ) * t,
+									a.y + ( b.y - a.y ) * t,
+									a.z + ( b.z - a.z ) * t );
+		}
+	}
+
+	KPVector *pSwap = m_pPoints;
+	m_pPoints	= m_pScratch;
+	m_pScratch	= pSwap;
+	m_NumPoints = nOut;
+
+	return true;
+
+} // ! Clip
+
+bool KPPolygon::Clip(const KPPlane *pPlanes, UINT nPlanes)
+{
+	for ( UINT p = 0; p < nPlanes && m_NumPoints; ++p )
+	{
+		if ( !Clip(pPlanes[p]) )
+			return false;
+	}
+
+	return true;
+}
+
+
+// KPClipTriangles ////
+///////////////////////
+//
+// The triangles are classified in batches into a buffer on the stack,
+// then copied, dropped or clipped one by one.
+bool KPClipTriangles(const KPPlane *pPlanes, UINT nPlanes, const KPVector *pTriangles, UINT nTriangles,
+					 KPVector *pOut, UINT nMaxOut, UINT *pNumOut, KPPolygon &Scratch)
+{
+	KPCLIPPLANES	planes;
+	unsigned char	nStates[KPCLIP_BATCH];
+	UINT			nOut = 0;
+
+	*pNumOut = 0;
+
+	if ( nPlanes == 0 || nPlanes > KPMAX_CULL_PLANES )
+		return false;
+
+	for ( UINT p = 0; p < nPlanes; ++p )
+	{
+		planes.nx[p] = pPlanes[p].m_vcNormal.x;
+		planes.ny[p] = pPlanes[p].m_vcNormal.y;
+		planes.nz[p] = pPlanes[p].m_vcNormal.z;
+		planes.d[p]	 = pPlanes[p].m_fDistance;
+	}
+
+	planes.nPlanes = nPlanes;
+
+	// Enough for any triangle, the clipping will not allocate
+	if ( !Scratch.Reserve( 2 * ( 3 + nPlanes ) ) )
+		return false;
+
+	for ( UINT nBatch = 0; nBatch < nTriangles; nBatch += KPCLIP_BATCH )
+	{
+		UINT nCount = ( nTriangles - nBatch < KPCLIP_BATCH ) ? nTriangles - nBatch : KPCLIP_BATCH;
+
+		KPClassifyTriangles(planes, pTriangles + 3*nBatch, nCount, nStates);
+
+		for ( UINT i = 0; i < nCount; ++i )
+		{
+			const KPVector *v = pTriangles + 3*(nBatch + i);
+
+			if ( nStates[i] == KPVISIBLE )
+			{
+				if ( nOut == nMaxOut )
+				{
+					*pNumOut = nOut;
+					return false;
+				}
+
+				pOut[3*nOut]	 = v[0];
+				pOut[3*nOut + 1] = v[1];
+				pOut[3*nOut + 2] = v[2];
+				++nOut;
+			}
+			else if ( nStates[i] == KPCLIPPED )
+			{
+				Scratch.Set(v, 3);
+				Scratch.Clip(pPlanes, nPlanes);
+
+				// Triangle fan of the remaining convex polygon
+				const KPVector *pPoints = Scratch.GetPoints();
+
+				for ( UINT k = 1; k + 1 < Scratch.GetNumPoints(); ++k )
+				{
+					if ( nOut == nMaxOut )
+					{
+						*pNumOut = nOut;
+						return false;
+					}
+
+					pOut[3*nOut]	 = pPoints[0];
+					pOut[3*nOut + 1] = pPoints[k];
+					pOut[3*nOut + 2] = pPoints[k + 1];
+					++nOut;
+				}
+			}
+		}
+	}
+
+	*pNumOut = nOut;
+
+	return true;
+
+} // ! KPClipTriangles
@@ -0,0 +1,436 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPProfile.cpp
+ *  Description: KPEngine hardware profile implementation
+ *
+ *				 The profile is a small JSON file:
+ *				 { "version": 1,
+ *				   "cpu": { "model": "...", "l2_kb": 256, ... },
+ *				   "memory": { "read_gbps": 9.5, ...,
+ *							   "latency_ns": { "l1": 1.2, ... } },
+ *				   "kernels": [ { "name": "...", ... }, ... ],
+ *				   "tuning": { "workers": 3, ... } }
+ *				 It is read by a minimal parser: objects, arrays,
+ *				 strings and numbers, the values are looked up by
+ *				 their keys, so the order does not matter and
+ *				 newer files load with the keys this code knows.
+ *
+ *****************************************************************
+*/
+
+#include "KPProfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Default size of the vertex caches
+#define KPDEFAULT_CACHE_VERTICES	3000
+#define KPDEFAULT_CACHE_INDICES		4500
+#define KPDEFAULT_NUM_CACHES		10
+
+// Limits of the vertex caches, the indices are 16 bit
+#define KPMIN_CACHE_SIZE			64
+#define KPMAX_CACHE_SIZE			65535
+#define KPMAX_NUM_CACHES			256
+
+// Largest profile file read
+#define KPMAX_PROFILE_SIZE			(1 << 16)
+
+
+// JSON Parser ////
+///////////////////
+//
+// A value is a range of the text, from its first character to one past
+// its last. The functions never read past the end of the range.
+
+typedef struct KPJSONVALUE
+{
+	const char *pBegin;
+	const char *pEnd;
+} KPJSONVALUE;
+
+static const char *KPSkipSpace(const char *p, const char *pEnd)
+{
+	while ( p < pEnd && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) )
+		++p;
+
+	return p;
+}
+
+// Returns one past the closing quote of the string starting at p, or pEnd
+static const char *KPSkipString(const char *p, const char *pEnd)
+{
+	for ( ++p; p < pEnd; ++p )
+	{
+		if ( *p == '\\' )
+			++p;
+		else if ( *p == '"' )
+			return p + 1;
+	}
+
+	return pEnd;
+}
+
+// Returns one past the end of the value starting at p
+static const char *KPSkipValue(const char *p, const char *pEnd)
+{
+	if ( p >= pEnd )
+		return pEnd;
+
+	if ( *p == '"' )
+		return KPSkipString(p, pEnd);
+
+	if ( *p == '{' || *p == '[' )
+	{
+		int nDepth = 0;
+
+		while ( p < pEnd )
+		{
+			if ( *p == '"' )
+			{
+				p = KPSkipString(p, pEnd);
+				continue;
+			}
+
+			if ( *p == '{' || *p == '[' )
+				++nDepth;
+			else if ( ( *p == '}' || *p == ']' ) && --nDepth == 0 )
+				return p + 1;
+
+			++p;
+		}
+
+		return pEnd;
+	}
+
+	// Number, true, false or null
+	while ( p < pEnd && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' )
+		++p;
+
+	return p;
+}
+
+// Finds the value of a key in an object, only the members of the object itself are searched
+static bool KPFindKey(const KPJSONVALUE &Object, const char *chKey, KPJSONVALUE *pValue)
+{
+	const char	*p		= KPSkipSpace(Object.pBegin, Object.pEnd);
+	const char	*pEnd	= Object.pEnd;
+	size_t		nKey	= strlen(chKey);
+
+	if ( p >= pEnd || *p != '{' )
+		return false;
+
+	for ( ++p; ; )
+	{
+		p = KPSkipSpace(p, pEnd);
+		if ( p < pEnd && *p == ',' )
+			p = KPSkipSpace(p + 1, pEnd);
+
+		if ( p >= pEnd || *p != '"' )
+			return false;
+
+		const char *pKey	= p + 1;
+		const char *pKeyEnd	= KPSkipString(p, pEnd) - 1;
+
+		p = KPSkipSpace(pKeyEnd + 1, pEnd);
+		if ( p >= pEnd || *p != ':' )
+			return false;
+
+		p = KPSkipSpace(p + 1, pEnd);
+		const char *pValueEnd = KPSkipValue(p, pEnd);
+
+		if ( (size_t)( pKeyEnd - pKey ) == nKey && strncmp(pKey, chKey, nKey) == 0 )
+		{
+			pValue->pBegin	= p;
+			pValue->pEnd	= pValueEnd;
+			return true;
+		}
+
+		p = pValueEnd;
+	}
+}
+
+// Returns the element of an array after pPrevious, the first one if pPrevious is NULL
+static bool KPNextElement(const KPJSONVALUE &Array, const KPJSONVALUE *pPrevious, KPJSONVALUE *pElement)
+{
+	const char *p = pPrevious ? pPrevious->pEnd : KPSkipSpace(Array.pBegin, Array.pEnd) + 1;
+
+	if ( !pPrevious && ( Array.pBegin >= Array.pEnd || *KPSkipSpace(Array.pBegin, Array.pEnd) != '[' ) )
+		return false;
+
+	p = KPSkipSpace(p, Array.pEnd);
+	if ( p < Array.pEnd && *p == ',' )
+		p = KPSkipSpace(p + 1, Array.pEnd);
+
+	if ( p >= Array.pEnd || *p == ']' )
+		return false;
+
+	pElement->pBegin	= p;
+	pElement->pEnd		= KPSkipValue(p, Array.pEnd);
+	return true;
+}
+
+// Reads a number member, returns false if the key is missing or not a number
+static bool KPReadNumber(const KPJSONVALUE &Object, const char *chKey, double *pValue)
+{
+	KPJSONVALUE Value;
+	char		chNumber[32];
+
+	if ( !KPFindKey(Object, chKey, &Value) || Value.pEnd - Value.pBegin >= (int)sizeof(chNumber) )
+		return false;
+
+	memcpy(chNumber, Value.pBegin, Value.pEnd - Value.pBegin);
+	chNumber[Value.pEnd - Value.pBegin] = 0;
+
+	char *pNumberEnd;
+	*pValue = strtod(chNumber, &pNumberEnd);
+
+	return ( pNumberEnd != chNumber && *pNumberEnd == 0 );
+}
+
+// Reads a float member, the value is unchanged if the key is missing
+static void KPReadFloat(const KPJSONVALUE &Object, const char *chKey, float *pValue)
+{
+	double dValue;
+
+	if ( KPReadNumber(Object, chKey, &dValue) )
+		*pValue = (float)dValue;
+}
+
+// Reads an unsigned member, a negative value is 0xFFFFFFFF
+static void KPReadUINT(const KPJSONVALUE &Object, const char *chKey, UINT *pValue)
+{
+	double dValue;
+
+	if ( KPReadNumber(Object, chKey, &dValue) )
+		*pValue = ( dValue < 0.0 || dValue >= 4294967295.0 ) ? 0xFFFFFFFF : (UINT)dValue;
+}
+
+// Reads a string member into a buffer of nSize characters, the escapes are taken literally
+static void KPReadString(const KPJSONVALUE &Object, const char *chKey, char *chValue, UINT nSize)
+{
+	KPJSONVALUE Value;
+
+	if ( !KPFindKey(Object, chKey, &Value) || *Value.pBegin != '"' )
+		return;
+
+	UINT n = 0;
+
+	for ( const char *p = Value.pBegin + 1; p < Value.pEnd - 1 && n + 1 < nSize; ++p )
+	{
+		if ( *p == '\\' && p + 1 < Value.pEnd - 1 )
+			++p;
+
+		chValue[n++] = *p;
+	}
+
+	chValue[n] = 0;
+}
+
+// Writes a string with the quotes and the backslashes escaped
+static void KPWriteString(FILE *pFile, const char *chValue)
+{
+	fputc('"', pFile);
+
+	for ( const char *p = chValue; *p; ++p )
+	{
+		if ( *p == '"' || *p == '\\' )
+			fputc('\\', pFile);
+
+		if ( (unsigned char)*p >= ' ' )
+			fputc(*p, pFile);
+	}
+
+	fputc('"', pFile);
+}
+
+// The sentinel 0xFFFFFFFF is written as -1
+static long KPProfileInt(UINT nValue)
+{
+	return ( nValue == 0xFFFFFFFF ) ? -1 : (long)nValue;
+}
+
+
+// KPDefaultHWProfile ////
+void KPDefaultHWProfile(KPHWPROFILE *pProfile)
+{
+	memset(pProfile, 0, sizeof(KPHWPROFILE));
+
+	pProfile->numWorkers		= KPDEFAULT_WORKERS;
+	pProfile->nMatrixThreshold	= KPDEFAULT_MATRIX_THRESHOLD;
+	pProfile->nVectorThreshold	= KPDEFAULT_VECTOR_THRESHOLD;
+	pProfile->nCacheVertices	= KPDEFAULT_CACHE_VERTICES;
+	pProfile->nCacheIndices		= KPDEFAULT_CACHE_INDICES;
+	pProfile->numCaches			= KPDEFAULT_NUM_CACHES;
+}
+
+
+// KPLoadHWProfile ////
+///////////////////////
+bool KPLoadHWProfile(const char *chFile, KPHWPROFILE *pProfile)
+{
+	KPDefaultHWProfile(pProfile);
+
+	if ( !chFile )
+	{
+		chFile = getenv("KPENGINE_PROFILE");
+
+		if ( !chFile || !*chFile )
+			chFile = KPHWPROFILE_FILE;
+	}
+
+	FILE *pFile = fopen(chFile, "rb");
+
+	if ( !pFile )
+		return false;
+
+	char	*chText = (char*)malloc(KPMAX_PROFILE_SIZE);
+	size_t	nSize	= chText ? fread(chText, 1, KPMAX_PROFILE_SIZE, pFile) : 0;
+
+	fclose(pFile);
+
+	KPJSONVALUE Root = { chText, chText + nSize };
+	KPJSONVALUE Cpu, Memory, Latency, Kernels, Tuning;
+
+	Root.pBegin = KPSkipSpace(Root.pBegin, Root.pEnd);
+
+	if ( !chText || Root.pBegin >= Root.pEnd || *Root.pBegin != '{' )
+	{
+		free(chText);
+		return false;
+	}
+
+	if ( KPFindKey(Root, "cpu", &Cpu) )
+	{
+		KPReadString(Cpu, "model",			pProfile->chCPU, sizeof(pProfile->chCPU));
+		KPReadString(Cpu, "isa",			pProfile->chISA, sizeof(pProfile->chISA));
+		KPReadUINT(Cpu, "logical_cores",	&pProfile->numLogicalCores);
+		KPReadUINT(Cpu, "physical_cores",	&pProfile->numPhysicalCores);
+		KPReadUINT(Cpu, "l1d_kb",			&pProfile->L1DataSize);
+		KPReadUINT(Cpu, "l2_kb",			&pProfile->L2Size);
+		KPReadUINT(Cpu, "l3_kb",			&pProfile->L3Size);
+		KPReadUINT(Cpu, "cache_line",		&pProfile->CacheLineSize);
+	}
+
+	if ( KPFindKey(Root, "memory", &Memory) )
+	{
+		KPReadFloat(Memory, "read_gbps",		&pProfile->fReadGBps);
+		KPReadFloat(Memory, "write_gbps",		&pProfile->fWriteGBps);
+		KPReadFloat(Memory, "copy_gbps",		&pProfile->fCopyGBps);
+		KPReadFloat(Memory, "read_all_gbps",	&pProfile->fReadAllGBps);
+
+		if ( KPFindKey(Memory, "latency_ns", &Latency) )
+		{
+			KPReadFloat(Latency, "l1",		&pProfile->fLatencyL1);
+			KPReadFloat(Latency, "l2",		&pProfile->fLatencyL2);
+			KPReadFloat(Latency, "l3",		&pProfile->fLatencyL3);
+			KPReadFloat(Latency, "dram",	&pProfile->fLatencyDRAM);
+		}
+	}
+
+	if ( KPFindKey(Root, "kernels", &Kernels) )
+	{
+		KPJSONVALUE Kernel, *pPrevious = NULL;
+
+		while ( pProfile->numKernels < KPMAX_PROFILE_KERNELS && KPNextElement(Kernels, pPrevious, &Kernel) )
+		{
+			KPKERNELTIMING *pTiming = &pProfile->Kernels[pProfile->numKernels++];
+
+			KPReadString(Kernel, "name",	pTiming->chName, sizeof(pTiming->chName));
+			KPReadString(Kernel, "isa",		pTiming->chISA, sizeof(pTiming->chISA));
+			KPReadFloat(Kernel, "cache_ns",		&pTiming->fCacheNs);
+			KPReadFloat(Kernel, "memory_ns",	&pTiming->fMemoryNs);
+			KPReadFloat(Kernel, "cache_gbps",	&pTiming->fCacheGBps);
+			KPReadFloat(Kernel, "memory_gbps",	&pTiming->fMemoryGBps);
+
+			pPrevious = &Kernel;
+		}
+	}
+
+	if ( KPFindKey(Root, "tuning", &Tuning) )
+	{
+		KPReadUINT(Tuning, "workers",			&pProfile->numWorkers);
+		KPReadUINT(Tuning, "matrix_threshold",	&pProfile->nMatrixThreshold);
+		KPReadUINT(Tuning, "vector_threshold",	&pProfile->nVectorThreshold);
+		KPReadUINT(Tuning, "cache_vertices",	&pProfile->nCacheVertices);
+		KPReadUINT(Tuning, "cache_indices",		&pProfile->nCacheIndices);
+		KPReadUINT(Tuning, "cache_count",		&pProfile->numCaches);
+	}
+
+	free(chText);
+
+	// The dynamic buffers use 16 bit indices
+	if ( pProfile->nCacheVertices < KPMIN_CACHE_SIZE )	pProfile->nCacheVertices = KPMIN_CACHE_SIZE;
+	if ( pProfile->nCacheVertices > KPMAX_CACHE_SIZE )	pProfile->nCacheVertices = KPMAX_CACHE_SIZE;
+	if ( pProfile->nCacheIndices < KPMIN_CACHE_SIZE )	pProfile->nCacheIndices = KPMIN_CACHE_SIZE;
+	if ( pProfile->nCacheIndices > KPMAX_CACHE_SIZE )	pProfile->nCacheIndices = KPMAX_CACHE_SIZE;
+	if ( pProfile->numCaches < 1 )						pProfile->numCaches = 1;
+	if ( pProfile->numCaches > KPMAX_NUM_CACHES )		pProfile->numCaches = KPMAX_NUM_CACHES;
+
+	return true;
+
+} // ! KPLoadHWProfile
+
+
+// KPSaveHWProfile ////
+///////////////////////
+bool KPSaveHWProfile(const char *chFile, const KPHWPROFILE *pProfile)
+{
+	FILE *pFile = fopen(chFile, "w");
+
+	if ( !pFile )
+		return false;
+
+	fprintf(pFile, "{\n\t\"version\": %d,\n", KPHWPROFILE_VERSION);
+
+	fprintf(pFile, "\t\"cpu\": {\n\t\t\"model\": ");
+	KPWriteString(pFile, pProfile->chCPU);
+	fprintf(pFile, ",\n\t\t\"isa\": ");
+	KPWriteString(pFile, pProfile->chISA);
+	fprintf(pFile, ",\n\t\t\"logical_cores\": %u,\n\t\t\"physical_cores\": %u,\n", pProfile->numLogicalCores, pProfile->numPhysicalCores);
+	fprintf(pFile, "\t\t\"l1d_kb\": %u,\n\t\t\"l2_kb\": %u,\n\t\t\"l3_kb\": %u,\n\t\t\"cache_line\": %u\n\t},\n",
+			pProfile->L1DataSize, pProfile->L2Size, pProfile->L3Size, pProfile->CacheLineSize);
+
+	fprintf(pFile, "\t\"memory\": {\n\t\t\"read_gbps\": %.2f,\n\t\t\"write_gbps\": %.2f,\n\t\t\"copy_gbps\": %.2f,\n\t\t\"read_all_gbps\": %.2f,\n",
+			pProfile->fReadGBps, pProfile->fWriteGBps, pProfile->fCopyGBps, pProfile->fReadAllGBps);
+	fprintf(pFile, "\t\t\"latency_ns\": { \"l1\": %.2f, \"l2\": %.2f, \"l3\": %.2f, \"dram\": %.2f }\n\t},\n",
+			pProfile->fLatencyL1, pProfile->fLatencyL2, pProfile->fLatencyL3, pProfile->fLatencyDRAM);
+
+	fprintf(pFile, "\t\"kernels\": [\n");
+
+	for ( UINT i = 0; i < pProfile->numKernels && i < KPMAX_PROFILE_KERNELS; ++i )
+	{
+		const KPKERNELTIMING &t = pProfile->Kernels[i];
+
+		fprintf(pFile, "\t\t{ \"name\": ");
+		KPWriteString(pFile, t.chName);
+		fprintf(pFile, ", \"isa\": ");
+		KPWriteString(pFile, t.chISA);
+		fprintf(pFile, ", \"cache_ns\": %.4f, \"memory_ns\": %.4f, \"cache_gbps\": %.2f, \"memory_gbps\": %.2f }%s\n",
+				t.fCacheNs, t.fMemoryNs, t.fCacheGBps, t.fMemoryGBps, ( i + 1 < pProfile->numKernels ) ? "," : "");
+	}
+
+	fprintf(pFile, "\t],\n");
+
+	fprintf(pFile, "\t\"tuning\": {\n\t\t\"workers\": %ld,\n\t\t\"matrix_threshold\": %ld,\n\t\t\"vector_threshold\": %ld,\n",
+			KPProfileInt(pProfile->numWorkers), KPProfileInt(pProfile->nMatrixThreshold), KPProfileInt(pProfile->nVectorThreshold));
+	fprintf(pFile, "\t\t\"cache_vertices\": %u,\n\t\t\"cache_indices\": %u,\n\t\t\"cache_count\": %u\n\t}\n}\n",
+			pProfile->nCacheVertices, pProfile->nCacheIndices, pProfile->numCaches);
+
+	return ( fclose(pFile) == 0 );
+
+} // ! KPSaveHWProfile
+
+
+// KPApplyHWProfile ////
+void KPApplyHWProfile(const KPHWPROFILE *pProfile)
+{
+	KPSetNumWorkers(pProfile->numWorkers);
+	KPSetParallelThreshold(KPJOB_MATRIX, pProfile->nMatrixThreshold);
+	KPSetParallelThreshold(KPJOB_VECTOR, pProfile->nVectorThreshold);
+}
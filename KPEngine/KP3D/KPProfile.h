@@ -0,0 +1,121 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPProfile.h
+ *  Description: KPEngine hardware profile
+ *				 - Measured caches, memory and kernel speeds
+ *				 - Tuning of the thread pool and the vertex caches
+ *				 - JSON loading and saving
+ *
+ *				 CpuTest --profile measures the machine and
+ *				 writes the profile, the engine loads it at
+ *				 startup instead of using the same constants
+ *				 on every machine.
+ *
+ *****************************************************************
+*/
+
+#ifndef KPPROFILE_H
+#define KPPROFILE_H
+
+#include "KPJobs.h"
+
+// File loaded when no file name is given and KPENGINE_PROFILE is not set
+#define KPHWPROFILE_FILE		"KPHardware.json"
+
+// Version of the file format
+#define KPHWPROFILE_VERSION		1
+
+// Maximum number of kernel timings in a profile
+#define KPMAX_PROFILE_KERNELS	16
+
+
+//! Measured speed of a math kernel
+typedef struct KPKERNELTIMING
+{
+	char	chName[32];				//!< Registry name of the kernel, see KPGetKernelName
+	char	chISA[16];				//!< Instruction set the kernel ran on, see KPGetISAName
+	float	fCacheNs;				//!< Nanoseconds per element on an L1 resident array
+	float	fMemoryNs;				//!< Nanoseconds per element on a DRAM resident array
+	float	fCacheGBps;				//!< Bytes read and written per second on the L1 resident array, in GB
+	float	fMemoryGBps;			//!< Bytes read and written per second on the DRAM resident array, in GB
+} KPKERNELTIMING;
+
+
+//! Hardware profile of a machine
+/*!
+	The measured values are only informative, the engine uses the tuning
+	values. Every field is 0 (the names empty) if it was not measured, the
+	tuning values are the engine defaults then.
+*/
+typedef struct KPHWPROFILE
+{
+	// CPU
+	char	chCPU[64];				//!< Model name
+	char	chISA[16];				//!< Instruction set the engine selected, see KPGetISAName
+	UINT	numLogicalCores;		//!< Hardware threads
+	UINT	numPhysicalCores;		//!< Cores
+	UINT	L1DataSize;				//!< L1 data cache of a core in KB
+	UINT	L2Size;					//!< L2 cache in KB
+	UINT	L3Size;					//!< L3 cache in KB
+	UINT	CacheLineSize;			//!< Cache line in bytes
+
+	// Memory, one thread unless noted
+	float	fReadGBps;				//!< Sequential read bandwidth, GB per second
+	float	fWriteGBps;				//!< Sequential write bandwidth
+	float	fCopyGBps;				//!< Copy bandwidth, the bytes read and written
+	float	fReadAllGBps;			//!< Sequential read bandwidth with all the threads of the pool
+	float	fLatencyL1;				//!< Dependent load latency in nanoseconds, L1 resident
+	float	fLatencyL2;				//!< L2 resident
+	float	fLatencyL3;				//!< L3 resident, 0 without an L3 cache
+	float	fLatencyDRAM;			//!< DRAM resident
+
+	// Math kernels, one thread
+	UINT			numKernels;							//!< Number of timings
+	KPKERNELTIMING	Kernels[KPMAX_PROFILE_KERNELS];		//!< Timings of the kernels
+
+	// Tuning
+	UINT	numWorkers;				//!< Worker threads besides the calling thread, KPDEFAULT_WORKERS for one less than the logical processors
+	UINT	nMatrixThreshold;		//!< Parallel threshold of KPJOB_MATRIX, 0xFFFFFFFF never splits
+	UINT	nVectorThreshold;		//!< Parallel threshold of KPJOB_VECTOR, 0xFFFFFFFF never splits
+	UINT	nCacheVertices;			//!< Vertices of a dynamic vertex cache
+	UINT	nCacheIndices;			//!< Indices of a dynamic vertex cache
+	UINT	numCaches;				//!< Dynamic vertex caches of a vertex type, more of them flush less with many skins
+
+} KPHWPROFILE;
+
+
+//! Fills a profile with nothing measured and the engine defaults as tuning
+void KPDefaultHWProfile(KPHWPROFILE *pProfile);
+
+//! Loads a hardware profile
+/*!
+	Reads the keys it knows, the rest of the file is ignored, and the
+	missing keys keep their defaults. The vertex cache sizes are clamped
+	to 16 bit indices.
+	\param [in] chFile file name, NULL loads KPENGINE_PROFILE or KPHWPROFILE_FILE
+	\param [out] pProfile the loaded profile, the defaults if the file can not be read
+	\return false if the file does not exist or is not a JSON object
+*/
+bool KPLoadHWProfile(const char *chFile, KPHWPROFILE *pProfile);
+
+//! Saves a hardware profile as JSON
+/*!
+	\param [in] chFile file name
+	\param [in] pProfile profile to save
+	\return false if the file can not be written
+*/
+bool KPSaveHWProfile(const char *chFile, const KPHWPROFILE *pProfile);
+
+//! Sets the worker count and the parallel thresholds of a profile
+/*!
+	The worker count only takes effect before the first parallel call or
+	after KPShutdownWorkers, see KPSetNumWorkers. The vertex cache sizes
+	are passed to the render device by the caller.
+*/
+void KPApplyHWProfile(const KPHWPROFILE *pProfile);
+
+#endif // ! KPPROFILE_H
@@ -0,0 +1,181 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPQuaternion.cpp
+ *  Description: KPEngine Quaternion Class implementation
+ *				 - Rotation matrix conversions
+ *				 - Interpolation
+ *				 - Scale * rotation * translation matrices
+ *
+ *****************************************************************
+*/
+
+#include "KP3D.h"
+#include "KPKernels.h"
+#include "KPJobs.h"
+
+
+// KPQuaternion::FromAxisAngle ////
+void KPQuaternion::FromAxisAngle(const KPVector &vcAxis, float fAngle)
+{
+	KPVector vcUnit = vcAxis;
+
+	if ( vcUnit.GetSqaredLength() != 1.0f )
+		vcUnit.Normalize();
+
+	float fSine, fCosine;
+
+	KPSinCos(fAngle * 0.5f, &fSine, &fCosine);
+
+	x = vcUnit.x * fSine;
+	y = vcUnit.y * fSine;
+	z = vcUnit.z * fSine;
+	w = fCosine;
+}
+
+
+// KPQuaternion::GetAxisAngle ////
+void KPQuaternion::GetAxisAngle(KPVector &vcAxis, float &fAngle) const
+{
+	float fCosine = w;
+
+	// Rounding can push a unit quaternion slightly out of the domain of acos
+	if ( fCosine > 1.0f )  fCosine = 1.0f;
+	if ( fCosine < -1.0f ) fCosine = -1.0f;
+
+	fAngle = 2.0f * acosf(fCosine);
+
+	float fSine = sqrtf(1.0f - fCosine * fCosine);
+
+	// No rotation, any axis will do
+	if ( fSine < 1e-6f )
+	{
+		vcAxis.Set(1.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	vcAxis.Set(x / fSine, y / fSine, z / fSine);
+}
+
+
+// KPQuaternion::FromMatrix ////
+////////////////////////////////
+//
+// Shepperd's method: the largest of the four elements is calculated from the
+// diagonal, it is far enough from 0 to divide the rest of them by it.
+void KPQuaternion::FromMatrix(const KPMatrix &m)
+{
+	float fTrace = m._11 + m._22 + m._33;
+	float s;
+
+	if ( fTrace > 0.0f )
+	{
+		s = 2.0f * sqrtf(fTrace + 1.0f);		// 4w
+		w = 0.25f * s;
+		x = ( m._23 - m._32 ) / s;
+		y = ( m._31 - m._13 ) / s;
+		z = ( m._12 - m._21 ) / s;
+	}
+	else if ( m._11 > m._22 && m._11 > m._33 )
+	{
+		s = 2.0f * sqrtf(1.0f + m._11 - m._22 - m._33);	// 4x
+		x = 0.25f * s;
+		w = ( m._23 - m._32 ) / s;
+		y = ( m._12 + m._21 ) / s;
+		z = ( m._31 + m._13 ) / s;
+	}
+	else if ( m._22 > m._33 )
+	{
+		s = 2.0f * sqrtf(1.0f + m._22 - m._11 - m._33);	// 4y
+		y = 0.25f * s;
+		w = ( m._31 - m._13 ) / s;
+		x = ( m._12 + m._21 ) / s;
+		z = ( m._23 + m._32 ) / s;
+	}
+	else
+	{
+		s = 2.0f * sqrtf(1.0f + m._33 - m._11 - m._22);	// 4z
+		z = 0.25f * s;
+		w = ( m._12 - m._21 ) / s;
+		x = ( m._31 + m._13 ) / s;
+		y = ( m._23 + m._32 ) / s;
+	}
+
+} // ! KPQuaternion::FromMatrix()
+
+
+// KPQuaternion::GetMatrix ////
+void KPQuaternion::GetMatrix(KPMatrix &m) const
+{
+	KPVector vcOne(1.0f, 1.0f, 1.0f);
+	KPVector vcZero(0.0f, 0.0f, 0.0f);
+
+	m.ScaleRotateTranslate(vcOne, *this, vcZero);
+}
+
+
+// KPQuaternion::Slerp ////
+///////////////////////////
+//
+// slerp = q0 * sin((1-t)a)/sin(a) + q1 * sin(ta)/sin(a), the weights are
+// the series in the Slerp Coefficients section of KPKernels.h evaluated
+// for t and 1 - t.
+void KPQuaternion::Slerp(const KPQuaternion &q0, const KPQuaternion &q1, float t)
+{
+	KPOps::Slerp(*this, q0, q1, t);
+}
+
+
+// KPBuildTRSMatrices ////
+//////////////////////////
+
+// Parameters of a KPBuildTRSMatrices call, passed to the worker threads
+typedef struct KPTRSJOB
+{
+	const KPTRS	*pIn;
+	KPMatrix	*pOut;
+} KPTRSJOB;
+
+// Array kernels, they build the [nBegin, nEnd) range of a call
+typedef void (*KPTRSKERNEL)(const KPTRSJOB *pJob, UINT nBegin, UINT nEnd);
+
+static void KPBuildTRSScalar(const KPTRSJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	for ( UINT i = nBegin; i < nEnd; ++i )
+		KPScalarOps::ScaleRotateTranslate(pJob->pOut[i], pJob->pIn[i].vcScale, pJob->pIn[i].qRotation, pJob->pIn[i].vcPosition);
+}
+
+#ifdef KP_SSE
+static void KPBuildTRSSSE(const KPTRSJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	for ( UINT i = nBegin; i < nEnd; ++i )
+		KPSSEOps::ScaleRotateTranslate(pJob->pOut[i], pJob->pIn[i].vcScale, pJob->pIn[i].qRotation, pJob->pIn[i].vcPosition);
+}
+#endif
+
+// A matrix is three rows of 4 floats, there is nothing for AVX to do
+static const KPTRSKERNEL g_pfnBuildTRS[KPISA_COUNT] = KPISA_TABLE_SSE(KPBuildTRS);
+KPISA_REGISTER(g_pfnBuildTRS, "TRS matrices");
+
+static void KPTRSJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	g_pfnBuildTRS[g_ISA]( (const KPTRSJOB*)pParam, nBegin, nEnd );
+}
+
+
+void KPBuildTRSMatrices(const KPTRS *pIn, KPMatrix *pOut, UINT nCount)
+{
+	KPTRSJOB job;
+
+	job.pIn	 = pIn;
+	job.pOut = pOut;
+
+	if ( nCount >= KPGetParallelThreshold(KPJOB_MATRIX) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_MATRIX), KPTRSJob, &job);
+	else
+		KPTRSJob(0, nCount, &job);
+
+} // ! KPBuildTRSMatrices
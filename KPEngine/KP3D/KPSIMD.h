@@ -0,0 +1,495 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPSIMD.h
+ *  Description: KPEngine Math Library SIMD helpers
+ *				 - Compile time instruction set detection
+ *				 - Array kernel tables
+ *				 - SSE intrinsic building blocks shared by
+ *				   the vector and matrix implementations
+ *
+ *****************************************************************
+*/
+
+// Outside the guard: KP3D.h includes this file back through KPInline.h,
+// which needs it complete
+#include "KP3D.h"
+
+#ifndef KPSIMD_H
+#define KPSIMD_H
+
+/*
+	The SIMD code paths used to be MSVC x86-32 inline assembly, which
+	neither the x64 compiler nor GCC/Clang understand. Intrinsics are
+	understood by all of them, and they let the compiler do the register
+	allocation for us too.
+
+	Instruction set levels:
+	  KP_SSE	- SSE1 single precision packed math. Always available on
+				  x86-64 and with MSVC on x86-32 (the intrinsics do not need
+				  /arch:SSE there), the array kernels are selected at runtime.
+	  KP_SSE_STATIC - The compiler targets SSE itself (x86-64, /arch:SSE or
+				  higher, -msse), every CPU running the build has it. The
+				  single vector operations use SSE unconditionally then,
+				  otherwise they are scalar.
+	  KP_SSE2	- SSE2 integer and cast intrinsics.
+	  KP_SSE41	- Blends, for the kernels of KPISA_SSE41.
+	  KP_AVX	- VEX encoded 256 bit operations for the array kernels of
+				  KPISA_AVX.
+	  KP_AVX_STATIC - The compiler targets AVX itself, the single vector
+				  operations are VEX encoded too then.
+	  KP_AVX2	- 256 bit integer operations, for KPISA_AVX2.
+	  KP_AVX512	- 512 bit AVX-512F operations, for KPISA_AVX512.
+	  KP_FMA	- Fused multiply-add in the matrix products, only when the
+				  compiler targets FMA3 (/arch:AVX2 implies it).
+
+	The kernels of SSE4.1 and above used to be compiled only when the
+	compiler targeted the instruction set, so a binary built for SSE2 never
+	ran them. Compilers with KP_SIMD_DISPATCH (GCC 5, Clang 9, VS2017 15.3
+	and later) compile every level: MSVC accepts the intrinsics without
+	/arch, GCC and Clang compile the code of a level between
+	KP_TARGET_<level>_BEGIN and KP_TARGET_END with the instruction set
+	enabled. Only the kernels may be compiled that way, they run only if
+	the CPU has the instruction set, see KPSetISA.
+
+	Precision:
+	  The SSE paths evaluate every expression in the same order as the
+	  scalar ones, ((x + y) + z) for sums, and use the correctly rounded
+	  SQRTSS/DIVPS instead of the RSQRT approximation. On a build where
+	  scalar float math is SSE math too (x86-64, or x86-32 with /arch:SSE2)
+	  the results are bit identical to the scalar path: 0 ULP.
+	  If the scalar path is compiled to x87 code, every multiply-add of it
+	  may round differently, up to 1 ULP per term, which is KPSIMD_MAXULP
+	  for the three term dot, length and vector*matrix operations.
+	  FMA contraction of the scalar code (-mfma, -ffp-contract=fast) drops
+	  the rounding of the products, near cancellation (cross products,
+	  perpendicular dot products) that can exceed any ULP bound of the
+	  result, so the reference must not be built that way.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__SSE__)
+	#define KP_SSE
+	#include <xmmintrin.h>
+#endif
+
+#if defined(KP_SSE) && ( defined(_M_X64) || defined(__SSE__) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 ) )
+	#define KP_SSE_STATIC
+#endif
+
+#if defined(KP_SSE) && ( defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__) )
+	#define KP_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(KP_SSE2) && ( ( defined(__clang__) && __clang_major__ >= 9 ) || \
+						  ( defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 5 ) || \
+						  ( defined(_MSC_VER) && _MSC_VER >= 1911 ) )
+	#define KP_SIMD_DISPATCH
+#endif
+
+#if defined(KP_SSE2) && defined(__AVX__)
+	#define KP_AVX_STATIC
+#endif
+
+#if defined(KP_SSE2) && ( defined(KP_SIMD_DISPATCH) || defined(__SSE4_1__) || defined(__AVX__) )
+	#define KP_SSE41
+	#include <smmintrin.h>
+#endif
+
+#if defined(KP_SSE41) && ( defined(KP_SIMD_DISPATCH) || defined(__AVX__) )
+	#define KP_AVX
+	#include <immintrin.h>
+#endif
+
+#if defined(KP_AVX) && ( defined(KP_SIMD_DISPATCH) || defined(__AVX2__) )
+	#define KP_AVX2
+#endif
+
+#if defined(KP_AVX2) && ( defined(KP_SIMD_DISPATCH) || defined(__AVX512F__) )
+	#define KP_AVX512
+#endif
+
+// MSVC has no __FMA__, /arch:AVX2 implies FMA3; -mavx2 of GCC does not
+#if defined(KP_AVX_STATIC) && ( defined(__FMA__) || ( defined(_MSC_VER) && defined(__AVX2__) ) )
+	#define KP_FMA
+#endif
+
+// Code regions of the instruction sets the compiler does not target
+#if defined(__clang__)
+	#define KP_TARGET_PRAGMA(...)	_Pragma(#__VA_ARGS__)
+	#define KP_TARGET_REGION(isa)	KP_TARGET_PRAGMA( clang attribute push (__attribute__((target(isa))), apply_to = function) )
+	#define KP_TARGET_END			_Pragma( "clang attribute pop" )
+#elif defined(__GNUC__)
+	#define KP_TARGET_PRAGMA(...)	_Pragma(#__VA_ARGS__)
+	#define KP_TARGET_REGION(isa)	_Pragma( "GCC push_options" ) KP_TARGET_PRAGMA( GCC target(isa) )
+	#define KP_TARGET_END			_Pragma( "GCC pop_options" )
+#else
+	#define KP_TARGET_REGION(isa)
+	#define KP_TARGET_END
+#endif
+
+#ifdef __SSE4_1__
+	#define KP_TARGET_SSE41_BEGIN
+	#define KP_TARGET_SSE41_END
+#else
+	#define KP_TARGET_SSE41_BEGIN	KP_TARGET_REGION("sse4.1")
+	#define KP_TARGET_SSE41_END		KP_TARGET_END
+#endif
+
+#ifdef __AVX__
+	#define KP_TARGET_AVX_BEGIN
+	#define KP_TARGET_AVX_END
+#else
+	#define KP_TARGET_AVX_BEGIN		KP_TARGET_REGION("avx")
+	#define KP_TARGET_AVX_END		KP_TARGET_END
+#endif
+
+#ifdef __AVX2__
+	#define KP_TARGET_AVX2_BEGIN
+	#define KP_TARGET_AVX2_END
+#else
+	#define KP_TARGET_AVX2_BEGIN	KP_TARGET_REGION("avx2")
+	#define KP_TARGET_AVX2_END		KP_TARGET_END
+#endif
+
+// AVX-512F implies FMA, and GCC contracts the multiply and add intrinsics
+// into fused multiply-adds (-ffp-contract=fast), which round differently
+// from the scalar code. Clang only contracts within a source expression.
+// GCC 12 also warns about the undefined source operand of its own
+// AVX-512 intrinsics.
+#if defined(__AVX512F__)
+	#define KP_TARGET_AVX512_BEGIN
+	#define KP_TARGET_AVX512_END
+#elif defined(__GNUC__) && !defined(__clang__)
+	#define KP_TARGET_AVX512_BEGIN	KP_TARGET_REGION("avx512f") _Pragma( "GCC optimize(\"fp-contract=off\")" ) \
+									_Pragma( "GCC diagnostic push" ) _Pragma( "GCC diagnostic ignored \"-Wuninitialized\"" ) \
+									_Pragma( "GCC diagnostic ignored \"-Wmaybe-uninitialized\"" )
+	#define KP_TARGET_AVX512_END	_Pragma( "GCC diagnostic pop" ) KP_TARGET_END
+#else
+	#define KP_TARGET_AVX512_BEGIN	KP_TARGET_REGION("avx512f")
+	#define KP_TARGET_AVX512_END	KP_TARGET_END
+#endif
+
+// Maximum difference between the SIMD and the scalar results in units in the last place
+#define KPSIMD_MAXULP	3
+
+
+// Array Kernels ////
+/////////////////////
+//
+// Every array operation has a kernel per instruction set in a table indexed
+// by KPISA, and calls the one of g_ISA. It is selected once, when the library
+// is loaded (KP3D.cpp), so the call costs a single indirect jump and the
+// loops of the kernels contain no feature checks.
+
+// Instruction set of the array kernels, see KPSetISA
+extern KPISA g_ISA;
+
+// The kernel nameSSE, nameSSE41, ... or the lower kernel lo if the build
+// has no code for the level
+#ifdef KP_SSE
+	#define KPISA_SSE_OR(name, lo)		name##SSE
+#else
+	#define KPISA_SSE_OR(name, lo)		lo
+#endif
+
+#ifdef KP_SSE41
+	#define KPISA_SSE41_OR(name, lo)	name##SSE41
+#else
+	#define KPISA_SSE41_OR(name, lo)	lo
+#endif
+
+#ifdef KP_AVX
+	#define KPISA_AVX_OR(name, lo)		name##AVX
+#else
+	#define KPISA_AVX_OR(name, lo)		lo
+#endif
+
+#ifdef KP_AVX2
+	#define KPISA_AVX2_OR(name, lo)		name##AVX2
+#else
+	#define KPISA_AVX2_OR(name, lo)		lo
+#endif
+
+#ifdef KP_AVX512
+	#define KPISA_AVX512_OR(name, lo)	name##AVX512
+#else
+	#define KPISA_AVX512_OR(name, lo)	lo
+#endif
+
+#define KPISA_S(name)	name##Scalar
+#define KPISA_E(name)	KPISA_SSE_OR( name, KPISA_S(name) )
+#define KPISA_A(name)	KPISA_AVX_OR( name, KPISA_E(name) )
+#define KPISA_F(name)	KPISA_SSE41_OR( name, KPISA_E(name) )
+
+// Initializers of the kernel tables, every level without a kernel gets the
+// one of the next lower level:
+//	KPISA_TABLE			- nameScalar, nameSSE, nameAVX
+//	KPISA_TABLE_SSE		- nameScalar, nameSSE
+//	KPISA_TABLE_AVX512	- nameScalar, nameSSE, nameAVX, nameAVX512
+//	KPISA_TABLE_INT		- nameScalar, nameSSE, nameAVX2, integer kernels
+//	KPISA_TABLE_INT41	- nameScalar, nameSSE, nameSSE41, nameAVX2
+#define KPISA_TABLE(name)			{ KPISA_S(name), KPISA_E(name), KPISA_E(name), KPISA_A(name), KPISA_A(name), KPISA_A(name) }
+#define KPISA_TABLE_SSE(name)		{ KPISA_S(name), KPISA_E(name), KPISA_E(name), KPISA_E(name), KPISA_E(name), KPISA_E(name) }
+#define KPISA_TABLE_AVX512(name)	{ KPISA_S(name), KPISA_E(name), KPISA_E(name), KPISA_A(name), KPISA_A(name), KPISA_AVX512_OR( name, KPISA_A(name) ) }
+#define KPISA_TABLE_INT(name)		{ KPISA_S(name), KPISA_E(name), KPISA_E(name), KPISA_E(name), \
+									  KPISA_AVX2_OR( name, KPISA_E(name) ), KPISA_AVX2_OR( name, KPISA_E(name) ) }
+#define KPISA_TABLE_INT41(name)		{ KPISA_S(name), KPISA_E(name), KPISA_F(name), KPISA_F(name), \
+									  KPISA_AVX2_OR( name, KPISA_F(name) ), KPISA_AVX2_OR( name, KPISA_F(name) ) }
+
+
+// Kernel Registry ////
+///////////////////////
+//
+// Every kernel table is registered under a name for the reports:
+//
+//	static const KPSINCOSKERNEL g_pfnSinCos[KPISA_COUNT] = KPISA_TABLE(KPSinCosArray);
+//	KPISA_REGISTER(g_pfnSinCos, "sincos");
+//
+// The levels a kernel has no variant for hold the kernel of the next lower
+// level, so the variant that runs is the lowest level with the same kernel.
+
+typedef KPISA (*KPKERNELISAFN)(const void *pTable, KPISA Isa);
+
+template <class F> KPISA KPKernelISA(const void *pTable, KPISA Isa)
+{
+	const F *pfnTable = (const F*)pTable;
+	int		i		  = Isa;
+
+	while ( i > KPISA_SCALAR && pfnTable[i - 1] == pfnTable[Isa] )
+		--i;
+
+	return (KPISA)i;
+}
+
+// Adds a kernel table to the registry, KP3D.cpp
+bool KPRegisterKernel(const char *chName, const void *pTable, KPKERNELISAFN pfnISA);
+
+template <class F> bool KPRegisterKernel(const char *chName, const F (&pfnTable)[KPISA_COUNT])
+{
+	return KPRegisterKernel( chName, pfnTable, KPKernelISA<F> );
+}
+
+#define KPISA_REGISTER(table, chName)	static bool table##Registered = KPRegisterKernel(chName, table)
+
+
+#ifdef KP_SSE
+
+// Shuffle helper, broadcasts one element of the register into all four
+#define KPSSE_SPLAT(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+
+
+// KPSSELoad ////
+// Loads the four coordinates of a vector, KPVector has no alignment guarantee.
+inline __m128 KPSSELoad(const KPVector &v)
+{
+	return _mm_loadu_ps(&v.x);
+}
+
+
+// KPSSEStore3 ////
+// Stores the x, y, z elements of the register, leaving the w coordinate untouched.
+inline void KPSSEStore3(KPVector &v, __m128 r)
+{
+	float w = v.w;
+	_mm_storeu_ps(&v.x, r);
+	v.w = w;
+}
+
+
+// KPSSEDot3 ////
+/////////////////
+//
+// Three component dot product, the result is in all four elements.
+// The w elements of the operands are ignored.
+inline __m128 KPSSEDot3(__m128 a, __m128 b)
+{
+	// SSE4.1 has DPPS for this, but it has a much longer latency than
+	// the three shuffles and two adds below, the benchmark shows it
+	// about 1.5x slower for a single dot product.
+	__m128 m = _mm_mul_ps(a, b);		// ax*bx ay*by az*bz aw*bw
+
+	return _mm_add_ps( _mm_add_ps( KPSSE_SPLAT(m, 0), KPSSE_SPLAT(m, 1) ), KPSSE_SPLAT(m, 2) );
+} // ! KPSSEDot3
+
+
+// KPSSEDot4 ////
+// Four component dot product, evaluated as ((x + y) + z) + w, the result is in all four elements.
+inline __m128 KPSSEDot4(__m128 a, __m128 b)
+{
+	__m128 m = _mm_mul_ps(a, b);
+
+	return _mm_add_ps( _mm_add_ps( _mm_add_ps( KPSSE_SPLAT(m, 0), KPSSE_SPLAT(m, 1) ), KPSSE_SPLAT(m, 2) ), KPSSE_SPLAT(m, 3) );
+}
+
+
+// KPSSERsqrtStep ////
+///////////////////////
+//
+// One Newton-Raphson step on the RSQRTPS estimate r of 1 / sqrt(a):
+// r * (1.5 - (0.5 * a * r) * r), the 12 bit estimate becomes about 22 bits.
+inline __m128 KPSSERsqrtStep(__m128 a, __m128 r)
+{
+	__m128 h = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps(0.5f), a ), r );
+
+	return _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps(1.5f), _mm_mul_ps(h, r) ) );
+} // ! KPSSERsqrtStep
+
+
+// KPSSECross ////
+//////////////////
+//
+// Three component cross product, the w element of the result is 0.
+//
+// <a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x>
+inline __m128 KPSSECross(__m128 a, __m128 b)
+{
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+
+	return _mm_sub_ps( _mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX) );
+} // ! KPSSECross
+
+
+// KPSSETransform ////
+//////////////////////
+//
+// Row vector * matrix product with an implicit w = 1.
+// Evaluated as ((x*row1 + y*row2) + z*row3) + row4, like the scalar code.
+inline __m128 KPSSETransform(__m128 v, const KPMatrix &m)
+{
+	__m128 r;
+
+	r = _mm_mul_ps( KPSSE_SPLAT(v, 0), _mm_loadu_ps(&m._11) );
+	r = _mm_add_ps( r, _mm_mul_ps( KPSSE_SPLAT(v, 1), _mm_loadu_ps(&m._21) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( KPSSE_SPLAT(v, 2), _mm_loadu_ps(&m._31) ) );
+	r = _mm_add_ps( r, _mm_loadu_ps(&m._41) );
+
+	return r;
+} // ! KPSSETransform
+
+
+// KPSSEMatRow ////
+///////////////////
+//
+// One row of a matrix product: a * B, where a is a row of the left matrix
+// and b1..b4 are the rows of the right matrix.
+// Evaluated as ((a1*b1 + a2*b2) + a3*b3) + a4*b4, like the scalar code.
+inline __m128 KPSSEMatRow(__m128 a, __m128 b1, __m128 b2, __m128 b3, __m128 b4)
+{
+	__m128 r;
+
+	r = _mm_mul_ps( KPSSE_SPLAT(a, 0), b1 );
+	r = _mm_add_ps( r, _mm_mul_ps( KPSSE_SPLAT(a, 1), b2 ) );
+	r = _mm_add_ps( r, _mm_mul_ps( KPSSE_SPLAT(a, 2), b3 ) );
+	r = _mm_add_ps( r, _mm_mul_ps( KPSSE_SPLAT(a, 3), b4 ) );
+
+	return r;
+} // ! KPSSEMatRow
+
+
+// KPSSEGather ////
+// Loads the coordinates of 4 strided vertices into x, y, z registers.
+inline void KPSSEGather(const char *p, UINT nStride, __m128 &x, __m128 &y, __m128 &z)
+{
+	const float *v0 = (const float*)( p );
+	const float *v1 = (const float*)( p + nStride );
+	const float *v2 = (const float*)( p + nStride*2 );
+	const float *v3 = (const float*)( p + nStride*3 );
+
+	// With at least 16 bytes per vertex a 4 float load does not read past the array
+	if ( nStride >= 16 )
+	{
+		__m128 a0 = _mm_loadu_ps(v0);
+		__m128 a1 = _mm_loadu_ps(v1);
+		__m128 a2 = _mm_loadu_ps(v2);
+		__m128 a3 = _mm_loadu_ps(v3);
+
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+
+		x = a0;
+		y = a1;
+		z = a2;
+	}
+	else
+	{
+		x = _mm_set_ps(v3[0], v2[0], v1[0], v0[0]);
+		y = _mm_set_ps(v3[1], v2[1], v1[1], v0[1]);
+		z = _mm_set_ps(v3[2], v2[2], v1[2], v0[2]);
+	}
+} // ! KPSSEGather
+
+
+// KPSSEScatter ////
+// Stores the x, y, z registers into 4 strided vertices, the rest of the vertex is untouched.
+inline void KPSSEScatter(char *p, UINT nStride, __m128 x, __m128 y, __m128 z)
+{
+	__m128 w = _mm_setzero_ps();
+
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	__m128 v[4] = { x, y, z, w };
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		float *o = (float*)( p + nStride*i );
+
+		_mm_storel_pi( (__m64*)o, v[i] );					// x, y
+		_mm_store_ss( o + 2, _mm_movehl_ps(v[i], v[i]) );	// z
+	}
+} // ! KPSSEScatter
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// Shuffle helper, broadcasts one element of both 128 bit lanes into the lane
+#define KPAVX_SPLAT(v, i) _mm256_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+
+// KPAVXRsqrtStep ////
+// KPSSERsqrtStep for 8 values
+inline __m256 KPAVXRsqrtStep(__m256 a, __m256 r)
+{
+	__m256 h = _mm256_mul_ps( _mm256_mul_ps( _mm256_set1_ps(0.5f), a ), r );
+
+	return _mm256_mul_ps( r, _mm256_sub_ps( _mm256_set1_ps(1.5f), _mm256_mul_ps(h, r) ) );
+} // ! KPAVXRsqrtStep
+
+// Joins two 4 wide registers
+#define KPAVX_JOIN(lo, hi) _mm256_insertf128_ps( _mm256_castps128_ps256(lo), (hi), 1 )
+
+// KPAVXMatRows ////
+////////////////////
+//
+// Two rows of a matrix product at once: the low lane of a holds a row of the
+// left matrix, the high lane the next one. b1..b4 hold the rows of the right
+// matrix in both lanes.
+inline __m256 KPAVXMatRows(__m256 a, __m256 b1, __m256 b2, __m256 b3, __m256 b4)
+{
+	__m256 r;
+
+	r = _mm256_mul_ps( KPAVX_SPLAT(a, 0), b1 );
+#ifdef KP_FMA
+	r = _mm256_fmadd_ps( KPAVX_SPLAT(a, 1), b2, r );
+	r = _mm256_fmadd_ps( KPAVX_SPLAT(a, 2), b3, r );
+	r = _mm256_fmadd_ps( KPAVX_SPLAT(a, 3), b4, r );
+#else
+	r = _mm256_add_ps( r, _mm256_mul_ps( KPAVX_SPLAT(a, 1), b2 ) );
+	r = _mm256_add_ps( r, _mm256_mul_ps( KPAVX_SPLAT(a, 2), b3 ) );
+	r = _mm256_add_ps( r, _mm256_mul_ps( KPAVX_SPLAT(a, 3), b4 ) );
+#endif
+
+	return r;
+} // ! KPAVXMatRows
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#endif // ! KP_SSE
+
+#endif // ! KPSIMD_H
@@ -0,0 +1,233 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPSkinning.cpp
+ *  Description: KPEngine linear blend skinning kernels
+ *
+ *				 Every vertex blends the palette matrices of its
+ *				 bones by the weights, then transforms its position
+ *				 and normal by the blended matrix. The influences
+ *				 are sorted by weight, so the loop stops at the
+ *				 first zero weight.
+ *
+ *				 The SSE kernel keeps the four blended matrix rows
+ *				 in registers, the AVX kernel blends two rows per
+ *				 instruction. The output is written 16 bytes at a
+ *				 time, in order, which suits write combined memory
+ *				 (locked dynamic vertex buffers).
+ *
+ *****************************************************************
+*/
+
+#include "KPAnimation.h"
+#include "KPSIMD.h"
+
+
+// KPSkinScalar ////
+////////////////////
+//
+// Sums in the same order as the SIMD kernels, the results are the same.
+static inline void KPSkinScalar(const KPSKINVERTEX *pIn, const KPMatrix *pPalette, float *pOut)
+{
+	float r[4][3];		// First three columns of the blended matrix
+
+	const float *pM = &pPalette[ pIn->nBones[0] ]._11;
+	float		w	= pIn->fWeights[0];
+
+	for ( int i = 0; i < 4; ++i )
+		for ( int j = 0; j < 3; ++j )
+			r[i][j] = w * pM[4*i + j];
+
+	for ( int k = 1; k < KPMAX_INFLUENCES && pIn->fWeights[k] != 0.0f; ++k )
+	{
+		pM	= &pPalette[ pIn->nBones[k] ]._11;
+		w	= pIn->fWeights[k];
+
+		for ( int i = 0; i < 4; ++i )
+			for ( int j = 0; j < 3; ++j )
+				r[i][j] = r[i][j] + w * pM[4*i + j];
+	}
+
+	const float *n = pIn->vcNormal;
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		pOut[j]		= pIn->x*r[0][j] + pIn->y*r[1][j] + pIn->z*r[2][j] + r[3][j];
+		pOut[3 + j] = n[0]*r[0][j] + n[1]*r[1][j] + n[2]*r[2][j];
+	}
+
+	float fLength = sqrtf( pOut[3]*pOut[3] + pOut[4]*pOut[4] + pOut[5]*pOut[5] );
+
+	if ( fLength > 0.0f )
+	{
+		pOut[3] /= fLength;
+		pOut[4] /= fLength;
+		pOut[5] /= fLength;
+	}
+
+	pOut[6] = pIn->tu;
+	pOut[7] = pIn->tv;
+
+} // ! KPSkinScalar
+
+
+#ifdef KP_SSE
+
+// KPSSESkinStore ////
+//////////////////////
+//
+// Normalizes the normal and writes the position, normal, tu, tv of a vertex
+static inline void KPSSESkinStore(__m128 vcPos, __m128 vcNormal, const KPSKINVERTEX *pIn, float *pOut)
+{
+	__m128 fLength = _mm_sqrt_ps( KPSSEDot3(vcNormal, vcNormal) );
+
+	if ( _mm_cvtss_f32(fLength) > 0.0f )
+		vcNormal = _mm_div_ps(vcNormal, fLength);
+
+	// px py pz nx | ny nz tu tv
+	__m128 t	= _mm_shuffle_ps( vcPos, vcNormal, _MM_SHUFFLE(0, 0, 2, 2) );		// pz pz nx nx
+	__m128 a	= _mm_shuffle_ps( vcPos, t,		 _MM_SHUFFLE(2, 0, 1, 0) );		// px py pz nx
+	__m128 uv	= _mm_loadl_pi( _mm_setzero_ps(), (const __m64*)&pIn->tu );		// tu tv 0  0
+	__m128 b	= _mm_shuffle_ps( vcNormal, uv, _MM_SHUFFLE(1, 0, 2, 1) );		// ny nz tu tv
+
+	_mm_storeu_ps(pOut,		a);
+	_mm_storeu_ps(pOut + 4, b);
+
+} // ! KPSSESkinStore
+
+
+// KPSSESkin ////
+/////////////////
+static inline void KPSSESkin(const KPSKINVERTEX *pIn, const KPMatrix *pPalette, float *pOut)
+{
+	const float *pM = &pPalette[ pIn->nBones[0] ]._11;
+	__m128		w	= _mm_set1_ps( pIn->fWeights[0] );
+
+	__m128 r1 = _mm_mul_ps( w, _mm_loadu_ps(pM) );
+	__m128 r2 = _mm_mul_ps( w, _mm_loadu_ps(pM + 4) );
+	__m128 r3 = _mm_mul_ps( w, _mm_loadu_ps(pM + 8) );
+	__m128 r4 = _mm_mul_ps( w, _mm_loadu_ps(pM + 12) );
+
+	for ( int k = 1; k < KPMAX_INFLUENCES && pIn->fWeights[k] != 0.0f; ++k )
+	{
+		pM	= &pPalette[ pIn->nBones[k] ]._11;
+		w	= _mm_set1_ps( pIn->fWeights[k] );
+
+		r1 = _mm_add_ps( r1, _mm_mul_ps( w, _mm_loadu_ps(pM) ) );
+		r2 = _mm_add_ps( r2, _mm_mul_ps( w, _mm_loadu_ps(pM + 4) ) );
+		r3 = _mm_add_ps( r3, _mm_mul_ps( w, _mm_loadu_ps(pM + 8) ) );
+		r4 = _mm_add_ps( r4, _mm_mul_ps( w, _mm_loadu_ps(pM + 12) ) );
+	}
+
+	__m128 vcPos, vcNormal;
+
+	vcPos = _mm_mul_ps( _mm_set1_ps(pIn->x), r1 );
+	vcPos = _mm_add_ps( vcPos, _mm_mul_ps( _mm_set1_ps(pIn->y), r2 ) );
+	vcPos = _mm_add_ps( vcPos, _mm_mul_ps( _mm_set1_ps(pIn->z), r3 ) );
+	vcPos = _mm_add_ps( vcPos, r4 );
+
+	vcNormal = _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[0]), r1 );
+	vcNormal = _mm_add_ps( vcNormal, _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[1]), r2 ) );
+	vcNormal = _mm_add_ps( vcNormal, _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[2]), r3 ) );
+
+	KPSSESkinStore(vcPos, vcNormal, pIn, pOut);
+
+} // ! KPSSESkin
+
+#endif // ! KP_SSE
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// KPAVXSkin ////
+/////////////////
+//
+// Blends rows 1-2 and 3-4 of the palette matrices in one register each
+static inline void KPAVXSkin(const KPSKINVERTEX *pIn, const KPMatrix *pPalette, float *pOut)
+{
+	const float *pM = &pPalette[ pIn->nBones[0] ]._11;
+	__m256		w	= _mm256_set1_ps( pIn->fWeights[0] );
+
+	__m256 r12 = _mm256_mul_ps( w, _mm256_loadu_ps(pM) );
+	__m256 r34 = _mm256_mul_ps( w, _mm256_loadu_ps(pM + 8) );
+
+	for ( int k = 1; k < KPMAX_INFLUENCES && pIn->fWeights[k] != 0.0f; ++k )
+	{
+		pM	= &pPalette[ pIn->nBones[k] ]._11;
+		w	= _mm256_set1_ps( pIn->fWeights[k] );
+
+#ifdef KP_FMA
+		r12 = _mm256_fmadd_ps( w, _mm256_loadu_ps(pM),	   r12 );
+		r34 = _mm256_fmadd_ps( w, _mm256_loadu_ps(pM + 8), r34 );
+#else
+		r12 = _mm256_add_ps( r12, _mm256_mul_ps( w, _mm256_loadu_ps(pM) ) );
+		r34 = _mm256_add_ps( r34, _mm256_mul_ps( w, _mm256_loadu_ps(pM + 8) ) );
+#endif
+	}
+
+	__m128 r1 = _mm256_castps256_ps128(r12);
+	__m128 r2 = _mm256_extractf128_ps(r12, 1);
+	__m128 r3 = _mm256_castps256_ps128(r34);
+	__m128 r4 = _mm256_extractf128_ps(r34, 1);
+
+	__m128 vcPos, vcNormal;
+
+	vcPos = _mm_mul_ps( _mm_set1_ps(pIn->x), r1 );
+	vcPos = _mm_add_ps( vcPos, _mm_mul_ps( _mm_set1_ps(pIn->y), r2 ) );
+	vcPos = _mm_add_ps( vcPos, _mm_mul_ps( _mm_set1_ps(pIn->z), r3 ) );
+	vcPos = _mm_add_ps( vcPos, r4 );
+
+	vcNormal = _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[0]), r1 );
+	vcNormal = _mm_add_ps( vcNormal, _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[1]), r2 ) );
+	vcNormal = _mm_add_ps( vcNormal, _mm_mul_ps( _mm_set1_ps(pIn->vcNormal[2]), r3 ) );
+
+	KPSSESkinStore(vcPos, vcNormal, pIn, pOut);
+
+} // ! KPAVXSkin
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+
+// KPSkinVertices ////
+////////////////////////
+//
+// One loop per instruction set, so the vertex kernel is inlined into it
+
+typedef void (*KPSKINKERNEL)(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, unsigned char *pDest, UINT nOutStride, UINT nCount);
+
+static void KPSkinArrayScalar(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, unsigned char *pDest, UINT nOutStride, UINT nCount)
+{
+	for ( UINT i = 0; i < nCount; ++i, pDest += nOutStride )
+		KPSkinScalar(&pVertices[i], pPalette, (float*)pDest);
+}
+
+#ifdef KP_SSE
+static void KPSkinArraySSE(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, unsigned char *pDest, UINT nOutStride, UINT nCount)
+{
+	for ( UINT i = 0; i < nCount; ++i, pDest += nOutStride )
+		KPSSESkin(&pVertices[i], pPalette, (float*)pDest);
+}
+#endif
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+static void KPSkinArrayAVX(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, unsigned char *pDest, UINT nOutStride, UINT nCount)
+{
+	for ( UINT i = 0; i < nCount; ++i, pDest += nOutStride )
+		KPAVXSkin(&pVertices[i], pPalette, (float*)pDest);
+}
+KP_TARGET_AVX_END
+#endif
+
+static const KPSKINKERNEL g_pfnSkinArray[KPISA_COUNT] = KPISA_TABLE(KPSkinArray);
+KPISA_REGISTER(g_pfnSkinArray, "skinning");
+
+void KPSkinVertices(const KPSKINVERTEX *pVertices, const KPMatrix *pPalette, void *pOut, UINT nOutStride, UINT nCount)
+{
+	g_pfnSkinArray[g_ISA](pVertices, pPalette, (unsigned char*)pOut, nOutStride, nCount);
+}
@@ -0,0 +1,520 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPTransform.cpp
+ *  Description: KPEngine Matrix array transformations
+ *				 - Points with and without the division by w
+ *				 - Normals
+ *				 - Strided (VERTEX, LVERTEX) and SoA streams
+ *
+ *				 The SIMD kernels process 4 (8 with AVX) vertices
+ *				 per iteration in SoA form: the coordinates of
+ *				 4 strided vertices are transposed into an x, y
+ *				 and z register, every matrix element is broadcast
+ *				 into a register, so a vertex costs the same 12
+ *				 multiplies and adds as the scalar code, 4 at once.
+ *
+ *				 Large arrays are split between the worker threads.
+ *
+ *****************************************************************
+*/
+
+#include "KP3D.h"
+#include "KPSIMD.h"
+#include "KPJobs.h"
+
+
+// Transformation modes
+typedef enum KPTRANSFORMMODE
+{
+	KPTM_POINTS,		// 4x4 transformation and division by w
+	KPTM_AFFINE,		// 4x3 transformation, w is ignored
+	KPTM_NORMALS		// 3x3 transformation, no translation
+} KPTRANSFORMMODE;
+
+// Parameters of a transformation call, passed to the worker threads
+typedef struct KPTRANSFORMJOB
+{
+	const KPMatrix		*pMatrix;
+	KPTRANSFORMMODE		Mode;
+
+	// Strided arrays
+	const float			*pIn;
+	float				*pOut;
+	UINT				nInStride;
+	UINT				nOutStride;
+
+	// SoA streams, used when pIn is NULL
+	KPSOASTREAM			In;
+	KPSOASTREAM			Out;
+
+} KPTRANSFORMJOB;
+
+
+// Scalar Kernels ////
+//////////////////////
+
+// Transforms a single vertex, the same math as KPVector::operator*(KPMatrix)
+static inline void KPTransformScalar(const KPMatrix &m, KPTRANSFORMMODE Mode,
+									 float x, float y, float z, float *pX, float *pY, float *pZ)
+{
+	float ox, oy, oz, ow;
+
+	if ( Mode == KPTM_NORMALS )
+	{
+		*pX = x*m._11 + y*m._21 + z*m._31;
+		*pY = x*m._12 + y*m._22 + z*m._32;
+		*pZ = x*m._13 + y*m._23 + z*m._33;
+		return;
+	}
+
+	ox = x*m._11 + y*m._21 + z*m._31 + m._41;
+	oy = x*m._12 + y*m._22 + z*m._32 + m._42;
+	oz = x*m._13 + y*m._23 + z*m._33 + m._43;
+
+	if ( Mode == KPTM_POINTS )
+	{
+		ow = x*m._14 + y*m._24 + z*m._34 + m._44;
+
+		ox /= ow;
+		oy /= ow;
+		oz /= ow;
+	}
+
+	*pX = ox;
+	*pY = oy;
+	*pZ = oz;
+}
+
+static void KPTransformStridedScalar(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const char	*pIn	= (const char*)pJob->pIn + (size_t)nBegin * pJob->nInStride;
+	char		*pOut	= (char*)pJob->pOut + (size_t)nBegin * pJob->nOutStride;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		const float *v = (const float*)pIn;
+		float		*o = (float*)pOut;
+
+		KPTransformScalar(*pJob->pMatrix, pJob->Mode, v[0], v[1], v[2], &o[0], &o[1], &o[2]);
+
+		pIn  += pJob->nInStride;
+		pOut += pJob->nOutStride;
+	}
+}
+
+static void KPTransformStreamScalar(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		KPTransformScalar(*pJob->pMatrix, pJob->Mode, pJob->In.pX[i], pJob->In.pY[i], pJob->In.pZ[i],
+						  &pJob->Out.pX[i], &pJob->Out.pY[i], &pJob->Out.pZ[i]);
+	}
+}
+
+
+#ifdef KP_SSE
+
+// SSE Kernels ////
+///////////////////
+
+// Matrix with every element broadcast into a register
+typedef struct KPSSEMATRIX
+{
+	__m128 m[4][4];		// [row][column]
+} KPSSEMATRIX;
+
+static inline void KPSSEBroadcast(const KPMatrix &m, KPSSEMATRIX *pM)
+{
+	const float *f = &m._11;
+
+	for ( int r = 0; r < 4; ++r )
+		for ( int c = 0; c < 4; ++c )
+			pM->m[r][c] = _mm_set1_ps( f[r*4 + c] );
+}
+
+// Transforms 4 vertices in SoA form, the evaluation order matches the scalar kernel
+static inline void KPTransformSSE(const KPSSEMATRIX &M, KPTRANSFORMMODE Mode, __m128 &x, __m128 &y, __m128 &z)
+{
+	__m128 ox, oy, oz, ow;
+
+	ox = _mm_add_ps( _mm_add_ps( _mm_mul_ps(x, M.m[0][0]), _mm_mul_ps(y, M.m[1][0]) ), _mm_mul_ps(z, M.m[2][0]) );
+	oy = _mm_add_ps( _mm_add_ps( _mm_mul_ps(x, M.m[0][1]), _mm_mul_ps(y, M.m[1][1]) ), _mm_mul_ps(z, M.m[2][1]) );
+	oz = _mm_add_ps( _mm_add_ps( _mm_mul_ps(x, M.m[0][2]), _mm_mul_ps(y, M.m[1][2]) ), _mm_mul_ps(z, M.m[2][2]) );
+
+	if ( Mode != KPTM_NORMALS )
+	{
+		ox = _mm_add_ps(ox, M.m[3][0]);
+		oy = _mm_add_ps(oy, M.m[3][1]);
+		oz = _mm_add_ps(oz, M.m[3][2]);
+
+		if ( Mode == KPTM_POINTS )
+		{
+			ow = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(x, M.m[0][3]), _mm_mul_ps(y, M.m[1][3]) ),
+										 _mm_mul_ps(z, M.m[2][3]) ), M.m[3][3] );
+
+			ox = _mm_div_ps(ox, ow);
+			oy = _mm_div_ps(oy, ow);
+			oz = _mm_div_ps(oz, ow);
+		}
+	}
+
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernels ////
+///////////////////
+
+typedef struct KPAVXMATRIX
+{
+	__m256 m[4][4];		// [row][column]
+} KPAVXMATRIX;
+
+static inline void KPAVXBroadcast(const KPMatrix &m, KPAVXMATRIX *pM)
+{
+	const float *f = &m._11;
+
+	for ( int r = 0; r < 4; ++r )
+		for ( int c = 0; c < 4; ++c )
+			pM->m[r][c] = _mm256_set1_ps( f[r*4 + c] );
+}
+
+// Transforms 8 vertices in SoA form, the evaluation order matches the scalar kernel
+static inline void KPTransformAVX(const KPAVXMATRIX &M, KPTRANSFORMMODE Mode, __m256 &x, __m256 &y, __m256 &z)
+{
+	__m256 ox, oy, oz, ow;
+
+	ox = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(x, M.m[0][0]), _mm256_mul_ps(y, M.m[1][0]) ), _mm256_mul_ps(z, M.m[2][0]) );
+	oy = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(x, M.m[0][1]), _mm256_mul_ps(y, M.m[1][1]) ), _mm256_mul_ps(z, M.m[2][1]) );
+	oz = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(x, M.m[0][2]), _mm256_mul_ps(y, M.m[1][2]) ), _mm256_mul_ps(z, M.m[2][2]) );
+
+	if ( Mode != KPTM_NORMALS )
+	{
+		ox = _mm256_add_ps(ox, M.m[3][0]);
+		oy = _mm256_add_ps(oy, M.m[3][1]);
+		oz = _mm256_add_ps(oz, M.m[3][2]);
+
+		if ( Mode == KPTM_POINTS )
+		{
+			ow = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(x, M.m[0][3]), _mm256_mul_ps(y, M.m[1][3]) ),
+											   _mm256_mul_ps(z, M.m[2][3]) ), M.m[3][3] );
+
+			ox = _mm256_div_ps(ox, ow);
+			oy = _mm256_div_ps(oy, ow);
+			oz = _mm256_div_ps(oz, ow);
+		}
+	}
+
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+
+static void KPTransformStridedSSE(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const char	*pIn		= (const char*)pJob->pIn + (size_t)nBegin * pJob->nInStride;
+	char		*pOut		= (char*)pJob->pOut + (size_t)nBegin * pJob->nOutStride;
+	UINT		nInStride	= pJob->nInStride;
+	UINT		nOutStride	= pJob->nOutStride;
+	UINT		i			= nBegin;
+	__m128		x, y, z;
+
+	KPSSEMATRIX M;
+	KPSSEBroadcast(*pJob->pMatrix, &M);
+
+	for ( ; i + 4 <= nEnd; i += 4 )
+	{
+		KPSSEGather(pIn, nInStride, x, y, z);
+		KPTransformSSE(M, pJob->Mode, x, y, z);
+		KPSSEScatter(pOut, nOutStride, x, y, z);
+
+		pIn  += nInStride * 4;
+		pOut += nOutStride * 4;
+	}
+
+	// The last 0-3 vertices
+	KPTransformStridedScalar(pJob, i, nEnd);
+}
+
+static void KPTransformStreamSSE(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPSOASTREAM	&In		= pJob->In;
+	const KPSOASTREAM	&Out	= pJob->Out;
+	UINT				i		= nBegin;
+
+	KPSSEMATRIX M;
+	KPSSEBroadcast(*pJob->pMatrix, &M);
+
+	for ( ; i + 4 <= nEnd; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps(In.pX + i);
+		__m128 y = _mm_loadu_ps(In.pY + i);
+		__m128 z = _mm_loadu_ps(In.pZ + i);
+
+		KPTransformSSE(M, pJob->Mode, x, y, z);
+
+		_mm_storeu_ps(Out.pX + i, x);
+		_mm_storeu_ps(Out.pY + i, y);
+		_mm_storeu_ps(Out.pZ + i, z);
+	}
+
+	// The last 0-3 vertices
+	KPTransformStreamScalar(pJob, i, nEnd);
+}
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+static void KPTransformStridedAVX(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const char	*pIn		= (const char*)pJob->pIn + (size_t)nBegin * pJob->nInStride;
+	char		*pOut		= (char*)pJob->pOut + (size_t)nBegin * pJob->nOutStride;
+	UINT		nInStride	= pJob->nInStride;
+	UINT		nOutStride	= pJob->nOutStride;
+	UINT		i			= nBegin;
+
+	KPAVXMATRIX M8;
+	KPAVXBroadcast(*pJob->pMatrix, &M8);
+
+	for ( ; i + 8 <= nEnd; i += 8 )
+	{
+		__m128 x, y, z, x1, y1, z1;
+
+		KPSSEGather(pIn,				 nInStride, x,  y,  z);
+		KPSSEGather(pIn + nInStride * 4, nInStride, x1, y1, z1);
+
+		__m256 X = KPAVX_JOIN(x, x1);
+		__m256 Y = KPAVX_JOIN(y, y1);
+		__m256 Z = KPAVX_JOIN(z, z1);
+
+		KPTransformAVX(M8, pJob->Mode, X, Y, Z);
+
+		KPSSEScatter(pOut,					nOutStride, _mm256_castps256_ps128(X), _mm256_castps256_ps128(Y), _mm256_castps256_ps128(Z));
+		KPSSEScatter(pOut + nOutStride * 4, nOutStride, _mm256_extractf128_ps(X, 1), _mm256_extractf128_ps(Y, 1), _mm256_extractf128_ps(Z, 1));
+
+		pIn  += nInStride * 8;
+		pOut += nOutStride * 8;
+	}
+
+	// The last 0-7 vertices
+	KPTransformStridedSSE(pJob, i, nEnd);
+}
+
+static void KPTransformStreamAVX(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPSOASTREAM	&In		= pJob->In;
+	const KPSOASTREAM	&Out	= pJob->Out;
+	UINT				i		= nBegin;
+
+	KPAVXMATRIX M8;
+	KPAVXBroadcast(*pJob->pMatrix, &M8);
+
+	for ( ; i + 8 <= nEnd; i += 8 )
+	{
+		__m256 x = _mm256_loadu_ps(In.pX + i);
+		__m256 y = _mm256_loadu_ps(In.pY + i);
+		__m256 z = _mm256_loadu_ps(In.pZ + i);
+
+		KPTransformAVX(M8, pJob->Mode, x, y, z);
+
+		_mm256_storeu_ps(Out.pX + i, x);
+		_mm256_storeu_ps(Out.pY + i, y);
+		_mm256_storeu_ps(Out.pZ + i, z);
+	}
+
+	// The last 0-7 vertices
+	KPTransformStreamSSE(pJob, i, nEnd);
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#ifdef KP_AVX512
+KP_TARGET_AVX512_BEGIN
+
+// AVX-512 Kernel ////
+//////////////////////
+//
+// 16 vertices at once, see KPTransformAVX
+
+typedef struct KPAVX512MATRIX
+{
+	__m512 m[4][4];		// [row][column]
+} KPAVX512MATRIX;
+
+static inline void KPTransformAVX512(const KPAVX512MATRIX &M, KPTRANSFORMMODE Mode, __m512 &x, __m512 &y, __m512 &z)
+{
+	__m512 ox, oy, oz, ow;
+
+	ox = _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps(x, M.m[0][0]), _mm512_mul_ps(y, M.m[1][0]) ), _mm512_mul_ps(z, M.m[2][0]) );
+	oy = _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps(x, M.m[0][1]), _mm512_mul_ps(y, M.m[1][1]) ), _mm512_mul_ps(z, M.m[2][1]) );
+	oz = _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps(x, M.m[0][2]), _mm512_mul_ps(y, M.m[1][2]) ), _mm512_mul_ps(z, M.m[2][2]) );
+
+	if ( Mode != KPTM_NORMALS )
+	{
+		ox = _mm512_add_ps(ox, M.m[3][0]);
+		oy = _mm512_add_ps(oy, M.m[3][1]);
+		oz = _mm512_add_ps(oz, M.m[3][2]);
+
+		if ( Mode == KPTM_POINTS )
+		{
+			ow = _mm512_add_ps( _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps(x, M.m[0][3]), _mm512_mul_ps(y, M.m[1][3]) ),
+											   _mm512_mul_ps(z, M.m[2][3]) ), M.m[3][3] );
+
+			ox = _mm512_div_ps(ox, ow);
+			oy = _mm512_div_ps(oy, ow);
+			oz = _mm512_div_ps(oz, ow);
+		}
+	}
+
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+static void KPTransformStreamAVX512(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	const KPSOASTREAM	&In		= pJob->In;
+	const KPSOASTREAM	&Out	= pJob->Out;
+	const float			*f		= &pJob->pMatrix->_11;
+	UINT				i		= nBegin;
+
+	KPAVX512MATRIX M16;
+
+	for ( int r = 0; r < 4; ++r )
+		for ( int c = 0; c < 4; ++c )
+			M16.m[r][c] = _mm512_set1_ps( f[r*4 + c] );
+
+	for ( ; i + 16 <= nEnd; i += 16 )
+	{
+		__m512 x = _mm512_loadu_ps(In.pX + i);
+		__m512 y = _mm512_loadu_ps(In.pY + i);
+		__m512 z = _mm512_loadu_ps(In.pZ + i);
+
+		KPTransformAVX512(M16, pJob->Mode, x, y, z);
+
+		_mm512_storeu_ps(Out.pX + i, x);
+		_mm512_storeu_ps(Out.pY + i, y);
+		_mm512_storeu_ps(Out.pZ + i, z);
+	}
+
+	// The last 0-15 vertices
+	KPTransformStreamAVX(pJob, i, nEnd);
+}
+
+KP_TARGET_AVX512_END
+#endif // ! KP_AVX512
+
+#endif // ! KP_SSE
+
+
+// KPTransformJob ////
+//////////////////////
+//
+// Transforms the [nBegin, nEnd) range of a call by the kernel of the
+// selected instruction set, this is what the worker threads run
+typedef void (*KPTRANSFORMKERNEL)(const KPTRANSFORMJOB *pJob, UINT nBegin, UINT nEnd);
+
+static const KPTRANSFORMKERNEL g_pfnTransformStrided[KPISA_COUNT]	= KPISA_TABLE(KPTransformStrided);
+static const KPTRANSFORMKERNEL g_pfnTransformStream[KPISA_COUNT]	= KPISA_TABLE_AVX512(KPTransformStream);
+KPISA_REGISTER(g_pfnTransformStrided,	"transform strided");
+KPISA_REGISTER(g_pfnTransformStream,	"transform stream");
+
+static void KPTransformJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	const KPTRANSFORMJOB *pJob = (const KPTRANSFORMJOB*)pParam;
+
+	if ( pJob->pIn )
+		g_pfnTransformStrided[g_ISA](pJob, nBegin, nEnd);
+	else
+		g_pfnTransformStream[g_ISA](pJob, nBegin, nEnd);
+}
+
+
+// KPTransform ////
+///////////////////
+//
+// Runs a transformation call, on the worker threads if the array is large enough
+static void KPTransform(KPTRANSFORMJOB *pJob, UINT nCount)
+{
+	if ( nCount >= KPGetParallelThreshold(KPJOB_VECTOR) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_VECTOR), KPTransformJob, pJob);
+	else
+		KPTransformJob(0, nCount, pJob);
+}
+
+static void KPTransformStrided(const KPMatrix *pMatrix, KPTRANSFORMMODE Mode, const float *pIn, UINT nInStride,
+							   float *pOut, UINT nOutStride, UINT nCount)
+{
+	KPTRANSFORMJOB job	= {};
+
+	job.pMatrix			= pMatrix;
+	job.Mode			= Mode;
+	job.pIn				= pIn;
+	job.pOut			= pOut;
+	job.nInStride		= nInStride;
+	job.nOutStride		= nOutStride;
+
+	KPTransform(&job, nCount);
+}
+
+static void KPTransformStream(const KPMatrix *pMatrix, KPTRANSFORMMODE Mode, const KPSOASTREAM &In,
+							  const KPSOASTREAM &Out, UINT nCount)
+{
+	KPTRANSFORMJOB job	= {};
+
+	job.pMatrix			= pMatrix;
+	job.Mode			= Mode;
+	job.In				= In;
+	job.Out				= Out;
+
+	KPTransform(&job, nCount);
+}
+
+
+// KPMatrix Array Transformations ////
+//////////////////////////////////////
+
+// The division by w is skipped for affine matrices, w would be exactly 1
+void KPMatrix::TransformPoints(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const
+{
+	KPTransformStrided(this, IsAffine() ? KPTM_AFFINE : KPTM_POINTS, pIn, nInStride, pOut, nOutStride, nCount);
+}
+
+void KPMatrix::TransformAffine(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const
+{
+	KPTransformStrided(this, KPTM_AFFINE, pIn, nInStride, pOut, nOutStride, nCount);
+}
+
+void KPMatrix::TransformNormals(const float *pIn, UINT nInStride, float *pOut, UINT nOutStride, UINT nCount) const
+{
+	KPTransformStrided(this, KPTM_NORMALS, pIn, nInStride, pOut, nOutStride, nCount);
+}
+
+void KPMatrix::TransformPoints(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const
+{
+	KPTransformStream(this, IsAffine() ? KPTM_AFFINE : KPTM_POINTS, In, Out, nCount);
+}
+
+void KPMatrix::TransformAffine(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const
+{
+	KPTransformStream(this, KPTM_AFFINE, In, Out, nCount);
+}
+
+void KPMatrix::TransformNormals(const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT nCount) const
+{
+	KPTransformStream(this, KPTM_NORMALS, In, Out, nCount);
+}
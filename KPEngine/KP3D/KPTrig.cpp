@@ -0,0 +1,378 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPTrig.cpp
+ *  Description: KPEngine sine and cosine
+ *				 - Polynomial sincos, scalar and SIMD kernels
+ *				 - Batched rotation matrices
+ *
+ *				 The method of the Cephes library (S. L. Moshier):
+ *				 the angle is reduced to [-pi/4, pi/4] around the
+ *				 nearest multiple j of pi/4 (j even), in three parts
+ *				 so that the product of j and pi/4 is exact, then
+ *				 the sine and cosine polynomials are evaluated and
+ *				 swapped or negated by the octant.
+ *
+ *****************************************************************
+*/
+
+#include <math.h>
+#include "KP3D.h"
+#include "KPKernels.h"
+#include "KPJobs.h"
+
+// Number of angles of a batch of KPBuildRotations, the sines and cosines are on the stack
+#define KPTRIG_BATCH		64
+
+// Largest angle of the polynomials, the reduction loses precision above it
+#define KPSINCOS_MAX		8192.0f
+
+// 4 / pi
+#define KPSINCOS_FOPI		1.27323954473516f
+
+// pi / 4 in three parts, the first two have few enough bits for exact products
+#define KPSINCOS_DP1		0.78515625f
+#define KPSINCOS_DP2		2.4187564849853515625e-4f
+#define KPSINCOS_DP3		3.77489497744594108e-8f
+#define KPSINCOS_DP23		( KPSINCOS_DP2 + KPSINCOS_DP3 )
+
+// Polynomials of KPPRECISION_REFINED, Cephes sinf / cosf
+#define KPSIN_R0	-1.9515295891e-4f
+#define KPSIN_R1	8.3321608736e-3f
+#define KPSIN_R2	-1.6666654611e-1f
+#define KPCOS_R0	2.443315711809948e-5f
+#define KPCOS_R1	-1.388731625493765e-3f
+#define KPCOS_R2	4.166664568298827e-2f
+
+// Polynomials of KPPRECISION_FAST, least squares fits on [0, pi/4]
+#define KPSIN_F0	8.165456957e-3f
+#define KPSIN_F1	-1.666338211e-1f
+#define KPCOS_F0	-1.366626099e-3f
+#define KPCOS_F1	4.166192547e-2f
+
+
+// Scalar Kernel ////
+/////////////////////
+//
+// The SIMD kernels evaluate the same expressions in the same order, so the
+// results are the same on every path, for every precision.
+
+static inline void KPSinCosPoly(float x, float *pSin, float *pCos, bool bRefined)
+{
+	float fAbs = fabsf(x);
+
+	// Also catches NaN
+	if ( !( fAbs <= KPSINCOS_MAX ) )
+	{
+		*pSin = sinf(x);
+		*pCos = cosf(x);
+		return;
+	}
+
+	// Nearest even multiple of pi/4 below the next one
+	int   j = (int)( fAbs * KPSINCOS_FOPI );
+	j		= ( j + 1 ) & ~1;
+	float y = (float)j;
+
+	float r = bRefined ? ( ( fAbs - y * KPSINCOS_DP1 ) - y * KPSINCOS_DP2 ) - y * KPSINCOS_DP3
+					   : ( fAbs - y * KPSINCOS_DP1 ) - y * KPSINCOS_DP23;
+	float z = r * r;
+	float c, s;
+
+	if ( bRefined )
+	{
+		c = ( ( KPCOS_R0 * z + KPCOS_R1 ) * z + KPCOS_R2 ) * z * z - 0.5f * z + 1.0f;
+		s = ( ( KPSIN_R0 * z + KPSIN_R1 ) * z + KPSIN_R2 ) * z * r + r;
+	}
+	else
+	{
+		c = ( KPCOS_F0 * z + KPCOS_F1 ) * z * z - 0.5f * z + 1.0f;
+		s = ( KPSIN_F0 * z + KPSIN_F1 ) * z * r + r;
+	}
+
+	// Octants 2, 3, 6, 7: the polynomials swap
+	if ( j & 2 )
+	{
+		float t = c;
+		c = s;
+		s = t;
+	}
+
+	// The sine is odd, the cosine is even
+	if ( ( ( j & 4 ) != 0 ) != ( x < 0.0f ) )
+		s = -s;
+
+	if ( ( ( j - 2 ) & 4 ) == 0 )
+		c = -c;
+
+	*pSin = s;
+	*pCos = c;
+}
+
+static void KPSinCosArrayScalar(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision)
+{
+	if ( Precision == KPPRECISION_EXACT )
+	{
+		for ( UINT i = 0; i < nCount; ++i )
+		{
+			pSin[i] = sinf(pAngles[i]);
+			pCos[i] = cosf(pAngles[i]);
+		}
+		return;
+	}
+
+	bool bRefined = ( Precision == KPPRECISION_REFINED );
+
+	for ( UINT i = 0; i < nCount; ++i )
+		KPSinCosPoly(pAngles[i], &pSin[i], &pCos[i], bRefined);
+}
+
+
+#ifdef KP_SSE
+
+// SSE Kernel ////
+//////////////////
+//
+// The octant is an integer, it needs SSE2. Groups with an angle beyond
+// KPSINCOS_MAX go to the scalar kernel.
+
+static void KPSinCosArraySSE(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision)
+{
+	UINT i = 0;
+
+#ifdef KP_SSE2
+	if ( Precision != KPPRECISION_EXACT )
+	{
+		bool   bRefined = ( Precision == KPPRECISION_REFINED );
+		__m128 neg0		= _mm_set1_ps(-0.0f);
+		__m128 zero		= _mm_setzero_ps();
+		__m128 half		= _mm_set1_ps(0.5f);
+		__m128 one		= _mm_set1_ps(1.0f);
+
+		for ( ; i + 4 <= nCount; i += 4 )
+		{
+			__m128 x	= _mm_loadu_ps(pAngles + i);
+			__m128 sign = _mm_and_ps( _mm_cmplt_ps(x, zero), neg0 );
+			__m128 a	= _mm_andnot_ps(neg0, x);
+
+			if ( _mm_movemask_ps( _mm_cmple_ps( a, _mm_set1_ps(KPSINCOS_MAX) ) ) != 0xF )
+			{
+				KPSinCosArrayScalar(pAngles + i, pSin + i, pCos + i, 4, Precision);
+				continue;
+			}
+
+			__m128i j = _mm_cvttps_epi32( _mm_mul_ps( a, _mm_set1_ps(KPSINCOS_FOPI) ) );
+			j		  = _mm_and_si128( _mm_add_epi32( j, _mm_set1_epi32(1) ), _mm_set1_epi32(~1) );
+			__m128 y  = _mm_cvtepi32_ps(j);
+
+			__m128 swap	   = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( j, _mm_set1_epi32(2) ), _mm_set1_epi32(2) ) );
+			__m128 sinFlip = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( j, _mm_set1_epi32(4) ), 29 ) );
+			__m128 cosFlip = _mm_castsi128_ps( _mm_slli_epi32( _mm_andnot_si128( _mm_sub_epi32( j, _mm_set1_epi32(2) ), _mm_set1_epi32(4) ), 29 ) );
+
+			__m128 r, c, s;
+
+			if ( bRefined )
+			{
+				r = _mm_sub_ps( _mm_sub_ps( _mm_sub_ps( a, _mm_mul_ps( y, _mm_set1_ps(KPSINCOS_DP1) ) ),
+														   _mm_mul_ps( y, _mm_set1_ps(KPSINCOS_DP2) ) ),
+														   _mm_mul_ps( y, _mm_set1_ps(KPSINCOS_DP3) ) );
+			}
+			else
+			{
+				r = _mm_sub_ps( _mm_sub_ps( a, _mm_mul_ps( y, _mm_set1_ps(KPSINCOS_DP1) ) ),
+											   _mm_mul_ps( y, _mm_set1_ps(KPSINCOS_DP23) ) );
+			}
+
+			__m128 z = _mm_mul_ps(r, r);
+
+			if ( bRefined )
+			{
+				c = _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps(KPCOS_R0), z ), _mm_set1_ps(KPCOS_R1) ), z ), _mm_set1_ps(KPCOS_R2) );
+				s = _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps(KPSIN_R0), z ), _mm_set1_ps(KPSIN_R1) ), z ), _mm_set1_ps(KPSIN_R2) );
+			}
+			else
+			{
+				c = _mm_add_ps( _mm_mul_ps( _mm_set1_ps(KPCOS_F0), z ), _mm_set1_ps(KPCOS_F1) );
+				s = _mm_add_ps( _mm_mul_ps( _mm_set1_ps(KPSIN_F0), z ), _mm_set1_ps(KPSIN_F1) );
+			}
+
+			c = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( _mm_mul_ps(c, z), z ), _mm_mul_ps(half, z) ), one );
+			s = _mm_add_ps( _mm_mul_ps( _mm_mul_ps(s, z), r ), r );
+
+			// Swap the polynomials of octants 2, 3, 6, 7 and set the signs
+			__m128 fSin = _mm_or_ps( _mm_and_ps(swap, c), _mm_andnot_ps(swap, s) );
+			__m128 fCos = _mm_or_ps( _mm_and_ps(swap, s), _mm_andnot_ps(swap, c) );
+
+			_mm_storeu_ps( pSin + i, _mm_xor_ps( fSin, _mm_xor_ps(sinFlip, sign) ) );
+			_mm_storeu_ps( pCos + i, _mm_xor_ps( fCos, cosFlip ) );
+		}
+	}
+#endif
+
+	KPSinCosArrayScalar(pAngles + i, pSin + i, pCos + i, nCount - i, Precision);
+}
+
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernel ////
+//////////////////
+//
+// AVX has no 256 bit integer operations, the octant is kept in floats,
+// the bits of j are extracted with FLOOR. Every value is a small integer,
+// so the results are exact.
+
+// v - 2 * floor(v / 2), 1 for odd and 0 for even integers
+static inline __m256 KPAVXOdd(__m256 v)
+{
+	__m256 h = _mm256_floor_ps( _mm256_mul_ps( v, _mm256_set1_ps(0.5f) ) );
+
+	return _mm256_sub_ps( v, _mm256_add_ps(h, h) );
+}
+
+static void KPSinCosArrayAVX(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision)
+{
+	UINT i = 0;
+
+	if ( Precision != KPPRECISION_EXACT )
+	{
+		bool   bRefined = ( Precision == KPPRECISION_REFINED );
+		__m256 neg0		= _mm256_set1_ps(-0.0f);
+		__m256 zero		= _mm256_setzero_ps();
+		__m256 half		= _mm256_set1_ps(0.5f);
+		__m256 one		= _mm256_set1_ps(1.0f);
+
+		for ( ; i + 8 <= nCount; i += 8 )
+		{
+			__m256 x	= _mm256_loadu_ps(pAngles + i);
+			__m256 sign = _mm256_and_ps( _mm256_cmp_ps(x, zero, _CMP_LT_OQ), neg0 );
+			__m256 a	= _mm256_andnot_ps(neg0, x);
+
+			if ( _mm256_movemask_ps( _mm256_cmp_ps( a, _mm256_set1_ps(KPSINCOS_MAX), _CMP_LE_OQ ) ) != 0xFF )
+			{
+				KPSinCosArrayScalar(pAngles + i, pSin + i, pCos + i, 8, Precision);
+				continue;
+			}
+
+			// y = j = ( trunc(a * 4/pi) + 1 ) & ~1, q = j / 2
+			__m256 t = _mm256_round_ps( _mm256_mul_ps( a, _mm256_set1_ps(KPSINCOS_FOPI) ), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+			__m256 q = _mm256_floor_ps( _mm256_mul_ps( _mm256_add_ps(t, one), half ) );
+			__m256 y = _mm256_add_ps(q, q);
+
+			// j & 2 is bit 0 of q, j & 4 is bit 1 of q, (j - 2) & 4 is bit 1 of q - 1
+			__m256 swap	   = _mm256_cmp_ps( KPAVXOdd(q), one, _CMP_EQ_OQ );
+			__m256 sinFlip = _mm256_and_ps( _mm256_cmp_ps( KPAVXOdd( _mm256_floor_ps( _mm256_mul_ps(q, half) ) ), one, _CMP_EQ_OQ ), neg0 );
+			__m256 cosFlip = _mm256_and_ps( _mm256_cmp_ps( KPAVXOdd( _mm256_floor_ps( _mm256_mul_ps( _mm256_sub_ps(q, one), half ) ) ), zero, _CMP_EQ_OQ ), neg0 );
+
+			__m256 r, c, s;
+
+			if ( bRefined )
+			{
+				r = _mm256_sub_ps( _mm256_sub_ps( _mm256_sub_ps( a, _mm256_mul_ps( y, _mm256_set1_ps(KPSINCOS_DP1) ) ),
+																	_mm256_mul_ps( y, _mm256_set1_ps(KPSINCOS_DP2) ) ),
+																	_mm256_mul_ps( y, _mm256_set1_ps(KPSINCOS_DP3) ) );
+			}
+			else
+			{
+				r = _mm256_sub_ps( _mm256_sub_ps( a, _mm256_mul_ps( y, _mm256_set1_ps(KPSINCOS_DP1) ) ),
+													 _mm256_mul_ps( y, _mm256_set1_ps(KPSINCOS_DP23) ) );
+			}
+
+			__m256 z = _mm256_mul_ps(r, r);
+
+			if ( bRefined )
+			{
+				c = _mm256_add_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps(KPCOS_R0), z ), _mm256_set1_ps(KPCOS_R1) ), z ), _mm256_set1_ps(KPCOS_R2) );
+				s = _mm256_add_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps(KPSIN_R0), z ), _mm256_set1_ps(KPSIN_R1) ), z ), _mm256_set1_ps(KPSIN_R2) );
+			}
+			else
+			{
+				c = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps(KPCOS_F0), z ), _mm256_set1_ps(KPCOS_F1) );
+				s = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps(KPSIN_F0), z ), _mm256_set1_ps(KPSIN_F1) );
+			}
+
+			c = _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( _mm256_mul_ps(c, z), z ), _mm256_mul_ps(half, z) ), one );
+			s = _mm256_add_ps( _mm256_mul_ps( _mm256_mul_ps(s, z), r ), r );
+
+			__m256 fSin = _mm256_blendv_ps(s, c, swap);
+			__m256 fCos = _mm256_blendv_ps(c, s, swap);
+
+			_mm256_storeu_ps( pSin + i, _mm256_xor_ps( fSin, _mm256_xor_ps(sinFlip, sign) ) );
+			_mm256_storeu_ps( pCos + i, _mm256_xor_ps( fCos, cosFlip ) );
+		}
+	}
+
+	KPSinCosArraySSE(pAngles + i, pSin + i, pCos + i, nCount - i, Precision);
+}
+
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#endif // ! KP_SSE
+
+
+typedef void (*KPSINCOSKERNEL)(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision);
+
+static const KPSINCOSKERNEL g_pfnSinCos[KPISA_COUNT] = KPISA_TABLE(KPSinCosArray);
+KPISA_REGISTER(g_pfnSinCos, "sincos");
+
+
+// KPSinCos ////
+void KPSinCos(float fAngle, float *pSin, float *pCos)
+{
+	KPSinCosPoly(fAngle, pSin, pCos, true);
+}
+
+
+// KPSinCosArray ////
+void KPSinCosArray(const float *pAngles, float *pSin, float *pCos, UINT nCount, KPPRECISION Precision)
+{
+	g_pfnSinCos[g_ISA](pAngles, pSin, pCos, nCount, Precision);
+}
+
+
+// KPBuildRotations ////
+////////////////////////
+
+// Parameters of a KPBuildRotations call, passed to the worker threads
+typedef struct KPROTJOB
+{
+	const float	*pAngles;
+	KPAXIS		Axis;
+	KPMatrix	*pOut;
+} KPROTJOB;
+
+static void KPRotationJob(UINT nBegin, UINT nEnd, void *pParam)
+{
+	const KPROTJOB *pJob = (const KPROTJOB*)pParam;
+	float			fSin[KPTRIG_BATCH], fCos[KPTRIG_BATCH];
+
+	for ( UINT nBatch = nBegin; nBatch < nEnd; nBatch += KPTRIG_BATCH )
+	{
+		UINT nCount = ( nEnd - nBatch < KPTRIG_BATCH ) ? nEnd - nBatch : KPTRIG_BATCH;
+
+		g_pfnSinCos[g_ISA](pJob->pAngles + nBatch, fSin, fCos, nCount, KPPRECISION_REFINED);
+
+		for ( UINT i = 0; i < nCount; ++i )
+			KPSetRotation(pJob->pOut[nBatch + i], pJob->Axis, fSin[i], fCos[i]);
+	}
+}
+
+void KPBuildRotations(const float *pAngles, KPAXIS Axis, KPMatrix *pOut, UINT nCount)
+{
+	KPROTJOB job;
+
+	job.pAngles = pAngles;
+	job.Axis	= Axis;
+	job.pOut	= pOut;
+
+	if ( nCount >= KPGetParallelThreshold(KPJOB_MATRIX) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_MATRIX), KPRotationJob, &job);
+	else
+		KPRotationJob(0, nCount, &job);
+
+} // ! KPBuildRotations
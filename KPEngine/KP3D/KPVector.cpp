@@ -4,295 +4,449 @@
  *	KPEngine Source code 
  *	Kovacs Peter - July 2009
  *
- *  File: KP.h
- *  Description: KPEngine Vector 4d Class Implementation
+ *  File: KPVector.cpp
+ *  Description: KPEngine Vector 4d array operations
+ *				 - Array normalization
+ *
+ *				 The single vector operations are inline,
+ *				 see KPInline.h.
  *
  *****************************************************************
 */
 
 #include "KP3D.h"
+#include "KPKernels.h"
+#include "KPJobs.h"
 
-// Globals ////
-extern bool g_bSSE;
-
-// KPVector::Set Method ////
-inline void KPVector::Set(float _x, float _y, float _z, float _w)
+// Array Normalization ////
+///////////////////////////
+//
+// The SIMD kernels transpose 4 (8) vectors into x, y, z registers
+// like the array transformations, the squared lengths are then computed
+// without shuffles. Lanes of null vectors keep their input by a blend.
+// The strided kernel reads and writes every vector by one 16 byte access
+// if the stride is at least 16 bytes: only the squares are transposed for
+// the lengths and the loaded rows are scaled, the float after z by 1. The
+// last vector of the array takes the narrow path, its 16 bytes may end
+// past the array.
+
+// Parameters of a normalization call, passed to the worker threads
+typedef struct KPNORMALIZEJOB
 {
-	x = _x;
-	y = _y;
-	z = _z;
-	w = _w;
-}
+	KPPRECISION		Precision;
 
+	// Strided array
+	float			*pVectors;
+	UINT			nStride;
+	UINT			nWideEnd;		// The vectors before it are written 16 bytes at a time
 
-// KPVector::GetSqaredLength ////
-inline float KPVector::GetSqaredLength() const
-{
-	return (x*x, y*y, z*z);
-}
+	// SoA streams, used when pVectors is NULL
+	KPSOASTREAM		Stream;
+
+} KPNORMALIZEJOB;
 
 
-// KPVector::Negate ////
-inline void KPVector::Negate(void)
+// Scalar Kernels ////
+static void KPNormalizeStridedScalar(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
 {
-	x = -x;
-	y = -y;
-	z = -z;
-}
+	char *p = (char*)pJob->pVectors + (size_t)nBegin * pJob->nStride;
 
+	for ( UINT i = nBegin; i < nEnd; ++i, p += pJob->nStride )
+	{
+		float	 *f = (float*)p;
+		KPVector v(f[0], f[1], f[2]);
 
-// KPVector::Difference ////
-inline void KPVector::Difference(const KPVector &v1, const KPVector &v2)
-{
-	x = v2.x - v1.x;
-	y = v2.y - v1.y;
-	z = v2.z - v1.z;
-	w = 1.0f;
-}
+		KPScalarOps::Normalize(v, pJob->Precision);
 
+		f[0] = v.x;
+		f[1] = v.y;
+		f[2] = v.z;
+	}
+}
 
-// KPVector::AngleWith ////
-///////////////////////////
-//
-// Calculates the angle between two vectors
-// Math: acos(v1.v2 / |v1| * |v2|) in rads
-inline float KPVector::AngleWith(KPVector &v)
+static void KPNormalizeStreamScalar(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
 {
-	return (float)acos( ( (*this) * v) / ( this->GetLength() * v.GetLength() ) );
+	const KPSOASTREAM &S = pJob->Stream;
+
+	for ( UINT i = nBegin; i < nEnd; ++i )
+	{
+		KPVector v(S.pX[i], S.pY[i], S.pZ[i]);
+
+		KPScalarOps::Normalize(v, pJob->Precision);
+
+		S.pX[i] = v.x;
+		S.pY[i] = v.y;
+		S.pZ[i] = v.z;
+	}
 }
 
 
-// KPVector::GetLength ////
-///////////////////////////
-//
-// Determining a Vectors magnitude(length) involves a square root operation
-// which is considerably slow.
-// 
-// We will try to take advantage of SIMD instructions here, if possible.
-//
-// Math: v.Length = sqtr(x*x + y*y + x*x)
-inline float KPVector::GetLength(void)
+#ifdef KP_SSE
+
+// SSE Kernels ////
+///////////////////
+
+// Normalizes 4 vectors in SoA form, the evaluation order matches KPSSEOps::Normalize
+static inline void KPNormalizeSSE(KPPRECISION Precision, __m128 &x, __m128 &y, __m128 &z)
 {
-	float fLength;
+	__m128 sq = _mm_add_ps( _mm_add_ps( _mm_mul_ps(x, x), _mm_mul_ps(y, y) ), _mm_mul_ps(z, z) );
+	__m128 keep, ox, oy, oz;
+
+	if ( Precision == KPPRECISION_EXACT )
+	{
+		__m128 l = _mm_sqrt_ps(sq);
 
-	// If SSE is not available, do the math the slower way.
-	if ( ! g_bSSE )
-		fLength = sqrt(x*x + y*y + z*z);
+		keep = _mm_cmpeq_ps( sq, _mm_setzero_ps() );
+		ox	 = _mm_div_ps(x, l);
+		oy	 = _mm_div_ps(y, l);
+		oz	 = _mm_div_ps(z, l);
+	}
 	else
 	{
-		float *pLength = &fLength;
-		w = 0.0f;	// Leaving it on 1.0f would make complications at addition
-
-		// Our goal here is to end up with the squared length of the vector
-		// in a single element of the register. We will do this by
-		// getting the square of all the numbers, then shuffle it around
-		// and add them together. At this point we will have the sum of 
-		// two numbers in each element of the register.
-		// Shuffle once more, add them together again and we will
-		// have the same squared length of the vector in each four
-		// elements of the register. This is actually faster than
-		// only dealing with a single value due to SSE though.
-		// After this we can use single instructions to get the square root
-		// of the first element and retrieve it.
-		__asm {
-			mov		ecx,	pLength		// store fLength's address in ECX
-			mov		esi,	this		// store our vector's address in ESI
-			movups	xmm0,	[esi]		// Copies four packed single precision floats regardless
-										// of alignment from memory to the xmm0 SSE register										
-			mulps	xmm0,	xmm0		// x*x  y*y  z*z  w*w
-			movaps	xmm1,	xmm0		// Copy the result into xmm1, now they are aligned
-
-			shufps	xmm1,	xmm1,	4Eh	// 0100_1110b -> reorders: 3210 -> 1032
-			addps	xmm0,	xmm1		// xx+zz yy+ww zz+xx ww+yy
-			movaps	xmm1,	xmm0
-			shufps	xmm1,	xmm1,	11h // 0001_0001b -> reorders: 3210 -> 0101
-										// ww+yy zz+xx ww+yy zz+xx
-			addps	xmm0,	xmm1		// xx+zz+ww+yy four times, perfect!
-			sqrtss	xmm0,	xmm0		// single scalar square root of first element
-			movss	[ecx],	xmm0		// Move the result of the square root to the address
-										// ecx is pointing at, which is fLength.
-		} // ! asm
-		
-		w = 1.0f;	// We can set it back to 1.0f now
-	} // ! else
-
-	return fLength;
-
-} // ! KPVector::GetLength()
-
-
-// KPVector::Normalize ////
-///////////////////////////
-//
-// Normalized vectors are vectors in the same direction
-// but with the legth 1.
-// 
-// Math: norm(x) = x / magnitude(x)
-inline void KPVector::Normalize(void)
+		__m128 r = _mm_rsqrt_ps(sq);
+
+		if ( Precision == KPPRECISION_REFINED )
+			r = KPSSERsqrtStep(sq, r);
+
+		keep = _mm_cmplt_ps( sq, _mm_set1_ps(FLT_MIN) );
+		ox	 = _mm_mul_ps(x, r);
+		oy	 = _mm_mul_ps(y, r);
+		oz	 = _mm_mul_ps(z, r);
+	}
+
+	x = _mm_or_ps( _mm_and_ps(keep, x), _mm_andnot_ps(keep, ox) );
+	y = _mm_or_ps( _mm_and_ps(keep, y), _mm_andnot_ps(keep, oy) );
+	z = _mm_or_ps( _mm_and_ps(keep, z), _mm_andnot_ps(keep, oz) );
+}
+
+// Normalizes 4 vectors loaded as rows: x, y, z and the float after them, which is kept.
+// Only the squares are transposed for the lengths, then every row is scaled by its own
+// reciprocal length (divided by its length) and the 4th lane by 1. Null vectors are
+// scaled by 1, the results are the same as the ones of KPNormalizeSSE.
+static inline void KPNormalizeRowsSSE(KPPRECISION Precision, __m128 &a0, __m128 &a1, __m128 &a2, __m128 &a3)
 {
-	// if SSE is not available, do the math the slower way
-	if ( ! g_bSSE )
+	__m128 s0 = _mm_mul_ps(a0, a0);
+	__m128 s1 = _mm_mul_ps(a1, a1);
+	__m128 s2 = _mm_mul_ps(a2, a2);
+	__m128 s3 = _mm_mul_ps(a3, a3);
+	__m128 t0 = _mm_unpacklo_ps(s0, s1);		// xx0 xx1 yy0 yy1
+	__m128 t1 = _mm_unpacklo_ps(s2, s3);		// xx2 xx3 yy2 yy3
+	__m128 t2 = _mm_unpackhi_ps(s0, s1);		// zz0 zz1
+	__m128 t3 = _mm_unpackhi_ps(s2, s3);		// zz2 zz3
+	__m128 sq = _mm_add_ps( _mm_add_ps( _mm_movelh_ps(t0, t1), _mm_movehl_ps(t1, t0) ), _mm_movelh_ps(t2, t3) );
+	__m128 keep, f;
+
+	if ( Precision == KPPRECISION_EXACT )
 	{
-		float fLength = sqrt(x*x + y*y + z*z);
-
-		// Check for NULL vector
-		if ( fLength != 0.0f )
-		{
-			x /= fLength;
-			y /= fLength;
-			z /= fLength;
-		}
-	} // ! SSE Check
+		keep = _mm_cmpeq_ps( sq, _mm_setzero_ps() );
+		f	 = _mm_sqrt_ps(sq);
+	}
 	else
 	{
-		w = 0.0f;	// Set this to 0 to avoid problems at additions
-
-		// To get the normal of the vector, we have to first calculate
-		// it's length the same way we did for GetLength.
-		// After that we have to scale the vector down with it to unit length.
-		// Normal(X) = X / sqrt(x*x+y*y+z*z)
-		// Notice that X/SQRT = X * 1/SQRT. Because of this, we can use the
-		// RSQRTPS - reciprocal square root SSE instruction
-		__asm {
-			mov		esi,	this		// Store our vector's address in ESI register
-			movups	xmm0,	[esi]		// Copy the vector data to XMM0 register
-			movaps	xmm2,	xmm0		// Make a copy of the data to XMM2 for later use
-			mulps	xmm0,	xmm0		// x*x y*y z*z w*w
-			movaps	xmm1,	xmm0		// Copy it to XMM1
-			shufps	xmm1,	xmm1,	4Eh	// Shuffle it around using 0100_0111b
-			addps	xmm0,	xmm1		// xx+zz yy+ww zz+xx ww+yy
-			movaps	xmm1,	xmm0		// Copy the result into XMM1
-			shufps	xmm1,	xmm1,	11h	// Shuffle it again using 0001_0001b
-			addps	xmm0,	xmm1		// All four floats are xx+zz+ww+yy now
-
-			rsqrtps	xmm0,	xmm0		// Reciprocal square root of the vector
-			mulps	xmm2,	xmm0		// vector * 1/vector_length
-			movups	[esi],	xmm2		// replace our vector with the normalized form
-		} // ! asm
-
-		w = 1.0f;	// Restore it's value after normalization
-
-	} // !else
-
-} // ! KPVector::Normalize()
-
-
-// KPVector::Cross ////
-///////////////////////
-//
-// Calculates the cross product from two vectors
-// Math: Too long to explain :P See the non SSE implementation
-inline void KPVector::Cross(const KPVector &v1, const KPVector &v2)
-{
-	// If there is no SSE support
-	if ( ! g_bSSE )
+		f = _mm_rsqrt_ps(sq);
+
+		if ( Precision == KPPRECISION_REFINED )
+			f = KPSSERsqrtStep(sq, f);
+
+		keep = _mm_cmplt_ps( sq, _mm_set1_ps(FLT_MIN) );
+	}
+
+	const __m128 one	= _mm_set1_ps(1.0f);
+	const __m128 w		= _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	const __m128 xyz	= _mm_cmplt_ps(w, one);				// Mask of the first 3 lanes
+
+	f = _mm_or_ps( _mm_and_ps(keep, one), _mm_andnot_ps(keep, f) );
+
+	__m128 f0 = _mm_or_ps( _mm_and_ps( KPSSE_SPLAT(f, 0), xyz ), w );
+	__m128 f1 = _mm_or_ps( _mm_and_ps( KPSSE_SPLAT(f, 1), xyz ), w );
+	__m128 f2 = _mm_or_ps( _mm_and_ps( KPSSE_SPLAT(f, 2), xyz ), w );
+	__m128 f3 = _mm_or_ps( _mm_and_ps( KPSSE_SPLAT(f, 3), xyz ), w );
+
+	if ( Precision == KPPRECISION_EXACT )
 	{
-		x = v1.y * v2.z - v1.z * v2.y;
-		y = v1.z * v2.x - v1.x * v2.z;
-		z = v1.x * v2.y - v1.y * v2.x;
-		w = 1.0f;	// Set w to 1 regardless of v1.w and v2.w
+		a0 = _mm_div_ps(a0, f0);
+		a1 = _mm_div_ps(a1, f1);
+		a2 = _mm_div_ps(a2, f2);
+		a3 = _mm_div_ps(a3, f3);
 	}
 	else
 	{
-		__asm
-		{
-			mov		esi,	v1			// Store v1's address in ESI
-			mov		edi,	v2			// Store v2's address in EDI
+		a0 = _mm_mul_ps(a0, f0);
+		a1 = _mm_mul_ps(a1, f1);
+		a2 = _mm_mul_ps(a2, f2);
+		a3 = _mm_mul_ps(a3, f3);
+	}
+}
+
+static void KPNormalizeStridedSSE(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
+{
+	char	*p		 = (char*)pJob->pVectors + (size_t)nBegin * pJob->nStride;
+	UINT	nStride	 = pJob->nStride;
+	UINT	i		 = nBegin;
+	UINT	nWideEnd = KPMin(nEnd, pJob->nWideEnd);
+	__m128	x, y, z, w;
+
+	for ( ; i + 4 <= nWideEnd; i += 4 )
+	{
+		float *v0 = (float*)( p );
+		float *v1 = (float*)( p + nStride );
+		float *v2 = (float*)( p + nStride * 2 );
+		float *v3 = (float*)( p + nStride * 3 );
 
-			movups	xmm0,	[esi]		// Copy v1's data to XMM0
-			movups	xmm1,	[edi]		// Copy v2's data to XMM1
-			movaps	xmm2,	xmm0		// Make a copy of v1 to XMM2 
-			movaps	xmm3,	xmm1		// Make a copy of v2 to XMM3
+		x = _mm_loadu_ps(v0);
+		y = _mm_loadu_ps(v1);
+		z = _mm_loadu_ps(v2);
+		w = _mm_loadu_ps(v3);
 
-			// Calculating the left side of the subtraction
-			shufps	xmm0,	xmm0,	0xD8// 1101_1000b, swaps y and z -> wyzx
-			shufps	xmm1,	xmm1,	0xE1// 1110_0001b, swaps x and y -> wzxy
-			mulps	xmm0,	xmm1		// <1y*2z,1z*2x,1x*2y,1w*2w>
+		KPNormalizeRowsSSE(pJob->Precision, x, y, z, w);
 
-			// Calculating the right side of the subtraction (inverse of left side)
-			shufps	xmm2,	xmm2,	0xE1
-			shufps	xmm3,	xmm3,	0xD8
-			mulps	xmm2,	xmm3		// <1z*2y,1x*2z,1y*2x,1w*2w>
+		_mm_storeu_ps(v0, x);
+		_mm_storeu_ps(v1, y);
+		_mm_storeu_ps(v2, z);
+		_mm_storeu_ps(v3, w);
 
-			subps	xmm0,	xmm2		// Subtract
+		p += nStride * 4;
+	}
 
-			mov		esi,	this		// Store the address of out vector in ESI
-			movups	[esi],	xmm0		// Copy the cross product into our vector
-		} // ! asm
-		w = 1.0f;	// Set w to 1 regardless of v1.w and v2.w
+	for ( ; i + 4 <= nEnd; i += 4 )
+	{
+		KPSSEGather(p, nStride, x, y, z);
+		KPNormalizeSSE(pJob->Precision, x, y, z);
+		KPSSEScatter(p, nStride, x, y, z);
 
-	} // ! else
-} // ! KPVector::Cross()
+		p += nStride * 4;
+	}
 
+	// The last 0-3 vectors, one at a time with the same instructions
+	for ( ; i < nEnd; ++i, p += nStride )
+	{
+		float	 *f = (float*)p;
+		KPVector v(f[0], f[1], f[2]);
 
-// KPVector Operator Overloads ////
-///////////////////////////////////
+		KPSSEOps::Normalize(v, pJob->Precision);
 
-KPVector KPVector::operator +(const KPVector &v) const
-{
-	return KPVector(x+v.x, y+v.y, z+v.z);
+		f[0] = v.x;
+		f[1] = v.y;
+		f[2] = v.z;
+	}
 }
 
-void KPVector::operator +=(const KPVector &v)
+static void KPNormalizeStreamSSE(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
 {
-	x += v.x;
-	y += v.y;
-	z += v.z;
+	const KPSOASTREAM	&S = pJob->Stream;
+	UINT				i  = nBegin;
+
+	for ( ; i + 4 <= nEnd; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps(S.pX + i);
+		__m128 y = _mm_loadu_ps(S.pY + i);
+		__m128 z = _mm_loadu_ps(S.pZ + i);
+
+		KPNormalizeSSE(pJob->Precision, x, y, z);
+
+		_mm_storeu_ps(S.pX + i, x);
+		_mm_storeu_ps(S.pY + i, y);
+		_mm_storeu_ps(S.pZ + i, z);
+	}
+
+	for ( ; i < nEnd; ++i )
+	{
+		KPVector v(S.pX[i], S.pY[i], S.pZ[i]);
+
+		KPSSEOps::Normalize(v, pJob->Precision);
+
+		S.pX[i] = v.x;
+		S.pY[i] = v.y;
+		S.pZ[i] = v.z;
+	}
 }
 
-KPVector KPVector::operator -(const KPVector &v) const
+
+#ifdef KP_AVX
+KP_TARGET_AVX_BEGIN
+
+// AVX Kernels ////
+///////////////////
+
+static inline void KPNormalizeAVX(KPPRECISION Precision, __m256 &x, __m256 &y, __m256 &z)
 {
-	return KPVector(x-v.x, y-v.y, z-v.z);
+	__m256 sq = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps(x, x), _mm256_mul_ps(y, y) ), _mm256_mul_ps(z, z) );
+	__m256 keep, ox, oy, oz;
+
+	if ( Precision == KPPRECISION_EXACT )
+	{
+		__m256 l = _mm256_sqrt_ps(sq);
+
+		keep = _mm256_cmp_ps( sq, _mm256_setzero_ps(), _CMP_EQ_OQ );
+		ox	 = _mm256_div_ps(x, l);
+		oy	 = _mm256_div_ps(y, l);
+		oz	 = _mm256_div_ps(z, l);
+	}
+	else
+	{
+		__m256 r = _mm256_rsqrt_ps(sq);
+
+		if ( Precision == KPPRECISION_REFINED )
+			r = KPAVXRsqrtStep(sq, r);
+
+		keep = _mm256_cmp_ps( sq, _mm256_set1_ps(FLT_MIN), _CMP_LT_OQ );
+		ox	 = _mm256_mul_ps(x, r);
+		oy	 = _mm256_mul_ps(y, r);
+		oz	 = _mm256_mul_ps(z, r);
+	}
+
+	x = _mm256_blendv_ps(ox, x, keep);
+	y = _mm256_blendv_ps(oy, y, keep);
+	z = _mm256_blendv_ps(oz, z, keep);
 }
 
-void KPVector::operator -=(const KPVector &v)
+static void KPNormalizeStreamAVX(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
 {
-	x -= v.x;
-	y -= v.y;
-	z -= v.z;
+	const KPSOASTREAM	&S = pJob->Stream;
+	UINT				i  = nBegin;
+
+	for ( ; i + 8 <= nEnd; i += 8 )
+	{
+		__m256 x = _mm256_loadu_ps(S.pX + i);
+		__m256 y = _mm256_loadu_ps(S.pY + i);
+		__m256 z = _mm256_loadu_ps(S.pZ + i);
+
+		KPNormalizeAVX(pJob->Precision, x, y, z);
+
+		_mm256_storeu_ps(S.pX + i, x);
+		_mm256_storeu_ps(S.pY + i, y);
+		_mm256_storeu_ps(S.pZ + i, z);
+	}
+
+	// The last 0-7 vectors
+	KPNormalizeStreamSSE(pJob, i, nEnd);
 }
 
-KPVector KPVector::operator *(const float f) const
+KP_TARGET_AVX_END
+#endif // ! KP_AVX
+
+#ifdef KP_AVX512
+KP_TARGET_AVX512_BEGIN
+
+// AVX-512 Kernel ////
+//////////////////////
+//
+// 16 vectors at once. The estimate of RSQRT14 is better than the one of
+// RSQRTPS, so KPPRECISION_FAST is more accurate here than on AVX.
+
+static inline void KPNormalizeAVX512(KPPRECISION Precision, __m512 &x, __m512 &y, __m512 &z)
 {
-	return KPVector(x*f, y*f, z*f);
+	__m512		sq = _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps(x, x), _mm512_mul_ps(y, y) ), _mm512_mul_ps(z, z) );
+	__mmask16	keep;
+	__m512		ox, oy, oz;
+
+	if ( Precision == KPPRECISION_EXACT )
+	{
+		__m512 l = _mm512_sqrt_ps(sq);
+
+		keep = _mm512_cmp_ps_mask( sq, _mm512_setzero_ps(), _CMP_EQ_OQ );
+		ox	 = _mm512_div_ps(x, l);
+		oy	 = _mm512_div_ps(y, l);
+		oz	 = _mm512_div_ps(z, l);
+	}
+	else
+	{
+		__m512 r = _mm512_rsqrt14_ps(sq);
+
+		// See KPSSERsqrtStep
+		if ( Precision == KPPRECISION_REFINED )
+		{
+			__m512 h = _mm512_mul_ps( _mm512_mul_ps( _mm512_set1_ps(0.5f), sq ), r );
+
+			r = _mm512_mul_ps( r, _mm512_sub_ps( _mm512_set1_ps(1.5f), _mm512_mul_ps(h, r) ) );
+		}
+
+		keep = _mm512_cmp_ps_mask( sq, _mm512_set1_ps(FLT_MIN), _CMP_LT_OQ );
+		ox	 = _mm512_mul_ps(x, r);
+		oy	 = _mm512_mul_ps(y, r);
+		oz	 = _mm512_mul_ps(z, r);
+	}
+
+	x = _mm512_mask_blend_ps(keep, ox, x);
+	y = _mm512_mask_blend_ps(keep, oy, y);
+	z = _mm512_mask_blend_ps(keep, oz, z);
 }
 
-void KPVector::operator *=(const float f)
+static void KPNormalizeStreamAVX512(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd)
 {
-	x *= f;
-	y *= f;
-	z *= f;
+	const KPSOASTREAM	&S = pJob->Stream;
+	UINT				i  = nBegin;
+
+	for ( ; i + 16 <= nEnd; i += 16 )
+	{
+		__m512 x = _mm512_loadu_ps(S.pX + i);
+		__m512 y = _mm512_loadu_ps(S.pY + i);
+		__m512 z = _mm512_loadu_ps(S.pZ + i);
+
+		KPNormalizeAVX512(pJob->Precision, x, y, z);
+
+		_mm512_storeu_ps(S.pX + i, x);
+		_mm512_storeu_ps(S.pY + i, y);
+		_mm512_storeu_ps(S.pZ + i, z);
+	}
+
+	// The last 0-15 vectors
+	KPNormalizeStreamAVX(pJob, i, nEnd);
 }
 
-void KPVector::operator /=(const float f)
+KP_TARGET_AVX512_END
+#endif // ! KP_AVX512
+
+#endif // ! KP_SSE
+
+
+typedef void (*KPNORMALIZEKERNEL)(const KPNORMALIZEJOB *pJob, UINT nBegin, UINT nEnd);
+
+// The 16 byte rows of the strided vectors would have to be inserted into and extracted from
+// the AVX registers, that costs more than the wider arithmetic gains: the AVX sets run 4 wide
+static const KPNORMALIZEKERNEL g_pfnNormalizeStrided[KPISA_COUNT]	= KPISA_TABLE_SSE(KPNormalizeStrided);
+static const KPNORMALIZEKERNEL g_pfnNormalizeStream[KPISA_COUNT]	= KPISA_TABLE_AVX512(KPNormalizeStream);
+KPISA_REGISTER(g_pfnNormalizeStrided,	"normalize strided");
+KPISA_REGISTER(g_pfnNormalizeStream,	"normalize stream");
+
+static void KPNormalizeJob(UINT nBegin, UINT nEnd, void *pParam)
 {
-	x /= f;
-	y /= f;
-	z /= f;
+	const KPNORMALIZEJOB *pJob = (const KPNORMALIZEJOB*)pParam;
+
+	if ( pJob->pVectors )
+		g_pfnNormalizeStrided[g_ISA](pJob, nBegin, nEnd);
+	else
+		g_pfnNormalizeStream[g_ISA](pJob, nBegin, nEnd);
 }
 
-float KPVector::operator *(const KPVector &v) const
+static void KPNormalize(KPNORMALIZEJOB *pJob, UINT nCount)
 {
-	return (x*v.x + y*v.y + z*v.z);
+	if ( nCount >= KPGetParallelThreshold(KPJOB_VECTOR) )
+		KPParallelFor(nCount, KPGetParallelGrain(KPJOB_VECTOR), KPNormalizeJob, pJob);
+	else
+		KPNormalizeJob(0, nCount, pJob);
 }
 
-KPVector KPVector::operator *(const KPMatrix &m) const
+
+// KPNormalizeArray ////
+void KPNormalizeArray(float *pVectors, UINT nStride, UINT nCount, KPPRECISION Precision)
 {
-	KPVector vcReturn;
+	KPNORMALIZEJOB job	= {};
 
-	vcReturn.x = x*m._11 + y*m._21 + z*m._31 + m._41;
-	vcReturn.y = x*m._12 + y*m._22 + z*m._32 + m._42;
-	vcReturn.z = x*m._13 + y*m._23 + z*m._33 + m._43;
-	vcReturn.w = x*m._14 + y*m._24 + z*m._34 + m._44;
+	job.Precision		= Precision;
+	job.pVectors		= pVectors;
+	job.nStride			= nStride;
+	job.nWideEnd		= ( nStride >= 16 && nCount > 0 ) ? nCount - 1 : 0;
 
-	// At this point vcReturn.w has some value, but we want it to be 1.0f
-	// we have to scale the matrix down by vcReturn.w for this
+	KPNormalize(&job, nCount);
+}
+
+void KPNormalizeArray(const KPSOASTREAM &Stream, UINT nCount, KPPRECISION Precision)
+{
+	KPNORMALIZEJOB job	= {};
 
-	vcReturn.x /= vcReturn.w;
-	vcReturn.y /= vcReturn.w;
-	vcReturn.z /= vcReturn.w;
-	vcReturn.w  = 1.0f;
+	job.Precision		= Precision;
+	job.Stream			= Stream;
 
-	return vcReturn;
+	KPNormalize(&job, nCount);
 }
-
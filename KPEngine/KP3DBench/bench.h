@@ -0,0 +1,133 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench.h
+ *  Description: KP3D micro-benchmark helpers
+ *				 - High resolution timer and cycle counter
+ *				 - ULP comparison of float results
+ *				 - Random test data
+ *				 - Result reporting
+ *
+ *****************************************************************
+*/
+
+#ifndef KPBENCH_H
+#define KPBENCH_H
+
+#include "KP3D.h"
+
+// Number of vectors processed by one pass and number of timed passes
+#define KPBENCH_COUNT		1024
+#define KPBENCH_PASSES		2000
+
+// Globals ////
+extern volatile float	g_fSink;	// Keeps the optimizer from removing the benchmarked code
+extern KPISA			g_SimdISA;	// Kernels compared to the scalar ones, the selected ones at the start (KPENGINE_ISA)
+
+//! Returns the time elapsed since an arbitrary point in seconds
+double	KPBenchTime(void);
+
+//! Returns the time stamp counter, reference cycles elapsed since an arbitrary point
+double	KPBenchCycles(void);
+
+//! Returns the nanoseconds per element elapsed since dStart, a KPBenchTime value, over nPasses passes of nCount elements
+double	KPBenchElapsedNs(double dStart, UINT nPasses, UINT nCount);
+
+//! Returns the cycles per element elapsed since dStart, a KPBenchCycles value, over nPasses passes of nCount elements
+double	KPBenchElapsedCycles(double dStart, UINT nPasses, UINT nCount);
+
+//! Returns the index of a registered kernel, KPGetNumKernels() if there is none of the name
+UINT	KPBenchFindKernel(const char *chName);
+
+//! Returns a random float between fMin and fMax, seeded by srand
+float	RandomFloat(float fMin, float fMax);
+
+//! Returns the distance of two floats in units in the last place
+int		KPUlpDiff(float a, float b);
+
+//! Returns the largest ULP distance between the x, y, z coordinates of two vector arrays
+int		KPUlpDiff(const KPVector *pA, const KPVector *pB, int n);
+
+//! Adds a timing to the JSON report
+/*!
+	KPBenchReport and KPBenchReportCycles record their timings themselves.
+	\param [in] chName name of the operation
+	\param [in] chPath kernel that ran, e.g. the name of the instruction set
+	\param [in] chUnit "ns" or "cycles"
+	\param [in] nCount number of elements processed by a pass
+	\param [in] dPerOp time of one element
+	\param [in] dBytesPerOp bytes read and written per element, 0 if not known
+*/
+void	KPBenchRecord(const char *chName, const char *chPath, const char *chUnit, UINT nCount, double dPerOp, double dBytesPerOp);
+
+//! Adds the timings of the scalar and the SIMD path of an operation to the JSON report
+void	KPBenchRecordPaths(const char *chName, UINT nCount, double dScalar, double dSIMD, double dBytesPerOp);
+
+//! Prints one line of the result table
+/*!
+	\param [in] chName name of the operation
+	\param [in] dScalar nanoseconds per operation on the scalar path
+	\param [in] dSIMD nanoseconds per operation on the SIMD path
+	\param [in] nUlp largest ULP distance between the results of the two paths
+	\param [in] nMaxUlp allowed ULP distance
+	\return true if the results are within the allowed distance
+*/
+bool	KPBenchReport(const char *chName, double dScalar, double dSIMD, int nUlp, int nMaxUlp);
+
+//! Prints one line of a result table comparing a general and a specialized path in cycles
+/*!
+	\param [in] chName name of the operation
+	\param [in] dFull cycles per operation on the general path
+	\param [in] dFast cycles per operation on the specialized path
+	\param [in] dError largest absolute error of the specialized results
+	\param [in] dMaxError allowed error
+	\return true if the error is within the allowed one
+*/
+bool	KPBenchReportCycles(const char *chName, double dFull, double dFast, double dError, double dMaxError);
+
+//! Runs the KPVector benchmarks, returns the number of failed result checks
+int		BenchVector(void);
+
+//! Runs the KPVector4x and KPVector8x benchmarks, returns the number of failed result checks
+int		BenchPacket(void);
+
+//! Runs the array normalization benchmarks, returns the number of failed result checks
+int		BenchNormalize(void);
+
+//! Runs the KPMatrix benchmarks, returns the number of failed result checks
+int		BenchMatrix(void);
+
+//! Runs the KPQuaternion benchmarks, returns the number of failed result checks
+int		BenchQuaternion(void);
+
+//! Runs the skeletal animation benchmarks, returns the number of failed result checks
+int		BenchAnimation(void);
+
+//! Runs the frustum classification benchmarks, returns the number of failed result checks
+int		BenchCulling(void);
+
+//! Runs the bounding box and sphere benchmarks, returns the number of failed result checks
+int		BenchBounds(void);
+
+//! Runs the triangle clipping benchmarks, returns the number of failed result checks
+int		BenchClipping(void);
+
+//! Runs the ray/triangle intersection benchmarks, returns the number of failed result checks
+int		BenchIntersect(void);
+
+//! Runs the sine and cosine benchmarks, returns the number of failed result checks
+int		BenchTrig(void);
+
+//! Runs the 16-bit index kernel benchmarks, returns the number of failed result checks
+int		BenchIndices(void);
+
+//! Runs the pixel kernel benchmarks on every instruction set, returns the number of failed result checks
+int		BenchPixels(void);
+
+//! Times the array operations on every instruction set and batch size, from L1 resident to DRAM resident
+void	BenchSweep(void);
+
+#endif // ! KPBENCH_H
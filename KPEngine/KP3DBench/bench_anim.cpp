@@ -0,0 +1,271 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_anim.cpp
+ *  Description: Skeletal animation benchmarks
+ *				 - Clip sampling and palette computation
+ *				 - Linear blend skinning
+ *				 - Skinning many characters on the worker threads
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "bench.h"
+#include "KPSIMD.h"
+#include "KPAnimation.h"
+#include "KPMemory.h"
+
+#define BENCH_BONES			32		// Bones of the test skeleton
+#define BENCH_KEYS			8		// Keys per bone track
+#define BENCH_CHARACTERS	64		// Characters skinned by one KPSkinCharacters call
+#define BENCH_CHARVERTICES	2000	// Vertices of one character
+
+// Output vertex, the layout of VERTEX
+typedef struct BENCHSKINNED
+{
+	float x, y, z;
+	float vcNormal[3];
+	float tu, tv;
+} BENCHSKINNED;
+
+
+// Random unit quaternion
+static void RandomRotation(KPQuaternion &q)
+{
+	do
+	{
+		q.Set( RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) );
+	}
+	while ( q.GetLength() < 1e-3f );
+
+	q.Normalize();
+}
+
+// Largest ULP distance between the floats of two output vertex arrays
+static int SkinnedUlpDiff(const BENCHSKINNED *pA, const BENCHSKINNED *pB, UINT n)
+{
+	int nMax = 0;
+
+	for ( UINT i = 0; i < n; ++i )
+	{
+		for ( int c = 0; c < 8; ++c )
+		{
+			int nUlp = KPUlpDiff( (&pA[i].x)[c], (&pB[i].x)[c] );
+			if ( nUlp > nMax )
+				nMax = nUlp;
+		}
+	}
+
+	return nMax;
+}
+
+
+// CreateTestData ////
+//////////////////////
+//
+// A chain of bones along the y axis with random rotation keys, and
+// vertices around it influenced by up to four neighbouring bones.
+static void CreateTestData(KPSkeleton &Skeleton, KPANIMATION &Anim, KPSKINVERTEX *pVertices, UINT numVertices)
+{
+	KPBONE bones[BENCH_BONES];
+
+	for ( int i = 0; i < BENCH_BONES; ++i )
+	{
+		KPMatrix mBind;
+
+		mBind.Identity();
+		mBind.Translate(0.0f, (float)i, 0.0f);
+
+		bones[i].nParent = i - 1;
+		bones[i].mInvBindPose.InverseOf(mBind, KPMT_RIGID);
+	}
+
+	Skeleton.Create(BENCH_BONES, bones);
+
+	Anim.fDuration	= 1.0f;
+	Anim.bLoop		= true;
+	Anim.numTracks	= BENCH_BONES;
+	Anim.pTracks	= new KPBONETRACK[BENCH_BONES];
+
+	for ( int i = 0; i < BENCH_BONES; ++i )
+	{
+		Anim.pTracks[i].numKeys = BENCH_KEYS;
+		Anim.pTracks[i].pKeys	= new KPKEYFRAME[BENCH_KEYS];
+
+		for ( int k = 0; k < BENCH_KEYS; ++k )
+		{
+			KPKEYFRAME &Key = Anim.pTracks[i].pKeys[k];
+
+			Key.fTime		= (float)k / (float)( BENCH_KEYS - 1 );
+			Key.fScale		= RandomFloat(0.9f, 1.1f);
+			Key.vcPosition.Set( 0.0f, ( i == 0 ) ? 0.0f : 1.0f, 0.0f );
+			RandomRotation(Key.qRotation);
+		}
+	}
+
+	for ( UINT v = 0; v < numVertices; ++v )
+	{
+		KPSKINVERTEX &Vertex = pVertices[v];
+		float fNormal[3], fLength;
+		float fSum = 0.0f;
+
+		Vertex.x = RandomFloat(-1.0f, 1.0f);
+		Vertex.y = RandomFloat(0.0f, (float)BENCH_BONES);
+		Vertex.z = RandomFloat(-1.0f, 1.0f);
+
+		for ( int c = 0; c < 3; ++c )
+			fNormal[c] = RandomFloat(-1.0f, 1.0f);
+		fLength = sqrtf(fNormal[0]*fNormal[0] + fNormal[1]*fNormal[1] + fNormal[2]*fNormal[2]) + 1e-3f;
+		for ( int c = 0; c < 3; ++c )
+			Vertex.vcNormal[c] = fNormal[c] / fLength;
+
+		Vertex.tu = RandomFloat(0.0f, 1.0f);
+		Vertex.tv = RandomFloat(0.0f, 1.0f);
+
+		// Decreasing weights, every fourth vertex has a single influence
+		int nFirst = (int)Vertex.y;
+		if ( nFirst > BENCH_BONES - 4 )
+			nFirst = BENCH_BONES - 4;
+
+		for ( int w = 0; w < KPMAX_INFLUENCES; ++w )
+		{
+			Vertex.nBones[w]	= (unsigned char)( nFirst + w );
+			Vertex.fWeights[w]	= ( v % 4 == 0 && w > 0 ) ? 0.0f : (float)( KPMAX_INFLUENCES - w );
+			fSum += Vertex.fWeights[w];
+		}
+
+		for ( int w = 0; w < KPMAX_INFLUENCES; ++w )
+			Vertex.fWeights[w] /= fSum;
+	}
+
+} // ! CreateTestData
+
+
+// BenchSkinning ////
+/////////////////////
+//
+// Times skinning one vertex array on the scalar and the SIMD path, and
+// animating and skinning a crowd serially and through KPSkinCharacters.
+static int BenchSkinning(void)
+{
+	KPSkeleton		Skeleton;
+	KPANIMATION		Anim;
+	UINT			numVertices	= BENCH_CHARACTERS * BENCH_CHARVERTICES;
+	KPSKINVERTEX	*pVertices	= new KPSKINVERTEX[numVertices];
+	KPAlignedArray<BENCHSKINNED>	Scalar, SIMD;
+	KPAlignedArray<KPMatrix>		Palettes;
+	KPSKINJOB		*pJobs		= new KPSKINJOB[BENCH_CHARACTERS];
+	KPMatrix		mWorld;
+	int				nFailed		= 0;
+	double			dStart, dScalar, dSIMD;
+
+	// The palettes and the outputs are written by the worker threads, they
+	// are aligned so that two characters never share a cache line
+	if ( !Scalar.Resize(numVertices) || !SIMD.Resize(numVertices) || !Palettes.Resize(BENCH_CHARACTERS * BENCH_BONES) )
+	{
+		delete [] pVertices;
+		delete [] pJobs;
+		return 1;
+	}
+
+	BENCHSKINNED	*pScalar	= Scalar.GetData();
+	BENCHSKINNED	*pSIMD		= SIMD.GetData();
+	KPMatrix		*pPalettes	= Palettes.GetData();
+
+	srand(5);
+
+	CreateTestData(Skeleton, Anim, pVertices, numVertices);
+
+	mWorld.Identity();
+	mWorld.Translate(1.0f, 2.0f, 3.0f);
+
+	// Sampling and palette
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		Skeleton.Sample(Anim, (float)p * 0.01f, pPalettes);
+		Skeleton.CalcPalette(pPalettes, mWorld, pPalettes);
+	}
+	dScalar = KPBenchElapsedNs(dStart, KPBENCH_PASSES, BENCH_BONES);
+
+	printf("%-16s %10.2f ns per bone\n", "sample+palette", dScalar);
+	KPBenchRecord("sample+palette", "scalar", "ns", BENCH_BONES, dScalar, 0.0);
+
+	// One vertex array
+	KPSetISA(KPISA_SCALAR);
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		KPSkinVertices(pVertices, pPalettes, pScalar, sizeof(BENCHSKINNED), KPBENCH_COUNT);
+	dScalar = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	KPSetISA( g_SimdISA );
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		KPSkinVertices(pVertices, pPalettes, pSIMD, sizeof(BENCHSKINNED), KPBENCH_COUNT);
+	dSIMD = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	if ( ! KPBenchReport("skin vertices", dScalar, dSIMD, SkinnedUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+		++nFailed;
+
+	// The crowd, every character at a different time of the clip
+	for ( int c = 0; c < BENCH_CHARACTERS; ++c )
+	{
+		KPSKINJOB &Job = pJobs[c];
+
+		Job.pSkeleton	= &Skeleton;
+		Job.pAnimation	= &Anim;
+		Job.fTime		= (float)c * 0.37f;
+		Job.mWorld		= mWorld;
+		Job.mWorld._41	= (float)c;
+		Job.pPalette	= pPalettes + c * BENCH_BONES;
+		Job.pVertices	= pVertices + c * BENCH_CHARVERTICES;
+		Job.numVertices	= BENCH_CHARVERTICES;
+		Job.nOutStride	= sizeof(BENCHSKINNED);
+	}
+
+	KPSetISA(KPISA_SCALAR);
+	dStart = KPBenchTime();
+	for ( int c = 0; c < BENCH_CHARACTERS; ++c )
+	{
+		KPSKINJOB &Job = pJobs[c];
+
+		Skeleton.Sample(Anim, Job.fTime, Job.pPalette);
+		Skeleton.CalcPalette(Job.pPalette, Job.mWorld, Job.pPalette);
+		KPSkinVertices(Job.pVertices, Job.pPalette, pScalar + c * BENCH_CHARVERTICES, sizeof(BENCHSKINNED), Job.numVertices);
+	}
+	dScalar = KPBenchElapsedNs(dStart, 1, numVertices);
+
+	KPSetISA( g_SimdISA );
+	for ( int c = 0; c < BENCH_CHARACTERS; ++c )
+		pJobs[c].pOut = pSIMD + c * BENCH_CHARVERTICES;
+
+	dStart = KPBenchTime();
+	KPSkinCharacters(pJobs, BENCH_CHARACTERS);
+	dSIMD = KPBenchElapsedNs(dStart, 1, numVertices);
+
+	if ( ! KPBenchReport("skin crowd", dScalar, dSIMD, SkinnedUlpDiff(pScalar, pSIMD, numVertices), KPSIMD_MAXULP) )
+		++nFailed;
+
+	for ( int i = 0; i < BENCH_BONES; ++i )
+		delete [] Anim.pTracks[i].pKeys;
+	delete [] Anim.pTracks;
+
+	delete [] pVertices;
+	delete [] pJobs;
+
+	return nFailed;
+} // ! BenchSkinning
+
+
+// BenchAnimation ////
+int BenchAnimation(void)
+{
+	return BenchSkinning();
+}
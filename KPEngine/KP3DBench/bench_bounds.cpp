@@ -0,0 +1,227 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_bounds.cpp
+ *  Description: Bounding box and sphere benchmarks
+ *				 - Boxes of VERTEX arrays, small and on the worker threads
+ *				 - Bounding spheres, Ritter and box center
+ *				 - Merging, transforming and ray tests
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+
+#define BENCH_BOUNDS_COUNT		( KPBENCH_COUNT + 3 )	// Odd count, the kernels run their tails
+#define BENCH_BOUNDS_LARGE		( 1 << 20 )				// Vertices of the large array
+#define BENCH_BOUNDS_PASSES		20						// Passes over the large array
+#define BENCH_BOUNDS_ERROR		1e-5f					// Allowed distance outside a transformed volume, relative to its size
+
+// The vertex layout of the models, position, normal and texture coordinates
+typedef struct BENCHVERTEX
+{
+	float x, y, z;
+	float nx, ny, nz;
+	float u, v;
+} BENCHVERTEX;
+
+
+static bool BoxEqual(const KPAABB &a, const KPAABB &b)
+{
+	for ( int c = 0; c < 3; ++c )
+	{
+		if ( a.vcMin[c] != b.vcMin[c] || a.vcMax[c] != b.vcMax[c] )
+			return false;
+	}
+
+	return true;
+}
+
+// Number of vertices outside the box or the sphere grown by fError
+static int CountOutside(const BENCHVERTEX *pVertices, int nCount, const KPMatrix *pMatrix,
+						const KPAabb &box, const KPSphere &sphere, float fError)
+{
+	KPVector	vcCenter	= sphere.GetCenter();
+	float		fRadius		= sphere.fRadius * ( 1.0f + fError );
+	int			nOutside	= 0;
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		KPVector v( pVertices[i].x, pVertices[i].y, pVertices[i].z );
+
+		if ( pMatrix )
+			v = v * (*pMatrix);
+
+		bool bInside = ( v - vcCenter ).GetLength() <= fRadius;
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			float fSlack = ( box.vcMax[c] - box.vcMin[c] ) * fError;
+
+			if ( (&v.x)[c] < box.vcMin[c] - fSlack || (&v.x)[c] > box.vcMax[c] + fSlack )
+				bInside = false;
+		}
+
+		if ( ! bInside )
+			++nOutside;
+	}
+
+	return nOutside;
+}
+
+// Prints a result line, the difference is the number of failed checks
+static bool ReportChecks(const char *chName, double dScalar, double dSIMD, int nDiff)
+{
+	KPBenchRecordPaths(chName, KPBENCH_COUNT, dScalar, dSIMD, 0.0);
+
+	printf("%-16s %10.2f %10.2f %8.2fx %6d err  %s\n", chName, dScalar, dSIMD,
+		   dScalar / dSIMD, nDiff, ( nDiff == 0 ) ? "ok" : "FAILED");
+
+	return ( nDiff == 0 );
+}
+
+
+// BenchBounds ////
+///////////////////
+//
+// Times the box of a VERTEX array on the scalar and the SIMD kernels, the
+// boxes have to be equal, and the sphere around the array, which has to
+// contain every vertex and be no larger than the sphere around the box.
+// Checks that merged and transformed volumes contain their inputs and the
+// ray tests of the box.
+int BenchBounds(void)
+{
+	BENCHVERTEX	*pVertices	= new BENCHVERTEX[BENCH_BOUNDS_LARGE];
+	KPAabb		Boxes[2];
+	int			nFailed		= 0;
+	double		dTime[2];
+
+	srand(10);
+
+	// A stretched, shifted cloud, the spheres have something to gain over the box
+	for ( int i = 0; i < BENCH_BOUNDS_LARGE; ++i )
+	{
+		pVertices[i].x	= RandomFloat(-40.0f, 40.0f) + 15.0f;
+		pVertices[i].y	= RandomFloat(-10.0f, 10.0f);
+		pVertices[i].z	= RandomFloat(-20.0f, 20.0f) - 5.0f;
+		pVertices[i].nx = pVertices[i].ny = 0.0f;
+		pVertices[i].nz = 1.0f;
+		pVertices[i].u	= pVertices[i].v = 0.0f;
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "bounds", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	// The box of a small array
+	for ( int nPath = 0; nPath < 2; ++nPath )
+	{
+		KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+		double dStart = KPBenchTime();
+		for ( int p = 0; p < KPBENCH_PASSES; ++p )
+			Boxes[nPath].Compute(&pVertices[0].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_COUNT);
+		dTime[nPath] = KPBenchElapsedNs(dStart, KPBENCH_PASSES, BENCH_BOUNDS_COUNT);
+	}
+
+	if ( ! ReportChecks("box", dTime[0], dTime[1], BoxEqual(Boxes[0], Boxes[1]) ? 0 : 1) )
+		++nFailed;
+
+	// The large array, split between the worker threads
+	KPSetISA(KPISA_SCALAR);
+	Boxes[0].Compute(&pVertices[0].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_LARGE);
+
+	KPSetISA( g_SimdISA );
+	double dStart = KPBenchTime();
+	for ( int p = 0; p < BENCH_BOUNDS_PASSES; ++p )
+		Boxes[1].Compute(&pVertices[0].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_LARGE);
+	double dMT = KPBenchElapsedNs(dStart, BENCH_BOUNDS_PASSES, BENCH_BOUNDS_LARGE);
+
+	if ( ! ReportChecks("box 1M", dTime[0], dMT, BoxEqual(Boxes[0], Boxes[1]) ? 0 : 1) )
+		++nFailed;
+
+	// The sphere, compared to the one around the box
+	KPSphere Sphere, BoxSphere;
+
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		Sphere.Compute(&pVertices[0].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_COUNT);
+	double dSphere = KPBenchElapsedNs(dStart, KPBENCH_PASSES, BENCH_BOUNDS_COUNT);
+
+	Boxes[1].Compute(&pVertices[0].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_COUNT);
+	BoxSphere.Set(Boxes[1]);
+
+	KPBenchRecord("sphere", "simd", "ns", BENCH_BOUNDS_COUNT, dSphere, 0.0);
+
+	int	 nOutside	= CountOutside(pVertices, BENCH_BOUNDS_COUNT, NULL, Boxes[1], Sphere, 0.0f);
+	bool bPassed	= ( nOutside == 0 && Sphere.fRadius <= BoxSphere.fRadius * ( 1.0f + BENCH_BOUNDS_ERROR ) );
+
+	printf("%-16s %10.2f ns, radius %.3f, %.3f around the box, %.1f%% smaller, %d outside  %s\n", "sphere",
+		   dSphere, Sphere.fRadius, BoxSphere.fRadius, 100.0f * ( 1.0f - Sphere.fRadius / BoxSphere.fRadius ),
+		   nOutside, bPassed ? "ok" : "FAILED");
+
+	if ( ! bPassed )
+		++nFailed;
+
+	// Two halves merged have to contain the whole array
+	KPAabb		BoxA, BoxB;
+	KPSphere	SphereA, SphereB;
+	int			nHalf	= BENCH_BOUNDS_COUNT / 2;
+	int			nErrors	= 0;
+
+	BoxA.Compute(&pVertices[0].x, sizeof(BENCHVERTEX), nHalf);
+	BoxB.Compute(&pVertices[nHalf].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_COUNT - nHalf);
+	SphereA.Compute(&pVertices[0].x, sizeof(BENCHVERTEX), nHalf);
+	SphereB.Compute(&pVertices[nHalf].x, sizeof(BENCHVERTEX), BENCH_BOUNDS_COUNT - nHalf);
+
+	BoxA.Merge(BoxB);
+	SphereA.Merge(SphereB);
+
+	nErrors += BoxEqual(BoxA, Boxes[1]) ? 0 : 1;
+	nErrors += CountOutside(pVertices, BENCH_BOUNDS_COUNT, NULL, BoxA, SphereA, BENCH_BOUNDS_ERROR);
+
+	// The transformed volumes have to contain the transformed vertices
+	KPMatrix mScale, mRotX, mRotY, mMove, mWorld;
+
+	mScale.Identity();
+	mScale._11 = 2.0f;
+	mScale._22 = 0.5f;
+	mScale._33 = 1.5f;
+	mRotX.RotateX(0.4f);
+	mRotY.RotateY(-1.1f);
+	mMove.Identity();
+	mMove.Translate(3.0f, -7.0f, 12.0f);
+	mWorld = mScale * mRotX * mRotY * mMove;
+
+	BoxA.Transform(Boxes[1], mWorld);
+	SphereA.Transform(Sphere, mWorld);
+
+	nErrors += CountOutside(pVertices, BENCH_BOUNDS_COUNT, &mWorld, BoxA, SphereA, BENCH_BOUNDS_ERROR);
+
+	// Rays from outside towards the center hit, parallel to the faces beside the box miss
+	KPVector	vcCenter	= Boxes[1].GetCenter();
+	KPVector	vcOrigin	= vcCenter + KPVector(100.0f, 30.0f, -60.0f);
+	float		fDistance	= -1.0f;
+
+	if ( ! Boxes[1].IntersectRay(vcOrigin, vcCenter - vcOrigin, &fDistance) || fDistance <= 0.0f || fDistance >= 1.0f )
+		++nErrors;
+	if ( ! Boxes[1].IntersectRay(vcCenter, KPVector(0.0f, 1.0f, 0.0f), &fDistance) || fDistance != 0.0f )
+		++nErrors;
+	if ( Boxes[1].IntersectRay(vcOrigin, vcOrigin - vcCenter, NULL) )
+		++nErrors;
+	if ( Boxes[1].IntersectRay(KPVector(0.0f, Boxes[1].vcMax[1] + 1.0f, 0.0f), KPVector(1.0f, 0.0f, 0.0f), NULL) )
+		++nErrors;
+
+	printf("%-16s %d errors  %s\n", "merge, transform", nErrors, ( nErrors == 0 ) ? "ok" : "FAILED");
+
+	if ( nErrors )
+		++nFailed;
+
+	delete [] pVertices;
+
+	return nFailed;
+} // ! BenchBounds
@@ -0,0 +1,283 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_cull.cpp
+ *  Description: Frustum classification and clipping benchmarks
+ *				 - Bounding spheres and boxes
+ *				 - 100k objects on the worker threads
+ *				 - Triangle clipping
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+
+#define BENCH_CULL_COUNT	100000		// Objects of the large array
+#define BENCH_CULL_PASSES	50			// Passes over the large array
+#define BENCH_CLIP_ERROR	1e-3		// Allowed distance of a clipped vertex in front of a plane
+
+
+// Number of differing states
+static int StateDiff(const unsigned char *pA, const unsigned char *pB, int n)
+{
+	int nDiff = 0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		if ( pA[i] != pB[i] )
+			++nDiff;
+	}
+
+	return nDiff;
+}
+
+// Prints a result line, the difference is the number of objects with differing states
+static bool ReportStates(const char *chName, double dScalar, double dSIMD, int nDiff)
+{
+	KPBenchRecordPaths(chName, KPBENCH_COUNT, dScalar, dSIMD, 0.0);
+
+	printf("%-16s %10.2f %10.2f %8.2fx %6d obj  %s\n", chName, dScalar, dSIMD,
+		   dScalar / dSIMD, nDiff, ( nDiff == 0 ) ? "ok" : "FAILED");
+
+	return ( nDiff == 0 );
+}
+
+
+// CreateFrustum ////
+/////////////////////
+//
+// A 90 degree frustum from the origin along the z axis, from 1 to 100,
+// turned around to have no axis aligned normals. Outward normals, like
+// the ones of KPRenderDevice::GetFrustum.
+static void CreateFrustum(KPPlane *pFrustum)
+{
+	static const float fPlanes[6][4] =
+	{
+		{ -1.0f,  0.0f, -1.0f,	  0.0f },		// left
+		{  1.0f,  0.0f, -1.0f,	  0.0f },		// right
+		{  0.0f,  1.0f, -1.0f,	  0.0f },		// top
+		{  0.0f, -1.0f, -1.0f,	  0.0f },		// bottom
+		{  0.0f,  0.0f, -1.0f,	  1.0f },		// near
+		{  0.0f,  0.0f,  1.0f, -100.0f },		// far
+	};
+
+	KPMatrix mYaw, mPitch, m;
+
+	mYaw.RotateY(0.7f);
+	mPitch.RotateX(0.3f);
+	m = mYaw * mPitch;
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		KPVector vcNormal( fPlanes[i][0], fPlanes[i][1], fPlanes[i][2] );
+
+		vcNormal.Normalize();
+
+		// Rotation only, the distances from the origin stay the same
+		pFrustum[i].m_vcNormal.Set( vcNormal.x*m._11 + vcNormal.y*m._21 + vcNormal.z*m._31,
+									vcNormal.x*m._12 + vcNormal.y*m._22 + vcNormal.z*m._32,
+									vcNormal.x*m._13 + vcNormal.y*m._23 + vcNormal.z*m._33 );
+		pFrustum[i].m_fDistance = fPlanes[i][3];
+	}
+}
+
+
+// BenchCulling ////
+////////////////////
+//
+// Times classifying spheres and boxes on the scalar and the SIMD kernels,
+// and the large arrays on the worker threads, the states have to be equal.
+int BenchCulling(void)
+{
+	KPPlane			frustum[6];
+	KPSPHERE		*pSpheres	= new KPSPHERE[BENCH_CULL_COUNT];
+	KPAABB			*pBoxes		= new KPAABB[BENCH_CULL_COUNT];
+	unsigned char	*pScalar	= new unsigned char[BENCH_CULL_COUNT];
+	unsigned char	*pSIMD		= new unsigned char[BENCH_CULL_COUNT];
+	int				nFailed		= 0;
+	int				nStates[KPVISIBLE + 1] = { 0 };
+
+	srand(8);
+
+	CreateFrustum(frustum);
+
+	for ( int i = 0; i < BENCH_CULL_COUNT; ++i )
+	{
+		float vcCenter[3];
+
+		for ( int c = 0; c < 3; ++c )
+			vcCenter[c] = RandomFloat(-100.0f, 100.0f);
+
+		pSpheres[i].x		= vcCenter[0];
+		pSpheres[i].y		= vcCenter[1];
+		pSpheres[i].z		= vcCenter[2];
+		pSpheres[i].fRadius = RandomFloat(0.5f, 5.0f);
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			float fHalf = RandomFloat(0.5f, 5.0f);
+
+			pBoxes[i].vcMin[c] = vcCenter[c] - fHalf;
+			pBoxes[i].vcMax[c] = vcCenter[c] + fHalf;
+		}
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "classification", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	for ( int nShape = 0; nShape < 2; ++nShape )
+	{
+		double dTime[2];
+
+		for ( int nPath = 0; nPath < 2; ++nPath )
+		{
+			unsigned char *pStates = nPath ? pSIMD : pScalar;
+
+			KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+			double dStart = KPBenchTime();
+			for ( int p = 0; p < KPBENCH_PASSES; ++p )
+			{
+				if ( nShape == 0 )
+					KPClassifySpheres(frustum, 6, pSpheres, pStates, KPBENCH_COUNT);
+				else
+					KPClassifyBoxes(frustum, 6, pBoxes, pStates, KPBENCH_COUNT);
+			}
+			dTime[nPath] = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+		}
+
+		if ( ! ReportStates(nShape ? "boxes" : "spheres", dTime[0], dTime[1], StateDiff(pScalar, pSIMD, KPBENCH_COUNT)) )
+			++nFailed;
+
+		// The large array, split between the worker threads
+		KPSetISA(KPISA_SCALAR);
+		if ( nShape == 0 )
+			KPClassifySpheres(frustum, 6, pSpheres, pScalar, BENCH_CULL_COUNT);
+		else
+			KPClassifyBoxes(frustum, 6, pBoxes, pScalar, BENCH_CULL_COUNT);
+
+		KPSetISA( g_SimdISA );
+		double dStart = KPBenchTime();
+		for ( int p = 0; p < BENCH_CULL_PASSES; ++p )
+		{
+			if ( nShape == 0 )
+				KPClassifySpheres(frustum, 6, pSpheres, pSIMD, BENCH_CULL_COUNT);
+			else
+				KPClassifyBoxes(frustum, 6, pBoxes, pSIMD, BENCH_CULL_COUNT);
+		}
+		double dMT = KPBenchElapsedNs(dStart, BENCH_CULL_PASSES, BENCH_CULL_COUNT);
+
+		if ( ! ReportStates(nShape ? "boxes 100k" : "spheres 100k", dTime[0], dMT, StateDiff(pScalar, pSIMD, BENCH_CULL_COUNT)) )
+			++nFailed;
+
+		for ( int i = 0; i < BENCH_CULL_COUNT; ++i )
+			++nStates[ pSIMD[i] ];
+	}
+
+	printf("%-16s %d visible, %d clipped, %d culled\n", "states", nStates[KPVISIBLE], nStates[KPCLIPPED], nStates[KPCULLED]);
+
+	delete [] pSpheres;
+	delete [] pBoxes;
+	delete [] pScalar;
+	delete [] pSIMD;
+
+	return nFailed;
+} // ! BenchCulling
+
+
+// BenchClipping ////
+/////////////////////
+//
+// Clips small triangles scattered around the frustum on the scalar and the
+// SIMD kernels, the output has to be the same and inside the frustum.
+int BenchClipping(void)
+{
+	KPPlane		frustum[6];
+	KPPolygon	Scratch;
+	KPVector	*pTriangles = new KPVector[3 * KPBENCH_COUNT];
+	KPVector	*pScalar	= new KPVector[3 * 7 * KPBENCH_COUNT];
+	KPVector	*pSIMD		= new KPVector[3 * 7 * KPBENCH_COUNT];
+	UINT		nOut[2]		= { 0, 0 };
+	double		dTime[2];
+	int			nFailed		= 0;
+
+	srand(9);
+
+	CreateFrustum(frustum);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		float x = RandomFloat(-100.0f, 100.0f);
+		float y = RandomFloat(-100.0f, 100.0f);
+		float z = RandomFloat(-100.0f, 100.0f);
+
+		for ( int k = 0; k < 3; ++k )
+			pTriangles[3*i + k].Set( x + RandomFloat(-10.0f, 10.0f), y + RandomFloat(-10.0f, 10.0f), z + RandomFloat(-10.0f, 10.0f) );
+	}
+
+	for ( int nPath = 0; nPath < 2; ++nPath )
+	{
+		KPVector *pOut = nPath ? pSIMD : pScalar;
+
+		KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+		double dStart = KPBenchTime();
+		for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		{
+			if ( ! KPClipTriangles(frustum, 6, pTriangles, KPBENCH_COUNT, pOut, 7 * KPBENCH_COUNT, &nOut[nPath], Scratch) )
+				++nFailed;
+		}
+		dTime[nPath] = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+	}
+
+	KPSetISA( g_SimdISA );
+
+	// Both paths have to produce the same triangles
+	int nUlp = ( nOut[0] == nOut[1] ) ? 0 : 1 << 30;
+
+	for ( UINT i = 0; nUlp == 0 && i < 3 * nOut[0]; ++i )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			int n = KPUlpDiff( (&pScalar[i].x)[c], (&pSIMD[i].x)[c] );
+			if ( n > nUlp )
+				nUlp = n;
+		}
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "clipping", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	if ( ! KPBenchReport("triangles", dTime[0], dTime[1], nUlp, 0) )
+		++nFailed;
+
+	// Every vertex has to be behind or on every plane
+	double dError = 0.0;
+
+	for ( UINT i = 0; i < 3 * nOut[1]; ++i )
+	{
+		for ( int p = 0; p < 6; ++p )
+		{
+			double d = frustum[p].m_vcNormal * pSIMD[i] + frustum[p].m_fDistance;
+			if ( d > dError )
+				dError = d;
+		}
+	}
+
+	bool bPassed = ( dError <= BENCH_CLIP_ERROR );
+
+	printf("%-16s %d triangles in, %u out, %.1e in front  %s\n", "inside", KPBENCH_COUNT, nOut[1], dError, bPassed ? "ok" : "FAILED");
+
+	if ( !bPassed )
+		++nFailed;
+
+	delete [] pTriangles;
+	delete [] pScalar;
+	delete [] pSIMD;
+
+	return nFailed;
+} // ! BenchClipping
@@ -0,0 +1,133 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_index.cpp
+ *  Description: Index kernel benchmarks
+ *				 - Rebasing the indices of small and large batches
+ *				 - Consecutive indices of unindexed batches
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define BENCH_INDEX_SMALL		( 36 + 3 )		// A box and a tail, the batches of the sprites and small props
+#define BENCH_INDEX_LARGE		( 3 * 20000 )	// A large skinned model, close to the index limit of a cache
+#define BENCH_INDEX_PASSES		200				// Passes over the large batch
+#define BENCH_INDEX_OFFSET		1234			// Vertices already in the cache
+
+
+// Number of different elements
+static int CountDiff(const unsigned short *pA, const unsigned short *pB, int nCount)
+{
+	int nDiff = 0;
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		if ( pA[i] != pB[i] )
+			++nDiff;
+	}
+
+	return nDiff;
+}
+
+// Prints a result line, the difference is the number of indices differing
+static bool ReportIndices(const char *chName, UINT nCount, double dScalar, double dSIMD, int nDiff)
+{
+	KPBenchRecordPaths(chName, nCount, dScalar, dSIMD, 4.0);
+
+	printf("%-16s %10.3f %10.3f %8.2fx %6d diff %s\n", chName, dScalar, dSIMD,
+		   dScalar / dSIMD, nDiff, ( nDiff == 0 ) ? "ok" : "FAILED");
+
+	return ( nDiff == 0 );
+}
+
+// Times one of the kernels on a batch, in nanoseconds per index
+static double TimeIndices(const unsigned short *pIn, unsigned short *pOut, UINT nCount, int nPasses)
+{
+	double dStart = KPBenchTime();
+
+	for ( int p = 0; p < nPasses; ++p )
+	{
+		if ( pIn )
+			KPRebaseIndices(pIn, pOut, nCount, BENCH_INDEX_OFFSET + ( p & 1 ));
+		else
+			KPSequenceIndices(pOut, nCount, BENCH_INDEX_OFFSET + ( p & 1 ));
+	}
+
+	g_fSink = pOut[nCount - 1];
+
+	return KPBenchElapsedNs(dStart, nPasses, nCount);
+}
+
+
+// BenchIndices ////
+////////////////////
+//
+// Times the index writing of KPD3DVertexCache::Add for a small and a large
+// batch, rebasing the indices of an indexed batch and generating them for
+// an unindexed one, on the scalar and the SIMD kernels. The results have to
+// be equal, the large batch also wraps around at 16 bits.
+int BenchIndices(void)
+{
+	unsigned short	*pIn		= new unsigned short[BENCH_INDEX_LARGE];
+	unsigned short	*pOut[2]	= { new unsigned short[BENCH_INDEX_LARGE], new unsigned short[BENCH_INDEX_LARGE] };
+	int				nFailed		= 0;
+	double			dTime[2];
+
+	srand(12);
+
+	for ( int i = 0; i < BENCH_INDEX_LARGE; ++i )
+		pIn[i] = (unsigned short)( rand() % 65536 );
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "indices", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	static const struct { const char *chName; bool bRebase; UINT nCount; int nPasses; } Runs[] =
+	{
+		{ "rebase small",	true,	BENCH_INDEX_SMALL,	KPBENCH_PASSES * 10 },
+		{ "rebase large",	true,	BENCH_INDEX_LARGE,	BENCH_INDEX_PASSES },
+		{ "sequence small",	false,	BENCH_INDEX_SMALL,	KPBENCH_PASSES * 10 },
+		{ "sequence large",	false,	BENCH_INDEX_LARGE,	BENCH_INDEX_PASSES },
+	};
+
+	for ( int r = 0; r < (int)( sizeof(Runs) / sizeof(Runs[0]) ); ++r )
+	{
+		for ( int nPath = 0; nPath < 2; ++nPath )
+		{
+			KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+			dTime[nPath] = TimeIndices(Runs[r].bRebase ? pIn : NULL, pOut[nPath], Runs[r].nCount, Runs[r].nPasses);
+		}
+
+		if ( ! ReportIndices(Runs[r].chName, Runs[r].nCount, dTime[0], dTime[1],
+							 CountDiff(pOut[0], pOut[1], Runs[r].nCount)) )
+			++nFailed;
+	}
+
+	// The SIMD results against the definition, the sequence crosses 65535
+	int nErrors = 0;
+
+	KPSetISA( g_SimdISA );
+	KPRebaseIndices(pIn, pOut[1], BENCH_INDEX_LARGE, BENCH_INDEX_OFFSET);
+	for ( int i = 0; i < BENCH_INDEX_LARGE; ++i )
+		nErrors += ( pOut[1][i] != (unsigned short)( pIn[i] + BENCH_INDEX_OFFSET ) ) ? 1 : 0;
+
+	KPSequenceIndices(pOut[1], BENCH_INDEX_LARGE, 65536 - 100);
+	for ( int i = 0; i < BENCH_INDEX_LARGE; ++i )
+		nErrors += ( pOut[1][i] != (unsigned short)( 65536 - 100 + i ) ) ? 1 : 0;
+
+	printf("%-16s %d errors  %s\n", "wrap around", nErrors, ( nErrors == 0 ) ? "ok" : "FAILED");
+
+	if ( nErrors )
+		++nFailed;
+
+	delete [] pIn;
+	delete [] pOut[0];
+	delete [] pOut[1];
+
+	return nFailed;
+} // ! BenchIndices
@@ -0,0 +1,524 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_matrix.cpp
+ *  Description: KPMatrix operation benchmarks
+ *				 - Matrix products
+ *				 - Rigid, affine and general matrix fast paths
+ *				 - Array transformations
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "bench.h"
+#include "KPKernels.h"
+#include "KPJobs.h"
+
+// Same layout as the VERTEX structure of the renderer
+typedef struct BENCHVERTEX
+{
+	float x, y, z;
+	float vcNormal[3];
+	float tu, tv;
+} BENCHVERTEX;
+
+// Number of vertices of the array used for timing the multithreaded path and its timed passes
+#define BENCH_MT_COUNT	100000
+#define BENCH_MT_PASSES	20
+
+
+// Array transformation modes
+typedef enum BENCHMODE { BM_POINTS, BM_AFFINE, BM_NORMALS } BENCHMODE;
+
+static void TransformArray(const KPMatrix &m, BENCHMODE Mode, const BENCHVERTEX *pIn, BENCHVERTEX *pOut, UINT n)
+{
+	switch ( Mode )
+	{
+	case BM_POINTS:  m.TransformPoints(&pIn[0].x, sizeof(BENCHVERTEX), &pOut[0].x, sizeof(BENCHVERTEX), n); break;
+	case BM_AFFINE:  m.TransformAffine(&pIn[0].x, sizeof(BENCHVERTEX), &pOut[0].x, sizeof(BENCHVERTEX), n); break;
+	case BM_NORMALS: m.TransformNormals(&pIn[0].x, sizeof(BENCHVERTEX), &pOut[0].x, sizeof(BENCHVERTEX), n); break;
+	}
+}
+
+static void TransformStream(const KPMatrix &m, BENCHMODE Mode, const KPSOASTREAM &In, const KPSOASTREAM &Out, UINT n)
+{
+	switch ( Mode )
+	{
+	case BM_POINTS:  m.TransformPoints(In, Out, n);  break;
+	case BM_AFFINE:  m.TransformAffine(In, Out, n);  break;
+	case BM_NORMALS: m.TransformNormals(In, Out, n); break;
+	}
+}
+
+// Times the transformation of the large array in nanoseconds per vertex, after a pass warming up the caches and the workers
+static double TimeLargeArray(const KPMatrix &m, BENCHMODE Mode, const BENCHVERTEX *pIn, BENCHVERTEX *pOut)
+{
+	TransformArray(m, Mode, pIn, pOut, BENCH_MT_COUNT);
+
+	double dStart = KPBenchTime();
+	for ( int p = 0; p < BENCH_MT_PASSES; ++p )
+		TransformArray(m, Mode, pIn, pOut, BENCH_MT_COUNT);
+
+	return KPBenchElapsedNs(dStart, BENCH_MT_PASSES, BENCH_MT_COUNT);
+}
+
+// Largest ULP distance between the coordinates of two vertex arrays
+static int VertexUlpDiff(const BENCHVERTEX *pA, const BENCHVERTEX *pB, UINT n)
+{
+	int nMax = 0;
+
+	for ( UINT i = 0; i < n; ++i )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			int nUlp = KPUlpDiff( (&pA[i].x)[c], (&pB[i].x)[c] );
+			if ( nUlp > nMax )
+				nMax = nUlp;
+		}
+
+		// The rest of the vertex must not change
+		if ( memcmp(pA[i].vcNormal, pB[i].vcNormal, sizeof(float) * 5) != 0 )
+			return 0x7FFFFFFF;
+	}
+
+	return nMax;
+}
+
+// Largest ULP distance between the elements of two matrix arrays
+static int MatrixUlpDiff(const KPMatrix *pA, const KPMatrix *pB, UINT n)
+{
+	int nMax = 0;
+
+	for ( UINT i = 0; i < n; ++i )
+	{
+		for ( int e = 0; e < 16; ++e )
+		{
+			int nUlp = KPUlpDiff( (&pA[i]._11)[e], (&pB[i]._11)[e] );
+			if ( nUlp > nMax )
+				nMax = nUlp;
+		}
+	}
+
+	return nMax;
+}
+
+
+static void RandomMatrix(KPMatrix &m)
+{
+	float *f = &m._11;
+	for ( int i = 0; i < 16; ++i )
+		f[i] = RandomFloat(-1.0f, 1.0f);
+}
+
+
+// BenchMultiply ////
+/////////////////////
+//
+// Times the matrix product on unaligned and aligned matrices and the
+// array version, which multiplies every matrix by the same one.
+static int BenchMultiply(void)
+{
+	KPMatrix	*pIn		= new KPMatrix[KPBENCH_COUNT];
+	KPMatrixA	*pInA		= new KPMatrixA[KPBENCH_COUNT];
+	KPMatrixA	*pScalar	= new KPMatrixA[KPBENCH_COUNT];
+	KPMatrixA	*pSIMD		= new KPMatrixA[KPBENCH_COUNT];
+	KPMatrixA	m;
+	int			nFailed		= 0;
+	double		dStart, dScalar, dSIMD;
+
+	srand(3);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		RandomMatrix(pIn[i]);
+		pInA[i] = pIn[i];
+	}
+
+	RandomMatrix(m);
+
+	// KPMatrix * KPMatrix
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			KPScalarOps::Multiply(pScalar[i], pIn[i], m, false);
+	dScalar = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			KPSSEOps::Multiply(pSIMD[i], pIn[i], m, false);
+	dSIMD = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	if ( ! KPBenchReport("matrix*matrix", dScalar, dSIMD, MatrixUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+		++nFailed;
+
+	// KPMatrixA * KPMatrixA
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			pSIMD[i] = pInA[i] * m;
+	dSIMD = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	if ( ! KPBenchReport("aligned m*m", dScalar, dSIMD, MatrixUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+		++nFailed;
+
+	// MultiplyArray
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		m.MultiplyArray(pIn, pSIMD, KPBENCH_COUNT);
+	dSIMD = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	if ( ! KPBenchReport("MultiplyArray", dScalar, dSIMD, MatrixUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+		++nFailed;
+
+	delete [] pIn;
+	delete [] pInA;
+	delete [] pScalar;
+	delete [] pSIMD;
+
+	return nFailed;
+} // ! BenchMultiply
+
+
+// Largest difference between m * mInv and the identity matrix, relative
+// to the largest product of the elements of the two matrices
+static double InverseError(const KPMatrix &m, const KPMatrix &mInv)
+{
+	KPMatrix mProduct = m * mInv;
+	double	 dMax	  = 0.0;
+	double	 dScale	  = 0.0;
+	double	 dScaleInv= 0.0;
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		double dIdentity = ( i % 5 == 0 ) ? 1.0 : 0.0;
+		double dError	 = fabs( (&mProduct._11)[i] - dIdentity );
+
+		if ( dError > dMax )
+			dMax = dError;
+
+		if ( fabs( (&m._11)[i] ) > dScale )
+			dScale = fabs( (&m._11)[i] );
+		if ( fabs( (&mInv._11)[i] ) > dScaleInv )
+			dScaleInv = fabs( (&mInv._11)[i] );
+	}
+
+	return dMax / ( dScale * dScaleInv );
+}
+
+// Random rotation and translation, scaled by up to 2x if bScale is true,
+// and with a perspective column if bGeneral is true
+static void RandomClassMatrix(KPMatrix &m, bool bScale, bool bGeneral)
+{
+	KPMatrix mX, mY, mZ;
+
+	mX.RotateX( RandomFloat(-3.14f, 3.14f) );
+	mY.RotateY( RandomFloat(-3.14f, 3.14f) );
+	mZ.RotateZ( RandomFloat(-3.14f, 3.14f) );
+
+	m = mX * mY * mZ;
+
+	if ( bScale )
+	{
+		KPMatrix mScale;
+
+		mScale.Identity();
+		mScale._11 = RandomFloat(0.5f, 2.0f);
+		mScale._22 = RandomFloat(0.5f, 2.0f);
+		mScale._33 = RandomFloat(0.5f, 2.0f);
+
+		m = mScale * m;
+	}
+
+	m.Translate( RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f) );
+
+	if ( bGeneral )
+	{
+		m._14 = RandomFloat(-0.1f, 0.1f);
+		m._24 = RandomFloat(-0.1f, 0.1f);
+		m._34 = RandomFloat(-0.1f, 0.1f);
+		m._44 = RandomFloat(1.0f, 2.0f);
+	}
+}
+
+
+// BenchMatrixTypes ////
+////////////////////////
+//
+// Times the inverse of rigid, affine and general matrices through the
+// full cofactor expansion and through InverseOf(m), which detects the
+// class of the matrix, and the point transformation by a general and
+// an affine matrix, in reference cycles per operation.
+static int BenchMatrixTypes(void)
+{
+	static const struct
+	{
+		const char		*chName;
+		KPMATRIXTYPE	Type;
+		bool			bScale;
+		bool			bGeneral;
+	} types[] = {
+		{ "inverse rigid",		KPMT_RIGID,		false,	false	},
+		{ "inverse affine",		KPMT_AFFINE,	true,	false	},
+		{ "inverse general",	KPMT_GENERAL,	true,	true	},
+	};
+
+	const int	nPasses		= KPBENCH_PASSES / 10;
+	KPMatrix	*pIn		= new KPMatrix[KPBENCH_COUNT];
+	KPMatrix	*pOut		= new KPMatrix[KPBENCH_COUNT];
+	KPVector	*pPoints	= new KPVector[KPBENCH_COUNT];
+	KPVector	*pResults	= new KPVector[KPBENCH_COUNT];
+	int			nFailed		= 0;
+	double		dStart, dFull, dFast, dError;
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "matrix class", "full cyc", "typed cyc", "speedup", "error");
+
+	srand(4);
+
+	for ( int t = 0; t < (int)( sizeof(types) / sizeof(types[0]) ); ++t )
+	{
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			RandomClassMatrix(pIn[i], types[t].bScale, types[t].bGeneral);
+
+			if ( pIn[i].GetType() != types[t].Type )
+			{
+				printf("%-16s GetType() misclassified a matrix  FAILED\n", types[t].chName);
+				++nFailed;
+				break;
+			}
+		}
+
+		dStart = KPBenchCycles();
+		for ( int p = 0; p < nPasses; ++p )
+			for ( int i = 0; i < KPBENCH_COUNT; ++i )
+				pOut[i].InverseOf(pIn[i], KPMT_GENERAL);
+		dFull = KPBenchElapsedCycles(dStart, nPasses, KPBENCH_COUNT);
+
+		dStart = KPBenchCycles();
+		for ( int p = 0; p < nPasses; ++p )
+			for ( int i = 0; i < KPBENCH_COUNT; ++i )
+				pOut[i].InverseOf(pIn[i]);
+		dFast = KPBenchElapsedCycles(dStart, nPasses, KPBENCH_COUNT);
+
+		dError = 0.0;
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			double d = InverseError(pIn[i], pOut[i]);
+			if ( d > dError )
+				dError = d;
+		}
+
+		if ( ! KPBenchReportCycles(types[t].chName, dFull, dFast, dError, 1e-4) )
+			++nFailed;
+	}
+
+	// Points by general (division by w) and by affine (no division) matrices
+	KPMatrix mGeneral, mAffine;
+
+	RandomClassMatrix(mGeneral, true, true);
+	RandomClassMatrix(mAffine,	true, false);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		pPoints[i] = KPVector( RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f) );
+
+	dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			pResults[i] = pPoints[i] * mGeneral;
+	dFull = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			pResults[i] = pPoints[i] * mAffine;
+	dFast = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	// Skipping the division by w = 1 must not change the results
+	dError = 0.0;
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		const KPVector &v = pPoints[i];
+		float fW = v.x*mAffine._14 + v.y*mAffine._24 + v.z*mAffine._34 + mAffine._44;
+		float fX = ( v.x*mAffine._11 + v.y*mAffine._21 + v.z*mAffine._31 + mAffine._41 ) / fW;
+
+		double d = fabs( (double)fX - (double)pResults[i].x );
+		if ( d > dError )
+			dError = d;
+	}
+
+	if ( ! KPBenchReportCycles("point affine", dFull, dFast, dError, 0.0) )
+		++nFailed;
+
+	delete [] pIn;
+	delete [] pOut;
+	delete [] pPoints;
+	delete [] pResults;
+
+	return nFailed;
+} // ! BenchMatrixTypes
+
+
+// BenchTransform ////
+//////////////////////
+//
+// Times the strided and SoA array transformations against transforming
+// the vertices one by one with KPVector * KPMatrix on the scalar path.
+static int BenchTransform(void)
+{
+	static const struct
+	{
+		const char	*chName;
+		BENCHMODE	Mode;
+	} modes[] = {
+		{ "points",		BM_POINTS	},
+		{ "affine",		BM_AFFINE	},
+		{ "normals",	BM_NORMALS	},
+	};
+
+	BENCHVERTEX	*pIn		= new BENCHVERTEX[BENCH_MT_COUNT];
+	BENCHVERTEX	*pScalar	= new BENCHVERTEX[BENCH_MT_COUNT];
+	BENCHVERTEX	*pSIMD		= new BENCHVERTEX[BENCH_MT_COUNT];
+	float		*pSoA		= new float[KPBENCH_COUNT * 6];
+	KPSOASTREAM	In			= { pSoA, pSoA + KPBENCH_COUNT, pSoA + KPBENCH_COUNT * 2 };
+	KPSOASTREAM	Out			= { pSoA + KPBENCH_COUNT * 3, pSoA + KPBENCH_COUNT * 4, pSoA + KPBENCH_COUNT * 5 };
+	KPMatrix	m;
+	int			nFailed		= 0;
+	char		chName[64];
+
+	srand(2);
+
+	for ( UINT i = 0; i < BENCH_MT_COUNT; ++i )
+	{
+		float *f = &pIn[i].x;
+		for ( int c = 0; c < 8; ++c )
+			f[c] = RandomFloat(-10.0f, 10.0f);
+	}
+
+	for ( UINT i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		In.pX[i] = pIn[i].x;
+		In.pY[i] = pIn[i].y;
+		In.pZ[i] = pIn[i].z;
+	}
+
+	float *f = &m._11;
+	for ( int i = 0; i < 16; ++i )
+		f[i] = RandomFloat(-1.0f, 1.0f);
+	m._44 = 4.0f;
+
+	for ( int i = 0; i < (int)( sizeof(modes) / sizeof(modes[0]) ); ++i )
+	{
+		BENCHMODE Mode = modes[i].Mode;
+
+		// Reference: the scalar path of the same call
+		memcpy(pScalar, pIn, sizeof(BENCHVERTEX) * BENCH_MT_COUNT);
+		memcpy(pSIMD,	pIn, sizeof(BENCHVERTEX) * BENCH_MT_COUNT);
+
+		KPSetISA(KPISA_SCALAR);
+		double dStart = KPBenchTime();
+		for ( int p = 0; p < KPBENCH_PASSES; ++p )
+			TransformArray(m, Mode, pIn, pScalar, KPBENCH_COUNT);
+		double dScalar = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+		KPSetISA( g_SimdISA );
+		dStart = KPBenchTime();
+		for ( int p = 0; p < KPBENCH_PASSES; ++p )
+			TransformArray(m, Mode, pIn, pSIMD, KPBENCH_COUNT);
+		double dSIMD = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+		sprintf(chName, "%s VERTEX", modes[i].chName);
+		if ( ! KPBenchReport(chName, dScalar, dSIMD, VertexUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+			++nFailed;
+
+		// SoA streams, checked against the strided results
+		dStart = KPBenchTime();
+		for ( int p = 0; p < KPBENCH_PASSES; ++p )
+			TransformStream(m, Mode, In, Out, KPBENCH_COUNT);
+		double dStream = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+		int nUlp = 0;
+		for ( UINT v = 0; v < KPBENCH_COUNT; ++v )
+		{
+			int nX = KPUlpDiff(Out.pX[v], pScalar[v].x);
+			int nY = KPUlpDiff(Out.pY[v], pScalar[v].y);
+			int nZ = KPUlpDiff(Out.pZ[v], pScalar[v].z);
+
+			if ( nX > nUlp ) nUlp = nX;
+			if ( nY > nUlp ) nUlp = nY;
+			if ( nZ > nUlp ) nUlp = nZ;
+		}
+
+		sprintf(chName, "%s SoA", modes[i].chName);
+		if ( ! KPBenchReport(chName, dScalar, dStream, nUlp, KPSIMD_MAXULP) )
+			++nFailed;
+
+	}
+
+	// Large array: the scalar and the SIMD kernel on the calling thread, then
+	// the SIMD kernel split between the worker threads, the gain of the split
+	// is what the KPJOB_VECTOR threshold is chosen by
+	UINT nThreshold = KPGetParallelThreshold(KPJOB_VECTOR);
+
+	printf("\n%-16s %10s %10s %10s %9s %9s %10s\n", "100k vertices", "scalar ns", "SIMD ns", "threads ns",
+		   "SIMD", "threads", "difference");
+
+	for ( int i = 0; i < (int)( sizeof(modes) / sizeof(modes[0]) ); ++i )
+	{
+		BENCHMODE Mode = modes[i].Mode;
+
+		KPSetParallelThreshold(KPJOB_VECTOR, 0xFFFFFFFF);
+
+		KPSetISA(KPISA_SCALAR);
+		double dScalar = TimeLargeArray(m, Mode, pIn, pScalar);
+
+		KPSetISA( g_SimdISA );
+		double dSIMD = TimeLargeArray(m, Mode, pIn, pSIMD);
+		int nUlp = VertexUlpDiff(pScalar, pSIMD, BENCH_MT_COUNT);
+
+		KPSetParallelThreshold(KPJOB_VECTOR, nThreshold);
+
+		double dThreads = TimeLargeArray(m, Mode, pIn, pSIMD);
+		int nUlpMT = VertexUlpDiff(pScalar, pSIMD, BENCH_MT_COUNT);
+
+		if ( nUlpMT > nUlp )
+			nUlp = nUlpMT;
+
+		sprintf(chName, "%s 100k", modes[i].chName);
+		KPBenchRecordPaths(chName, BENCH_MT_COUNT, dScalar, dSIMD, 0.0);
+		KPBenchRecord(chName, "threads", "ns", BENCH_MT_COUNT, dThreads, 0.0);
+
+		printf("%-16s %10.3f %10.3f %10.3f %8.2fx %8.2fx %6d ulp  %s\n", chName, dScalar, dSIMD, dThreads,
+			   dScalar / dSIMD, dSIMD / dThreads, nUlp, ( nUlp <= KPSIMD_MAXULP ) ? "ok" : "FAILED");
+
+		if ( nUlp > KPSIMD_MAXULP )
+			++nFailed;
+	}
+
+	delete [] pIn;
+	delete [] pScalar;
+	delete [] pSIMD;
+	delete [] pSoA;
+
+	return nFailed;
+} // ! BenchTransform
+
+
+// BenchMatrix ////
+int BenchMatrix(void)
+{
+	int nFailed = 0;
+
+	nFailed += BenchMultiply();
+	nFailed += BenchTransform();
+	nFailed += BenchMatrixTypes();
+
+	return nFailed;
+}
@@ -0,0 +1,160 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_pixels.cpp
+ *  Description: Pixel kernel benchmarks
+ *				 - Color key replacement
+ *				 - Alpha limiting
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+#define BENCH_PIXEL_COUNT		( KPBENCH_COUNT + 5 )	// Timed batch, not a multiple of 4 or 8
+#define BENCH_PIXEL_TAILS		24						// Every count below it is checked, each tail of the 4 and 8 wide loops
+#define BENCH_PIXEL_GUARD		8						// Pixels after the batch, the kernels must not touch them
+#define BENCH_PIXEL_KEY			0xFFFF00FF
+#define BENCH_PIXEL_COLOR		0x12345678
+#define BENCH_PIXEL_ALPHA		0x80
+
+
+// Random A8R8G8B8 pixels, every third one is the color key
+static void FillPixels(UINT *pPixels, UINT nCount)
+{
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		if ( rand() % 3 == 0 )
+			pPixels[i] = BENCH_PIXEL_KEY;
+		else
+			pPixels[i] = ( (UINT)( rand() & 0xFFFF ) << 16 ) | (UINT)( rand() & 0xFFFF );
+	}
+}
+
+// Runs one of the kernels on the selected instruction set
+static void RunPixels(bool bColorKey, UINT *pPixels, UINT nCount)
+{
+	if ( bColorKey )
+		KPReplaceColor(pPixels, nCount, BENCH_PIXEL_KEY, BENCH_PIXEL_COLOR);
+	else
+		KPLimitAlpha(pPixels, nCount, BENCH_PIXEL_ALPHA);
+}
+
+// Number of pixels the kernel of Isa writes differently from the scalar one,
+// on every count below BENCH_PIXEL_TAILS and on the timed batch. The guard
+// pixels after the count are compared too.
+static int CheckPixels(bool bColorKey, KPISA Isa, const UINT *pIn, UINT *pScalar, UINT *pSIMD)
+{
+	int nDiff = 0;
+
+	for ( UINT n = 0; n <= BENCH_PIXEL_TAILS; ++n )
+	{
+		UINT nCount = ( n < BENCH_PIXEL_TAILS ) ? n : BENCH_PIXEL_COUNT;
+
+		memcpy(pScalar, pIn, ( BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD ) * sizeof(UINT));
+		memcpy(pSIMD,	pIn, ( BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD ) * sizeof(UINT));
+
+		KPSetISA( KPISA_SCALAR );
+		RunPixels(bColorKey, pScalar, nCount);
+
+		KPSetISA( Isa );
+		RunPixels(bColorKey, pSIMD, nCount);
+
+		for ( UINT i = 0; i < nCount + BENCH_PIXEL_GUARD; ++i )
+		{
+			if ( pScalar[i] != pSIMD[i] )
+				++nDiff;
+		}
+	}
+
+	return nDiff;
+}
+
+// Times one of the kernels on the selected instruction set, in nanoseconds per pixel
+static double TimePixels(bool bColorKey, const UINT *pIn, UINT *pPixels)
+{
+	memcpy(pPixels, pIn, BENCH_PIXEL_COUNT * sizeof(UINT));
+
+	double dStart = KPBenchTime();
+
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		RunPixels(bColorKey, pPixels, BENCH_PIXEL_COUNT);
+
+	g_fSink = (float)pPixels[BENCH_PIXEL_COUNT - 1];
+
+	return KPBenchElapsedNs(dStart, KPBENCH_PASSES, BENCH_PIXEL_COUNT);
+}
+
+
+// BenchPixels ////
+///////////////////
+//
+// Compares the color key and alpha limit kernels of every instruction set
+// up to the selected one with the scalar ones, on every count up to three
+// whole vectors of AVX2 and on a batch that leaves a tail, and times them.
+// The levels without a kernel of their own would run the one below again,
+// they are skipped.
+int BenchPixels(void)
+{
+	UINT	*pIn		= new UINT[BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD];
+	UINT	*pScalar	= new UINT[BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD];
+	UINT	*pSIMD		= new UINT[BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD];
+	int		nFailed		= 0;
+
+	srand(14);
+
+	FillPixels(pIn, BENCH_PIXEL_COUNT + BENCH_PIXEL_GUARD);
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "pixels", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	static const struct { const char *chName; const char *chKernel; bool bColorKey; } Ops[] =
+	{
+		{ "color key",		"replace color",	true },
+		{ "limit alpha",	"limit alpha",		false },
+	};
+
+	for ( int o = 0; o < (int)( sizeof(Ops) / sizeof(Ops[0]) ); ++o )
+	{
+		UINT nKernel = KPBenchFindKernel(Ops[o].chKernel);
+
+		KPSetISA( KPISA_SCALAR );
+		double dScalar = TimePixels(Ops[o].bColorKey, pIn, pScalar);
+
+		for ( int nIsa = KPISA_SSE; nIsa <= g_SimdISA; ++nIsa )
+		{
+			char chName[32];
+
+			if ( nKernel < KPGetNumKernels() && KPGetKernelISA(nKernel, (KPISA)nIsa) != nIsa )
+				continue;
+
+			if ( ! KPSetISA( (KPISA)nIsa ) )
+				continue;
+
+			double	dSIMD = TimePixels(Ops[o].bColorKey, pIn, pSIMD);
+			int		nDiff = CheckPixels(Ops[o].bColorKey, (KPISA)nIsa, pIn, pScalar, pSIMD);
+
+			sprintf(chName, "%s %s", Ops[o].chName, KPGetISAName( (KPISA)nIsa ));
+			KPBenchRecordPaths(chName, BENCH_PIXEL_COUNT, dScalar, dSIMD, 8.0);
+
+			printf("%-16s %10.3f %10.3f %8.2fx %6d diff %s\n", chName, dScalar, dSIMD,
+				   dScalar / dSIMD, nDiff, ( nDiff == 0 ) ? "ok" : "FAILED");
+
+			if ( nDiff )
+				++nFailed;
+		}
+	}
+
+	KPSetISA( g_SimdISA );
+
+	delete [] pIn;
+	delete [] pScalar;
+	delete [] pSIMD;
+
+	return nFailed;
+} // ! BenchPixels
@@ -0,0 +1,310 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_quat.cpp
+ *  Description: KPQuaternion benchmarks
+ *				 - Product and interpolation
+ *				 - Matrix conversions
+ *				 - World matrices of many objects
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+#include "KPKernels.h"
+
+// Allowed error of the slerp weights and of the matrix conversions
+#define BENCH_QUAT_ERROR	1e-6
+
+
+static void RandomRotation(KPQuaternion &q)
+{
+	do
+	{
+		q.Set( RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) );
+	}
+	while ( q.GetLength() < 1e-3f );
+
+	q.Normalize();
+}
+
+// Largest ULP distance between the elements of two quaternion arrays
+static int QuatUlpDiff(const KPQuaternion *pA, const KPQuaternion *pB, int n)
+{
+	int nMax = 0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		for ( int c = 0; c < 4; ++c )
+		{
+			int nUlp = KPUlpDiff( (&pA[i].x)[c], (&pB[i].x)[c] );
+			if ( nUlp > nMax )
+				nMax = nUlp;
+		}
+	}
+
+	return nMax;
+}
+
+// Largest absolute difference of the elements of two matrices
+static double MatrixError(const KPMatrix &a, const KPMatrix &b)
+{
+	const float *fA = &a._11;
+	const float *fB = &b._11;
+	double		dMax = 0.0;
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		double d = fabs( (double)fA[i] - (double)fB[i] );
+		if ( d > dMax )
+			dMax = d;
+	}
+
+	return dMax;
+}
+
+// Prints a result line of an accuracy check, returns true if the error is within the allowed one
+static bool ReportError(const char *chName, double dError, double dMaxError)
+{
+	bool bPassed = ( dError <= dMaxError );
+
+	printf("%-16s %10s %10s %9s %10.1e  %s\n", chName, "", "", "", dError, bPassed ? "ok" : "FAILED");
+
+	return bPassed;
+}
+
+// Reference slerp with the trigonometric weights, in double precision
+static void RefSlerp(const KPQuaternion &q0, const KPQuaternion &q1, double t, double *q)
+{
+	double a[4] = { q0.x, q0.y, q0.z, q0.w };
+	double b[4] = { q1.x, q1.y, q1.z, q1.w };
+	double dDot = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+
+	if ( dDot < 0.0 )
+	{
+		dDot = -dDot;
+		for ( int c = 0; c < 4; ++c )
+			b[c] = -b[c];
+	}
+
+	if ( dDot > 1.0 )
+		dDot = 1.0;
+
+	double dAngle = acos(dDot);
+	double dSine  = sin(dAngle);
+	double w0	  = ( dSine < 1e-12 ) ? 1.0 - t : sin( (1.0 - t) * dAngle ) / dSine;
+	double w1	  = ( dSine < 1e-12 ) ? t		: sin( t * dAngle ) / dSine;
+
+	for ( int c = 0; c < 4; ++c )
+		q[c] = a[c] * w0 + b[c] * w1;
+}
+
+
+// Times a product or interpolation of the arrays with one implementation, in nanoseconds per operation
+template <class Ops> static double TimeQuatOp(int op, const KPQuaternion *pA, const KPQuaternion *pB, const float *pT, KPQuaternion *pOut)
+{
+	double dStart = KPBenchTime();
+
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			switch ( op )
+			{
+			case 0: Ops::Multiply(pOut[i], pA[i], pB[i]);		break;
+			case 1: Ops::Nlerp(pOut[i], pA[i], pB[i], pT[i]);	break;
+			case 2: Ops::Slerp(pOut[i], pA[i], pB[i], pT[i]);	break;
+			}
+		}
+	}
+
+	return KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+}
+
+
+// BenchQuatOps ////
+////////////////////
+//
+// Times the product and the interpolations of the scalar and the SIMD
+// implementation, and checks the slerp against the trigonometric formula.
+static int BenchQuatOps(void)
+{
+	KPQuaternion	*pA			= new KPQuaternion[KPBENCH_COUNT];
+	KPQuaternion	*pB			= new KPQuaternion[KPBENCH_COUNT];
+	KPQuaternion	*pScalar	= new KPQuaternion[KPBENCH_COUNT];
+	KPQuaternion	*pSIMD		= new KPQuaternion[KPBENCH_COUNT];
+	float			*pT			= new float[KPBENCH_COUNT];
+	int				nFailed		= 0;
+
+	srand(6);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		RandomRotation(pA[i]);
+		RandomRotation(pB[i]);
+		pT[i] = RandomFloat(0.0f, 1.0f);
+	}
+
+	static const char *chNames[] = { "quat*quat", "nlerp", "slerp" };
+
+	for ( int op = 0; op < 3; ++op )
+	{
+		double dTime[2];
+
+		dTime[0] = TimeQuatOp<KPScalarOps>(op, pA, pB, pT, pScalar);
+		dTime[1] = TimeQuatOp<KPSSEOps>(op, pA, pB, pT, pSIMD);
+
+		if ( ! KPBenchReport(chNames[op], dTime[0], dTime[1], QuatUlpDiff(pScalar, pSIMD, KPBENCH_COUNT), KPSIMD_MAXULP) )
+			++nFailed;
+	}
+
+	// pSIMD holds the slerp results, compare them to the exact formula
+	double dError = 0.0;
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		double q[4];
+
+		RefSlerp(pA[i], pB[i], pT[i], q);
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			double d = fabs( q[c] - (&pSIMD[i].x)[c] );
+			if ( d > dError )
+				dError = d;
+		}
+	}
+
+	if ( ! ReportError("slerp vs trig", dError, BENCH_QUAT_ERROR) )
+		++nFailed;
+
+	delete [] pA;
+	delete [] pB;
+	delete [] pScalar;
+	delete [] pSIMD;
+	delete [] pT;
+
+	return nFailed;
+} // ! BenchQuatOps
+
+
+// BenchQuatMatrix ////
+///////////////////////
+//
+// Checks the matrix conversions against RotateX/Y and times building the
+// world matrices of many objects from yaw and pitch angles the way the
+// tester does it, RotateY * RotateX plus the translation, against
+// KPBuildTRSMatrices, in reference cycles per object.
+static int BenchQuatMatrix(void)
+{
+	KPTRS		*pTRS		= new KPTRS[KPBENCH_COUNT];
+	float		*pYaw		= new float[KPBENCH_COUNT];
+	float		*pPitch		= new float[KPBENCH_COUNT];
+	KPMatrix	*pFull		= new KPMatrix[KPBENCH_COUNT];
+	KPMatrix	*pFast		= new KPMatrix[KPBENCH_COUNT];
+	KPVector	vcX(1.0f, 0.0f, 0.0f), vcY(0.0f, 1.0f, 0.0f);
+	int			nFailed		= 0;
+	double		dError		= 0.0;
+
+	srand(7);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		KPQuaternion qYaw, qPitch;
+
+		pYaw[i]	  = RandomFloat(-3.14f, 3.14f);
+		pPitch[i] = RandomFloat(-1.5f, 1.5f);
+
+		qYaw.FromAxisAngle(vcY, pYaw[i]);
+		qPitch.FromAxisAngle(vcX, pPitch[i]);
+
+		pTRS[i].vcScale.Set(1.0f, 1.0f, 1.0f);
+		pTRS[i].qRotation = qYaw * qPitch;
+		pTRS[i].vcPosition.Set( RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f) );
+	}
+
+	// Matrices composed the old way
+	double dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			KPMatrix mYaw, mPitch;
+
+			mYaw.RotateY(pYaw[i]);
+			mPitch.RotateX(pPitch[i]);
+
+			pFull[i] = mYaw * mPitch;
+			pFull[i].Translate(pTRS[i].vcPosition.x, pTRS[i].vcPosition.y, pTRS[i].vcPosition.z);
+		}
+	}
+	double dFull = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		KPBuildTRSMatrices(pTRS, pFast, KPBENCH_COUNT);
+	double dFast = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		double d = MatrixError(pFull[i], pFast[i]);
+		if ( d > dError )
+			dError = d;
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "quaternion", "matrix cyc", "quat cyc", "speedup", "error");
+
+	if ( ! KPBenchReportCycles("TRS matrices", dFull, dFast, dError, BENCH_QUAT_ERROR * 10.0) )
+		++nFailed;
+
+	// Round trip through FromMatrix, q and -q are the same rotation
+	dError = 0.0;
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		KPQuaternion q;
+		KPMatrix	 m;
+
+		q.FromMatrix(pFull[i]);
+		q.GetMatrix(m);
+
+		for ( int r = 0; r < 3; ++r )
+		{
+			for ( int c = 0; c < 3; ++c )
+			{
+				double d = fabs( (double)(&m._11)[r*4 + c] - (double)(&pFull[i]._11)[r*4 + c] );
+				if ( d > dError )
+					dError = d;
+			}
+		}
+	}
+
+	if ( ! ReportError("FromMatrix", dError, BENCH_QUAT_ERROR) )
+		++nFailed;
+
+	delete [] pTRS;
+	delete [] pYaw;
+	delete [] pPitch;
+	delete [] pFull;
+	delete [] pFast;
+
+	return nFailed;
+} // ! BenchQuatMatrix
+
+
+// BenchQuaternion ////
+int BenchQuaternion(void)
+{
+	int nFailed = 0;
+
+	nFailed += BenchQuatOps();
+	nFailed += BenchQuatMatrix();
+
+	return nFailed;
+}
@@ -0,0 +1,126 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_ray.cpp
+ *  Description: Ray/triangle intersection benchmarks
+ *				 - Closest hit queries of a pick mesh
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define BENCH_RAY_TRIANGLES		4096		// Triangles of the mesh
+#define BENCH_RAY_RAYS			256			// Rays cast through it
+#define BENCH_RAY_PASSES		20			// Passes over the rays
+
+
+// BenchIntersect ////
+//////////////////////
+//
+// Casts rays from around a cloud of triangles into it on the scalar and the
+// SIMD kernels, both have to find the same triangles at the same distances.
+// The throughput is the number of ray/triangle tests per second.
+int BenchIntersect(void)
+{
+	float		*pPositions = new float[9 * BENCH_RAY_TRIANGLES];
+	KPVector	*pOrigins	= new KPVector[BENCH_RAY_RAYS];
+	KPVector	*pDirs		= new KPVector[BENCH_RAY_RAYS];
+	KPRAYHIT	*pHits[2]	= { new KPRAYHIT[BENCH_RAY_RAYS], new KPRAYHIT[BENCH_RAY_RAYS] };
+	bool		*pHit[2]	= { new bool[BENCH_RAY_RAYS], new bool[BENCH_RAY_RAYS] };
+	KPPickMesh	Mesh;
+	double		dTime[2];
+	int			nFailed		= 0;
+
+	srand(10);
+
+	for ( int i = 0; i < BENCH_RAY_TRIANGLES; ++i )
+	{
+		float x = RandomFloat(-10.0f, 10.0f);
+		float y = RandomFloat(-10.0f, 10.0f);
+		float z = RandomFloat(-10.0f, 10.0f);
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			pPositions[9*i + 3*k]	  = x + RandomFloat(-1.0f, 1.0f);
+			pPositions[9*i + 3*k + 1] = y + RandomFloat(-1.0f, 1.0f);
+			pPositions[9*i + 3*k + 2] = z + RandomFloat(-1.0f, 1.0f);
+		}
+	}
+
+	if ( ! Mesh.Create(pPositions, 3 * sizeof(float), NULL, BENCH_RAY_TRIANGLES) )
+		++nFailed;
+
+	for ( int i = 0; i < BENCH_RAY_RAYS; ++i )
+	{
+		KPVector vcTarget( RandomFloat(-5.0f, 5.0f), RandomFloat(-5.0f, 5.0f), RandomFloat(-5.0f, 5.0f) );
+
+		pOrigins[i].Set( RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) );
+		pOrigins[i].Normalize();
+		pOrigins[i] *= 30.0f;
+
+		pDirs[i] = vcTarget - pOrigins[i];
+		pDirs[i].Normalize();
+	}
+
+	for ( int nPath = 0; nPath < 2; ++nPath )
+	{
+		KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+		double dStart = KPBenchTime();
+		for ( int p = 0; p < BENCH_RAY_PASSES; ++p )
+		{
+			for ( int i = 0; i < BENCH_RAY_RAYS; ++i )
+				pHit[nPath][i] = Mesh.Intersect(pOrigins[i], pDirs[i], &pHits[nPath][i]);
+		}
+		dTime[nPath] = KPBenchElapsedNs(dStart, BENCH_RAY_PASSES, BENCH_RAY_RAYS * BENCH_RAY_TRIANGLES);
+	}
+
+	KPSetISA( g_SimdISA );
+
+	// The same triangle at the same distance, a different triangle is a failure
+	int nUlp = 0, nHits = 0;
+
+	for ( int i = 0; i < BENCH_RAY_RAYS; ++i )
+	{
+		if ( pHit[0][i] != pHit[1][i] || ( pHit[0][i] && pHits[0][i].nTriangle != pHits[1][i].nTriangle ) )
+		{
+			nUlp = 1 << 30;
+			break;
+		}
+
+		if ( pHit[0][i] )
+		{
+			int n = KPUlpDiff(pHits[0][i].fDistance, pHits[1][i].fDistance);
+			if ( n > nUlp )
+				nUlp = n;
+
+			++nHits;
+		}
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "ray/triangle", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	if ( ! KPBenchReport("closest hit", dTime[0], dTime[1], nUlp, 0) )
+		++nFailed;
+
+	printf("%-16s %.0f / %.0f million tests per second, %d of %d rays hit\n", "throughput",
+		   1e3 / dTime[0], 1e3 / dTime[1], nHits, BENCH_RAY_RAYS);
+
+	delete [] pPositions;
+	delete [] pOrigins;
+	delete [] pDirs;
+
+	for ( int i = 0; i < 2; ++i )
+	{
+		delete [] pHits[i];
+		delete [] pHit[i];
+	}
+
+	return nFailed;
+} // ! BenchIntersect
@@ -0,0 +1,288 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_sweep.cpp
+ *  Description: Batch size sweep of the array operations
+ *				 - Every kernel of every instruction set it has
+ *				 - Batches from L1 resident to DRAM resident
+ *				 - ns per element and memory throughput
+ *
+ *				 The other benchmarks compare the results of
+ *				 the kernels on L1 resident batches, this one
+ *				 only times them, to show where an operation
+ *				 stops being compute bound.
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+// Number of elements processed per measurement, the small batches are repeated to reach it
+#define BENCH_SWEEP_WORK	(1u << 22)
+
+// Largest batch, its arrays are far larger than any L3 cache
+#define BENCH_SWEEP_MAX		(1u << 20)
+
+// Floats per vertex, the size of VERTEX
+#define BENCH_SWEEP_STRIDE	8
+
+
+// Batch sizes, the footprints are for 32 byte vertices
+static const struct
+{
+	const char	*chLevel;
+	UINT		nCount;
+} g_Sizes[] =
+{
+	{ "L1",		256 },				// 8 KB
+	{ "L2",		4096 },				// 128 KB
+	{ "L3",		65536 },			// 2 MB
+	{ "DRAM",	BENCH_SWEEP_MAX },	// 32 MB
+};
+
+
+// Arrays shared by the operations, allocated for the largest batch
+typedef struct SWEEPDATA
+{
+	float			*pVertices;		// BENCH_SWEEP_STRIDE floats per vertex
+	float			*pAngles;
+	float			*pSin;
+	float			*pCos;
+	KPMatrix		*pMatrices;
+	KPTRS			*pTRS;
+	KPSPHERE		*pSpheres;
+	KPAABB			*pBoxes;
+	unsigned char	*pStates;
+	UINT			*pPixels;
+	KPSOASTREAM		Stream;			// x, y, z of the vertices in separate arrays, in pVertices
+	KPPlane			Frustum[6];
+	KPMatrix		mTransform;
+} SWEEPDATA;
+
+// An operation processes nCount elements of the arrays
+typedef void (*SWEEPOP)(SWEEPDATA *pData, UINT nCount);
+
+
+// Operations ////
+//////////////////
+
+static void OpPoints(SWEEPDATA *pData, UINT nCount)
+{
+	pData->mTransform.TransformPoints(pData->pVertices, BENCH_SWEEP_STRIDE * sizeof(float),
+									  pData->pVertices, BENCH_SWEEP_STRIDE * sizeof(float), nCount);
+}
+
+static void OpNormals(SWEEPDATA *pData, UINT nCount)
+{
+	pData->mTransform.TransformNormals(pData->pVertices + 3, BENCH_SWEEP_STRIDE * sizeof(float),
+									   pData->pVertices + 3, BENCH_SWEEP_STRIDE * sizeof(float), nCount);
+}
+
+static void OpPointStreams(SWEEPDATA *pData, UINT nCount)
+{
+	pData->mTransform.TransformPoints(pData->Stream, pData->Stream, nCount);
+}
+
+static void OpNormalize(SWEEPDATA *pData, UINT nCount)
+{
+	KPNormalizeArray(pData->pVertices + 3, BENCH_SWEEP_STRIDE * sizeof(float), nCount, KPPRECISION_REFINED);
+}
+
+static void OpNormalizeStreams(SWEEPDATA *pData, UINT nCount)
+{
+	KPNormalizeArray(pData->Stream, nCount, KPPRECISION_REFINED);
+}
+
+static void OpMultiply(SWEEPDATA *pData, UINT nCount)
+{
+	pData->mTransform.MultiplyArray(pData->pMatrices, pData->pMatrices, nCount);
+}
+
+static void OpSinCos(SWEEPDATA *pData, UINT nCount)
+{
+	KPSinCosArray(pData->pAngles, pData->pSin, pData->pCos, nCount, KPPRECISION_REFINED);
+}
+
+static void OpTRS(SWEEPDATA *pData, UINT nCount)
+{
+	KPBuildTRSMatrices(pData->pTRS, pData->pMatrices, nCount);
+}
+
+static void OpSpheres(SWEEPDATA *pData, UINT nCount)
+{
+	KPClassifySpheres(pData->Frustum, 6, pData->pSpheres, pData->pStates, nCount);
+}
+
+static void OpBoxes(SWEEPDATA *pData, UINT nCount)
+{
+	KPClassifyBoxes(pData->Frustum, 6, pData->pBoxes, pData->pStates, nCount);
+}
+
+static void OpColorKey(SWEEPDATA *pData, UINT nCount)
+{
+	KPReplaceColor(pData->pPixels, nCount, 0xFFFF00FF, 0x00000000);
+}
+
+
+// Fills the arrays, every value stays in range when an operation is repeated on its own output
+static void FillData(SWEEPDATA *pData)
+{
+	for ( UINT i = 0; i < BENCH_SWEEP_MAX; ++i )
+	{
+		float *v = pData->pVertices + i * BENCH_SWEEP_STRIDE;
+
+		for ( int k = 0; k < BENCH_SWEEP_STRIDE; ++k )
+			v[k] = RandomFloat(-10.0f, 10.0f);
+
+		pData->pAngles[i] = RandomFloat(-10.0f, 10.0f);
+		pData->pPixels[i] = ( rand() & 1 ) ? 0xFFFF00FF : 0xFF000000 | (UINT)rand();
+		pData->pMatrices[i].Identity();
+
+		KPTRS &t = pData->pTRS[i];
+		t.vcScale.Set(1.0f, 2.0f, 1.0f);
+		t.qRotation.FromAxisAngle(KPVector(v[0], v[1], v[2]), v[3]);
+		t.vcPosition.Set(v[4], v[5], v[6]);
+
+		KPSPHERE &s = pData->pSpheres[i];
+		s.x = v[0] * 10.0f;		s.y = v[1] * 10.0f;		s.z = v[2] * 10.0f;		s.fRadius = 2.0f;
+
+		KPAABB &b = pData->pBoxes[i];
+		b.vcMin[0] = s.x - 1.0f;	b.vcMin[1] = s.y - 1.0f;	b.vcMin[2] = s.z - 1.0f;
+		b.vcMax[0] = s.x + 1.0f;	b.vcMax[1] = s.y + 1.0f;	b.vcMax[2] = s.z + 1.0f;
+	}
+
+	// A rotation, applying it again and again keeps the points at the same distance
+	pData->mTransform.RotateY(0.01f);
+
+	// A 90 degree frustum along the z axis, outward normals
+	static const float fPlanes[6][4] =
+	{
+		{ -1.0f,  0.0f, -1.0f,	  0.0f },
+		{  1.0f,  0.0f, -1.0f,	  0.0f },
+		{  0.0f,  1.0f, -1.0f,	  0.0f },
+		{  0.0f, -1.0f, -1.0f,	  0.0f },
+		{  0.0f,  0.0f, -1.0f,	  1.0f },
+		{  0.0f,  0.0f,  1.0f, -100.0f },
+	};
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		KPPlane &p = pData->Frustum[i];
+
+		p.m_vcNormal.Set(fPlanes[i][0], fPlanes[i][1], fPlanes[i][2]);
+		p.m_vcNormal.Normalize();
+		p.m_fDistance = fPlanes[i][3];
+	}
+}
+
+
+// BenchSweep ////
+//////////////////
+//
+// Every operation on every instruction set it has a kernel for and every
+// batch size. The same amount of elements is processed for every batch
+// size, so the small batches are repeated many times. Arrays of the large
+// batches are split between the worker threads by the library, so those
+// timings include the threading.
+void BenchSweep(void)
+{
+	static const struct
+	{
+		const char	*chName;
+		const char	*chKernel;	// Name in the kernel registry
+		SWEEPOP		pfnOp;
+		double		dBytes;		// Bytes read and written per element
+	} ops[] =
+	{
+		{ "points",			"transform strided",	OpPoints,			24.0 },
+		{ "normals",		"transform strided",	OpNormals,			24.0 },
+		{ "point streams",	"transform stream",		OpPointStreams,		24.0 },
+		{ "normalize",		"normalize strided",	OpNormalize,		24.0 },
+		{ "norm streams",	"normalize stream",		OpNormalizeStreams,	24.0 },
+		{ "MultiplyArray",	"matrix multiply",		OpMultiply,			128.0 },
+		{ "sincos",			"sincos",				OpSinCos,			12.0 },
+		{ "TRS matrices",	"TRS matrices",			OpTRS,				sizeof(KPTRS) + sizeof(KPMatrix) },
+		{ "spheres",		"cull spheres",			OpSpheres,			sizeof(KPSPHERE) + 1.0 },
+		{ "boxes",			"cull boxes",			OpBoxes,			sizeof(KPAABB) + 1.0 },
+		{ "color key",		"replace color",		OpColorKey,			8.0 },
+	};
+
+	SWEEPDATA data;
+
+	data.pVertices	= new float[BENCH_SWEEP_MAX * BENCH_SWEEP_STRIDE];
+	data.pAngles	= new float[BENCH_SWEEP_MAX];
+	data.pSin		= new float[BENCH_SWEEP_MAX];
+	data.pCos		= new float[BENCH_SWEEP_MAX];
+	data.pMatrices	= new KPMatrix[BENCH_SWEEP_MAX];
+	data.pTRS		= new KPTRS[BENCH_SWEEP_MAX];
+	data.pSpheres	= new KPSPHERE[BENCH_SWEEP_MAX];
+	data.pBoxes		= new KPAABB[BENCH_SWEEP_MAX];
+	data.pStates	= new unsigned char[BENCH_SWEEP_MAX];
+	data.pPixels	= new UINT[BENCH_SWEEP_MAX];
+
+	data.Stream.pX	= data.pVertices;
+	data.Stream.pY	= data.pVertices + BENCH_SWEEP_MAX;
+	data.Stream.pZ	= data.pVertices + BENCH_SWEEP_MAX * 2;
+
+	srand(13);
+	FillData(&data);
+
+	printf("\n%-16s %8s %-7s %10s %10s %10s\n", "batch sweep", "count", "path", "ns", "Mop/s", "MB/s");
+
+	for ( int o = 0; o < (int)( sizeof(ops) / sizeof(ops[0]) ); ++o )
+	{
+		UINT nKernel = KPBenchFindKernel(ops[o].chKernel);
+
+		for ( int s = 0; s < (int)( sizeof(g_Sizes) / sizeof(g_Sizes[0]) ); ++s )
+		{
+			UINT nCount  = g_Sizes[s].nCount;
+			UINT nPasses = BENCH_SWEEP_WORK / nCount;
+
+			for ( int nIsa = KPISA_SCALAR; nIsa <= g_SimdISA; ++nIsa )
+			{
+				char chName[32];
+
+				// A level without a kernel of its own would time the one below again
+				if ( nKernel < KPGetNumKernels() && KPGetKernelISA(nKernel, (KPISA)nIsa) != nIsa )
+					continue;
+
+				KPSetISA( (KPISA)nIsa );
+
+				// Warm up, the DRAM batch is evicted from the caches by the previous one anyway
+				ops[o].pfnOp(&data, nCount);
+
+				double dStart = KPBenchTime();
+				for ( UINT p = 0; p < nPasses; ++p )
+					ops[o].pfnOp(&data, nCount);
+				double dNs = KPBenchElapsedNs(dStart, nPasses, nCount);
+
+				printf("%-16s %8u %-7s %10.2f %10.1f %10.1f\n", ops[o].chName, nCount, KPGetISAName( (KPISA)nIsa ),
+					   dNs, 1e3 / dNs, 1e3 * ops[o].dBytes / dNs);
+
+				sprintf(chName, "%s %s", ops[o].chName, g_Sizes[s].chLevel);
+				KPBenchRecord(chName, KPGetISAName( (KPISA)nIsa ), "ns", nCount, dNs, ops[o].dBytes);
+			}
+		}
+	}
+
+	KPSetISA(g_SimdISA);
+
+	g_fSink = g_fSink + data.pVertices[0] + data.pSin[0] + data.pMatrices[0]._11 + data.pStates[0] + (float)data.pPixels[0];
+
+	delete [] data.pVertices;
+	delete [] data.pAngles;
+	delete [] data.pSin;
+	delete [] data.pCos;
+	delete [] data.pMatrices;
+	delete [] data.pTRS;
+	delete [] data.pSpheres;
+	delete [] data.pBoxes;
+	delete [] data.pStates;
+	delete [] data.pPixels;
+} // ! BenchSweep
@@ -0,0 +1,176 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_trig.cpp
+ *  Description: Sine and cosine benchmarks
+ *				 - The three precisions against the C library
+ *				 - Batched rotation matrices
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+
+#define BENCH_TRIG_RANGE	100.0f		// Angles are in [-range, range]
+#define BENCH_TRIG_FAST		3e-6		// Allowed absolute error of KPPRECISION_FAST
+#define BENCH_TRIG_REFINED	3e-7		// Allowed absolute error of KPPRECISION_REFINED
+
+
+// Largest absolute error of the sines and cosines against the double precision library
+static double TrigError(const float *pAngles, const float *pSin, const float *pCos, int n)
+{
+	double dError = 0.0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		double ds = fabs( pSin[i] - sin( (double)pAngles[i] ) );
+		double dc = fabs( pCos[i] - cos( (double)pAngles[i] ) );
+
+		if ( ds > dError )
+			dError = ds;
+		if ( dc > dError )
+			dError = dc;
+	}
+
+	return dError;
+}
+
+
+// BenchTrig ////
+/////////////////
+//
+// Times KPSinCosArray on the scalar and the SIMD kernels for every
+// precision, the two have to give the same results, and checks the error
+// against the double precision library. Then builds rotation matrices with
+// RotateX, as the tester did, and with KPBuildRotations.
+int BenchTrig(void)
+{
+	static const struct
+	{
+		const char	*chName;
+		KPPRECISION	Precision;
+		double		dMaxError;
+	} precisions[] =
+	{
+		{ "sincos fast",	KPPRECISION_FAST,		BENCH_TRIG_FAST },
+		{ "sincos refined", KPPRECISION_REFINED,	BENCH_TRIG_REFINED },
+		{ "sincos exact",	KPPRECISION_EXACT,		BENCH_TRIG_REFINED },
+	};
+
+	float		*pAngles	= new float[KPBENCH_COUNT];
+	float		*pSin[2]	= { new float[KPBENCH_COUNT], new float[KPBENCH_COUNT] };
+	float		*pCos[2]	= { new float[KPBENCH_COUNT], new float[KPBENCH_COUNT] };
+	KPMatrix	*pFull		= new KPMatrix[KPBENCH_COUNT];
+	KPMatrix	*pFast		= new KPMatrix[KPBENCH_COUNT];
+	int			nFailed		= 0;
+
+	srand(11);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		pAngles[i] = RandomFloat(-BENCH_TRIG_RANGE, BENCH_TRIG_RANGE);
+
+	// A few angles beyond the range of the polynomials
+	pAngles[0] = 1e5f;
+	pAngles[1] = -3e4f;
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "trigonometry", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	double dErrors[3];
+
+	for ( int t = 0; t < 3; ++t )
+	{
+		double dTime[2];
+
+		for ( int nPath = 0; nPath < 2; ++nPath )
+		{
+			KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+			double dStart = KPBenchTime();
+			for ( int p = 0; p < KPBENCH_PASSES; ++p )
+				KPSinCosArray(pAngles, pSin[nPath], pCos[nPath], KPBENCH_COUNT, precisions[t].Precision);
+			dTime[nPath] = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+		}
+
+		int nUlp = 0;
+
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			int ns = KPUlpDiff(pSin[0][i], pSin[1][i]);
+			int nc = KPUlpDiff(pCos[0][i], pCos[1][i]);
+
+			if ( ns > nUlp )
+				nUlp = ns;
+			if ( nc > nUlp )
+				nUlp = nc;
+		}
+
+		if ( ! KPBenchReport(precisions[t].chName, dTime[0], dTime[1], nUlp, 0) )
+			++nFailed;
+
+		dErrors[t] = TrigError(pAngles, pSin[1], pCos[1], KPBENCH_COUNT);
+	}
+
+	KPSetISA( g_SimdISA );
+
+	for ( int t = 0; t < 3; ++t )
+	{
+		bool bPassed = ( dErrors[t] <= precisions[t].dMaxError );
+
+		printf("%-16s %.1e abs error  %s\n", precisions[t].chName, dErrors[t], bPassed ? "ok" : "FAILED");
+
+		if ( !bPassed )
+			++nFailed;
+	}
+
+	// Rotation matrices, one by one with RotateX and batched
+	double dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			pFull[i].RotateX(pAngles[i]);
+	}
+	double dFull = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	dStart = KPBenchCycles();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+		KPBuildRotations(pAngles, KPAXIS_X, pFast, KPBENCH_COUNT);
+	double dFast = KPBenchElapsedCycles(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	double dError = 0.0;
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		const float *f = (const float*)&pFull[i]._11;
+		const float *g = (const float*)&pFast[i]._11;
+
+		for ( int k = 0; k < 16; ++k )
+		{
+			double d = fabs( (double)f[k] - g[k] );
+			if ( d > dError )
+				dError = d;
+		}
+	}
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "rotations", "single cyc", "batch cyc", "speedup", "error");
+
+	if ( ! KPBenchReportCycles("rotate x", dFull, dFast, dError, 0.0) )
+		++nFailed;
+
+	delete [] pAngles;
+	delete [] pFull;
+	delete [] pFast;
+
+	for ( int i = 0; i < 2; ++i )
+	{
+		delete [] pSin[i];
+		delete [] pCos[i];
+	}
+
+	return nFailed;
+} // ! BenchTrig
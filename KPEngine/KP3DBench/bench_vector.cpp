@@ -0,0 +1,517 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: bench_vector.cpp
+ *  Description: KPVector operation benchmarks
+ *				 - Single vector operations
+ *				 - Array normalization of VERTEX normals
+ *				 - KPVector4x and KPVector8x packets
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "KPKernels.h"
+#include "KPPacket.h"
+
+// Every operation reads two vector arrays and a matrix and writes
+// its results into pOut. Scalar results are stored in pOut[i].x
+typedef void (*KPBENCHOP)(const KPVector *pA, const KPVector *pB, const KPMatrix &m, KPVector *pOut, int n);
+
+
+// Operations ////
+//////////////////
+//
+// Instantiated with KPScalarOps and KPSSEOps, the two implementations
+// KPVector can be compiled with
+
+template <class Ops> static void OpAdd(const KPVector *pA, const KPVector *pB, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		Ops::Add(pOut[i], pA[i], pB[i]);
+}
+
+template <class Ops> static void OpSub(const KPVector *pA, const KPVector *pB, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		Ops::Sub(pOut[i], pA[i], pB[i]);
+}
+
+template <class Ops> static void OpScale(const KPVector *pA, const KPVector *pB, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		Ops::Scale(pOut[i], pA[i], pB[i].x);
+}
+
+template <class Ops> static void OpDot(const KPVector *pA, const KPVector *pB, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		pOut[i].x = Ops::Dot(pA[i], pB[i]);
+}
+
+template <class Ops> static void OpCross(const KPVector *pA, const KPVector *pB, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		Ops::Cross(pOut[i], pA[i], pB[i]);
+}
+
+template <class Ops> static void OpLength(const KPVector *pA, const KPVector *, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		pOut[i].x = Ops::Length(pA[i]);
+}
+
+template <class Ops> static void OpNormalize(const KPVector *pA, const KPVector *, const KPMatrix &, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+	{
+		pOut[i] = pA[i];
+		Ops::Normalize(pOut[i]);
+	}
+}
+
+template <class Ops> static void OpTransform(const KPVector *pA, const KPVector *, const KPMatrix &m, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i )
+		Ops::Transform(pOut[i], pA[i], m);
+}
+
+
+// Array normalization ////
+#define BENCH_NORMAL_STRIDE		8			// Floats per vertex, the size of VERTEX
+#define BENCH_NORMAL_FAST		4e-4		// Allowed error of KPPRECISION_FAST
+#define BENCH_NORMAL_REFINED	5e-7		// Allowed error of KPPRECISION_REFINED
+#define BENCH_NORMAL_EXACT		1.5e-7		// Allowed error of KPPRECISION_EXACT
+
+
+// TimeOp ////
+//////////////
+//
+// Runs the operation and returns the time of one operation in nanoseconds
+static double TimeOp(KPBENCHOP pfnOp, const KPVector *pA, const KPVector *pB, const KPMatrix &m, KPVector *pOut)
+{
+	// Warm up the caches and the branch predictors first
+	pfnOp(pA, pB, m, pOut, KPBENCH_COUNT);
+
+	double dStart = KPBenchTime();
+
+	for ( int i = 0; i < KPBENCH_PASSES; ++i )
+	{
+		pfnOp(pA, pB, m, pOut, KPBENCH_COUNT);
+		g_fSink = g_fSink + pOut[i % KPBENCH_COUNT].x;
+	}
+
+	return KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+} // ! TimeOp
+
+
+// NormalError ////
+// Largest difference of the x, y, z coordinates from the double precision unit vectors
+static double NormalError(const float *pIn, const float *pOut, int n)
+{
+	double dError = 0.0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		const float *v = pIn  + i * BENCH_NORMAL_STRIDE;
+		const float *o = pOut + i * BENCH_NORMAL_STRIDE;
+		double		 l = sqrt( (double)v[0]*v[0] + (double)v[1]*v[1] + (double)v[2]*v[2] );
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			double d = ( l == 0.0 ) ? fabs( (double)o[k] - v[k] ) : fabs( o[k] - v[k] / l );
+
+			if ( d > dError )
+				dError = d;
+		}
+	}
+
+	return dError;
+}
+
+
+// BenchNormalize ////
+//////////////////////
+//
+// Times KPNormalizeArray on the normals of a VERTEX sized array on the
+// scalar and the SIMD kernels. The SIMD kernels have to give the same
+// results as KPSSEOps::Normalize, the errors are measured against double
+// precision unit vectors.
+int BenchNormalize(void)
+{
+	static const struct
+	{
+		const char	*chName;
+		KPPRECISION	Precision;
+		double		dMaxError;
+	} precisions[] =
+	{
+		{ "normals fast",		KPPRECISION_FAST,		BENCH_NORMAL_FAST },
+		{ "normals refined",	KPPRECISION_REFINED,	BENCH_NORMAL_REFINED },
+		{ "normals exact",		KPPRECISION_EXACT,		BENCH_NORMAL_EXACT },
+	};
+
+	const int	nFloats		= KPBENCH_COUNT * BENCH_NORMAL_STRIDE;
+	float		*pIn		= new float[nFloats];
+	float		*pOut[2]	= { new float[nFloats], new float[nFloats] };
+	int			nFailed		= 0;
+	double		dErrors[3];
+
+	srand(12);
+
+	for ( int i = 0; i < nFloats; ++i )
+		pIn[i] = RandomFloat(-10.0f, 10.0f);
+
+	// Null vectors have to stay null
+	pIn[3] = pIn[4] = pIn[5] = 0.0f;
+	pIn[BENCH_NORMAL_STRIDE * 9 + 3] = pIn[BENCH_NORMAL_STRIDE * 9 + 4] = pIn[BENCH_NORMAL_STRIDE * 9 + 5] = 0.0f;
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "normal arrays", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	for ( int t = 0; t < 3; ++t )
+	{
+		double dTime[2];
+
+		for ( int nPath = 0; nPath < 2; ++nPath )
+		{
+			KPSetISA( nPath ? g_SimdISA : KPISA_SCALAR );
+
+			// The array is normalized in place, after the first pass the
+			// passes renormalize unit vectors, which costs the same
+			memcpy( pOut[nPath], pIn, nFloats * sizeof(float) );
+
+			double dStart = KPBenchTime();
+			for ( int p = 0; p < KPBENCH_PASSES; ++p )
+				KPNormalizeArray( pOut[nPath] + 3, BENCH_NORMAL_STRIDE * sizeof(float), KPBENCH_COUNT, precisions[t].Precision );
+			dTime[nPath] = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+			// The results of a single pass are compared
+			memcpy( pOut[nPath], pIn, nFloats * sizeof(float) );
+			KPNormalizeArray( pOut[nPath] + 3, BENCH_NORMAL_STRIDE * sizeof(float), KPBENCH_COUNT, precisions[t].Precision );
+		}
+
+		// The vectors one by one with the single vector operation
+		int nUlp = 0;
+
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+		{
+			const float *v = pIn + i * BENCH_NORMAL_STRIDE + 3;
+			const float *o = pOut[1] + i * BENCH_NORMAL_STRIDE + 3;
+			KPVector	 vc(v[0], v[1], v[2]);
+
+			KPSSEOps::Normalize(vc, precisions[t].Precision);
+
+			int nX = KPUlpDiff(vc.x, o[0]);
+			int nY = KPUlpDiff(vc.y, o[1]);
+			int nZ = KPUlpDiff(vc.z, o[2]);
+
+			if ( nX > nUlp ) nUlp = nX;
+			if ( nY > nUlp ) nUlp = nY;
+			if ( nZ > nUlp ) nUlp = nZ;
+		}
+
+		if ( ! KPBenchReport(precisions[t].chName, dTime[0], dTime[1], nUlp, 0) )
+			++nFailed;
+
+		dErrors[t] = NormalError(pIn + 3, pOut[1] + 3, KPBENCH_COUNT);
+	}
+
+	KPSetISA( g_SimdISA );
+
+	for ( int t = 0; t < 3; ++t )
+	{
+		bool bPassed = ( dErrors[t] <= precisions[t].dMaxError );
+
+		printf("%-16s %.1e abs error  %s\n", precisions[t].chName, dErrors[t], bPassed ? "ok" : "FAILED");
+
+		if ( !bPassed )
+			++nFailed;
+	}
+
+	delete [] pIn;
+	delete [] pOut[0];
+	delete [] pOut[1];
+
+	return nFailed;
+} // ! BenchNormalize
+
+
+// BenchVector ////
+///////////////////
+int BenchVector(void)
+{
+	static const struct
+	{
+		const char	*chName;
+		KPBENCHOP	pfnScalar;
+		KPBENCHOP	pfnSIMD;
+	} ops[] = {
+		{ "vector +",		OpAdd<KPScalarOps>,			OpAdd<KPSSEOps>			},
+		{ "vector -",		OpSub<KPScalarOps>,			OpSub<KPSSEOps>			},
+		{ "vector * f",		OpScale<KPScalarOps>,		OpScale<KPSSEOps>		},
+		{ "dot",			OpDot<KPScalarOps>,			OpDot<KPSSEOps>			},
+		{ "cross",			OpCross<KPScalarOps>,		OpCross<KPSSEOps>		},
+		{ "length",			OpLength<KPScalarOps>,		OpLength<KPSSEOps>		},
+		{ "normalize",		OpNormalize<KPScalarOps>,	OpNormalize<KPSSEOps>	},
+		{ "vector*matrix",	OpTransform<KPScalarOps>,	OpTransform<KPSSEOps>	},
+	};
+
+	KPVector	*pA			= new KPVector[KPBENCH_COUNT];
+	KPVector	*pB			= new KPVector[KPBENCH_COUNT];
+	KPVector	*pScalar	= new KPVector[KPBENCH_COUNT];
+	KPVector	*pSIMD		= new KPVector[KPBENCH_COUNT];
+	KPMatrix	m;
+	int			nFailed		= 0;
+
+	srand(1);
+
+	for ( int i = 0; i < KPBENCH_COUNT; ++i )
+	{
+		pA[i].Set( RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f) );
+		pB[i].Set( RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f) );
+	}
+
+	// A perspective-like matrix, so the w divide has some work to do
+	float *f = &m._11;
+	for ( int i = 0; i < 16; ++i )
+		f[i] = RandomFloat(-1.0f, 1.0f);
+	m._44 = 4.0f;
+
+	for ( int i = 0; i < (int)( sizeof(ops) / sizeof(ops[0]) ); ++i )
+	{
+		double dScalar	= TimeOp(ops[i].pfnScalar, pA, pB, m, pScalar);
+		double dSIMD	= TimeOp(ops[i].pfnSIMD,   pA, pB, m, pSIMD);
+		int	   nUlp		= KPUlpDiff(pScalar, pSIMD, KPBENCH_COUNT);
+
+		if ( ! KPBenchReport(ops[i].chName, dScalar, dSIMD, nUlp, KPSIMD_MAXULP) )
+			++nFailed;
+	}
+
+	// Inline operations without a SIMD version, only timed
+	KPPlane plane;
+
+	double dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		for ( int i = 0; i + 2 < KPBENCH_COUNT; ++i )
+		{
+			plane.Set(pA[i], pA[i+1], pA[i+2]);
+			pScalar[i].x = plane.m_fDistance;
+		}
+		g_fSink = g_fSink + pScalar[p % KPBENCH_COUNT].x;
+	}
+	double dPlane = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT - 2);
+
+	dStart = KPBenchTime();
+	for ( int p = 0; p < KPBENCH_PASSES; ++p )
+	{
+		for ( int i = 0; i < KPBENCH_COUNT; ++i )
+			pScalar[i].x = KPMax(pA[i].x, pA[i].y, pA[i].z) - KPMin(pB[i].x, pB[i].y, pB[i].z);
+		g_fSink = g_fSink + pScalar[p % KPBENCH_COUNT].x;
+	}
+	double dMinMax = KPBenchElapsedNs(dStart, KPBENCH_PASSES, KPBENCH_COUNT);
+
+	printf("%-16s %10.2f %10s %9s\n", "plane 3 points", dPlane, "-", "-");
+	printf("%-16s %10.2f %10s %9s\n", "max3 - min3", dMinMax, "-", "-");
+	KPBenchRecord("plane 3 points", "scalar", "ns", KPBENCH_COUNT - 2, dPlane, 0.0);
+	KPBenchRecord("max3 - min3", "scalar", "ns", KPBENCH_COUNT, dMinMax, 0.0);
+
+	delete [] pA;
+	delete [] pB;
+	delete [] pScalar;
+	delete [] pSIMD;
+
+	return nFailed;
+} // ! BenchVector
+
+
+// Packet Operations ////
+/////////////////////////
+//
+// Every operation is written once, for KPVector and the packets alike.
+// The operands are the positions of two VERTEX sized arrays, the results
+// are written into a KPVector array, scalar results into its x coordinates.
+
+typedef void (*KPBENCHPACKETOP)(const float *pA, const float *pB, const KPMatrix &m, KPVector *pOut, int n);
+
+struct PacketAdd		{ template <class V, class M> static V Run(const V &a, const V &b, const M &)	{ return a + b; } };
+struct PacketSub		{ template <class V, class M> static V Run(const V &a, const V &b, const M &)	{ return a - b; } };
+struct PacketScale		{ template <class V, class M> static V Run(const V &a, const V &, const M &)	{ return a * 1.7f; } };
+struct PacketDot		{ template <class V, class M> static V Run(const V &a, const V &b, const M &)	{ V r; r.x = a * b; return r; } };
+struct PacketCross		{ template <class V, class M> static V Run(const V &a, const V &b, const M &)	{ V r; r.Cross(a, b); return r; } };
+struct PacketLength		{ template <class V, class M> static V Run(const V &a, const V &, const M &)	{ V r, t = a; r.x = t.GetLength(); return r; } };
+struct PacketNormalize	{ template <class V, class M> static V Run(const V &a, const V &, const M &)	{ V r = a; r.Normalize(); return r; } };
+struct PacketFast		{ template <class V, class M> static V Run(const V &a, const V &, const M &)	{ V r = a; r.Normalize(KPPRECISION_FAST); return r; } };
+struct PacketTransform	{ template <class V, class M> static V Run(const V &a, const V &, const M &m)	{ return a * m; } };
+
+// The reference of the affine transform is the vector * matrix product of KPVector
+struct PacketAffine
+{
+	static KPVector Run(const KPVector &a, const KPVector &, const KPMatrix &m)		{ return a * m; }
+	template <class V, class M> static V Run(const V &a, const V &, const M &m)		{ return a.TransformAffine(m); }
+};
+
+// KPVector, one vector at a time
+template <class F> static void PacketRef(const float *pA, const float *pB, const KPMatrix &m, KPVector *pOut, int n)
+{
+	for ( int i = 0; i < n; ++i, pA += BENCH_NORMAL_STRIDE, pB += BENCH_NORMAL_STRIDE )
+		pOut[i] = F::Run( KPVector(pA[0], pA[1], pA[2]), KPVector(pB[0], pB[1], pB[2]), m );
+}
+
+// A packet at a time, the last one is partial if n is not a multiple of the width
+template <class F, class L> static void PacketRun(const float *pA, const float *pB, const KPMatrix &m, KPVector *pOut, int n)
+{
+	typedef KPVectorPacket<L> V;
+
+	const UINT			nStride = BENCH_NORMAL_STRIDE * sizeof(float);
+	KPMatrixPacket<L>	mp(m);
+
+	for ( int i = 0; i < n; i += V::WIDTH )
+	{
+		V a, b;
+
+		a.Gather(pA + i * BENCH_NORMAL_STRIDE, nStride, n - i);
+		b.Gather(pB + i * BENCH_NORMAL_STRIDE, nStride, n - i);
+
+		F::Run(a, b, mp).Scatter(&pOut[i].x, sizeof(KPVector), n - i);
+	}
+}
+
+
+// TimePacketOp ////
+// Runs the operation on n vectors and returns the time of one vector in nanoseconds
+static double TimePacketOp(KPBENCHPACKETOP pfnOp, const float *pA, const float *pB, const KPMatrix &m, KPVector *pOut, int n)
+{
+	pfnOp(pA, pB, m, pOut, n);
+
+	double dStart = KPBenchTime();
+
+	for ( int i = 0; i < KPBENCH_PASSES; ++i )
+	{
+		pfnOp(pA, pB, m, pOut, n);
+		g_fSink = g_fSink + pOut[i % n].x;
+	}
+
+	return KPBenchElapsedNs(dStart, KPBENCH_PASSES, n);
+} // ! TimePacketOp
+
+
+// BenchPacket ////
+///////////////////
+//
+// Times the packets against KPVector on VERTEX arrays, every lane has to
+// give the result of KPVector bit for bit. The arrays are 3 vectors short
+// of KPBENCH_COUNT, so the last packets are partial.
+// The packets on plain float lanes, the ones of the builds without SSE,
+// are only checked; their estimate is the exact reciprocal square root.
+int BenchPacket(void)
+{
+	#define PACKET_OP(F)	PacketRef<F>, PacketRun<F, KPLanes4>, PacketRun<F, KPLanes8>, PacketRun< F, KPScalarLanes<4> >
+
+	static const struct
+	{
+		const char		*chName;
+		bool			bAffine;
+		KPBENCHPACKETOP	pfnRef;
+		KPBENCHPACKETOP	pfn4x;
+		KPBENCHPACKETOP	pfn8x;
+		KPBENCHPACKETOP	pfnPlain;
+	} ops[] = {
+		{ "vector +",		false,	PACKET_OP(PacketAdd)		},
+		{ "vector -",		false,	PACKET_OP(PacketSub)		},
+		{ "vector * f",		false,	PACKET_OP(PacketScale)		},
+		{ "dot",			false,	PACKET_OP(PacketDot)		},
+		{ "cross",			false,	PACKET_OP(PacketCross)		},
+		{ "length",			false,	PACKET_OP(PacketLength)		},
+		{ "normalize",		false,	PACKET_OP(PacketNormalize)	},
+		{ "normalize fast",	false,	PACKET_OP(PacketFast)		},
+		{ "vector*matrix",	false,	PACKET_OP(PacketTransform)	},
+		{ "affine",			true,	PACKET_OP(PacketAffine)		},
+	};
+
+	#undef PACKET_OP
+
+	const int	nCount		= KPBENCH_COUNT - 3;
+	const int	nFloats		= KPBENCH_COUNT * BENCH_NORMAL_STRIDE;
+	float		*pA			= new float[nFloats];
+	float		*pB			= new float[nFloats];
+	KPVector	*pRef		= new KPVector[KPBENCH_COUNT];
+	KPVector	*pPacket	= new KPVector[KPBENCH_COUNT];
+	KPMatrix	m, mAffine;
+	int			nFailed		= 0;
+	int			nPlainUlp	= 0;
+
+	srand(19);
+
+	for ( int i = 0; i < nFloats; ++i )
+	{
+		pA[i] = RandomFloat(-10.0f, 10.0f);
+		pB[i] = RandomFloat(-10.0f, 10.0f);
+	}
+
+	// Null vectors have to stay null
+	pA[0] = pA[1] = pA[2] = 0.0f;
+	pA[BENCH_NORMAL_STRIDE * 13] = pA[BENCH_NORMAL_STRIDE * 13 + 1] = pA[BENCH_NORMAL_STRIDE * 13 + 2] = 0.0f;
+
+	// A perspective-like matrix, so the w divide has some work to do
+	float *f = &m._11;
+	for ( int i = 0; i < 16; ++i )
+		f[i] = RandomFloat(-1.0f, 1.0f);
+	m._44 = 4.0f;
+
+	mAffine = m;
+	mAffine._14 = mAffine._24 = mAffine._34 = 0.0f;
+	mAffine._44 = 1.0f;
+
+	printf("\n%-16s %10s %10s %9s %10s\n", "packets", "KPVector", "packet ns", "speedup", "difference");
+
+	for ( int i = 0; i < (int)( sizeof(ops) / sizeof(ops[0]) ); ++i )
+	{
+		const KPMatrix	&mOp = ops[i].bAffine ? mAffine : m;
+		char			chName[32];
+
+		double dRef = TimePacketOp(ops[i].pfnRef, pA, pB, mOp, pRef, nCount);
+
+		for ( int w = 0; w < 2; ++w )
+		{
+			double dPacket = TimePacketOp(w ? ops[i].pfn8x : ops[i].pfn4x, pA, pB, mOp, pPacket, nCount);
+
+			sprintf(chName, "%.16s %s", ops[i].chName, w ? "8x" : "4x");
+
+			if ( ! KPBenchReport(chName, dRef, dPacket, KPUlpDiff(pRef, pPacket, nCount), 0) )
+				++nFailed;
+		}
+
+		// KPVector of an SSE build normalizes by the estimate
+	#ifdef KP_SSE_STATIC
+		if ( ops[i].pfnRef == PacketRef<PacketFast> )
+			continue;
+	#endif
+
+		ops[i].pfnPlain(pA, pB, mOp, pPacket, nCount);
+
+		int nUlp = KPUlpDiff(pRef, pPacket, nCount);
+
+		if ( nUlp > nPlainUlp )
+			nPlainUlp = nUlp;
+	}
+
+	printf("%-16s %6d ulp  %s\n", "plain lanes", nPlainUlp, nPlainUlp == 0 ? "ok" : "FAILED");
+
+	if ( nPlainUlp != 0 )
+		++nFailed;
+
+	delete [] pA;
+	delete [] pB;
+	delete [] pRef;
+	delete [] pPacket;
+
+	return nFailed;
+} // ! BenchPacket
@@ -0,0 +1,338 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Benchmark Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: main.cpp
+ *  Description: KP3D math library micro-benchmark
+ *
+ *				 Runs every benchmarked operation through the
+ *				 scalar and the SIMD path, prints the time per
+ *				 operation and the speedup, and checks that the
+ *				 two paths agree within the documented ULP bound.
+ *				 Returns 1 if any of the checks failed.
+ *
+ *				 KP3DBench [--json file] [--no-sweep]
+ *				   --json		writes every timing into a JSON
+ *								file for regression tracking
+ *				   --no-sweep	skips the batch size sweep of
+ *								the array operations
+ *
+ *				 KPENGINE_ISA=<level> compares the kernels of a
+ *				 lower level, e.g. sse2 or avx, to the scalar ones.
+ *
+ *				 Do not build it with FMA code generation (-mfma,
+ *				 -march=native): the compiler then contracts the
+ *				 scalar reference into fused multiply-adds, which
+ *				 round differently (see KPSIMD.h).
+ *
+ *				 Linux build:
+ *				 g++ -O2 -I../KP3D -o KP3DBench main.cpp bench_vector.cpp
+ *					 bench_matrix.cpp ../KP3D/KP3D.cpp ../KP3D/KPCPU.cpp
+ *					 ../KP3D/KPVector.cpp ../KP3D/KPMatrix.cpp
+ *					 ../KP3D/KPTransform.cpp ../KP3D/KPJobs.cpp ../KP3D/KPMemory.cpp
+ *					 bench_anim.cpp
+ *					 ../KP3D/KPAnimation.cpp ../KP3D/KPSkinning.cpp bench_quat.cpp
+ *					 ../KP3D/KPQuaternion.cpp bench_cull.cpp
+ *					 ../KP3D/KPCulling.cpp ../KP3D/KPPolygon.cpp bench_ray.cpp
+ *					 ../KP3D/KPIntersect.cpp bench_trig.cpp ../KP3D/KPTrig.cpp
+ *					 ../KP3D/KPPixels.cpp bench_sweep.cpp bench_bounds.cpp
+ *					 ../KP3D/KPBounds.cpp bench_index.cpp ../KP3D/KPIndices.cpp
+ *					 -lpthread
+ *
+ *****************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "KPJobs.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <intrin.h>		// __rdtsc()
+#else
+	#include <time.h>
+	#include <x86intrin.h>	// __rdtsc()
+#endif
+
+volatile float g_fSink = 0.0f;
+KPISA g_SimdISA = KPISA_SCALAR;
+
+// Maximum number of results of a run
+#define KPBENCH_MAX_RECORDS	512
+
+// A timing of the JSON report
+typedef struct KPBENCHRECORD
+{
+	char	chName[32];			// Operation
+	char	chPath[16];			// Kernel, an instruction set, "simd" or "fast"
+	char	chUnit[8];			// "ns" or "cycles"
+	UINT	nCount;				// Number of elements of a pass
+	double	dPerOp;				// Time of one element
+	double	dBytesPerOp;		// Bytes read and written per element, 0 if not known
+} KPBENCHRECORD;
+
+static KPBENCHRECORD	g_Records[KPBENCH_MAX_RECORDS];
+static UINT				g_numRecords = 0;
+
+
+// KPBenchRecord ////
+void KPBenchRecord(const char *chName, const char *chPath, const char *chUnit, UINT nCount, double dPerOp, double dBytesPerOp)
+{
+	if ( g_numRecords == KPBENCH_MAX_RECORDS )
+		return;
+
+	KPBENCHRECORD *pRecord = &g_Records[g_numRecords++];
+
+	// The names are short, snprintf is not in the older MSVC runtimes
+	pRecord->chName[0] = pRecord->chPath[0] = pRecord->chUnit[0] = 0;
+	strncat(pRecord->chName, chName, sizeof(pRecord->chName) - 1);
+	strncat(pRecord->chPath, chPath, sizeof(pRecord->chPath) - 1);
+	strncat(pRecord->chUnit, chUnit, sizeof(pRecord->chUnit) - 1);
+
+	pRecord->nCount		 = nCount;
+	pRecord->dPerOp		 = dPerOp;
+	pRecord->dBytesPerOp = dBytesPerOp;
+} // ! KPBenchRecord
+
+
+// WriteJson ////
+/////////////////
+//
+// Writes the recorded timings, the throughput is derived from the time:
+//	{ "isa": "AVX", "threads": 4, "results": [
+//		{ "name": "dot", "path": "scalar", "count": 1024, "unit": "ns",
+//		  "per_op": 1.01, "mops": 990.1, "mbps": 0.0 }, ... ] }
+// mops and mbps are only written for timings in ns.
+static bool WriteJson(const char *chFile)
+{
+	FILE *pFile = fopen(chFile, "w");
+
+	if ( !pFile )
+		return false;
+
+	fprintf(pFile, "{\n\t\"isa\": \"%s\",\n\t\"threads\": %u,\n\t\"results\": [\n", KPGetISAName(g_SimdISA), KPGetNumThreads());
+
+	for ( UINT i = 0; i < g_numRecords; ++i )
+	{
+		const KPBENCHRECORD &r = g_Records[i];
+
+		fprintf(pFile, "\t\t{ \"name\": \"%s\", \"path\": \"%s\", \"count\": %u, \"unit\": \"%s\", \"per_op\": %.4f",
+				r.chName, r.chPath, r.nCount, r.chUnit, r.dPerOp);
+
+		if ( strcmp(r.chUnit, "ns") == 0 && r.dPerOp > 0.0 )
+			fprintf(pFile, ", \"mops\": %.2f, \"mbps\": %.1f", 1e3 / r.dPerOp, 1e3 * r.dBytesPerOp / r.dPerOp);
+
+		fprintf(pFile, " }%s\n", ( i + 1 < g_numRecords ) ? "," : "");
+	}
+
+	fprintf(pFile, "\t]\n}\n");
+
+	return ( fclose(pFile) == 0 );
+} // ! WriteJson
+
+
+// KPBenchRecordPaths ////
+void KPBenchRecordPaths(const char *chName, UINT nCount, double dScalar, double dSIMD, double dBytesPerOp)
+{
+	KPBenchRecord(chName, "scalar", "ns", nCount, dScalar, dBytesPerOp);
+	KPBenchRecord(chName, "simd",	"ns", nCount, dSIMD,   dBytesPerOp);
+}
+
+
+// KPBenchTime ////
+double KPBenchTime(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+} // ! KPBenchTime
+
+
+// KPBenchCycles ////
+double KPBenchCycles(void)
+{
+	return (double)__rdtsc();
+}
+
+
+// KPBenchElapsedNs ////
+double KPBenchElapsedNs(double dStart, UINT nPasses, UINT nCount)
+{
+	return ( KPBenchTime() - dStart ) * 1e9 / ( (double)nPasses * nCount );
+}
+
+
+// KPBenchElapsedCycles ////
+double KPBenchElapsedCycles(double dStart, UINT nPasses, UINT nCount)
+{
+	return ( KPBenchCycles() - dStart ) / ( (double)nPasses * nCount );
+}
+
+
+// KPBenchFindKernel ////
+UINT KPBenchFindKernel(const char *chName)
+{
+	UINT k = 0;
+
+	while ( k < KPGetNumKernels() && strcmp( KPGetKernelName(k), chName ) != 0 )
+		++k;
+
+	return k;
+}
+
+
+// RandomFloat ////
+float RandomFloat(float fMin, float fMax)
+{
+	return fMin + ( fMax - fMin ) * ( (float)rand() / (float)RAND_MAX );
+}
+
+
+// KPUlpDiff ////
+/////////////////
+//
+// Floats of the same sign are ordered the same way as their bit patterns
+// interpreted as integers, so the difference of the integers is the number
+// of representable floats between the two values.
+int KPUlpDiff(float a, float b)
+{
+	int ia, ib;
+
+	if ( a == b )
+		return 0;
+
+	memcpy(&ia, &a, sizeof(int));
+	memcpy(&ib, &b, sizeof(int));
+
+	// Map the negative floats below the positive ones
+	if ( ia < 0 ) ia = (int)0x80000000 - ia;
+	if ( ib < 0 ) ib = (int)0x80000000 - ib;
+
+	return ( ia > ib ) ? ia - ib : ib - ia;
+} // ! KPUlpDiff
+
+int KPUlpDiff(const KPVector *pA, const KPVector *pB, int n)
+{
+	int nMax = 0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		int nX = KPUlpDiff(pA[i].x, pB[i].x);
+		int nY = KPUlpDiff(pA[i].y, pB[i].y);
+		int nZ = KPUlpDiff(pA[i].z, pB[i].z);
+
+		if ( nX > nMax ) nMax = nX;
+		if ( nY > nMax ) nMax = nY;
+		if ( nZ > nMax ) nMax = nZ;
+	}
+
+	return nMax;
+} // ! KPUlpDiff
+
+
+// KPBenchReport ////
+bool KPBenchReport(const char *chName, double dScalar, double dSIMD, int nUlp, int nMaxUlp)
+{
+	bool bPassed = ( nUlp <= nMaxUlp );
+
+	KPBenchRecordPaths(chName, KPBENCH_COUNT, dScalar, dSIMD, 0.0);
+
+	printf("%-16s %10.2f %10.2f %8.2fx %6d ulp  %s\n", chName, dScalar, dSIMD,
+		   dScalar / dSIMD, nUlp, bPassed ? "ok" : "FAILED");
+
+	return bPassed;
+} // ! KPBenchReport
+
+bool KPBenchReportCycles(const char *chName, double dFull, double dFast, double dError, double dMaxError)
+{
+	bool bPassed = ( dError <= dMaxError );
+
+	KPBenchRecord(chName, "full", "cycles", KPBENCH_COUNT, dFull, 0.0);
+	KPBenchRecord(chName, "fast", "cycles", KPBENCH_COUNT, dFast, 0.0);
+
+	printf("%-16s %10.1f %10.1f %8.2fx %10.1e  %s\n", chName, dFull, dFast,
+		   dFull / dFast, dError, bPassed ? "ok" : "FAILED");
+
+	return bPassed;
+} // ! KPBenchReportCycles
+
+
+int main(int argc, char *argv[])
+{
+	int			nFailed	= 0;
+	const char	*chJson	= NULL;
+	bool		bSweep	= true;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( strcmp(argv[i], "--json") == 0 && i + 1 < argc )
+			chJson = argv[++i];
+		else if ( strcmp(argv[i], "--no-sweep") == 0 )
+			bSweep = false;
+		else
+		{
+			printf("usage: %s [--json file] [--no-sweep]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	g_SimdISA = KPGetISA();
+
+	if ( g_SimdISA == KPISA_SCALAR )
+	{
+		printf("SSE is not supported or not selected, there is nothing to compare the scalar code to.\n");
+		return 0;
+	}
+
+	printf("SIMD array kernels: %s\n", KPGetISAName(g_SimdISA));
+
+	for ( UINT k = 0; k < KPGetNumKernels(); ++k )
+		printf("  %-20s %s\n", KPGetKernelName(k), KPGetISAName( KPGetKernelISA(k, g_SimdISA) ));
+
+	printf("\n");
+
+	printf("%-16s %10s %10s %9s %10s\n", "operation", "scalar ns", "SIMD ns", "speedup", "difference");
+
+	nFailed += BenchVector();
+	nFailed += BenchPacket();
+	nFailed += BenchMatrix();
+	nFailed += BenchQuaternion();
+	nFailed += BenchAnimation();
+	nFailed += BenchCulling();
+	nFailed += BenchBounds();
+	nFailed += BenchClipping();
+	nFailed += BenchIntersect();
+	nFailed += BenchTrig();
+	nFailed += BenchIndices();
+	nFailed += BenchPixels();
+	nFailed += BenchNormalize();
+
+	if ( bSweep )
+		BenchSweep();
+
+	if ( chJson && ! WriteJson(chJson) )
+	{
+		printf("\nCould not write %s\n", chJson);
+		return 2;
+	}
+
+	if ( nFailed )
+		printf("\n%d operation(s) differ from the scalar results more than allowed.\n", nFailed);
+
+	return nFailed ? 1 : 0;
+}
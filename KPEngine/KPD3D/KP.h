@@ -212,6 +212,60 @@ typedef struct LVERTEX
 } LVERTEX;
 
 
+// Index Formats ////
+//////////////////////
+
+// Chooses the index size of the static buffers created from 32-bit indices.
+// The buffers addressing at most 65536 vertices always get 16-bit indices.
+typedef enum KPINDEXMODE
+{
+	IM_AUTO,				// 32-bit indices above 65536 vertices if the device addresses all of them, split meshes otherwise (default)
+	IM_SPLIT				// Split the meshes above 65536 vertices into chunks with 16-bit indices
+
+} KPINDEXMODE;
+
+
+// Dynamic Vertex Caches ////
+/////////////////////////////
+
+#define KPMAXCACHES 256			// Maximum number of dynamic caches of a vertex type
+
+// Chooses the dynamic cache to flush when no cache uses the skin of the rendered vertices.
+// The empty caches are always taken first, they cost no flush.
+typedef enum KPCACHEPOLICY
+{
+	CP_FULLEST,				// Flush the cache holding the most vertices (default)
+	CP_LRU,					// Flush the cache whose skin was rendered least recently
+	CP_LFU					// Flush the cache whose skin was rendered the fewest times since it got the cache
+
+} KPCACHEPOLICY;
+
+// Counters of the dynamic caches of a vertex type
+typedef struct KPCACHESTATS
+{
+	UINT numRequests;		// Render and Reserve calls
+	UINT numHits;			// Calls finding a cache that uses their skin
+	UINT numMisses;			// Calls giving a new skin to a cache
+	UINT numEvictions;		// Misses that had to flush the cached vertices of another skin
+	UINT numFlushes;		// Flushes of the caches, for any reason (full cache, eviction, forced flush)
+	UINT numWraps;			// Flushes restarting the shared vertex and index ring at its front
+	UINT numStalls;			// Flushes waiting for the GPU to finish reading the ring
+
+} KPCACHESTATS;
+
+// Counters of the deferred render queue and of the states bound by the vertex cache manager,
+// the bindings are counted in both modes so the two can be compared
+typedef struct KPQUEUESTATS
+{
+	UINT numQueued;			// Render calls recorded in deferred mode
+	UINT numSorts;			// Sorted and executed batches of the queue
+	UINT numSkinChanges;	// Material, texture and alpha state bindings of the static buffers and caches
+	UINT numBufferChanges;	// Vertex and index buffer bindings of the static buffers and caches
+	UINT numWorldChanges;	// World matrices set by the queue between its draws
+
+} KPQUEUESTATS;
+
+
 // Engine Render States ////
 ////////////////////////////
 typedef enum KPRENDERSTATE
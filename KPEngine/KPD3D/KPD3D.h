@@ -20,6 +20,8 @@
 #include <d3dx9.h>
 #include "KP.h"
 #include "../KP3D/KP3D.h"
+#include "../KP3D/KPMemory.h"
+#include "../KP3D/KPProfile.h"
 #include "../KPRenderer/KPRenderDevice.h"
 
 
@@ -237,6 +239,8 @@ class KPD3D : public KPRenderDevice
 		void	Log(char *chFormat, ...);
 		void	LogDeviceCaps(D3DCAPS9 *pCaps);
 		void	LogCpuCaps(CPUINFO *pInfo);
+		void	LogKernels(void);
+		void	LogProfile(const KPHWPROFILE *pProfile, bool bLoaded);
 
 		// VIEW / PROJECTION
 		////////////////////////
@@ -293,6 +297,11 @@ class KPD3D : public KPRenderDevice
 		UINT			GetActiveSkinID(void);
 		void			SetActiveSkinID(UINT nSkinID);
 
+		// WORLD MATRICES
+		////////////////////
+		const D3DMATRIX*	GetWorldMatrix(void);
+		const D3DMATRIX*	GetWorldViewProjMatrix(void);
+
 		// LIGHTNING
 		////////////////
 		void			SetAmbientLight(float fR, float fG, float fB);
@@ -65,7 +65,7 @@ KPD3DSkinManager::~KPD3DSkinManager(void)
 		} // ! for number of textures
 
 		// Free up the Textures object
-		free( m_pTextures );
+		KPAlignedFree( m_pTextures );
 		m_pTextures = NULL;
 
 	} // ! if textures
@@ -74,14 +74,14 @@ KPD3DSkinManager::~KPD3DSkinManager(void)
 	// Free up the materials
 	if ( m_pMaterials )
 	{
-		free( m_pMaterials );
+		KPAlignedFree( m_pMaterials );
 		m_pMaterials = NULL;
 	}
 
 	// Free up the skins
 	if ( m_pSkins )
 	{
-		free( m_pSkins );
+		KPAlignedFree( m_pSkins );
 		m_pSkins = NULL;
 	}
 
@@ -189,28 +189,15 @@ HRESULT KPD3DSkinManager::AddSkin(const KPCOLOR *pAmbient, const KPCOLOR *pDiffu
 		// Calculate the new size of the list
 		size = ( m_numSkins + 25 ) * sizeof(KPSKIN);
 
-		// Reallocate the list with the increased size.
-		void* tmp = realloc(m_pSkins, size);
-		if ( tmp != NULL)
+		// Reallocate the list with the increased size, the old list is kept on failure
+		void* tmp = KPAlignedRealloc(m_pSkins, m_numSkins * sizeof(KPSKIN), size);
+		if ( tmp == NULL )
 		{
-			m_pSkins = (KPSKIN*)tmp;
-			tmp = NULL;
-		}
-		else
-		{
-			free(m_pSkins);
-			free(tmp);
 			Log("AddSkin: Unable to reallocate SKIN object"); 
 			return KP_OUTOFMEMORY;
 		}
 
-		/*
-		if ( ( m_pSkins = (KPSKIN*)realloc(m_pSkins, size) ) == NULL )
-		{
-			Log("AddSkin: Unable to reallocate SKIN object"); 
-			return KP_OUTOFMEMORY;
-		}
-		*/
+		m_pSkins = (KPSKIN*)tmp;
 	}
 
 	// Create the material of the Skin
@@ -255,28 +242,16 @@ HRESULT KPD3DSkinManager::AddSkin(const KPCOLOR *pAmbient, const KPCOLOR *pDiffu
 			// Calculate the size of the new material list
 			size = ( m_numMaterials + 50 ) * sizeof(KPMATERIAL);
 			
-			// Reallocate the material list with the new size
-			void* tmp = realloc(m_pMaterials, size);
-			if ( tmp != NULL )
+			// Reallocate the material list with the new size, the colors of
+			// the materials start on 16 byte boundaries this way
+			void* tmp = KPAlignedRealloc(m_pMaterials, m_numMaterials * sizeof(KPMATERIAL), size);
+			if ( tmp == NULL )
 			{
-				m_pMaterials = (KPMATERIAL*)tmp;
-				tmp = NULL;
-			}
-			else
-			{
-				free(m_pMaterials);
-				free(tmp);
 				Log("AddSkin: Unable to reallocate MATERIAL Object");
 				return KP_OUTOFMEMORY;
 			}
 
-			/*
-			if ( ( m_pMaterials = (KPMATERIAL*)realloc(m_pMaterials, size) ) == NULL )
-			{
-				Log("AddSkin: Unable to reallocate MATERIAL Object");
-				return KP_OUTOFMEMORY;
-			}
-			*/
+			m_pMaterials = (KPMATERIAL*)tmp;
 		}
 
 		// Copy the material data into the list
@@ -343,27 +318,14 @@ HRESULT KPD3DSkinManager::AddTexture(UINT nSkinID, const char *chName, bool bAlp
 			int size = ( m_numTextures + 25 ) * sizeof(KPTEXTURE);
 
 			// Reallocate the index with the new size
-			void* tmp = realloc(m_pTextures, size);
-			if ( tmp != NULL)
-			{
-				m_pTextures = (KPTEXTURE*)tmp;
-				tmp = NULL;
-			}
-			else
+			void* tmp = KPAlignedRealloc(m_pTextures, m_numTextures * sizeof(KPTEXTURE), size);
+			if ( tmp == NULL )
 			{
-				free(m_pTextures);
-				free(tmp);
 				Log("AddTexture: unable to reallocate Texture object");
 				return KP_OUTOFMEMORY;
 			}
-			/*
-			if ( ( m_pTextures = (KPTEXTURE*)realloc(m_pTextures, size) ) == NULL )
-			{
-				Log("AddTexture: unable to reallocate Texture object");
-				return KP_OUTOFMEMORY;
-			}
-			*/
 
+			m_pTextures = (KPTEXTURE*)tmp;
 		}
 
 		// Check whether we should use alpha blending 
@@ -560,18 +522,10 @@ HRESULT	KPD3DSkinManager::SetAlphaKey(LPDIRECT3DTEXTURE9 *ppTexture, UCHAR R, UC
 		return KP_BUFFERLOCK;
 	}
 
-	// Replace the Color Key pixels with their new values
+	// Replace the Color Key pixels with their new values, a row at a time:
+	// the rows are Pitch bytes apart, which can be more than the width
 	for ( DWORD y = 0; y < desc.Height; ++y )
-	{
-		for ( DWORD x = 0; x < desc.Width; ++x )
-		{
-			// If the pixel is affected by the ColorKey, replace it with new Color
-			if ( ((DWORD*)rect.pBits)[y*desc.Width + x] == ColorKey )
-				((DWORD*)rect.pBits)[y*desc.Width + x] = Color;
-
-		} // ! for width
-
-	} // ! for height
+		KPReplaceColor( (UINT*)( (BYTE*)rect.pBits + y * rect.Pitch ), desc.Width, ColorKey, Color );
 
 	// We can unlock the surface now
 	(*ppTexture)->UnlockRect(0);
@@ -590,8 +544,6 @@ HRESULT KPD3DSkinManager::SetTransparency(LPDIRECT3DTEXTURE9 *ppTexture, UCHAR A
 {
 	D3DSURFACE_DESC	desc;
 	D3DLOCKED_RECT	rect;
-	DWORD			Color;
-	UCHAR			R, G, B, A;
 
 	// Make sure our texture is in 32-bit ARGB format
 	(*ppTexture)->GetLevelDesc(0, &desc);
@@ -609,32 +561,11 @@ HRESULT KPD3DSkinManager::SetTransparency(LPDIRECT3DTEXTURE9 *ppTexture, UCHAR A
 		return KP_BUFFERLOCK;
 	}
 
-	// Apply transparency to every pixel of the surface
+	// Apply transparency to every pixel of the surface. Only change alpha if
+	// it's larger than the one provided, this way we can have 100% transparent
+	// key colors while the rest is less
 	for ( DWORD y = 0; y < desc.Height; ++y )
-	{
-		for ( DWORD x = 0; x < desc.Width; ++x )
-		{
-			// Retrieve the color value of the pixel [ rownum + rowwidth + columnnum ]
-			// (where columnwidth is sizeof(x) = dword = 4byte
-			Color = ((DWORD*)rect.pBits)[y*desc.Width + x];
-
-			// Calculate the color values from pixel color
-			A = (UCHAR)( (Color & 0xFF000000) >> 24);
-			R = (UCHAR)( (Color & 0x00FF0000) >> 16);
-			G = (UCHAR)( (Color & 0x0000FF00) >> 8);
-			B = (UCHAR)(  Color & 0x000000FF);
-
-			// Only change alpha if it's smaller than the one provided by the AlphaKey
-			// This way we can have 100% transparent key colors while the rest is less
-			if ( Alpha < A )
-				A = Alpha;
-
-			// Set the new color value with the updated alpha channel
-			((DWORD*)rect.pBits)[y*desc.Width + x] = MakeD3DColor(R, G, B, A);
-
-		} // ! for width
-
-	} // ! for height
+		KPLimitAlpha( (UINT*)( (BYTE*)rect.pBits + y * rect.Pitch ), desc.Width, Alpha );
 
 	// We can unlock the surface now.
 	(*ppTexture)->UnlockRect(0);
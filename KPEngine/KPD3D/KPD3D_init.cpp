@@ -487,15 +487,21 @@ HRESULT KPD3D::FirstTimeInitialization(void)
 
 	LogCpuCaps(&info);
 
-	if ( IsSSESupported() )
-		Log("Using SIMD.");
-	else
-		Log("Not using SIMD.");
+	// The math kernels are selected when KP3D is loaded
+	LogKernels();
+
+	// Tune the thread pool and the vertex caches for the machine, the defaults without a profile
+	KPHWPROFILE Profile;
+	bool bProfile = KPLoadHWProfile(NULL, &Profile);
+
+	KPApplyHWProfile(&Profile);
+	LogProfile(&Profile, bProfile);
 
 	// Initialize the Managers
 	m_pSkinManager	= new KPD3DSkinManager(m_pDevice, m_pLog);
 
-	m_pVertexMan	= new KPD3DVertexCacheManager( (KPD3DSkinManager*)m_pSkinManager, m_pDevice, this, 3000, 4500, m_pLog);
+	m_pVertexMan	= new KPD3DVertexCacheManager( (KPD3DSkinManager*)m_pSkinManager, m_pDevice, this,
+												   Profile.nCacheVertices, Profile.nCacheIndices, Profile.numCaches, m_pLog);
 
 	// Set the default render states
 	m_pDevice->SetRenderState(D3DRS_LIGHTING, TRUE);			// Enable lightning
@@ -677,6 +683,10 @@ HRESULT KPD3D::Clear(bool bClearPixel, bool bClearDepth, bool bClearStencil)
 	if ( bClearDepth )					dw |= D3DCLEAR_ZBUFFER;
 	if ( bClearStencil && m_bStencil )	dw |= D3DCLEAR_STENCIL;
 
+	// The draws queued before the Clear call are rendered before it, like in immediate mode
+	if ( m_pVertexMan->IsDeferred() && FAILED( m_pVertexMan->ForcedFlushAll() ) )
+		Log("Clear: Failed to render the queued draws!");
+
 	// If the scene is running, end it first.
 	if ( m_bIsSceneRunning )
 		m_pDevice->EndScene();
@@ -705,6 +715,9 @@ void KPD3D::EndRendering(void)
 	if ( FAILED( m_pVertexMan->ForcedFlushAll() ) )
 		Log("EndRendering: Failed to flush all the caches!");
 
+	// The dynamic vertices of the frame are rendered, their ring room is freed when the GPU is done
+	((KPD3DVertexCacheManager*)m_pVertexMan)->EndFrame();
+
 	// Present must be called after the scene is ended or it fails.
 	// Only call it ONCE for a swap chain per frame.
 	m_pDevice->EndScene();
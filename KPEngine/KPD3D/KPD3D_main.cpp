@@ -21,8 +21,15 @@ inline DWORD FToDW( float f )
 void KPD3D::SetWorldTransform(const KPMatrix *mWorld)
 {
 	// Render all the vertices from the cache
-	// before we change the World transform matrix
-	m_pVertexMan->ForcedFlushAll();
+	// before we change the World transform matrix.
+	// The deferred draws keep their World matrix, they stay queued.
+	if ( m_pVertexMan->IsDeferred() )
+	{
+		m_pVertexMan->ForcedFlush(VID_UU);
+		m_pVertexMan->ForcedFlush(VID_UL);
+	}
+	else
+		m_pVertexMan->ForcedFlushAll();
 
 	// Set the World Transform Matrix
 	if ( !mWorld )
@@ -55,6 +62,21 @@ void KPD3D::SetActiveSkinID(UINT nSkinID)
 }
 
 
+// Get World Matrices ////
+//////////////////////////
+//
+// The render queue records the World matrix of its draws and sorts them by depth
+const D3DMATRIX* KPD3D::GetWorldMatrix(void)
+{
+	return &m_mWorld;
+}
+
+const D3DMATRIX* KPD3D::GetWorldViewProjMatrix(void)
+{
+	return &m_mWorldViewProj;
+}
+
+
 // SetBackfaceCulling ////
 //////////////////////////
 /*
@@ -104,6 +104,9 @@ HRESULT KPD3D::SetView3D(const KPVector &vcX, const KPVector &vcY, const KPVecto
 		return KP_FAIL;
 	}
 
+	// The cached and the deferred draws are rendered with the old view
+	m_pVertexMan->ForcedFlushAll();
+
 	m_mView3D._14 = 0.0f;
 	m_mView3D._24 = 0.0f;
 	m_mView3D._34 = 0.0f;
@@ -716,7 +719,8 @@ void KPD3D::Transform2Dto3D(const POINT &point, KPVector *vcOrigin, KPVector *vc
 	// back to [-1.0f, 1.0f] dimensions, practically have to do the inverse of Transform3Dto2D.
 
 	vcScreen.x	= ( (point.x * 2.0f/dwWidth)  - 1.0f ) / pProj->_11;
-	vcScreen.y	= ( (point.y * 2.0f/dwHeight) - 1.0f ) / pProj->_22;
+	vcScreen.y	= ( 1.0f - (point.y * 2.0f/dwHeight) ) / pProj->_22;	// Screen y points down
+	vcScreen.z	= 1.0f;
 
 	// Now we have to invert the view matrix too
 	mInvView.InverseOf( *((KPMatrix*)&m_mView3D) );
@@ -732,7 +736,7 @@ void KPD3D::Transform2Dto3D(const POINT &point, KPVector *vcOrigin, KPVector *vc
 	vcOrigin->z	= mInvView._43;
 
 	// Ensure that it is a unit vector
-	vcOrigin->Normalize();
+	vcDirection->Normalize();
 	}
 
 } // ! Transform2Dto3D
@@ -1005,6 +1009,33 @@ void KPD3D::LogCpuCaps(CPUINFO *pInfo)
 	Log("\t\tCPU_FEATURE_3DNOW:\t%s",	(pInfo->Feature & CPU_FEATURE_3DNOW)?"Yes":"No");
 	Log("\t\tCPU_FEATURE_3DNOWEX:\t%s",	(pInfo->Feature & CPU_FEATURE_3DNOWEX)?"Yes":"No");
 	Log("\t\tCPU_FEATURE_MMXEX:\t%s",	(pInfo->Feature & CPU_FEATURE_MMXEX)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX:\t%s",		(pInfo->Feature & CPU_FEATURE_AVX)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX2:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX2)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_FMA:\t%s",		(pInfo->Feature & CPU_FEATURE_FMA)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_F16C:\t%s",	(pInfo->Feature & CPU_FEATURE_F16C)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX512F:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX512F)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX512DQ:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX512DQ)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX512CD:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX512CD)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX512BW:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX512BW)?"Yes":"No");
+	Log("\t\tCPU_FEATURE_AVX512VL:\t%s",	(pInfo->Feature & CPU_FEATURE_AVX512VL)?"Yes":"No");
+
+	Log("");
+
+	// The AVX registers are only usable if the OS saves them
+	Log("\tOS SIMD SUPPORT:");
+	Log("\t\tXSAVE enabled:\t%s",		(pInfo->OS_Support & CPU_FEATURE_XSAVE)?"Yes":"No");
+	Log("\t\tAVX state:\t%s",			(pInfo->OS_Support & CPU_FEATURE_AVX)?"Yes":"No");
+	Log("\t\tAVX-512 state:\t%s",		(pInfo->OS_Support & CPU_FEATURE_AVX512F)?"Yes":"No");
+
+	Log("");
+
+	Log("\tTOPOLOGY:");
+	Log("\t\tPackages:\t%d", pInfo->numPackages);
+	Log("\t\tCores:\t\t%d physical, %d logical", pInfo->numPhysicalCores, pInfo->numLogicalCores);
+	Log("\t\tL1 Cache:\t%d KB data, %d KB code", pInfo->L1DataSize, pInfo->L1CodeSize);
+	Log("\t\tL2 Cache:\t%d KB", pInfo->L2Size);
+	Log("\t\tL3 Cache:\t%d KB", pInfo->L3Size);
+	Log("\t\tCache Line:\t%d bytes", pInfo->CacheLineSize);
 
 	Log("");
 
@@ -1024,3 +1055,54 @@ void KPD3D::LogCpuCaps(CPUINFO *pInfo)
 
 } // ! LogCpuCaps
 
+// LogKernels ////
+//////////////////
+//
+// The instruction set of the math kernels and the variant each kernel runs,
+// a kernel without a variant for the selected level runs the next lower one.
+// KPENGINE_ISA=<level> forces a lower level, see KPSetISA.
+void KPD3D::LogKernels(void)
+{
+	KPISA Isa = KPGetISA();
+
+	Log("KERNELS:");
+	Log("\tSelected:\t%s", KPGetISAName(Isa));
+	Log("\tBest available:\t%s", KPGetISAName( KPGetMaxISA() ));
+
+	for ( UINT k = 0; k < KPGetNumKernels(); ++k )
+		Log("\t\t%s:\t%s", KPGetKernelName(k), KPGetISAName( KPGetKernelISA(k, Isa) ));
+
+	Log("");
+
+} // ! LogKernels
+
+
+// LogProfile ////
+//////////////////
+//
+// The hardware profile the engine is tuned by, written by CpuTest --profile.
+// Without one the defaults are used, the same on every machine.
+void KPD3D::LogProfile(const KPHWPROFILE *pProfile, bool bLoaded)
+{
+	Log("HARDWARE PROFILE:");
+
+	if ( bLoaded )
+	{
+		Log("\tMeasured on:\t%s (%s)", pProfile->chCPU, pProfile->chISA);
+		Log("\tBandwidth:\t%.2f GB/s read, %.2f GB/s write, %.2f GB/s all threads",
+			pProfile->fReadGBps, pProfile->fWriteGBps, pProfile->fReadAllGBps);
+		Log("\tLatency:\tL1 %.2f ns, L2 %.2f ns, L3 %.2f ns, DRAM %.2f ns",
+			pProfile->fLatencyL1, pProfile->fLatencyL2, pProfile->fLatencyL3, pProfile->fLatencyDRAM);
+	}
+	else
+		Log("\tNone found, using the defaults. Run CpuTest --profile %s to create one.", KPHWPROFILE_FILE);
+
+	Log("\tWorker threads:\t%u", KPGetNumThreads() - 1);
+	Log("\tParallel from:\t%d matrices, %d vectors (-1: never)",
+		(int)pProfile->nMatrixThreshold, (int)pProfile->nVectorThreshold);
+	Log("\tVertex caches:\t%u per vertex type, %u vertices, %u indices",
+		pProfile->numCaches, pProfile->nCacheVertices, pProfile->nCacheIndices);
+
+	Log("");
+
+} // ! LogProfile
@@ -0,0 +1,332 @@
+/*
+ *****************************************************************
+ *
+ *	KPEngine Source code
+ *	Kovacs Peter - October 2009
+ *
+ *  File: KPD3D_ring.cpp
+ *  Description: Direct3D Stream Ring definition
+ *
+ *****************************************************************
+*/
+
+#include "KPD3D_vcache.h"
+
+LPDIRECT3DVERTEXBUFFER9 KPD3DStreamRing::GetVB(void)
+{
+	return m_pVB;
+}
+
+LPDIRECT3DINDEXBUFFER9 KPD3DStreamRing::GetIB(void)
+{
+	return m_pIB;
+}
+
+DWORD KPD3DStreamRing::GetID(void)
+{
+	return m_dwID;
+}
+
+// Log Function ////
+////////////////////
+void KPD3DStreamRing::Log(char *chFormat, ...)
+{
+	char msg[256];
+	char *pArgs;
+
+	// Point at the argument list
+	pArgs = (char*) &chFormat + sizeof(chFormat);
+
+	// Convert arguments to message using the format string
+	vsprintf_s(msg, sizeof(msg), chFormat, pArgs);
+
+	fprintf(m_pLog, "[ KPD3DStreamRing ]: ");
+	fprintf(m_pLog, msg);
+	fprintf(m_pLog, "\n");
+
+	// Instantly write the buffer into the log file
+	fflush(m_pLog);
+
+} // ! ::Log()
+
+
+// KPD3DStreamRing ////
+///////////////////////
+/*
+	Creates the vertex and index rings of a vertex type and the event queries of their fences.
+
+	Params:
+		nMaxVertices	: UINT type value specifying the size of the vertex ring
+		nMaxIndices		: UINT type value specifying the size of the index ring
+		nStride			: UINT type value specifying the stride of a vertex (size of a single vertex element)
+		pDevice			: Address of a Direct3D9 device
+		dwID			: DWORD type value specifying the ID the active cache flag holds while the ring is bound
+		pStats			: Address of the counters of the cache pool, the wraps and stalls are counted in it
+		pLog			: Address of a FILE object used for logging important messages
+*/
+KPD3DStreamRing::KPD3DStreamRing(UINT nMaxVertices, UINT nMaxIndices, UINT nStride, LPDIRECT3DDEVICE9 pDevice,
+								 DWORD dwID, KPCACHESTATS *pStats, FILE *pLog)
+{
+	m_pDevice			= pDevice;
+	m_dwID				= dwID;
+	m_nStride			= nStride;
+	m_pStats			= pStats;
+	m_pLog				= pLog;
+	m_pVB				= NULL;
+	m_pIB				= NULL;
+	m_numVertices		= nMaxVertices;
+	m_numIndices		= nMaxIndices;
+	m_nVertexPos		= 0;
+	m_nIndexPos			= 0;
+	m_nVertexUsed		= 0;
+	m_nIndexUsed		= 0;
+	m_nFrameVertices	= 0;
+	m_nFrameIndices		= 0;
+	m_bDiscard			= true;
+	m_bFences			= true;
+	m_nFirstFence		= 0;
+	m_numFences			= 0;
+
+	HRESULT	hr;
+
+	// Create a non FVF dynamic & write only vertex buffer
+	hr = pDevice->CreateVertexBuffer(nMaxVertices * nStride, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+									 0, D3DPOOL_DEFAULT, &m_pVB, NULL);
+
+	if ( FAILED(hr) )
+	{
+		Log("Unable to create vertex buffer");
+		m_pVB	= NULL;
+	}
+
+	// Create a dynamic & write only index buffer
+	hr = pDevice->CreateIndexBuffer(nMaxIndices * sizeof(WORD), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+									D3DFMT_INDEX16, D3DPOOL_DEFAULT, &m_pIB, NULL);
+	if ( FAILED(hr) )
+	{
+		Log("Unable to create index buffer");
+		m_pIB	= NULL;
+	}
+
+	// The fences need every query, otherwise the ring is discarded upon wrapping around
+	for ( UINT i = 0; i < KPRING_FENCES; ++i )
+	{
+		m_Fences[i].pQuery		= NULL;
+		m_Fences[i].nVertices	= 0;
+		m_Fences[i].nIndices	= 0;
+
+		if ( m_bFences && FAILED( pDevice->CreateQuery(D3DQUERYTYPE_EVENT, &m_Fences[i].pQuery) ) )
+		{
+			m_Fences[i].pQuery	= NULL;
+			m_bFences			= false;
+		}
+	}
+
+	Log("%u vertices, %u indices, %s", nMaxVertices, nMaxIndices,
+		m_bFences ? "fenced by event queries" : "no event queries, discarded upon wrapping around");
+
+} // ! KPD3DStreamRing
+
+KPD3DStreamRing::~KPD3DStreamRing(void)
+{
+	for ( UINT i = 0; i < KPRING_FENCES; ++i )
+	{
+		if ( m_Fences[i].pQuery )
+		{
+			m_Fences[i].pQuery->Release();
+			m_Fences[i].pQuery = NULL;
+		}
+	}
+
+	if ( m_pVB )
+	{
+		m_pVB->Release();
+		m_pVB = NULL;
+	}
+	if ( m_pIB )
+	{
+		m_pIB->Release();
+		m_pIB = NULL;
+	}
+}
+
+
+// Write ////
+/////////////
+/*
+	Copies the vertices and indices of a flushed cache behind the data written before.
+	If they do not fit before the end of the ring, they are written to its front and the
+	end is skipped. The oldest fences are waited for until the data they cover frees
+	enough room, the data of the current frame gets a fence of its own if needed.
+
+	Params:
+		pVertices		: Pointer to the vertices
+		nVertices		: UINT type value specifying the number of vertices, at most the size of the vertex ring
+		pIndices		: Pointer to the indices
+		nIndices		: UINT type value specifying the number of indices, at most the size of the index ring
+		pnBaseVertex	: Receives the position of the first vertex, the BaseVertexIndex of the draws
+		pnStartIndex	: Receives the position of the first index, the StartIndex of the draws
+
+	Returns:
+		KP_BUFFERSIZE if the data is larger than the ring,
+		KP_BUFFERLOCK if the buffers can't be locked
+*/
+HRESULT KPD3DStreamRing::Write(const void *pVertices, UINT nVertices, const WORD *pIndices, UINT nIndices,
+							   UINT *pnBaseVertex, UINT *pnStartIndex)
+{
+	DWORD	dwFlags;
+	BYTE	*tmpV	= NULL;
+	WORD	*tmpI	= NULL;
+
+	if ( ! m_pVB || ! m_pIB )
+		return KP_FAIL;
+
+	if ( nVertices > m_numVertices || nIndices > m_numIndices )
+	{
+		Log("Write: Data can't fit into the ring! nV:%d // %d, nI:%d // %d", nVertices, m_numVertices, nIndices, m_numIndices);
+		return KP_BUFFERSIZE;
+	}
+
+	bool bWrapV, bWrapI;					// Does the data go to the front of the ring?
+	UINT nSkipV, nSkipI;					// Room skipped at the end of the ring
+	bool bWrapped = false;
+	bool bStalled = false;
+
+	for ( ;; )
+	{
+		// An empty ring starts at its front again
+		if ( m_nVertexUsed == 0 )	m_nVertexPos	= 0;
+		if ( m_nIndexUsed == 0 )	m_nIndexPos		= 0;
+
+		// The ends of the rings are skipped if the data does not fit before them
+		bWrapV = ( m_nVertexPos + nVertices > m_numVertices );
+		bWrapI = ( m_nIndexPos  + nIndices  > m_numIndices  );
+		nSkipV = ( bWrapV ) ? m_numVertices - m_nVertexPos : 0;
+		nSkipI = ( bWrapI ) ? m_numIndices  - m_nIndexPos  : 0;
+
+		// Without fences the driver renames the discarded buffers, the queued draws keep the old ones
+		if ( ( bWrapV || bWrapI ) && ! m_bFences )
+		{
+			m_nVertexUsed	= m_nIndexUsed	= 0;
+			m_bDiscard		= true;
+			bWrapped		= true;
+			continue;
+		}
+
+		if ( m_nVertexUsed + nSkipV + nVertices <= m_numVertices && m_nIndexUsed + nSkipI + nIndices <= m_numIndices )
+			break;
+
+		// Wait until the GPU is done with the room the data is written to.
+		// If the data of the current frame is in the way, its draws are already submitted.
+		if ( m_numFences == 0 )
+			IssueFence();
+
+		RetireFence();
+		bStalled = true;
+	}
+
+	UINT nVertexPos = ( bWrapV ) ? 0 : m_nVertexPos;
+	UINT nIndexPos	= ( bWrapI ) ? 0 : m_nIndexPos;
+
+	if ( m_pStats )
+	{
+		if ( bWrapped || bWrapV || bWrapI )
+			++m_pStats->numWraps;
+		if ( bStalled )
+			++m_pStats->numStalls;
+	}
+
+	dwFlags = ( m_bDiscard ) ? D3DLOCK_DISCARD : D3DLOCK_NOOVERWRITE;
+
+	// Copy the data, the fences guarantee no queued draw reads the locked room
+	if ( FAILED( m_pVB->Lock(nVertexPos * m_nStride, nVertices * m_nStride, (void**)&tmpV, dwFlags) ) )
+	{
+		Log("Write: Unable to lock the vertex buffer");
+		return KP_BUFFERLOCK;
+	}
+
+	memcpy(tmpV, pVertices, nVertices * m_nStride);
+	m_pVB->Unlock();
+
+	if ( FAILED( m_pIB->Lock(nIndexPos * sizeof(WORD), nIndices * sizeof(WORD), (void**)&tmpI, dwFlags) ) )
+	{
+		Log("Write: Unable to lock the index buffer");
+		return KP_BUFFERLOCK;
+	}
+
+	memcpy(tmpI, pIndices, nIndices * sizeof(WORD));
+	m_pIB->Unlock();
+
+	*pnBaseVertex	= nVertexPos;
+	*pnStartIndex	= nIndexPos;
+
+	m_nVertexPos		= nVertexPos + nVertices;
+	m_nIndexPos			= nIndexPos  + nIndices;
+	m_nVertexUsed		+= nSkipV + nVertices;
+	m_nIndexUsed		+= nSkipI + nIndices;
+	m_nFrameVertices	+= nSkipV + nVertices;
+	m_nFrameIndices		+= nSkipI + nIndices;
+	m_bDiscard			= false;
+
+	return KP_OK;
+
+} // ! Write
+
+
+// EndFrame ////
+////////////////
+/*
+	Issues the fence of the data written during the frame. Called after the
+	last flush of the frame, the draws reading the data are submitted.
+*/
+void KPD3DStreamRing::EndFrame(void)
+{
+	if ( m_bFences && ( m_nFrameVertices || m_nFrameIndices ) )
+		IssueFence();
+
+} // ! EndFrame
+
+
+// IssueFence ////
+//////////////////
+//
+// Issues an event after the draws submitted so far, the data taken since the
+// last fence is retired with it. The oldest fence is waited for if all are issued.
+void KPD3DStreamRing::IssueFence(void)
+{
+	if ( m_numFences == KPRING_FENCES )
+		RetireFence();
+
+	KPRINGFENCE *pFence = &m_Fences[ ( m_nFirstFence + m_numFences ) % KPRING_FENCES ];
+
+	pFence->nVertices	= m_nFrameVertices;
+	pFence->nIndices	= m_nFrameIndices;
+	pFence->pQuery->Issue(D3DISSUE_END);
+
+	m_nFrameVertices	= 0;
+	m_nFrameIndices		= 0;
+	++m_numFences;
+
+} // ! IssueFence
+
+
+// RetireFence ////
+///////////////////
+//
+// Waits until the GPU passes the oldest fence and frees the room of the data before it
+void KPD3DStreamRing::RetireFence(void)
+{
+	KPRINGFENCE *pFence = &m_Fences[m_nFirstFence];
+
+	// S_FALSE while the event is not reached. The flush sends the queued
+	// commands to the GPU, otherwise the event may never be reached. An
+	// error (lost device) means the GPU does not read the data any more.
+	while ( pFence->pQuery->GetData(NULL, 0, D3DGETDATA_FLUSH) == S_FALSE )
+		;
+
+	m_nVertexUsed	-= pFence->nVertices;
+	m_nIndexUsed	-= pFence->nIndices;
+	m_nFirstFence	= ( m_nFirstFence + 1 ) % KPRING_FENCES;
+	--m_numFences;
+
+} // ! RetireFence
@@ -6,6 +6,7 @@
  *
  *  File: KPD3D_vcache.h
  *  Description: Direct3D Cache Management
+ *				 - Stream Ring
  *				 - Vertex Cache 
  *				 - Vertex Cache Manager
  *
@@ -18,13 +19,105 @@
 #include "KPD3D.h"
 #include "KPD3DSkinManager.h"
 
-#define KPNUMCACHES 10			// Number of caches used by the Vertex Cache Manager
+#define KPNOCACHE 0xFFFFFFFF	// Cache index of the free hash table slots
+#define KPNOCHUNK 0xFFFFFFFF	// Next chunk of the static buffers that are not split
+#define KPMAX_INDEX16 65536		// Vertices addressable with 16-bit indices
+#define KPMAXDRAWS 4			// Base-vertex draws of a dynamic cache per flush
+#define KPBASEDRAW_MIN 8192		// Indices of a batch copied unchanged into a base-vertex draw of its own
 
+class KPD3DStreamRing;
 class KPD3DVertexCache;
 class KPD3DVertexCacheManager;
 struct KPSTATICBUFFER;
 
 
+// Draw of a dynamic cache, the indices of its batches are relative to its base vertex
+typedef struct KPCACHEDRAW
+{
+	UINT	nBaseVertex;			// First vertex of the draw in the cache, the BaseVertexIndex is this plus the ring position
+	UINT	nStartIndex;			// First index of the draw in the cache
+	UINT	nIndices;				// Number of indices
+
+} KPCACHEDRAW;
+
+
+// Stream Ring ////
+///////////////////
+//
+// One dynamic vertex buffer and index buffer shared by the caches of a vertex
+// type. The caches collect their batches in system memory and copy them into
+// the ring when they are flushed, so a flush locks each buffer once and the
+// caches of a vertex type bind the same buffers. The ring is written front to
+// back with NOOVERWRITE. The data written during a frame is retired when the
+// GPU has passed the event query issued at the end of the frame, a write
+// reaching data that is not retired waits for it. Without event queries the
+// ring is discarded when it wraps around and the driver renames the buffers.
+
+#define KPRING_FLUSHES	4		// Full caches a ring holds
+#define KPRING_FENCES	4		// Frames a ring tracks, the driver queues at most 3 ahead
+
+// Fence of the data written in a frame
+typedef struct KPRINGFENCE
+{
+	IDirect3DQuery9	*pQuery;		// Event issued after the draws of the frame
+	UINT			nVertices;		// Vertices the frame took from the ring, the skipped end included
+	UINT			nIndices;		// Indices the frame took from the ring, the skipped end included
+
+} KPRINGFENCE;
+
+class KPD3DStreamRing
+{
+	public:
+		KPD3DStreamRing(UINT nMaxVertices, UINT nMaxIndices, UINT nStride, LPDIRECT3DDEVICE9 pDevice,
+						DWORD dwID, KPCACHESTATS *pStats, FILE *pLog);
+		~KPD3DStreamRing(void);
+
+		// Copies the vertices and indices of a flushed cache into the ring, returns the position of the first ones
+		HRESULT	Write(const void *pVertices, UINT nVertices, const WORD *pIndices, UINT nIndices,
+					  UINT *pnBaseVertex, UINT *pnStartIndex);
+
+		// Issues the fence of the data written since the last one, called at the end of every frame
+		void	EndFrame(void);
+
+		// Retrieves the buffers and the ID the active cache flag of the vertex cache manager holds
+		LPDIRECT3DVERTEXBUFFER9	GetVB(void);
+		LPDIRECT3DINDEXBUFFER9	GetIB(void);
+		DWORD					GetID(void);
+
+	private:
+		LPDIRECT3DVERTEXBUFFER9	m_pVB;				// Vertex ring
+		LPDIRECT3DINDEXBUFFER9	m_pIB;				// Index ring
+		LPDIRECT3DDEVICE9		m_pDevice;			// Rendering Device
+		DWORD					m_dwID;				// Active cache ID of the caches using the ring
+		UINT					m_nStride;			// Size of one vertex
+		KPCACHESTATS			*m_pStats;			// Counters of the cache pool, the wraps and stalls are counted here
+		FILE					*m_pLog;			// Log file
+
+		UINT					m_numVertices;		// Size of the vertex ring
+		UINT					m_numIndices;		// Size of the index ring
+		UINT					m_nVertexPos;		// Next vertex written
+		UINT					m_nIndexPos;		// Next index written
+		UINT					m_nVertexUsed;		// Vertices not retired, the skipped ends included
+		UINT					m_nIndexUsed;		// Indices not retired, the skipped ends included
+		UINT					m_nFrameVertices;	// Vertices taken since the last fence
+		UINT					m_nFrameIndices;	// Indices taken since the last fence
+		bool					m_bFences;			// Does the device support event queries?
+		bool					m_bDiscard;			// Is the next lock a discard? The first one and the wraps without fences
+		KPRINGFENCE				m_Fences[KPRING_FENCES];	// Issued fences, oldest first from m_nFirstFence
+		UINT					m_nFirstFence;		// Oldest fence not retired
+		UINT					m_numFences;		// Fences not retired
+
+		void	Log(char *chFormat, ... );
+
+		// Issues a fence of the data taken since the last one
+		void	IssueFence(void);
+
+		// Waits for the oldest fence and frees the data written before it
+		void	RetireFence(void);
+
+}; // ! KPD3D Stream Ring
+
+
 // Vertex Cache ////
 ////////////////////
 //
@@ -36,7 +129,8 @@ class KPD3DVertexCache
 
 	public:
 		KPD3DVertexCache(UINT nMaxVertices, UINT nMaxIndices, UINT nStride, KPD3DSkinManager *pSkinManager,
-						 LPDIRECT3DDEVICE9 pDevice, KPD3DVertexCacheManager *pVCM, DWORD dwID, DWORD dwFVF, FILE * pLog);
+						 LPDIRECT3DDEVICE9 pDevice, KPD3DVertexCacheManager *pVCM, KPD3DStreamRing *pRing, DWORD dwFVF,
+						 KPCACHESTATS *pStats, FILE * pLog);
 		~KPD3DVertexCache(void);
 
 		// This is the actual rendering call. Renders the contents of a vertex cache object
@@ -45,12 +139,24 @@ class KPD3DVertexCache
 		// Appends data to the buffer, vetrices or vertices and indices.
 		HRESULT	Add(UINT nVertices, UINT nIndices, const void *pVertices, const WORD *pIndices);
 
+		// Appends the indices and returns a pointer to the cached vertices, where the caller writes the vertices.
+		HRESULT	Reserve(UINT nVertices, UINT nIndices, const WORD *pIndices, void **ppVertices);
+
+		// Releases the vertices reserved by Reserve, they are written
+		void	Commit(void);
+
+		// Determines whether reserved vertices are waiting to be written
+		bool	IsReserved(void);
+
 		// Changes the skin Id of the vertex cache object
 		void	SetSkin(UINT nSkinID);
 
 		// Determines whether the vertex cache uses the specified texture
 		bool	UsesSkin(UINT nSkinID);
 
+		// Retrieves the skin ID of the vertex cache, KPNOTEXTURE if it has none
+		UINT	GetSkinID(void);
+
 		// Determines whether the vertex cache is empty
 		bool	IsEmpty(void);
 
@@ -58,11 +164,11 @@ class KPD3DVertexCache
 		int		GetNumVertices(void);
 
 	private:
-		LPDIRECT3DVERTEXBUFFER9	m_pVB;				// Vertex buffer
-		LPDIRECT3DINDEXBUFFER9	m_pIB;				// Index buffer
+		KPD3DStreamRing			*m_pRing;			// Vertex and index buffers the cache is flushed into
+		KPAlignedArray<BYTE>	m_Vertices;			// Cached vertices
+		KPAlignedArray<WORD>	m_Indices;			// Cached indices
 		LPDIRECT3DDEVICE9		m_pDevice;			// Rendering Device
 		KPSKIN					m_Skin;				// Skin the vertices use
-		DWORD					m_dwID;				// Id of the active vertex cache
 		DWORD					m_dwFVF;			// Combination of FVF format flags defining the format of the vertices
 		UINT					m_nSkinID;			// Skin ID
 
@@ -72,15 +178,96 @@ class KPD3DVertexCache
 
 		UINT					m_numMaxVertices;	// Number of maximum vertices to cache into a single batch
 		UINT					m_numMaxIndices;	// Number of maximum indices to cache into a single batch
-		UINT					m_numVertices;		// Actual number of vertices in the vertex buffer
-		UINT					m_numIndices;		// Actual number of indices int he index buffer
+		UINT					m_numVertices;		// Actual number of cached vertices
+		UINT					m_numIndices;		// Actual number of cached indices
 		UINT					m_nStride;			// Size of one vertex
+		BYTE					*m_pReserved;		// First vertex reserved by Reserve, NULL if every reserved vertex is written
+		KPCACHESTATS			*m_pStats;			// Counters of the cache pool, the flushes are counted here
+		KPCACHEDRAW				m_Draws[KPMAXDRAWS];	// Base-vertex draws of the cached batches
+		UINT					m_numDraws;			// Number of draws, 0 if the cache is empty
 
 		void	Log(char *chFormat, ... );
 
+		// Writes the indices of a batch appended after the cached vertices
+		void	WriteIndices(WORD *pDest, UINT nVertices, UINT nIndices, const WORD *pIndices);
+
 }; // ! KPD3D Vertex Cache
 
 
+// Cache Pool ////
+//////////////////
+//
+// The dynamic caches of one vertex type. A hash table maps the skins to
+// the caches using them, so Render finds the cache of a skin without
+// looking at the others. The caches are only scanned on a miss, when the
+// eviction policy picks the cache that gets the new skin.
+
+// Slot of the skin to cache hash table
+typedef struct KPCACHESLOT
+{
+	UINT	nSkinID;				// Skin of the cache
+	UINT	nCache;					// Index of the cache in the pool, KPNOCACHE if the slot is free
+
+} KPCACHESLOT;
+
+typedef struct KPCACHEPOOL
+{
+	KPD3DVertexCache	**pCaches;	// Dynamic caches
+	KPD3DStreamRing		*pRing;		// Vertex and index buffers shared by the caches
+	UINT				*pLastUse;	// Request clock of the last request each cache served, for CP_LRU
+	UINT				*pUses;		// Requests each cache served since it got its skin, for CP_LFU
+	UINT				numCaches;	// Number of caches
+	KPCACHESLOT			*pSlots;	// Skin to cache hash table, open addressing with linear probing
+	UINT				nSlotMask;	// Number of slots - 1, a power of two at least twice the number of caches
+	UINT				nSlotShift;	// 32 - log2 of the number of slots, the hash keeps the high bits
+	UINT				nStride;	// Size of one vertex
+	DWORD				dwFVF;		// FVF flags of the vertices
+	KPCACHESTATS		Stats;		// Counters since the last ResetCacheStats
+
+} KPCACHEPOOL;
+
+
+// Render Queue ////
+////////////////////
+//
+// In deferred mode the Render calls are recorded with a sort key and
+// executed in key order when the queue is flushed, so the draws of a skin
+// follow each other and its states are bound once. The sort keys, from the
+// most significant bit:
+//
+//	opaque:			0 | vertex type (2) | skin (16) | static buffer (16) | depth (24)		| 0 (5)
+//	transparent:	1 | inverted depth (24) | vertex type (2) | skin (16) | static buffer (16) | 0 (5)
+//
+// The opaque draws come first, near to far within a skin, the transparent
+// ones after them, far to near. The dynamic draws have 0xFFFF as static buffer.
+
+#define KPQUEUE_DYNAMIC		0xFFFF		// Static buffer field of the dynamic draws
+#define KPQUEUE_DEPTHBITS	24			// Bits of the quantized depth
+
+// Draw recorded in deferred mode
+typedef struct KPQUEUEITEM
+{
+	UINT		nSBufferID;		// Static buffer, KPQUEUE_DYNAMIC for vertices copied from a user pointer
+	KPVERTEXID	VertexID;		// Type of the dynamic vertices
+	UINT		nSkinID;		// Skin of the dynamic vertices
+	UINT		nVertices;		// Number of dynamic vertices
+	UINT		nIndices;		// Number of dynamic indices
+	bool		bIndices;		// Were indices supplied?
+	UINT		nData;			// Offset of the copied vertices in the queue data, the indices follow them
+	UINT		nWorld;			// Index of the World matrix of the draw
+
+} KPQUEUEITEM;
+
+// Sort key of a recorded draw
+typedef struct KPQUEUEKEY
+{
+	UINT64		nKey;			// Sort key
+	UINT		nItem;			// Index of the draw in the queue
+	UINT		nPad;
+
+} KPQUEUEKEY;
+
+
 // Vertex Cache Manager ////
 ////////////////////////////
 //
@@ -91,7 +278,7 @@ class KPD3DVertexCacheManager : public KPVertexCacheManager
 {
 	public:
 		KPD3DVertexCacheManager(KPD3DSkinManager *pSkinManager, LPDIRECT3DDEVICE9 pDevice, KPD3D *pKPD3D,
-								UINT numMaxVertices, UINT numMaxIndices, FILE *pLog);
+								UINT numMaxVertices, UINT numMaxIndices, UINT numCaches, FILE *pLog);
 		~KPD3DVertexCacheManager(void);
 
 		// Creates a static buffer and fills it with data. The index pointer is optional. Returns an ID to the
@@ -99,21 +286,65 @@ class KPD3DVertexCacheManager : public KPVertexCacheManager
 		HRESULT	CreateStaticBuffer(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
 								   const void *pVertices, const WORD *pIndices, UINT *pSBufferID);
 
+		// Creates a static buffer from 32-bit indices, with 16-bit indices if they are enough, otherwise
+		// with 32-bit indices or split into chunks depending on the index mode
+		HRESULT	CreateStaticBuffer32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+									 const void *pVertices, const UINT *pIndices, UINT *pSBufferID);
+
+		// Sets whether the static buffers above 65536 vertices get 32-bit indices or are split
+		void	SetIndexMode(KPINDEXMODE Mode);
+
 		// Renders from user pointer, automatically creates dynamic buffer, uses caching for better performance
 		HRESULT	Render(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
 					   const void *pVertices, const WORD *pIndices);
+
+		// Renders from user pointer with 32-bit indices, the lists too large for a cache are split
+		HRESULT	Render32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+						 const void *pVertices, const UINT *pIndices);
 		
 		// Renders the static buffer
 		HRESULT Render(UINT nSBufferID);
 
+		// Reserves room for vertices in a dynamic buffer, the caller (or its worker threads) writes the
+		// vertices to the returned pointer. Only Reserve can be called until Commit is called.
+		HRESULT	Reserve(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+						const WORD *pIndices, void **ppVertices);
+
+		// Unlocks the dynamic buffers locked by Reserve, their vertices are rendered with the cache from now on
+		HRESULT	Commit(void);
+
+		// Changes the number of dynamic caches of a vertex type, the old caches are flushed
+		HRESULT	SetNumCaches(KPVERTEXID VertexID, UINT numCaches);
+
+		// Sets the policy choosing the cache to flush when no cache uses the skin
+		void	SetCachePolicy(KPCACHEPOLICY Policy);
+
+		// Retrieves the counters of the dynamic caches of a vertex type
+		HRESULT	GetCacheStats(KPVERTEXID VertexID, KPCACHESTATS *pStats);
+
+		// Resets the counters of every vertex type and of the queue
+		void	ResetCacheStats(void);
+
+		// Turns the deferred render queue on or off, the queue is executed when turned off
+		void	SetDeferred(bool bDeferred);
+
+		// Determines whether the Render calls are recorded into the queue
+		bool	IsDeferred(void);
+
+		// Retrieves the counters of the queue and of the state bindings
+		void	GetQueueStats(KPQUEUESTATS *pStats);
+
 		// Forces all cached dynamic data of a vertex type to be rendered immediately
 		// Usually used to render data before changing major rendering settings (for example render state or projection matrices)
 		HRESULT ForcedFlush(KPVERTEXID VertexID);
 
-		// Forces all cached dynamic data of all vertex types to be rendered immediately
+		// Forces all cached dynamic data of all vertex types and the queued draws to be rendered immediately
 		// Usually used to render data before changing major rendering settings (for example render state or projection matrices)
 		HRESULT	ForcedFlushAll(void);
 
+		// Fences the data the caches wrote into the rings during the frame, called by EndRendering
+		void	EndFrame(void);
+
 		// Resets all the active skin, static- and dynamic buffer flags
 		void    InvalidateStates(void);
 
@@ -129,6 +360,10 @@ class KPD3DVertexCacheManager : public KPVertexCacheManager
 		// Retrieves the Shading/Filling mode the Direct3D device uses
 		KPRENDERSTATE	GetShadeMode(void);
 
+		// Counts the state bindings of a dynamic cache
+		void			CountSkinChange(void);
+		void			CountBufferChange(void);
+
 	private:
 		// Interfaces
 		KPD3DSkinManager	*m_pSkinManager;			// Pointer to the Skin Manager
@@ -137,16 +372,68 @@ class KPD3DVertexCacheManager : public KPVertexCacheManager
 		
 		// Cache objects
 		KPSTATICBUFFER		*m_pSB;						// Static Buffer
-		KPD3DVertexCache	*m_CacheUU[KPNUMCACHES];	// Untransformed, Unlit dynamic vertex cache
-		KPD3DVertexCache	*m_CacheUL[KPNUMCACHES];	// Untransformed, lit dynamic vertex cache
+		KPCACHEPOOL			m_Pools[2];					// Dynamic vertex caches, VID_UU (untransformed, unlit) and VID_UL (untransformed, lit)
+		KPCACHEPOLICY		m_Policy;					// Chooses the cache to flush on a miss
+		UINT				m_nClock;					// Request counter, the time of the LRU policy
 
 		UINT				m_numSB;					// Number of static buffers
+		UINT				m_numMaxVertices;			// Vertices of a dynamic cache
+		UINT				m_numMaxIndices;			// Indices of a dynamic cache
+		DWORD				m_dwNextID;					// ID of the next dynamic cache created
 		DWORD				m_dwActiveCache;			// Active dynamic vertex cache ID
 		DWORD				m_dwActiveSB;				// Active static buffer ID
 		FILE				*m_pLog;					// Log file
 
+		// Render queue
+		bool						m_bDeferred;		// Are the Render calls recorded?
+		KPAlignedArray<KPQUEUEITEM>	m_Queue;			// Recorded draws
+		KPAlignedArray<KPQUEUEKEY>	m_QueueKeys;		// Sort keys of the draws
+		KPAlignedArray<KPQUEUEKEY>	m_QueueSorted;		// Second buffer of the radix sort
+		KPAlignedArray<BYTE>		m_QueueData;		// Vertices and indices of the dynamic draws
+		KPAlignedArray<D3DMATRIX>	m_QueueWorlds;		// World matrices of the draws
+		KPQUEUESTATS				m_QueueStats;		// Counters since the last ResetCacheStats
+
+		// 32-bit indices
+		KPINDEXMODE					m_IndexMode;		// Index size of the large static buffers
+		bool						m_bIndex32;			// Does the device support 32-bit indices?
+		UINT						m_nMaxVertexIndex;	// Largest vertex index the device can draw, D3DCAPS9::MaxVertexIndex
+		KPAlignedArray<UINT>		m_SplitLocal;		// Index of each source vertex in the chunk being built
+		KPAlignedArray<UINT>		m_SplitStamp;		// Chunk that set the local index, the older ones are stale
+		UINT						m_nSplitStamp;		// Stamp of the chunk being built
+		KPAlignedArray<BYTE>		m_SplitVertices;	// Vertices of the chunk
+		KPAlignedArray<WORD>		m_SplitIndices;		// 16-bit indices of the chunk
+
 		void			Log(char* chFormat, ...);
 
+		// Cache pools
+		KPCACHEPOOL*	GetPool(KPVERTEXID VertexID);
+		void			CreatePool(KPCACHEPOOL *pPool, UINT numCaches);
+		void			ReleasePool(KPCACHEPOOL *pPool);
+		UINT			FindCache(const KPCACHEPOOL *pPool, UINT nSkinID);
+		void			MapSkin(KPCACHEPOOL *pPool, UINT nSkinID, UINT nCache);
+		void			UnmapSkin(KPCACHEPOOL *pPool, UINT nSkinID, UINT nCache);
+		UINT			ChooseCache(const KPCACHEPOOL *pPool, bool bSkipReserved);
+		void			AssignSkin(KPCACHEPOOL *pPool, UINT nCache, UINT nSkinID);
+
+		// Immediate rendering, the queue is executed with these
+		HRESULT			RenderDynamic(KPCACHEPOOL *pPool, UINT nSkinID, UINT nVertices, UINT nIndices,
+									  const void *pVertices, const WORD *pIndices);
+		HRESULT			RenderStatic(UINT nSBufferID);
+
+		// Render queue
+		HRESULT			Enqueue(UINT nSBufferID, KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+								const void *pVertices, const WORD *pIndices);
+		HRESULT			ExecuteQueue(void);
+		HRESULT			FlushCaches(void);
+
+		// Static buffers and splitting
+		HRESULT			CreateStaticChunk(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+										  const void *pVertices, const void *pIndices, bool bIndex32, UINT *pSBufferID);
+		HRESULT			RenderChunk(UINT nSBufferID);
+		bool			PrepareSplit(UINT nVertices, UINT nStride, UINT nMaxVertices, UINT nMaxIndices);
+		UINT			SplitChunk(const BYTE *pVertices, UINT nStride, const UINT *pIndices, UINT nIndices, UINT nStart,
+								   UINT nMaxVertices, UINT nMaxIndices, UINT *pnVertices, UINT *pnIndices);
+
 }; // ! Vertex Cache Manager
 
 // Static Buffer Structure ////
@@ -154,8 +441,11 @@ class KPD3DVertexCacheManager : public KPVertexCacheManager
 typedef struct KPSTATICBUFFER
 {
 	int		nStride;				// Size of one vertex
+	KPVERTEXID VertexID;			// Vertex type
 	UINT	nSkinID;				// ID of the skin used by these vertices
 	bool	bIndices;				// Are they using index list?
+	bool	bIndex32;				// Are the indices 32-bit?
+	UINT	nNext;					// Next chunk of a split mesh, KPNOCHUNK if none
 	int		numVertices;			// Number of vertices
 	int		numIndices;				// Number of indices
 	int		numTriangles;			// Number of triangles
@@ -17,6 +17,11 @@ bool KPD3DVertexCache::UsesSkin(UINT nSkinID)
 	return (m_nSkinID == nSkinID);
 }
 
+UINT KPD3DVertexCache::GetSkinID(void)
+{
+	return m_nSkinID;
+}
+
 bool KPD3DVertexCache::IsEmpty(void)
 {
 	if ( 0 < m_numVertices )
@@ -30,6 +35,11 @@ int KPD3DVertexCache::GetNumVertices(void)
 	return m_numVertices;
 }
 
+bool KPD3DVertexCache::IsReserved(void)
+{
+	return (m_pReserved != NULL);
+}
+
 // Log Function ////
 ////////////////////
 void KPD3DVertexCache::Log(char *chFormat, ...)
@@ -68,27 +78,29 @@ void KPD3DVertexCache::Log(char *chFormat, ...)
 		pSkinmanager	: Address of a KPD3DSkinManager object
 		pDevice			: Address of a Direct3D9 device
 		pVCM			: Address of a KPD3DVertexCacheManager object managing this cache
-		dwID			: DWORD type value specifying the ID of this vertex cache
+		pRing			: Address of the stream ring of the vertex type, the cache is flushed into it
 		dwFVF			: DWORD type value specifying a combination of FVF format flags defining the format of the vertices
+		pStats			: Address of the counters of the cache pool, the flushes are counted in it. Optional, can be NULL
 		pLog			: Address of a FILE object used for logging important messages
 */
 KPD3DVertexCache::KPD3DVertexCache(UINT nMaxVertices, UINT nMaxIndices, UINT nStride, KPD3DSkinManager *pSkinManager, 
-								   LPDIRECT3DDEVICE9 pDevice, KPD3DVertexCacheManager *pVCM, DWORD dwID, DWORD dwFVF, FILE *pLog)
+								   LPDIRECT3DDEVICE9 pDevice, KPD3DVertexCacheManager *pVCM, KPD3DStreamRing *pRing, DWORD dwFVF,
+								   KPCACHESTATS *pStats, FILE *pLog)
 {
 	m_pDevice			= pDevice;
 	m_pSkinManager		= pSkinManager;
 	m_pVCM				= pVCM;
+	m_pRing				= pRing;
 	m_numMaxVertices	= nMaxVertices;
 	m_numMaxIndices		= nMaxIndices;
 	m_numVertices		= 0;
 	m_numIndices		= 0;
-	m_dwID				= dwID;
+	m_dwFVF				= dwFVF;
 	m_nStride			= nStride;
 	m_pLog				= pLog;
-	m_pVB				= NULL;
-	m_pIB				= NULL;
-
-	HRESULT	hr;
+	m_pReserved			= NULL;
+	m_pStats			= pStats;
+	m_numDraws			= 0;
 
 	// Set the skin to KPNOTEXTURE, being an impossible value to get serving as 'NULL'
 	m_Skin.nMaterial = KPNOTEXTURE;
@@ -97,39 +109,14 @@ KPD3DVertexCache::KPD3DVertexCache(UINT nMaxVertices, UINT nMaxIndices, UINT nSt
 
 	m_nSkinID = KPNOTEXTURE;
 
-	// Create a non FVF dynamic & write only vertex buffer
-	hr = pDevice->CreateVertexBuffer(nMaxVertices * nStride, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 
-									 0, D3DPOOL_DEFAULT, &m_pVB, NULL);
-
-	if ( FAILED(hr) )
-	{
-		Log("Unable to create vertex buffer");
-		m_pVB	= NULL;
-	}
-
-	// Create a dynamic & write only index buffer
-	hr = pDevice->CreateIndexBuffer(nMaxIndices * sizeof(WORD), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 
-									D3DFMT_INDEX16, D3DPOOL_DEFAULT, &m_pIB, NULL);
-	if ( FAILED(hr) )
-	{
-		Log("Unable to create index buffer");
-		m_pIB	= NULL;
-	}
+	// The vertices and indices are collected in system memory, the ring gets them upon flushing
+	if ( ! m_Vertices.Reserve(nMaxVertices * nStride) || ! m_Indices.Reserve(nMaxIndices) )
+		Log("Unable to allocate the cache memory");
 
 } // ! KPD3DVertexCache
 
 KPD3DVertexCache::~KPD3DVertexCache(void)
 {
-	if ( m_pVB )
-	{
-		m_pVB->Release();
-		m_pVB = NULL;
-	}
-	if ( m_pIB )
-	{
-		m_pIB->Release();
-		m_pIB = NULL;
-	}
 }
 
 // SetSkin ////
@@ -179,13 +166,12 @@ void KPD3DVertexCache::SetSkin(UINT nSkinID)
 */
 HRESULT KPD3DVertexCache::Add(UINT nVertices, UINT nIndices, const void *pVertices, const WORD *pIndices)
 {
-	DWORD	dwFlags;							// Flags for D3D
-	WORD	*tmpI	= NULL;						// Pointer to index buffer
-	BYTE	*tmpV	= NULL;						// Pointer to vertex buffer
-	int		nSizeV	= m_nStride * nVertices;	// Size of the vertex data
-	int		nSizeI	= sizeof(WORD) * nIndices;  // Size of the index data
-	int		nPosV;								// Vertex index 
-	int		nPosI;								// Index index :)
+	// Only Reserve can be called until Commit, the reserved vertices are written
+	if ( IsReserved() )
+		Commit();
+
+	if ( ! pIndices )
+		nIndices = nVertices;					// if no index list is supplied, the number of indices = number of verticles
 
 	// First check if the data fits into our bffer
 	if ( nVertices > m_numMaxVertices || nIndices > m_numMaxIndices )
@@ -194,6 +180,9 @@ HRESULT KPD3DVertexCache::Add(UINT nVertices, UINT nIndices, const void *pVertic
 		return KP_BUFFERSIZE;
 	}
 
+	if ( ! m_Vertices.GetData() || ! m_Indices.GetData() )
+		return KP_OUTOFMEMORY;
+
 	// Now check whether the data fits into our current cache
 	// or we will have to flush it out first
 	if ( (nVertices+m_numVertices > m_numMaxVertices) || (nIndices+m_numIndices > m_numMaxIndices ) )
@@ -205,95 +194,176 @@ HRESULT KPD3DVertexCache::Add(UINT nVertices, UINT nIndices, const void *pVertic
 		}
 	}
 
-	// If the cache is totally empty
-	// we ask Direct3D to discard the current cache memory upon lock
-	if ( m_numVertices == 0 )
-	{
-		// reset the indices
-		nPosV = nPosI = 0;
+	// Now we can append our vertex data to the cached vertices,
+	// the buffers are only locked when the cache is flushed
+	memcpy(m_Vertices.GetData() + m_nStride * m_numVertices, pVertices, m_nStride * nVertices);
 
-		// Set the discard flag
-		dwFlags = D3DLOCK_DISCARD;
-	}
-	// Otherwise prepare for appending data
-	else
-	{
-		nPosV = m_nStride	 * m_numVertices;
-		nPosI = sizeof(WORD) * m_numIndices;
+	// And the index data to the cached indices, this updates the counters
+	WriteIndices(m_Indices.GetData() + m_numIndices, nVertices, nIndices, pIndices);
 
-		// Make sure we are not overwriting anything. This speeds up appending a bit on D3D's part.
-		dwFlags = D3DLOCK_NOOVERWRITE;
-	}
+	return KP_OK;
+
+} // ! Add
+
+
+// Reserve ////
+///////////////
+/*
+	Appends index data to the cache and returns a pointer to the cached vertices, so
+	they can be written directly (e.g. by the skinning worker threads) instead of
+	copying them from a user pointer. The reserved vertices are not written until
+	Commit is called, the cache can't be flushed before, so more vertices can be
+	reserved only until the cache is full.
+
+	Params:
+		nVertices		: UINT type value specifying the number of vertices to reserve
+		nIndices		: UINT type value specifying the number of indices to add to the cache
+		pIndices		: Pointer to an index list relative to the reserved vertices. This value is optional.
+						  If no index list is available, use NULL.
+		ppVertices		: Receives the address of the reserved vertices
+
+	Returns:
+		KP_INVALIDPARAM if the data can never fit into the cache,
+		KP_BUFFERSIZE if the reserved cache is full, Commit has to be called before reserving more
+*/
+HRESULT KPD3DVertexCache::Reserve(UINT nVertices, UINT nIndices, const WORD *pIndices, void **ppVertices)
+{
+	if ( ! pIndices )
+		nIndices = nVertices;					// if no index list is supplied, the number of indices = number of verticles
 
-	// Lock the vertex cache and obtain pointers to the buffer memories
-	if ( FAILED( m_pVB->Lock(nPosV, nSizeV, (void**)&tmpV, dwFlags) ) )
+	// First check if the data fits into our buffer at all
+	if ( nVertices > m_numMaxVertices || nIndices > m_numMaxIndices )
 	{
-		Log("Add: Unable to lock the vertex buffer");
-		return KP_BUFFERLOCK;
+		Log("Reserve: Data can't fit into cache! nV:%d // %d, nI:%d // %d", nVertices, m_numMaxVertices, nIndices, m_numMaxIndices);
+		return KP_INVALIDPARAM;
 	}
 
-	if ( FAILED( m_pIB->Lock(nPosI, nSizeI, (void**)&tmpI, dwFlags) ) )
+	if ( ! m_Vertices.GetData() || ! m_Indices.GetData() )
+		return KP_OUTOFMEMORY;
+
+	// Now check whether the data fits into our current cache
+	if ( (nVertices+m_numVertices > m_numMaxVertices) || (nIndices+m_numIndices > m_numMaxIndices ) )
 	{
-		Log("Add: Unable to lock the index buffer");
-		return KP_BUFFERLOCK;
+		// The reserved vertices are not written yet, we can't flush them
+		if ( IsReserved() )
+			return KP_BUFFERSIZE;
+
+		if ( FAILED( Flush() ) )
+		{
+			Log("Reserve: Unable to flush vertex cache");
+			return KP_FAIL;
+		}
 	}
 
+	// The vertices are written by the caller
+	m_pReserved = m_Vertices.GetData() + m_nStride * m_numVertices;
+	*ppVertices = m_pReserved;
 
-	// Now we can append our vertex data to the vertex buffer
-	memcpy(tmpV, pVertices, nSizeV);
-	m_numVertices += nVertices;					// update the number of verticles
+	// Append the indices, this updates the counters
+	WriteIndices(m_Indices.GetData() + m_numIndices, nVertices, nIndices, pIndices);
 
-	// And the index data to the index buffer
-	int nLastIndex = m_numIndices;				// The latest index of the cache
+	return KP_OK;
 
-	if ( ! pIndices )
-		nIndices = nVertices;					// if no index list is supplied, the number of indices = number of verticles
+} // ! Reserve
 
-	for (UINT i = 0; i < nIndices; ++i)
-	{
-		if ( pIndices != NULL )
-			tmpI[i] = pIndices[i] + nLastIndex; // Last index of old cache + this index
-		else
-			tmpI[i] = i + nLastIndex;			// Else just increment the last index of the old cache by i
 
-		++m_numIndices;							// update the number of indexes
+// WriteIndices ////
+////////////////////
+/*
+	Writes the indices of a batch whose vertices follow the cached ones and updates
+	the counters. DrawIndexedPrimitive adds the base vertex of a draw to its indices,
+	so the indices of a batch are either copied unchanged into a new draw starting at
+	its first vertex, or rebased onto the last draw by the SIMD kernels. Rebasing a
+	batch costs far less than a draw call, only the first batch of the cache and the
+	batches of at least KPBASEDRAW_MIN indices get a draw of their own.
+
+	Params:
+		pDest			: Address of the cached indices of the batch
+		nVertices		: UINT type value specifying the number of vertices of the batch
+		nIndices		: UINT type value specifying the number of indices of the batch
+		pIndices		: Pointer to an index list relative to the vertices of the batch, NULL for consecutive indices
+*/
+void KPD3DVertexCache::WriteIndices(WORD *pDest, UINT nVertices, UINT nIndices, const WORD *pIndices)
+{
+	// Base-vertex draws only save the copy of indices supplied by the caller
+	if ( m_numDraws == 0 || ( pIndices && nIndices >= KPBASEDRAW_MIN && m_numDraws < KPMAXDRAWS ) )
+	{
+		m_Draws[m_numDraws].nBaseVertex	= m_numVertices;
+		m_Draws[m_numDraws].nStartIndex	= m_numIndices;
+		m_Draws[m_numDraws].nIndices	= 0;
+		++m_numDraws;
 	}
 
+	KPCACHEDRAW *pDraw	 = &m_Draws[m_numDraws - 1];
+	UINT		nOffset	 = m_numVertices - pDraw->nBaseVertex;
 
-	// Finally, unlock the buffers
-	m_pVB->Unlock();
-	m_pIB->Unlock();
+	if ( ! pIndices )
+		KPSequenceIndices(pDest, nIndices, nOffset);
+	else if ( nOffset == 0 )
+		memcpy(pDest, pIndices, sizeof(WORD) * nIndices);
+	else
+		KPRebaseIndices(pIndices, pDest, nIndices, nOffset);
 
-	return KP_OK;
+	pDraw->nIndices	+= nIndices;
+	m_numVertices	+= nVertices;
+	m_numIndices	+= nIndices;
+
+} // ! WriteIndices
 
-} // ! Add
+
+// Commit ////
+//////////////
+/*
+	Releases the vertices reserved by Reserve, the cache can be flushed again.
+	The reserved vertices must be written before calling it.
+*/
+void KPD3DVertexCache::Commit(void)
+{
+	m_pReserved = NULL;
+
+} // ! Commit
 
 
 // Flush ////
 /////////////
 /*
-	Sends the content of the cache to the renderer device and
-	resets the cache to accept new content.
+	Copies the content of the cache into the stream ring of its vertex type,
+	sends it to the renderer device and resets the cache to accept new content.
 */
 HRESULT KPD3DVertexCache::Flush()
 {
 	KPRENDERSTATE rs = m_pVCM->GetKPD3D()->GetShadeMode();
+	UINT		  nBaseVertex;		// Position of the vertices in the ring
+	UINT		  nStartIndex;		// Position of the indices in the ring
+
+	// The reserved vertices are written by now
+	if ( IsReserved() )
+		Commit();
 
 	// Is there any data in the cache to render?
 	if ( m_numVertices <= 0 )
 		return KP_OK;
 
-	// Is this the active cache?
-	if ( m_pVCM->GetActiveCache() != m_dwID )
+	// Copy the data into the ring, one lock of each buffer for the whole cache
+	if ( FAILED( m_pRing->Write(m_Vertices.GetData(), m_numVertices, m_Indices.GetData(), m_numIndices,
+								&nBaseVertex, &nStartIndex) ) )
+	{
+		Log("Flush: Unable to write the stream ring");
+		return KP_FAIL;
+	}
+
+	// Are the buffers of the ring active? The caches of a vertex type share them
+	if ( m_pVCM->GetActiveCache() != m_pRing->GetID() )
 	{
 		// Set Flexible Vertex Format flags
 		m_pDevice->SetFVF(m_dwFVF);
 
-		m_pDevice->SetIndices(m_pIB);						// Set the index data
-		m_pDevice->SetStreamSource(0, m_pVB, 0, m_nStride); // Binds the vertex buffer to the 0th device data stream
+		m_pDevice->SetIndices(m_pRing->GetIB());						// Set the index data
+		m_pDevice->SetStreamSource(0, m_pRing->GetVB(), 0, m_nStride);	// Binds the vertex buffer to the 0th device data stream
 
 		// Make this the active cache
-		m_pVCM->SetActiveCache(m_dwID);
+		m_pVCM->SetActiveCache(m_pRing->GetID());
+		m_pVCM->CountBufferChange();
 
 	} // ! if not active cache
 
@@ -387,6 +457,7 @@ HRESULT KPD3DVertexCache::Flush()
 
 		// Make this the active skin
 		m_pVCM->GetKPD3D()->SetActiveSkinID(m_nSkinID);
+		m_pVCM->CountSkinChange();
 	
 	} // ! if not active skin
 
@@ -395,52 +466,68 @@ HRESULT KPD3DVertexCache::Flush()
 	//	 RENDERING
 	////
 
-	// Choose which primite type to render
-
-	switch ( rs )
+	// Render POINT, the vertices need no indices
+	if ( rs == RS_SHADE_POINTS )
 	{
-	// Render POINT
-	case RS_SHADE_POINTS:
-		if ( FAILED( m_pDevice->DrawPrimitive(D3DPT_POINTLIST, 0, m_numVertices) ) )
+		if ( FAILED( m_pDevice->DrawPrimitive(D3DPT_POINTLIST, nBaseVertex, m_numVertices) ) )
 		{
 			Log("Flush: Unable to render point list");
 			return KP_FAIL;
 		}
-		break;
+	}
 
-	// Render LINE LIST
-	case RS_SHADE_LINES:
-		if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_LINELIST, 0, 0, m_numVertices, 0, m_numIndices/2) ) )
-		{
-			Log("Flush: Unable to render hull wireframe linestip");
-			return KP_FAIL;
-		}
-		break;
+	// One indexed draw per base vertex
+	for ( UINT d = 0; rs != RS_SHADE_POINTS && d < m_numDraws; ++d )
+	{
+		const KPCACHEDRAW &Draw = m_Draws[d];
 
-	// Render HULL WIREFRAME LINESTRIP
-	case RS_SHADE_HULLWIRE:
-		if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_LINESTRIP, 0, 0, m_numVertices, 0, m_numVertices) ) )
-		{
-			Log("Flush: Unable to render hull wireframe linestip");
-			return KP_FAIL;
-		}
-		break;
+		// The draw uses the vertices up to the base of the next one
+		UINT nVertices	= ( ( d + 1 < m_numDraws ) ? m_Draws[d + 1].nBaseVertex : m_numVertices ) - Draw.nBaseVertex;
+		INT	 nBase		= nBaseVertex + Draw.nBaseVertex;
+		UINT nStart		= nStartIndex + Draw.nStartIndex;
+
+		// Choose which primite type to render
 
-	// RENDER SOLID OR WIREFRAME POLYGON
-	case RS_SHADE_SOLID:
-	case RS_SHADE_TRIWIRE:
-	default:
-		if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, m_numVertices, 0, m_numIndices/3) ) )
+		switch ( rs )
 		{
-			Log("Flush: Unable to render triangle wireframe or solid triangle list");
-			return KP_FAIL;
+		// Render LINE LIST
+		case RS_SHADE_LINES:
+			if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_LINELIST, nBase, 0, nVertices, nStart, Draw.nIndices/2) ) )
+			{
+				Log("Flush: Unable to render hull wireframe linestip");
+				return KP_FAIL;
+			}
+			break;
+
+		// Render HULL WIREFRAME LINESTRIP
+		case RS_SHADE_HULLWIRE:
+			if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_LINESTRIP, nBase, 0, nVertices, nStart, nVertices) ) )
+			{
+				Log("Flush: Unable to render hull wireframe linestip");
+				return KP_FAIL;
+			}
+			break;
+
+		// RENDER SOLID OR WIREFRAME POLYGON
+		case RS_SHADE_SOLID:
+		case RS_SHADE_TRIWIRE:
+		default:
+			if ( FAILED( m_pDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, nBase, 0, nVertices, nStart, Draw.nIndices/3) ) )
+			{
+				Log("Flush: Unable to render triangle wireframe or solid triangle list");
+				return KP_FAIL;
+			}
 		}
-	}
 
+	} // ! for draws
+
+	if ( m_pStats )
+		++m_pStats->numFlushes;
 
 	// Reset the cache counters
 	m_numVertices	= 0;
 	m_numIndices	= 0;
+	m_numDraws		= 0;
 
 	return KP_OK;
 
@@ -13,11 +13,101 @@
 #include "KPD3D_vcache.h"
 
 
+// Skin Hash ////
+//////////////////
+//
+// Fibonacci hashing, the skin IDs are small consecutive numbers and the
+// high bits of the product spread them over the whole table.
+static inline UINT KPSkinSlot(const KPCACHEPOOL *pPool, UINT nSkinID)
+{
+	return ( nSkinID * 2654435761u ) >> pPool->nSlotShift;
+}
+
+// Returns true if cache a of the pool is a better cache to give a new skin than cache b
+static bool KPBetterVictim(const KPCACHEPOOL *pPool, KPCACHEPOLICY Policy, UINT a, UINT b)
+{
+	bool bEmptyA = pPool->pCaches[a]->IsEmpty();
+	bool bEmptyB = pPool->pCaches[b]->IsEmpty();
+
+	// An empty cache costs no flush
+	if ( bEmptyA != bEmptyB )
+		return bEmptyA;
+
+	if ( Policy == CP_FULLEST )
+	{
+		int nA = pPool->pCaches[a]->GetNumVertices();
+		int nB = pPool->pCaches[b]->GetNumVertices();
+
+		if ( nA != nB )
+			return ( nA > nB );
+	}
+	else if ( Policy == CP_LFU )
+	{
+		if ( pPool->pUses[a] != pPool->pUses[b] )
+			return ( pPool->pUses[a] < pPool->pUses[b] );
+	}
+
+	// Least recently used, also the tie breaker of the other policies.
+	// The difference keeps the order right when the request clock wraps around.
+	return ( (int)( pPool->pLastUse[a] - pPool->pLastUse[b] ) < 0 );
+}
+
+// Radix Sort ////
+//////////////////
+//
+// LSD radix sort of the queue keys, a byte per pass. The histograms of
+// every byte are counted in one read, and the passes whose byte is the same
+// in every key are skipped (the high depth bytes of a small scene, the
+// vertex type byte). Stable, the draws with equal keys keep their order.
+// Returns the buffer holding the sorted keys, pKeys or pTemp.
+static KPQUEUEKEY* KPRadixSort(KPQUEUEKEY *pKeys, KPQUEUEKEY *pTemp, UINT nCount)
+{
+	UINT nHist[8][256];
+
+	memset(nHist, 0, sizeof(nHist));
+
+	for ( UINT i = 0; i < nCount; ++i )
+	{
+		UINT64 nKey = pKeys[i].nKey;
+
+		for ( UINT b = 0; b < 8; ++b )
+			++nHist[b][ (UINT)( nKey >> ( b * 8 ) ) & 0xFF ];
+	}
+
+	for ( UINT b = 0; b < 8; ++b )
+	{
+		UINT *pHist		= nHist[b];
+		UINT nShift		= b * 8;
+
+		// Every key has the same byte, the order would not change
+		if ( pHist[ (UINT)( pKeys[0].nKey >> nShift ) & 0xFF ] == nCount )
+			continue;
+
+		// Start of each bucket
+		for ( UINT j = 0, nSum = 0; j < 256; ++j )
+		{
+			UINT n	 = pHist[j];
+			pHist[j] = nSum;
+			nSum	+= n;
+		}
+
+		for ( UINT i = 0; i < nCount; ++i )
+			pTemp[ pHist[ (UINT)( pKeys[i].nKey >> nShift ) & 0xFF ]++ ] = pKeys[i];
+
+		KPQUEUEKEY *pSwap = pKeys;
+		pKeys = pTemp;
+		pTemp = pSwap;
+	}
+
+	return pKeys;
+}
+
+
 // KPD3DVertexManager ////
 //////////////////////////
 /*
-	Sets up the initial class attributes and creates two dynamic buffers
-	for rendering primitive lists.
+	Sets up the initial class attributes and creates the dynamic
+	buffers for rendering primitive lists.
 
 	Params:
 		pSkinManager	: Pointer to a KPD3DSkinManager object
@@ -25,180 +115,1001 @@
 		pKPD3D			: Pointer to a Direct3D interface
 		numMaxVertices	: UINT Type value specifying the maximum amount of vertices in the dynamic buffers
 		numMaxVertices	: UINT Type value specifying the maximum amount of indices in the dynamic buffers
+		numCaches		: UINT Type value specifying the number of dynamic buffers of each vertex type, 1 to KPMAXCACHES
 		pLog			: Pointer to a FILE object that can be used for logging data
 */
-KPD3DVertexCacheManager::KPD3DVertexCacheManager(KPD3DSkinManager *pSkinManager, LPDIRECT3DDEVICE9 pDevice, KPD3D *pKPD3D,
-												 UINT numMaxVertices, UINT numMaxIndices, FILE *pLog)
+KPD3DVertexCacheManager::KPD3DVertexCacheManager(KPD3DSkinManager *pSkinManager, LPDIRECT3DDEVICE9 pDevice, KPD3D *pKPD3D,
+												 UINT numMaxVertices, UINT numMaxIndices, UINT numCaches, FILE *pLog)
+{
+	m_pSB			= NULL;
+	m_numSB			= 0;
+	m_pLog			= pLog;
+	m_pDevice		= pDevice;
+	m_pKPD3D		= pKPD3D;
+	m_pSkinManager	= pSkinManager;
+	m_numMaxVertices = numMaxVertices;
+	m_numMaxIndices	= numMaxIndices;
+	m_dwNextID		= 0;
+	m_Policy		= CP_FULLEST;
+	m_nClock		= 0;
+	m_bDeferred		= false;
+	m_IndexMode		= IM_AUTO;
+	m_nSplitStamp	= 0;
+	m_dwActiveCache	= KPNOTEXTURE;	// 65535, this is the maximum a dword can hold
+	m_dwActiveSB	= KPNOTEXTURE;	// 65535, this is the maximum a dword can hold
+
+	if ( numCaches < 1 )			numCaches = 1;
+	if ( numCaches > KPMAXCACHES )	numCaches = KPMAXCACHES;
+
+	memset(m_Pools, 0, sizeof(m_Pools));
+	memset(&m_QueueStats, 0, sizeof(m_QueueStats));
+
+	// 32-bit indices need a device addressing more than 65536 vertices,
+	// without the caps only the 16-bit range is assumed
+	D3DCAPS9 Caps;
+
+	m_nMaxVertexIndex	= SUCCEEDED( pDevice->GetDeviceCaps(&Caps) ) ? Caps.MaxVertexIndex : KPMAX_INDEX16 - 1;
+	m_bIndex32			= ( m_nMaxVertexIndex >= KPMAX_INDEX16 );
+
+	// Untransformed, Unlit vertex buffers
+	m_Pools[VID_UU].nStride	= sizeof(VERTEX);
+	m_Pools[VID_UU].dwFVF	= FVF_VERTEX;
+
+	// Untransformed, lit vertex buffers
+	m_Pools[VID_UL].nStride	= sizeof(LVERTEX);
+	m_Pools[VID_UL].dwFVF	= FVF_LVERTEX;
+
+	// The stream rings of the vertex types, shared by their caches. A draw addresses
+	// base vertex + index, which can't go past the MaxVertexIndex of the device.
+	UINT nRingVertices = KPRING_FLUSHES * numMaxVertices;
+
+	if ( nRingVertices > 0 && nRingVertices - 1 > m_nMaxVertexIndex )
+		nRingVertices = m_nMaxVertexIndex + 1;
+
+	for ( UINT v = VID_UU; v <= VID_UL; ++v )
+	{
+		// KPNOTEXTURE is the invalid active cache ID
+		if ( ++m_dwNextID == KPNOTEXTURE )
+			++m_dwNextID;
+
+		m_Pools[v].pRing = new KPD3DStreamRing(nRingVertices, KPRING_FLUSHES * numMaxIndices, m_Pools[v].nStride,
+											   pDevice, m_dwNextID, &m_Pools[v].Stats, pLog);
+	}
+
+	// Create the caches
+	CreatePool(&m_Pools[VID_UU], numCaches);
+	CreatePool(&m_Pools[VID_UL], numCaches);
+
+	Log("successfully initialized. %u dynamic caches per vertex type, rings of %u vertices, 32-bit indices %s, max vertex index: %u.",
+		numCaches, nRingVertices, m_bIndex32 ? "supported" : "not supported", m_nMaxVertexIndex);
+	
+} // ! Constructor
+
+KPD3DVertexCacheManager::~KPD3DVertexCacheManager(void)
+{
+	UINT n;
+
+	// Free up the static buffers if there is any
+	if ( m_pSB )
+	{
+		for ( n = 0; n < m_numSB; ++n )
+		{
+			// Release the D3D vertex buffer
+			if ( m_pSB[n].pVB )
+			{
+				m_pSB[n].pVB->Release();
+				m_pSB[n].pVB = NULL;
+			}
+			
+			// Release the D3D index buffer
+			if ( m_pSB[n].pIB )
+			{
+				m_pSB[n].pIB->Release();
+				m_pSB[n].pIB = NULL;
+			}
+
+		} // ! for n
+
+		KPAlignedFree( m_pSB );
+		m_pSB = NULL;
+
+	} // ! if SB
+
+	// Release the dynamic vertex caches and their rings
+	ReleasePool(&m_Pools[VID_UU]);
+	ReleasePool(&m_Pools[VID_UL]);
+
+	delete m_Pools[VID_UU].pRing;
+	delete m_Pools[VID_UL].pRing;
+
+	Log("successfully released.");
+
+} // ! Destructor
+
+
+// CreatePool ////
+//////////////////
+/*
+	Creates the dynamic caches of a pool and its empty skin hash table.
+	The stride, the FVF flags and the stream ring of the pool have to be set.
+
+	Parameters:
+		pPool		: Pointer to the pool, it must not have caches
+		numCaches	: UINT type value specifying the number of caches
+*/
+void KPD3DVertexCacheManager::CreatePool(KPCACHEPOOL *pPool, UINT numCaches)
+{
+	// At most half of the slots are used, the probe sequences stay short
+	UINT nSlots = 2;
+	UINT nBits	= 1;
+
+	while ( nSlots < 2 * numCaches )
+	{
+		nSlots *= 2;
+		++nBits;
+	}
+
+	pPool->pCaches		= new KPD3DVertexCache*[numCaches];
+	pPool->pLastUse		= new UINT[numCaches];
+	pPool->pUses		= new UINT[numCaches];
+	pPool->pSlots		= new KPCACHESLOT[nSlots];
+	pPool->numCaches	= numCaches;
+	pPool->nSlotMask	= nSlots - 1;
+	pPool->nSlotShift	= 32 - nBits;
+
+	for ( UINT i = 0; i < numCaches; ++i )
+	{
+		pPool->pCaches[i]	= new KPD3DVertexCache(m_numMaxVertices, m_numMaxIndices, pPool->nStride, m_pSkinManager,
+												   m_pDevice, this, pPool->pRing, pPool->dwFVF, &pPool->Stats, m_pLog);
+		pPool->pLastUse[i]	= 0;
+		pPool->pUses[i]		= 0;
+	}
+
+	for ( UINT i = 0; i < nSlots; ++i )
+	{
+		pPool->pSlots[i].nSkinID	= KPNOTEXTURE;
+		pPool->pSlots[i].nCache		= KPNOCACHE;
+	}
+
+} // ! CreatePool
+
+
+// ReleasePool ////
+///////////////////
+//
+// Releases the caches of a pool without flushing them, the counters and the ring are kept
+void KPD3DVertexCacheManager::ReleasePool(KPCACHEPOOL *pPool)
+{
+	for ( UINT i = 0; i < pPool->numCaches; ++i )
+		delete pPool->pCaches[i];
+
+	delete [] pPool->pCaches;
+	delete [] pPool->pLastUse;
+	delete [] pPool->pUses;
+	delete [] pPool->pSlots;
+
+	pPool->pCaches		= NULL;
+	pPool->pLastUse		= NULL;
+	pPool->pUses		= NULL;
+	pPool->pSlots		= NULL;
+	pPool->numCaches	= 0;
+
+} // ! ReleasePool
+
+
+// GetPool ////
+///////////////
+//
+// Returns the cache pool of a vertex type, NULL upon invalid vertex type
+KPCACHEPOOL* KPD3DVertexCacheManager::GetPool(KPVERTEXID VertexID)
+{
+	switch ( VertexID )
+	{
+	case VID_UU:
+		return &m_Pools[VID_UU];
+	case VID_UL:
+		return &m_Pools[VID_UL];
+	default:
+		return NULL;
+	}
+}
+
+
+// Skin Hash Table ////
+///////////////////////
+//
+// Linear probing, a skin maps to the cache that got it last. A skin can be
+// used by two caches when a locked cache filled up during Reserve, the
+// older one is no longer mapped and gets a new skin like any other cache.
+
+// Returns the index of the cache using the skin, KPNOCACHE if none
+UINT KPD3DVertexCacheManager::FindCache(const KPCACHEPOOL *pPool, UINT nSkinID)
+{
+	for ( UINT i = KPSkinSlot(pPool, nSkinID); pPool->pSlots[i].nCache != KPNOCACHE; i = ( i + 1 ) & pPool->nSlotMask )
+	{
+		if ( pPool->pSlots[i].nSkinID == nSkinID )
+			return pPool->pSlots[i].nCache;
+	}
+
+	return KPNOCACHE;
+}
+
+// Maps the skin to a cache, replacing its old cache
+void KPD3DVertexCacheManager::MapSkin(KPCACHEPOOL *pPool, UINT nSkinID, UINT nCache)
+{
+	UINT i = KPSkinSlot(pPool, nSkinID);
+
+	while ( pPool->pSlots[i].nCache != KPNOCACHE && pPool->pSlots[i].nSkinID != nSkinID )
+		i = ( i + 1 ) & pPool->nSlotMask;
+
+	pPool->pSlots[i].nSkinID	= nSkinID;
+	pPool->pSlots[i].nCache		= nCache;
+}
+
+// Removes the skin if it is mapped to the cache
+void KPD3DVertexCacheManager::UnmapSkin(KPCACHEPOOL *pPool, UINT nSkinID, UINT nCache)
+{
+	UINT i = KPSkinSlot(pPool, nSkinID);
+
+	while ( pPool->pSlots[i].nSkinID != nSkinID )
+	{
+		if ( pPool->pSlots[i].nCache == KPNOCACHE )
+			return;
+
+		i = ( i + 1 ) & pPool->nSlotMask;
+	}
+
+	if ( pPool->pSlots[i].nCache != nCache )
+		return;
+
+	// Backward shift deletion: the following entries of the probe sequence
+	// move into the hole unless their home slot is after it, so the table
+	// needs no deleted markers and the lookups stop at the first free slot
+	for ( UINT j = ( i + 1 ) & pPool->nSlotMask; pPool->pSlots[j].nCache != KPNOCACHE; j = ( j + 1 ) & pPool->nSlotMask )
+	{
+		UINT nHome = KPSkinSlot(pPool, pPool->pSlots[j].nSkinID);
+
+		// Distances from the home slot, the entry stays if the hole is not on its probe sequence
+		if ( ( ( j - nHome ) & pPool->nSlotMask ) >= ( ( j - i ) & pPool->nSlotMask ) )
+		{
+			pPool->pSlots[i] = pPool->pSlots[j];
+			i = j;
+		}
+	}
+
+	pPool->pSlots[i].nSkinID	= KPNOTEXTURE;
+	pPool->pSlots[i].nCache		= KPNOCACHE;
+}
+
+
+// ChooseCache ////
+///////////////////
+/*
+	Chooses the cache getting a new skin: an empty cache if there is one,
+	otherwise the one the eviction policy selects. Scans the caches of
+	the pool, it only runs when no cache uses the skin.
+
+	Parameters:
+		pPool			: Pointer to the cache pool
+		bSkipReserved	: true if the caches locked by Reserve can't be chosen
+
+	Returns:
+		The index of the cache, KPNOCACHE if every cache is locked
+*/
+UINT KPD3DVertexCacheManager::ChooseCache(const KPCACHEPOOL *pPool, bool bSkipReserved)
+{
+	UINT nBest = KPNOCACHE;
+
+	for ( UINT i = 0; i < pPool->numCaches; ++i )
+	{
+		if ( bSkipReserved && pPool->pCaches[i]->IsReserved() )
+			continue;
+
+		if ( nBest == KPNOCACHE || KPBetterVictim(pPool, m_Policy, i, nBest) )
+			nBest = i;
+	}
+
+	return nBest;
+
+} // ! ChooseCache
+
+
+// AssignSkin ////
+//////////////////
+//
+// Gives a skin to a cache chosen by ChooseCache, its vertices of another skin are flushed
+void KPD3DVertexCacheManager::AssignSkin(KPCACHEPOOL *pPool, UINT nCache, UINT nSkinID)
+{
+	KPD3DVertexCache *pCache = pPool->pCaches[nCache];
+
+	++pPool->Stats.numMisses;
+
+	if ( ! pCache->UsesSkin(nSkinID) )
+	{
+		if ( ! pCache->IsEmpty() )
+			++pPool->Stats.numEvictions;
+
+		UnmapSkin(pPool, pCache->GetSkinID(), nCache);
+		pCache->SetSkin(nSkinID);	// We render data here if the cache is not empty
+	}
+
+	MapSkin(pPool, nSkinID, nCache);
+	pPool->pUses[nCache] = 0;
+
+} // ! AssignSkin
+
+
+// RENDER ////
+//////////////
+/*
+	Caches the vertex and index lists. NOTE: The supplised data
+	will not be rendered to the screen immediately, only after
+	enough data is cached. You can force immediate rendering
+	by calling the ForcedFlush, ForceFlushAll functions.
+
+	Parameters:
+		VertexID	: KPVERTEXID type object specifying the type of the vertex data
+		nSkinID		: UINT type value specifying the ID of the Skin the vertices are using
+		nVertices	: UINT type value specifying the amount of vertices
+		nIndices	: Uint Type value specifying the amount of indices
+		pVertices	: Pointer to an array of vertex data
+		pIndices	: Pointer to an array of index data
+
+	Returns:
+		KP_OK upon success
+
+*/
+HRESULT KPD3DVertexCacheManager::Render(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices, 
+										const void *pVertices, const WORD *pIndices)
+{
+	////
+	//  1) Determine the vertex type 
+	////
+
+	KPCACHEPOOL *pPool = GetPool(VertexID);
+
+	if ( ! pPool )
+	{
+		Log("Render: Invalid vertex type!");
+		return KP_INVALIDID;
+	}
+
+	// The deferred draws are cached when the queue is executed
+	if ( m_bDeferred )
+		return Enqueue(KPQUEUE_DYNAMIC, VertexID, nSkinID, nVertices, nIndices, pVertices, pIndices);
+
+	return RenderDynamic(pPool, nSkinID, nVertices, nIndices, pVertices, pIndices);
+
+} // Render vertex & index lists
+
+
+// RenderDynamic ////
+/////////////////////
+//
+// Adds the vertices to the cache of their skin, Render without the queue
+HRESULT KPD3DVertexCacheManager::RenderDynamic(KPCACHEPOOL *pPool, UINT nSkinID, UINT nVertices, UINT nIndices,
+											   const void *pVertices, const WORD *pIndices)
+{
+	m_dwActiveSB  = KPNOTEXTURE;	// Invalidate the currently active static buffer.
+
+	++pPool->Stats.numRequests;
+	++m_nClock;
+
+	////
+	//	2) Search for the most appropriate cache
+	////
+
+	// If a cache uses the same skin, we can just add our
+	// vertices to it fast, without setting a new skin for it.
+	UINT nCache = FindCache(pPool, nSkinID);
+
+	if ( nCache != KPNOCACHE )
+		++pPool->Stats.numHits;
+	else
+	{
+		// Otherwise an empty cache gets the skin, if there is no empty
+		// cache we have no other option but flushing one and reuse that.
+		nCache = ChooseCache(pPool, false);
+		AssignSkin(pPool, nCache, nSkinID);
+	}
+
+	pPool->pLastUse[nCache] = m_nClock;
+	++pPool->pUses[nCache];
+
+	return pPool->pCaches[nCache]->Add(nVertices, nIndices, pVertices, pIndices);
+
+} // ! RenderDynamic
+
+
+// Render32 ////
+////////////////
+/*
+	Caches vertex and 32-bit index lists like Render. The lists fitting into
+	a cache only get 16-bit indices, the larger triangle lists are split into
+	chunks a cache can hold.
+
+	Parameters:
+		VertexID	: KPVERTEXID type object specifying the type of the vertex data
+		nSkinID		: UINT type value specifying the ID of the Skin the vertices are using
+		nVertices	: UINT type value specifying the amount of vertices
+		nIndices	: UINT type value specifying the amount of indices
+		pVertices	: Pointer to an array of vertex data
+		pIndices	: Pointer to an array of index data, optional. Without indices the vertices are a triangle list
+
+	Returns:
+		KP_OK			: upon success
+
+		KP_INVALIDPARAM	: if an index is out of range, or a list to split is not a triangle list
+		KP_OUTOFMEMORY	: if the chunks can't be built
+		KP_INVALIDID	: upon invalid vertex id
+		KP_FAIL			: if a cache can't hold a whole triangle
+*/
+HRESULT KPD3DVertexCacheManager::Render32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+										  const void *pVertices, const UINT *pIndices)
+{
+	KPCACHEPOOL *pPool	= GetPool(VertexID);
+	HRESULT		hr		= KP_OK;
+
+	if ( ! pPool )
+	{
+		Log("Render32: Invalid vertex type!");
+		return KP_INVALIDID;
+	}
+
+	// Without indices whole triangles are passed to the caches
+	if ( ! pIndices )
+	{
+		UINT nBatch = ( ( m_numMaxVertices < m_numMaxIndices ) ? m_numMaxVertices : m_numMaxIndices ) / 3 * 3;
+
+		if ( nBatch == 0 )
+		{
+			Log("Render32: The caches can't hold a triangle, max vertices: %u, max indices: %u", m_numMaxVertices, m_numMaxIndices);
+			return KP_FAIL;
+		}
+
+		for ( UINT n = 0; n < nVertices && SUCCEEDED(hr); n += nBatch )
+		{
+			UINT nCount = ( nVertices - n < nBatch ) ? nVertices - n : nBatch;
+
+			hr = Render(VertexID, nSkinID, nCount, nCount, (const BYTE*)pVertices + (size_t)n * pPool->nStride, NULL);
+		}
+
+		return hr;
+	}
+
+	for ( UINT i = 0; i < nIndices; ++i )
+	{
+		if ( pIndices[i] >= nVertices )
+		{
+			Log("Render32: Index out of range: %u at %u, number of vertices: %u", pIndices[i], i, nVertices);
+			return KP_INVALIDPARAM;
+		}
+	}
+
+	// Fits into a cache, only the index size changes
+	if ( nVertices <= m_numMaxVertices && nIndices <= m_numMaxIndices )
+	{
+		if ( ! m_SplitIndices.SetCount(nIndices) )
+			return KP_OUTOFMEMORY;
+
+		for ( UINT i = 0; i < nIndices; ++i )
+			m_SplitIndices[i] = (WORD)pIndices[i];
+
+		return Render(VertexID, nSkinID, nVertices, nIndices, pVertices, m_SplitIndices.GetData());
+	}
+
+	if ( nIndices % 3 != 0 )
+	{
+		Log("Render32: Only triangle lists can be split, number of indices: %u", nIndices);
+		return KP_INVALIDPARAM;
+	}
+
+	if ( ! PrepareSplit(nVertices, pPool->nStride, m_numMaxVertices, m_numMaxIndices) )
+		return KP_OUTOFMEMORY;
+
+	// Render copies the chunk, the scratch arrays are reused by the next one
+	for ( UINT nStart = 0; nStart < nIndices && SUCCEEDED(hr); )
+	{
+		UINT nChunkVertices, nChunkIndices;
+
+		nStart	= SplitChunk((const BYTE*)pVertices, pPool->nStride, pIndices, nIndices, nStart,
+							 m_numMaxVertices, m_numMaxIndices, &nChunkVertices, &nChunkIndices);
+		hr		= Render(VertexID, nSkinID, nChunkVertices, nChunkIndices, m_SplitVertices.GetData(), m_SplitIndices.GetData());
+	}
+
+	return hr;
+
+} // ! Render32
+
+
+// Mesh Splitting ////
+//////////////////////
+//
+// A triangle list is split into chunks in index order, a chunk takes
+// triangles until the next one's new vertices would not fit. The vertices
+// of a chunk are copied once, the first time a triangle uses them, and the
+// chunk indices point to the copies. The source vertices remember their
+// copy with a stamp of the chunk, so the table is never cleared.
+
+// Makes room for splitting a list of nVertices into chunks of the given size
+bool KPD3DVertexCacheManager::PrepareSplit(UINT nVertices, UINT nStride, UINT nMaxVertices, UINT nMaxIndices)
+{
+	// The new stamps are zero, older than any chunk. The local indices
+	// and the chunks are written before they are read, they are not cleared.
+	if ( nVertices > m_SplitStamp.GetCount() )
+	{
+		if ( ! m_SplitStamp.Resize(nVertices) || ! m_SplitLocal.SetCount(nVertices) )
+			return false;
+	}
+
+	return m_SplitVertices.SetCount(nMaxVertices * nStride) && m_SplitIndices.SetCount(nMaxIndices);
+}
+
+// Builds the chunk starting at index nStart into the scratch arrays, returns the start of the next one
+UINT KPD3DVertexCacheManager::SplitChunk(const BYTE *pVertices, UINT nStride, const UINT *pIndices, UINT nIndices, UINT nStart,
+										 UINT nMaxVertices, UINT nMaxIndices, UINT *pnVertices, UINT *pnIndices)
+{
+	UINT	*pLocal		= m_SplitLocal.GetData();
+	UINT	*pStamp		= m_SplitStamp.GetData();
+	BYTE	*pChunkV	= m_SplitVertices.GetData();
+	WORD	*pChunkI	= m_SplitIndices.GetData();
+	UINT	numVertices	= 0;
+	UINT	numIndices	= 0;
+	UINT	i			= nStart;
+
+	// The clock wrapped around, the old stamps could match again
+	if ( ++m_nSplitStamp == 0 )
+	{
+		memset(pStamp, 0, m_SplitStamp.GetCount() * sizeof(UINT));
+		m_nSplitStamp = 1;
+	}
+
+	for ( ; i + 3 <= nIndices && numIndices + 3 <= nMaxIndices; i += 3 )
+	{
+		UINT nNew = 0;
+
+		// A vertex used twice by a degenerate triangle is counted twice, the chunk just ends earlier
+		for ( UINT k = 0; k < 3; ++k )
+		{
+			if ( pStamp[ pIndices[i + k] ] != m_nSplitStamp )
+				++nNew;
+		}
+
+		if ( numVertices + nNew > nMaxVertices )
+			break;
+
+		for ( UINT k = 0; k < 3; ++k )
+		{
+			UINT v = pIndices[i + k];
+
+			if ( pStamp[v] != m_nSplitStamp )
+			{
+				pStamp[v] = m_nSplitStamp;
+				pLocal[v] = numVertices;
+
+				memcpy(pChunkV + (size_t)numVertices * nStride, pVertices + (size_t)v * nStride, nStride);
+				++numVertices;
+			}
+
+			pChunkI[numIndices++] = (WORD)pLocal[v];
+		}
+	}
+
+	*pnVertices	= numVertices;
+	*pnIndices	= numIndices;
+
+	return i;
+
+} // ! SplitChunk
+
+
+// Reserve ////
+///////////////
+/*
+	Reserves room for vertices in a dynamic cache and returns a pointer to it, so the
+	vertices can be written directly into the vertex buffer (e.g. by the skinning worker
+	threads). The vertices are rendered with the cache after Commit is called.
+	Until then only Reserve can be called, the locked caches can't be flushed.
+
+	Parameters:
+		VertexID	: KPVERTEXID type object specifying the type of the vertex data
+		nSkinID		: UINT type value specifying the ID of the Skin the vertices are using
+		nVertices	: UINT type value specifying the amount of vertices
+		nIndices	: UINT type value specifying the amount of indices
+		pIndices	: Pointer to an array of index data relative to the reserved vertices, optional
+		ppVertices	: Receives the address where the vertices have to be written
+
+	Returns:
+		KP_OK upon success
+
+		KP_BUFFERSIZE	: if all the usable caches are locked and full, call Commit and try again
+		KP_INVALIDPARAM	: if the data can never fit into a cache
+		KP_INVALIDID	: upon invalid vertex id
+*/
+HRESULT KPD3DVertexCacheManager::Reserve(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+										 const WORD *pIndices, void **ppVertices)
+{
+	KPCACHEPOOL *pPool = GetPool(VertexID);
+	HRESULT		hr;
+
+	if ( ! pPool )
+	{
+		Log("Reserve: Invalid vertex type!");
+		return KP_INVALIDID;
+	}
+
+	m_dwActiveSB  = KPNOTEXTURE;	// Invalidate the currently active static buffer.
+
+	++pPool->Stats.numRequests;
+	++m_nClock;
+
+	UINT nCache = FindCache(pPool, nSkinID);
+
+	if ( nCache != KPNOCACHE )
+	{
+		hr = pPool->pCaches[nCache]->Reserve(nVertices, nIndices, pIndices, ppVertices);
+
+		// If the locked cache is full, the vertices may still fit into another one
+		if ( hr != KP_BUFFERSIZE )
+		{
+			++pPool->Stats.numHits;
+			pPool->pLastUse[nCache] = m_nClock;
+			++pPool->pUses[nCache];
+
+			return hr;
+		}
+	}
+
+	// Same choice as Render, but the locked caches can't be flushed or given a new skin
+	nCache = ChooseCache(pPool, true);
+
+	// Every cache is locked
+	if ( nCache == KPNOCACHE )
+		return KP_BUFFERSIZE;
+
+	AssignSkin(pPool, nCache, nSkinID);
+
+	pPool->pLastUse[nCache] = m_nClock;
+	++pPool->pUses[nCache];
+
+	return pPool->pCaches[nCache]->Reserve(nVertices, nIndices, pIndices, ppVertices);
+
+} // ! Reserve
+
+
+// Commit ////
+//////////////
+/*
+	Unlocks the caches locked by Reserve. The reserved vertices must be written before calling it.
+*/
+HRESULT KPD3DVertexCacheManager::Commit(void)
+{
+	for ( UINT v = VID_UU; v <= VID_UL; ++v )
+	{
+		for ( UINT i = 0; i < m_Pools[v].numCaches; ++i )
+			m_Pools[v].pCaches[i]->Commit();
+	}
+
+	return KP_OK;
+
+} // ! Commit
+
+
+// SetNumCaches ////
+////////////////////
+/*
+	Replaces the dynamic caches of a vertex type. The cached vertices are
+	rendered first, the vertices reserved by Reserve have to be written.
+	More caches mean fewer flushes when many skins are rendered in a frame.
+
+	Parameters:
+		VertexID	: KPVERTEXID type object specifying the type of the vertex data
+		numCaches	: UINT type value specifying the number of caches, 1 to KPMAXCACHES
+
+	Returns:
+		KP_OK			: upon success
+
+		KP_INVALIDPARAM	: upon invalid number of caches
+		KP_INVALIDID	: upon invalid vertex id
+*/
+HRESULT KPD3DVertexCacheManager::SetNumCaches(KPVERTEXID VertexID, UINT numCaches)
+{
+	KPCACHEPOOL *pPool = GetPool(VertexID);
+
+	if ( ! pPool )
+	{
+		Log("SetNumCaches: Invalid vertex type!");
+		return KP_INVALIDID;
+	}
+
+	if ( numCaches < 1 || numCaches > KPMAXCACHES )
+	{
+		Log("SetNumCaches: Invalid number of caches: %u, the maximum is %u", numCaches, KPMAXCACHES);
+		return KP_INVALIDPARAM;
+	}
+
+	if ( numCaches == pPool->numCaches )
+		return KP_OK;
+
+	// The queued draws may use the old caches
+	ExecuteQueue();
+	ForcedFlush(VertexID);
+	ReleasePool(pPool);
+	CreatePool(pPool, numCaches);
+
+	Log("SetNumCaches: %u caches of vertex type %d", numCaches, VertexID);
+
+	return KP_OK;
+
+} // ! SetNumCaches
+
+
+// Cache Policy and Counters ////
+/////////////////////////////////
+
+void KPD3DVertexCacheManager::SetCachePolicy(KPCACHEPOLICY Policy)
+{
+	m_Policy = Policy;
+}
+
+HRESULT KPD3DVertexCacheManager::GetCacheStats(KPVERTEXID VertexID, KPCACHESTATS *pStats)
+{
+	KPCACHEPOOL *pPool = GetPool(VertexID);
+
+	if ( ! pPool )
+		return KP_INVALIDID;
+
+	*pStats = pPool->Stats;
+
+	return KP_OK;
+}
+
+void KPD3DVertexCacheManager::ResetCacheStats(void)
+{
+	memset(&m_Pools[VID_UU].Stats, 0, sizeof(KPCACHESTATS));
+	memset(&m_Pools[VID_UL].Stats, 0, sizeof(KPCACHESTATS));
+	memset(&m_QueueStats, 0, sizeof(KPQUEUESTATS));
+}
+
+void KPD3DVertexCacheManager::GetQueueStats(KPQUEUESTATS *pStats)
+{
+	*pStats = m_QueueStats;
+}
+
+void KPD3DVertexCacheManager::CountSkinChange(void)
+{
+	++m_QueueStats.numSkinChanges;
+}
+
+void KPD3DVertexCacheManager::CountBufferChange(void)
+{
+	++m_QueueStats.numBufferChanges;
+}
+
+
+// SetDeferred ////
+///////////////////
+/*
+	Turns the deferred render queue on or off. While it is on, the Render calls
+	are recorded and executed sorted by ForcedFlushAll, which EndRendering and
+	the render state changes call. Turning it off executes the recorded draws.
+
+	Parameters:
+		bDeferred	: true to record the Render calls, false to render them immediately
+*/
+void KPD3DVertexCacheManager::SetDeferred(bool bDeferred)
+{
+	if ( ! bDeferred )
+		ExecuteQueue();
+
+	m_bDeferred = bDeferred;
+}
+
+bool KPD3DVertexCacheManager::IsDeferred(void)
+{
+	return m_bDeferred;
+}
+
+
+// Enqueue ////
+///////////////
+/*
+	Records a draw and its sort key. The vertices and indices of a dynamic draw
+	are copied, the caller may reuse its arrays after Render returns. The draw
+	keeps the World matrix set at the time of the call, its depth is the depth
+	of the World origin: 0 at the near, 1 at the far clipping plane.
+
+	Parameters:
+		nSBufferID	: ID of the static buffer, KPQUEUE_DYNAMIC for dynamic vertices
+		VertexID	: KPVERTEXID type object specifying the type of the dynamic vertices
+		nSkinID		: UINT type value specifying the ID of the Skin the dynamic vertices are using
+		nVertices	: UINT type value specifying the amount of dynamic vertices
+		nIndices	: UINT type value specifying the amount of dynamic indices
+		pVertices	: Pointer to an array of vertex data
+		pIndices	: Pointer to an array of index data, optional
+
+	Returns:
+		KP_OK			: upon success
+
+		KP_OUTOFMEMORY	: if the queue can't grow, the draw is lost
+		KP_INVALIDID	: upon invalid static buffer or skin id
+*/
+HRESULT KPD3DVertexCacheManager::Enqueue(UINT nSBufferID, KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+										 const void *pVertices, const WORD *pIndices)
 {
-	DWORD dwID = 0;	// Vertex cache ID
+	const D3DMATRIX *pWorld		= m_pKPD3D->GetWorldMatrix();
+	const D3DMATRIX *pWVP		= m_pKPD3D->GetWorldViewProjMatrix();
+	UINT			numWorlds	= m_QueueWorlds.GetCount();
+	KPQUEUEITEM		Item;
+	KPQUEUEKEY		Key;
+
+	// The sort key reads the skin, a bad ID must not get that far
+	if ( nSBufferID != KPQUEUE_DYNAMIC && nSBufferID >= m_numSB )
+	{
+		Log("Enqueue: Invalid static buffer id: %u", nSBufferID);
+		return KP_INVALIDID;
+	}
 
-	m_pSB			= NULL;
-	m_numSB			= 0;
-	m_pLog			= pLog;
-	m_pDevice		= pDevice;
-	m_pKPD3D		= pKPD3D;
-	m_pSkinManager	= pSkinManager;
-	m_dwActiveCache	= KPNOTEXTURE;	// 65535, this is the maximum a dword can hold
-	m_dwActiveSB	= KPNOTEXTURE;	// 65535, this is the maximum a dword can hold
+	if ( nSBufferID == KPQUEUE_DYNAMIC && nSkinID >= m_pSkinManager->m_numSkins )
+	{
+		Log("Enqueue: Invalid skin id: %u", nSkinID);
+		return KP_INVALIDID;
+	}
 
-	// Create the buffers
-	for ( int i = 0; i < KPNUMCACHES; ++i )
+	// The draws following each other share their World matrix
+	if ( numWorlds == 0 || memcmp(&m_QueueWorlds[numWorlds - 1], pWorld, sizeof(D3DMATRIX)) != 0 )
 	{
-		// Untransformed, Unlit vertex buffer
-		m_CacheUU[i] = new KPD3DVertexCache(numMaxVertices, numMaxIndices, sizeof(VERTEX), pSkinManager,
-											pDevice, this, ++dwID, FVF_VERTEX, pLog);
+		if ( ! m_QueueWorlds.PushBack(*pWorld) )
+			return KP_OUTOFMEMORY;
+
+		++numWorlds;
+	}
 
-		// Untransformed, lit vertex buffer
-		m_CacheUL[i] = new KPD3DVertexCache(numMaxVertices, numMaxIndices, sizeof(LVERTEX), pSkinManager,
-											pDevice, this, ++dwID, FVF_LVERTEX, pLog);
+	Item.nSBufferID	= nSBufferID;
+	Item.nWorld		= numWorlds - 1;
+	Item.nData		= 0;
+	Item.bIndices	= false;
 
+	if ( nSBufferID != KPQUEUE_DYNAMIC )
+	{
+		VertexID		= m_pSB[nSBufferID].VertexID;
+		nSkinID			= m_pSB[nSBufferID].nSkinID;
+		Item.nVertices	= 0;
+		Item.nIndices	= 0;
 	}
+	else
+	{
+		UINT nSizeV = nVertices * GetPool(VertexID)->nStride;
+		UINT nSizeI = pIndices ? nIndices * sizeof(WORD) : 0;
+		UINT nData	= m_QueueData.GetCount();
+		UINT nEnd	= nData + ( ( nSizeV + nSizeI + 3 ) & ~3u );	// The vertices of the next draw start aligned
+		UINT nGrow	= m_QueueData.GetCapacity() * 3 / 2;
+
+		// Grow by half, a frame records the data of many draws
+		if ( nEnd > m_QueueData.GetCapacity() && ! m_QueueData.Reserve( ( nEnd > nGrow ) ? nEnd : nGrow ) )
+			return KP_OUTOFMEMORY;
 
-	Log("successfully initialized.");
-	
-} // ! Constructor
+		// The data is copied right after, it is not cleared first
+		if ( ! m_QueueData.SetCount(nEnd) )
+			return KP_OUTOFMEMORY;
 
-KPD3DVertexCacheManager::~KPD3DVertexCacheManager(void)
-{
-	UINT n;
+		memcpy(m_QueueData.GetData() + nData, pVertices, nSizeV);
 
-	// Free up the static buffers if there is any
-	if ( m_pSB )
-	{
-		for ( n = 0; n < m_numSB; ++n )
-		{
-			// Release the D3D vertex buffer
-			if ( m_pSB[n].pVB )
-			{
-				m_pSB[n].pVB->Release();
-				m_pSB[n].pVB = NULL;
-			}
-			
-			// Release the D3D index buffer
-			if ( m_pSB[n].pIB )
-			{
-				m_pSB[n].pIB->Release();
-				m_pSB[n].pIB = NULL;
-			}
+		if ( pIndices )
+			memcpy(m_QueueData.GetData() + nData + nSizeV, pIndices, nSizeI);
 
-		} // ! for n
+		Item.VertexID	= VertexID;
+		Item.nSkinID	= nSkinID;
+		Item.nVertices	= nVertices;
+		Item.nIndices	= nIndices;
+		Item.nData		= nData;
+		Item.bIndices	= ( pIndices != NULL );
+	}
 
-		free( m_pSB );
-		m_pSB = NULL;
+	// Depth of the World origin in clip space, the NaN of a degenerate matrix goes to the near plane
+	float fDepth = ( pWVP->_44 > 0.0f ) ? pWVP->_43 / pWVP->_44 : 0.0f;
 
-	} // ! if SB
+	if ( ! ( fDepth > 0.0f ) )	fDepth = 0.0f;
+	if ( fDepth > 1.0f )		fDepth = 1.0f;
 
-	// Release the dynamic vertex caches
-	for ( int i = 0; i < KPNUMCACHES; ++i )
-	{
-		if ( m_CacheUU[i] )
-		{
-			delete m_CacheUU[i];
-			m_CacheUU[i] = NULL;
-		}
+	UINT64 nDepth = (UINT64)( fDepth * (float)( ( 1 << KPQUEUE_DEPTHBITS ) - 1 ) );
+	UINT64 nState = ( (UINT64)VertexID << 32 ) | ( (UINT64)( nSkinID & 0xFFFF ) << 16 ) | (UINT64)( nSBufferID & 0xFFFF );
 
-		if ( m_CacheUL[i] )
-		{
-			delete m_CacheUL[i];
-			m_CacheUL[i] = NULL;
-		}
+	// Opaque near to far, transparent far to near after every opaque draw
+	if ( ! m_pSkinManager->m_pSkins[nSkinID].bAlpha )
+		Key.nKey = ( nState << 29 ) | ( nDepth << 5 );
+	else
+		Key.nKey = ( (UINT64)1 << 63 ) | ( ( ( ( 1 << KPQUEUE_DEPTHBITS ) - 1 ) - nDepth ) << 39 ) | ( nState << 5 );
 
-	} // ! for i
+	Key.nItem	= m_Queue.GetCount();
+	Key.nPad	= 0;
 
-	Log("successfully released.");
+	if ( ! m_Queue.PushBack(Item) || ! m_QueueKeys.PushBack(Key) )
+	{
+		m_Queue.Resize(Key.nItem);
+		return KP_OUTOFMEMORY;
+	}
 
-} // ! Destructor
+	++m_QueueStats.numQueued;
 
+	return KP_OK;
 
-// RENDER ////
-//////////////
-/*
-	Caches the vertex and index lists. NOTE: The supplised data
-	will not be rendered to the screen immediately, only after
-	enough data is cached. You can force immediate rendering
-	by calling the ForcedFlush, ForceFlushAll functions.
+} // ! Enqueue
 
-	Parameters:
-		VertexID	: KPVERTEXID type object specifying the type of the vertex data
-		nSkinID		: UINT type value specifying the ID of the Skin the vertices are using
-		nVertices	: UINT type value specifying the amount of vertices
-		nIndices	: Uint Type value specifying the amount of indices
-		pVertices	: Pointer to an array of vertex data
-		pIndices	: Pointer to an array of index data
+
+// ExecuteQueue ////
+////////////////////
+/*
+	Sorts the recorded draws by their keys and renders them, setting the World
+	matrix of each. The dynamic draws go through the caches, which are flushed
+	when the World matrix changes and at the end. The current World matrix is
+	set back afterwards and the queue is emptied.
 
 	Returns:
-		KP_OK upon success
+		KP_OK			: upon success
 
+		KP_FAIL			: if a draw failed, the others are still rendered
 */
-HRESULT KPD3DVertexCacheManager::Render(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices, 
-										const void *pVertices, const WORD *pIndices)
+HRESULT KPD3DVertexCacheManager::ExecuteQueue(void)
 {
-	KPD3DVertexCache	**pCache = NULL,		// Pointer to a pointer pointing at a vertex cache
-						*pEmptyCache = NULL,	// Pointer to the last empty cache
-						*pFullestCache = NULL;  // Pointer to the cache that is the most full
+	UINT		numItems	= m_Queue.GetCount();
+	UINT		nWorld		= KPNOCACHE;
+	HRESULT		hr			= KP_OK;
+	KPQUEUEKEY	*pSorted;
 
-	int	nEmptyVC	= -1;
-	int nFullestVC	=  0;
+	if ( numItems == 0 )
+		return KP_OK;
 
-	////
-	//  1) Determine the vertex type 
-	////
+	// Without room for the sort the draws are rendered in submission order
+	if ( m_QueueSorted.Reserve(numItems) )
+		pSorted = KPRadixSort(m_QueueKeys.GetData(), m_QueueSorted.GetData(), numItems);
+	else
+		pSorted = m_QueueKeys.GetData();
 
-	switch ( VertexID )
+	for ( UINT i = 0; i < numItems; ++i )
 	{
-	case VID_UU:
-		pCache = m_CacheUU;
-		break;
-	case VID_UL:
-		pCache = m_CacheUL;
-		break;
-	default:
-		Log("Render: Invalid vertex type!");
-		return KP_INVALIDID;
-	}
+		const KPQUEUEITEM	*pItem = &m_Queue[pSorted[i].nItem];
+		HRESULT				hrDraw;
 
-	pFullestCache = pCache[0];		// Set the fullest cache to the first one.
-	m_dwActiveSB  = KPNOTEXTURE;	// Invalidate the currently active static buffer.
+		if ( pItem->nWorld != nWorld )
+		{
+			// The cached vertices belong to the previous World matrix
+			FlushCaches();
 
-	////
-	//	2) Search for the most appropriate cache
-	////
+			nWorld = pItem->nWorld;
+			m_pDevice->SetTransform(D3DTS_WORLD, &m_QueueWorlds[nWorld]);
+			++m_QueueStats.numWorldChanges;
+		}
 
-	// First we check whether any other cache uses the same skin.
-	// In that case, we can just try to add our vertices to it fast,
-	// without setting a new skin for it.
-	for ( int i = 0; i< KPNUMCACHES; ++i )
-	{
-		if ( pCache[i]->UsesSkin(nSkinID) )
-			return pCache[i]->Add(nVertices, nIndices, pVertices, pIndices);
+		if ( pItem->nSBufferID != KPQUEUE_DYNAMIC )
+			hrDraw = RenderStatic(pItem->nSBufferID);
+		else
+		{
+			KPCACHEPOOL *pPool		= GetPool(pItem->VertexID);
+			const BYTE	*pVertices	= m_QueueData.GetData() + pItem->nData;
+			const WORD	*pIndices	= pItem->bIndices ? (const WORD*)( pVertices + pItem->nVertices * pPool->nStride ) : NULL;
+
+			hrDraw = RenderDynamic(pPool, pItem->nSkinID, pItem->nVertices, pItem->nIndices, pVertices, pIndices);
+		}
 
-		// If it does not use the same skin:
+		if ( FAILED(hrDraw) )
+			hr = KP_FAIL;
+	}
 
-		// Check if the cache is empty
-		if ( pCache[i]->IsEmpty() )
-			pEmptyCache = pCache[i];
+	FlushCaches();
 
-		// Find the bigger cache
-		if ( pCache[i]->GetNumVertices() > pFullestCache->GetNumVertices() )
-			pFullestCache = pCache[i];
+	m_pDevice->SetTransform(D3DTS_WORLD, m_pKPD3D->GetWorldMatrix());
 
-	} // ! for i
+	m_Queue.Clear();
+	m_QueueKeys.Clear();
+	m_QueueData.Clear();
+	m_QueueWorlds.Clear();
 
-	// If none of the current caches use the same skin,
-	// try to add the data to an empty cache
-	if ( pEmptyCache )
-	{
-		pEmptyCache->SetSkin(nSkinID);
-		return pEmptyCache->Add(nVertices, nIndices, pVertices, pIndices);
-	}
+	++m_QueueStats.numSorts;
 
-	// If there is no empty cache we have no other option
-	// but flushing the fullest cache and reuse that.
-	pFullestCache->Flush();	// We render data here :) Cool!
-	pFullestCache->SetSkin(nSkinID);
-	return pFullestCache->Add(nVertices, nIndices, pVertices, pIndices);
+	return hr;
 
-} // Render vertex & index lists
+} // ! ExecuteQueue
 
 
 // Render Static Buffer ////
@@ -209,8 +1120,6 @@ HRESULT KPD3DVertexCacheManager::Render(KPVERTEXID VertexID, UINT nSkinID, UINT
 */
 HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 {
-	KPRENDERSTATE rs = m_pKPD3D->GetShadeMode();
-
 	// Is this a valid static buffer id?
 	if ( nSBufferID >= m_numSB )
 	{
@@ -218,6 +1127,36 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 		return KP_INVALIDPARAM;
 	}
 
+	if ( m_bDeferred )
+		return Enqueue(nSBufferID, m_pSB[nSBufferID].VertexID, 0, 0, 0, NULL, NULL);
+
+	return RenderStatic(nSBufferID);
+
+} // ! Render static buffer
+
+
+// RenderStatic ////
+////////////////////
+//
+// Draws the chunks of the static buffer, Render without the queue
+HRESULT KPD3DVertexCacheManager::RenderStatic(UINT nSBufferID)
+{
+	HRESULT hr = KP_OK;
+
+	for ( UINT n = nSBufferID; n != KPNOCHUNK; n = m_pSB[n].nNext )
+	{
+		if ( FAILED( RenderChunk(n) ) )
+			hr = KP_FAIL;
+	}
+
+	return hr;
+}
+
+// Binds a static buffer and its skin and draws it
+HRESULT KPD3DVertexCacheManager::RenderChunk(UINT nSBufferID)
+{
+	KPRENDERSTATE rs = m_pKPD3D->GetShadeMode();
+
 	/*
 	// Is there any data in the static buffer to be rendered?
 	if ( m_pSB[nSBufferID].numVertices <= 0 )
@@ -238,6 +1177,7 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 
 		// Make this the active static buffer
 		m_dwActiveSB = nSBufferID;
+		++m_QueueStats.numBufferChanges;
 
 	} // ! if not active cache
 
@@ -355,6 +1295,7 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 
 		// Make this the active skin
 		m_pKPD3D->SetActiveSkinID( m_pSB[nSBufferID].nSkinID);
+		++m_QueueStats.numSkinChanges;
 	
 	} // ! if not active skin
 
@@ -456,7 +1397,7 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 
 	return KP_OK;
 
-} // ! Render static buffer
+} // ! RenderChunk
 
 
 // ForcedFlush ////
@@ -464,6 +1405,7 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 /*
 	Forces the rendering of all caches of a given vertex type to the backbuffer.
 	This will automatically happen when EndScene() is called for the render device.
+	The draws recorded in deferred mode are not rendered, see ForcedFlushAll.
 
 	Parameters:
 		VertexID	: KPVERTEXID type objet specifying the vertex type
@@ -476,29 +1418,20 @@ HRESULT KPD3DVertexCacheManager::Render(UINT nSBufferID)
 */
 HRESULT KPD3DVertexCacheManager::ForcedFlush(KPVERTEXID VertexID)
 {
-	KPD3DVertexCache	**pCache = NULL;	// Pointer to a vertex cache pointer
-	HRESULT				hr = KP_OK;
+	KPCACHEPOOL *pPool = GetPool(VertexID);	// Caches of the vertex type
+	HRESULT		hr = KP_OK;
 
-	// Determine which cache to use
-	switch ( VertexID )
+	// Unknown vertex type
+	if ( ! pPool )
 	{
-	case VID_UU:				// Untransformed, unlit vertex
-		pCache = m_CacheUU;
-		break;
-
-	case VID_UL:				// Untransformed, lit vertex
-		pCache = m_CacheUL;	
-		break;
-
-	default:					// Unknown vertex type
 		Log("ForcedFlush: Invalid vertex type");
 		return KP_INVALIDID;
 	}
 
 	// Flush the caches
-	for ( int i = 0; i < KPNUMCACHES; ++i )
+	for ( UINT i = 0; i < pPool->numCaches; ++i )
 	{
-		if ( FAILED( hr = pCache[i]->Flush() ) )
+		if ( FAILED( hr = pPool->pCaches[i]->Flush() ) )
 			Log("ForcedFlush: Unable to flush cache. Type: %d, Num: %d", VertexID, i);
 
 	} // ! for num caches
@@ -512,6 +1445,7 @@ HRESULT KPD3DVertexCacheManager::ForcedFlush(KPVERTEXID VertexID)
 /*
 	Forces the rendering of all caches of a every vertex type to the backbuffer.
 	This will automatically happen when EndScene() is called for the render device.
+	The draws recorded in deferred mode are sorted and rendered first.
 
 	Returns:
 		KP_OK			: upon success
@@ -520,28 +1454,51 @@ HRESULT KPD3DVertexCacheManager::ForcedFlush(KPVERTEXID VertexID)
 */
 HRESULT KPD3DVertexCacheManager::ForcedFlushAll(void)
 {
-	HRESULT hr = KP_OK;
+	HRESULT hr = ExecuteQueue();
 
-	// Flush all the UU caches
-	for ( int i = 0; i < KPNUMCACHES; ++i )
-	{
-		if ( ! m_CacheUU[i]->IsEmpty() )
-			if ( FAILED ( hr = m_CacheUU[i]->Flush() ) )
-				Log("ForcedFlushAll: Unable to flush UU Cache! Id: %d", i);
+	if ( FAILED(hr) )
+		Log("ForcedFlushAll: Unable to render the queued draws");
 
-	}
+	HRESULT hrCaches = FlushCaches();
+
+	return FAILED(hrCaches) ? hrCaches : hr;
+
+} // ! ForcedFlushAll
 
-	// Flush all the UU caches
-	for ( int i = 0; i < KPNUMCACHES; ++i )
+
+// FlushCaches ////
+///////////////////
+//
+// Renders the caches of every vertex type, the queue is left alone
+HRESULT KPD3DVertexCacheManager::FlushCaches(void)
+{
+	HRESULT hr = KP_OK;
+
+	// Flush the caches of every vertex type
+	for ( UINT v = VID_UU; v <= VID_UL; ++v )
 	{
-		if ( ! m_CacheUL[i]->IsEmpty() )
-			if ( FAILED ( hr = m_CacheUL[i]->Flush() ) )
-				Log("ForcedFlushAll: Unable to flush UL Cache! Id: %d", i);
+		for ( UINT i = 0; i < m_Pools[v].numCaches; ++i )
+		{
+			if ( ! m_Pools[v].pCaches[i]->IsEmpty() )
+				if ( FAILED ( hr = m_Pools[v].pCaches[i]->Flush() ) )
+					Log("FlushCaches: Unable to flush %s Cache! Id: %d", ( v == VID_UU ) ? "UU" : "UL", i);
+		}
 	}
 
 	return hr;
 
-} // ! ForcedFlushAll
+} // ! FlushCaches
+
+
+// EndFrame ////
+////////////////
+//
+// Fences the data the caches wrote into the rings, their room is reused when the GPU is done with the frame
+void KPD3DVertexCacheManager::EndFrame(void)
+{
+	m_Pools[VID_UU].pRing->EndFrame();
+	m_Pools[VID_UL].pRing->EndFrame();
+}
 
 
 // Invalidate States ////
@@ -582,10 +1539,166 @@ void KPD3DVertexCacheManager::InvalidateStates(void)
 HRESULT KPD3DVertexCacheManager::CreateStaticBuffer(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices, 
 													const void *pVertices, const WORD *pIndices, UINT *pSBufferID)
 {
+	return CreateStaticChunk(VertexID, nSkinID, nVertices, nIndices, pVertices, pIndices, false, pSBufferID);
+
+} // ! CreateStaticBuffer
+
+
+// Create Static Buffer 32 ////
+///////////////////////////////
+/*
+	Creates a static buffer from 32-bit indices. The buffer gets 16-bit indices
+	if it addresses at most 65536 vertices, half the memory. The larger ones get
+	32-bit indices in IM_AUTO mode if the device supports them, otherwise the
+	triangle list is split into chunks addressable with 16-bit indices. The chunks
+	share the returned ID, rendering it renders all of them.
+
+	Parameters:
+		VertexID	: KPVERTEXID type object specifying the vertex format
+		nSkinID		: UINT type falue specifying the Skin the vertices use
+		nVertices	: UINT type value specifying the number of vertices
+		nIndices	: UINT type value specifying the number of indices
+		pVertices	: Pointer to the vertex data
+		pIndices	: Pointer to the 32-bit index data, optional
+		pSBufferID	: [OUT] Pointer to an UINT type value the ID of the new static buffer can be returned into
+
+	Returns:
+		KP_OK			: upon success
+
+		KP_INVALIDPARAM	: if an index is out of range, or a mesh to split is not a triangle list
+		KP_OUTOFMEMORY	: upon not enough memory
+		KP_INVALIDID	: upon invalid vertex format id
+		KP_CREATEBUFFER	: upon failure to create vertex or index buffer
+		KP_BUFFERLOCK	: upon failure to lock the buffer
+*/
+HRESULT KPD3DVertexCacheManager::CreateStaticBuffer32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+													  const void *pVertices, const UINT *pIndices, UINT *pSBufferID)
+{
+	KPCACHEPOOL *pPool	= GetPool(VertexID);	// Only for the stride of the vertex type
+	UINT		nFirst	= KPNOCHUNK;
+	UINT		nLast	= KPNOCHUNK;
+	UINT		nChunks	= 0;
+
+	if ( ! pPool )
+	{
+		Log("CreateStaticBuffer32: Invalid vertex id: %d", VertexID );
+		return KP_INVALIDID;
+	}
+
+	if ( ! pIndices || nIndices == 0 )
+		return CreateStaticChunk(VertexID, nSkinID, nVertices, 0, pVertices, NULL, false, pSBufferID);
+
+	for ( UINT i = 0; i < nIndices; ++i )
+	{
+		if ( pIndices[i] >= nVertices )
+		{
+			Log("CreateStaticBuffer32: Index out of range: %u at %u, number of vertices: %u", pIndices[i], i, nVertices);
+			return KP_INVALIDPARAM;
+		}
+	}
+
+	// 16-bit indices are enough
+	if ( nVertices <= KPMAX_INDEX16 )
+	{
+		if ( ! m_SplitIndices.SetCount(nIndices) )
+			return KP_OUTOFMEMORY;
+
+		for ( UINT i = 0; i < nIndices; ++i )
+			m_SplitIndices[i] = (WORD)pIndices[i];
+
+		return CreateStaticChunk(VertexID, nSkinID, nVertices, nIndices, pVertices, m_SplitIndices.GetData(), false, pSBufferID);
+	}
+
+	// 32-bit indices if the device addresses every vertex, split otherwise
+	if ( m_IndexMode == IM_AUTO && nVertices - 1 <= m_nMaxVertexIndex )
+		return CreateStaticChunk(VertexID, nSkinID, nVertices, nIndices, pVertices, pIndices, true, pSBufferID);
+
+	if ( nIndices % 3 != 0 )
+	{
+		Log("CreateStaticBuffer32: Only triangle lists can be split, number of indices: %u", nIndices);
+		return KP_INVALIDPARAM;
+	}
+
+	// A chunk can take every index, only its vertices are limited
+	if ( ! PrepareSplit(nVertices, pPool->nStride, KPMAX_INDEX16, nIndices) )
+		return KP_OUTOFMEMORY;
+
+	for ( UINT nStart = 0; nStart < nIndices; ++nChunks )
+	{
+		UINT	nChunkVertices, nChunkIndices, nID;
+		HRESULT hr;
+
+		nStart	= SplitChunk((const BYTE*)pVertices, pPool->nStride, pIndices, nIndices, nStart,
+							 KPMAX_INDEX16, nIndices, &nChunkVertices, &nChunkIndices);
+		hr		= CreateStaticChunk(VertexID, nSkinID, nChunkVertices, nChunkIndices,
+									m_SplitVertices.GetData(), m_SplitIndices.GetData(), false, &nID);
+
+		// No ID of the mesh reaches the caller, the chunks built so far are
+		// dropped. They are the last ones of the array, nothing follows them.
+		if ( FAILED(hr) )
+		{
+			if ( nFirst != KPNOCHUNK )
+			{
+				for ( UINT n = nFirst; n < m_numSB; ++n )
+				{
+					if ( m_pSB[n].pVB )
+					{
+						m_pSB[n].pVB->Release();
+						m_pSB[n].pVB = NULL;
+					}
+
+					if ( m_pSB[n].pIB )
+					{
+						m_pSB[n].pIB->Release();
+						m_pSB[n].pIB = NULL;
+					}
+				}
+
+				m_numSB = nFirst;
+			}
+
+			Log("CreateStaticBuffer32: Unable to create chunk %u, the mesh is not created", nChunks);
+			return hr;
+		}
+
+		// Link the chunks in order
+		if ( nFirst == KPNOCHUNK )
+			nFirst = nID;
+		else
+			m_pSB[nLast].nNext = nID;
+
+		nLast = nID;
+	}
+
+	Log("CreateStaticBuffer32: %u vertices split into %u chunks with 16-bit indices. SB id: %u", nVertices, nChunks, nFirst);
+
+	*pSBufferID = nFirst;
+
+	return KP_OK;
+
+} // ! CreateStaticBuffer32
+
+
+void KPD3DVertexCacheManager::SetIndexMode(KPINDEXMODE Mode)
+{
+	m_IndexMode = Mode;
+}
+
+
+// CreateStaticChunk ////
+/////////////////////////
+//
+// Creates one static buffer with 16- or 32-bit indices, CreateStaticBuffer
+// and every chunk of a split mesh. The parameters and the return values are
+// the ones of CreateStaticBuffer, pIndices points to UINTs if bIndex32 is set.
+HRESULT KPD3DVertexCacheManager::CreateStaticChunk(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+												   const void *pVertices, const void *pIndices, bool bIndex32, UINT *pSBufferID)
+{
 
 	HRESULT hr;
 	DWORD	dwActualFVF;
 	void	*pData;
+	UINT	nIndexSize = bIndex32 ? sizeof(UINT) : sizeof(WORD);
 
 	// Check if we have enough space for another static buffer
 	if ( m_numSB >= KPMAX_ID )
@@ -600,37 +1713,26 @@ HRESULT KPD3DVertexCacheManager::CreateStaticBuffer(KPVERTEXID VertexID, UINT nS
 	{
 		int nSize = (m_numSB+25) * sizeof(KPSTATICBUFFER);
 		
-		void* tmp = realloc(m_pSB, nSize);
-		if ( tmp != NULL )
-		{
-			m_pSB = (KPSTATICBUFFER*)tmp;
-			tmp = NULL;
-		}
-		else
+		// The old array is kept on failure, the buffers created so far stay valid
+		void* tmp = KPAlignedRealloc(m_pSB, m_numSB * sizeof(KPSTATICBUFFER), nSize);
+		if ( tmp == NULL )
 		{
-			free(m_pSB);
-			free(tmp);
 			Log("CreateStaticBuffer: Unable to extend static buffer: OUT_OF_MEMORY. SB Nr: %d, New size: %d", m_numSB, nSize);
 			return KP_OUTOFMEMORY;
 		}
 
-		/*
-		m_pSB = (KPSTATICBUFFER*)realloc(m_pSB, nSize);
-
-		if ( ! m_pSB )
-		{
-			Log("CreateStaticBuffer: Unable to extend static buffer: OUT_OF_MEMORY. SB Nr: %d, New size: %d", m_numSB, nSize);
-			return KP_OUTOFMEMORY;
-		}
-		*/
+		m_pSB = (KPSTATICBUFFER*)tmp;
 	}
 
 	// Set Static Buffer properties
 	m_pSB[m_numSB].numVertices	= nVertices;
 	m_pSB[m_numSB].numIndices	= nIndices;
+	m_pSB[m_numSB].VertexID		= VertexID;
 	m_pSB[m_numSB].nSkinID		= nSkinID;
 	m_pSB[m_numSB].pVB			= NULL;
 	m_pSB[m_numSB].pIB			= NULL;
+	m_pSB[m_numSB].bIndex32		= bIndex32;
+	m_pSB[m_numSB].nNext		= KPNOCHUNK;
 
 	// Determine the size and format of vertices
 	switch ( VertexID )
@@ -657,8 +1759,8 @@ HRESULT KPD3DVertexCacheManager::CreateStaticBuffer(KPVERTEXID VertexID, UINT nS
 		m_pSB[m_numSB].bIndices	= true;
 		m_pSB[m_numSB].numTriangles = nIndices / 3;
 
-		hr = m_pDevice->CreateIndexBuffer(nIndices * sizeof(WORD), D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT,
-										  &m_pSB[m_numSB].pIB, NULL);
+		hr = m_pDevice->CreateIndexBuffer(nIndices * nIndexSize, D3DUSAGE_WRITEONLY, bIndex32 ? D3DFMT_INDEX32 : D3DFMT_INDEX16,
+										  D3DPOOL_DEFAULT, &m_pSB[m_numSB].pIB, NULL);
 		if ( FAILED(hr) )
 		{
 			Log("CreateStaticBuffer: Unable to create index buffer");
@@ -668,7 +1770,7 @@ HRESULT KPD3DVertexCacheManager::CreateStaticBuffer(KPVERTEXID VertexID, UINT nS
 		// Lock the index buffer
 		if( SUCCEEDED( m_pSB[m_numSB].pIB->Lock(0, 0, (void**)(&pData), 0) ) )
 		{
-			memcpy(pData, pIndices, nIndices*sizeof(WORD));
+			memcpy(pData, pIndices, nIndices*nIndexSize);
 			m_pSB[m_numSB].pIB->Unlock();
 		}
 		else
@@ -720,7 +1822,7 @@ HRESULT KPD3DVertexCacheManager::CreateStaticBuffer(KPVERTEXID VertexID, UINT nS
 
 	return KP_OK;
 
-} // ! CreateStaticBuffer
+} // ! CreateStaticChunk
 
 
 
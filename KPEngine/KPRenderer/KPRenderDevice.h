@@ -114,6 +114,35 @@ class KPVertexCacheManager
 		virtual HRESULT	CreateStaticBuffer(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
 										   const void *pVertices, const WORD *pIndices, UINT *pSBufferID) = 0;
 
+		//! Letrehoz egy statikus buffert 32 bites indexekbol. A buffer 16 bites indexeket kap, ha legfeljebb 65536 vertexet cimez.
+		/*!
+			A nagyobb haloknal az SetIndexMode beallitasa donti el, hogy a buffer 32 bites indexeket kap, vagy a halo
+			16 bitesen cimezheto darabokra bomlik. A darabok egy azonositot kapnak, a Render(nSBufferID) mindet rendereli.
+			Darabolas csak haromszoglistakra mukodik, az indexek szama 3 tobbszorose kell legyen.
+
+			\param [in] VertexID KPVERTEXID tipusu objektum amely meghatarozza a vertex tipusat.
+			\param [in] nSkinID UINT tipusu ertek amely meghatarozza a vertexek altal hasznalt skint.
+			\param [in] nVertices UINT tipusu ertek amely megadja a vertexek szamat.
+			\param [in] nIndices UINT tipusu ertek amely megadja a vertex indexek szamat.
+			\param [in] pVertices Mutato egy bufferre amely tartalmazza a vertexeket.
+			\param [in] pIndices Mutato egy UINT tipusu bufferre amely tartalmazza a vertex indexeket, lehet NULL.
+			\param [out] pSBufferID Mutato egy UINT tipusu valtozora amely befogadja a letrehozott statikus buffer azonositojat.
+			\return KP_OK sikeres vegrehajtas eseten.
+			\return KP_INVALIDPARAM ha egy index a vertexeken kivulre mutat, vagy a darabolando halo nem haromszoglista.
+			\return KP_OUTOFMEMORY memoria tulcsordulas eseten.
+			\return KP_INVALIDID ervenytelen vertex tipus eseten.
+			\return KP_CREATEBUFFER a statikus es index bufferek letrehozasa kozben felmerulo hibak eseten.
+			\return KP_BUFFERLOCK sikertelen buffer lock eseten.
+		*/
+		virtual HRESULT	CreateStaticBuffer32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+											 const void *pVertices, const UINT *pIndices, UINT *pSBufferID) = 0;
+
+		//! Beallitja, hogy a 65536-nal tobb vertexet cimzo statikus bufferek 32 bites indexeket kapjanak, vagy darabokra bomoljanak.
+		/*!
+			\param [in] Mode KPINDEXMODE tipusu ertek: IM_AUTO (alapertelmezett) vagy IM_SPLIT.
+		*/
+		virtual void	SetIndexMode(KPINDEXMODE Mode) = 0;
+
 		//! A gyorsttrba helyezi a renderelni kvnt vertex s index listk azonostit. Elegend? mennyisg? adat esetn a kperny?re renderel.
 		/*!
 			A gyorsttrba helyezett adatok csak akkor kerlnek renderelsre ha elegend? adatmennyisg gylemlett fel.
@@ -132,6 +161,21 @@ class KPVertexCacheManager
 		virtual HRESULT	Render(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
 							   const void *pVertices, const WORD *pIndices) = 0;
 
+		//! Mint a Render, de 32 bites indexeket fogad. A dinamikus bufferekbe nem fero haromszoglistak darabokban kerulnek a bufferekbe.
+		/*!
+			\param [in] VertexID KPVERTEXID tipusu objektum amely megadja a vertexek tipusat
+			\param [in] nSkinID UINT tipusu ertek amely megadja a vertexek altal hasznalt skin azonositojat
+			\param [in] nVertices UINT tipusu ertek amely megadja a vertexek szamat
+			\param [in] nIndices UINT tipusu ertek amely megadja a vertex indexek szamat
+			\param [in] pVertices Mutato egy a vertexeket tartalmazo tombre.
+			\param [in] pIndices Mutato egy UINT tipusu a vertex indexeket tartalmazo tombre, lehet NULL.
+			\return KP_OK sikeres vegrehajtas eseten.
+			\return KP_INVALIDPARAM ha egy index a vertexeken kivulre mutat, vagy a darabolando lista nem haromszoglista.
+			\return KP_INVALIDID ervenytelen vertex tipus eseten.
+		*/
+		virtual HRESULT	Render32(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+								 const void *pVertices, const UINT *pIndices) = 0;
+
 		//! A statikus buffer tartalmt a kperny?re rendereli.
 		/*!
 			\param [in] nSBufferID UINT tpus vltoz amely megadja a renderelni kvnt statikus buffer azonostjt
@@ -141,6 +185,79 @@ class KPVertexCacheManager
 		*/
 		virtual HRESULT Render(UINT nSBufferID) = 0;
 
+		//! Helyet foglal a vertexeknek egy dinamikus bufferben, a vertexeket a hivo kozvetlenul a bufferbe irja.
+		/*!
+			A visszaadott cimre a hivo (vagy a munkaszalai, pl. KPSkinCharacters) irja a vertexeket.
+			A lefoglalt bufferek a Commit hivasig zarolva maradnak, addig csak Reserve hivhato.
+
+			\param [in] VertexID KPVERTEXID tipusu objektum amely megadja a vertexek tipusat
+			\param [in] nSkinID UINT tipusu ertek amely megadja a vertexek altal hasznalt skin azonositojat
+			\param [in] nVertices UINT tipusu ertek amely megadja a vertexek szamat
+			\param [in] nIndices UINT tipusu ertek amely megadja a vertex indexek szamat
+			\param [in] pIndices Mutato a lefoglalt vertexekhez viszonyitott indexeket tartalmazo tombre, lehet NULL.
+			\param [out] ppVertices Ide kerul a cim, ahova a vertexeket irni kell.
+			\return KP_OK sikeres vegrehajtas eseten.
+			\return KP_BUFFERSIZE ha minden hasznalhato buffer zarolt es megtelt, ekkor Commit utan ujra kell probalni.
+			\return KP_INVALIDPARAM ha az adat egyetlen bufferbe sem fer bele.
+			\return KP_INVALIDID ervenytelen vertex tipus eseten.
+		*/
+		virtual HRESULT	Reserve(KPVERTEXID VertexID, UINT nSkinID, UINT nVertices, UINT nIndices,
+								const WORD *pIndices, void **ppVertices) = 0;
+
+		//! Feloldja a Reserve altal zarolt buffereket, a lefoglalt vertexek ezutan renderelhetok.
+		/*!
+			\return KP_OK sikeres vegrehajtas eseten.
+		*/
+		virtual HRESULT	Commit(void) = 0;
+
+		//! Beallitja egy vertex tipus dinamikus buffereinek szamat.
+		/*!
+			A regi bufferek tartalma elobb kirajzolodik, a Reserve altal lefoglalt vertexeket a hivas elott meg kell irni.
+			Sok kulonbozo skin eseten a tobb buffer kevesebb kiuritest jelent.
+			A bufferek a rendszermemoriaban gyujtik a vertexeket, kiuriteskor a vertex tipus kozos gyuru bufferebe
+			masolodnak, igy a bufferek szama nem noveli a videomemoria hasznalatat.
+
+			\param [in] VertexID KPVERTEXID tipusu ertek amely megadja a vertexek tipusat.
+			\param [in] numCaches UINT tipusu ertek amely megadja a bufferek szamat, 1 es KPMAXCACHES kozott.
+			\return KP_OK sikeres vegrehajtas eseten.
+			\return KP_INVALIDPARAM ervenytelen bufferszam eseten.
+			\return KP_INVALIDID ervenytelen vertex tipus eseten.
+		*/
+		virtual HRESULT	SetNumCaches(KPVERTEXID VertexID, UINT numCaches) = 0;
+
+		//! Beallitja, hogy melyik dinamikus buffer uruljon ki, ha egyik sem hasznalja a renderelt vertexek skinjet.
+		/*!
+			\param [in] Policy KPCACHEPOLICY tipusu ertek: CP_FULLEST (alapertelmezett), CP_LRU vagy CP_LFU.
+		*/
+		virtual void	SetCachePolicy(KPCACHEPOLICY Policy) = 0;
+
+		//! Visszaadja egy vertex tipus dinamikus buffereinek szamlaloit az utolso ResetCacheStats hivas ota.
+		/*!
+			\param [in] VertexID KPVERTEXID tipusu ertek amely megadja a vertexek tipusat.
+			\param [out] pStats Mutato egy KPCACHESTATS tipusu objektumra amely a szamlalokat kapja.
+			\return KP_OK sikeres vegrehajtas eseten.
+			\return KP_INVALIDID ervenytelen vertex tipus eseten.
+		*/
+		virtual HRESULT	GetCacheStats(KPVERTEXID VertexID, KPCACHESTATS *pStats) = 0;
+
+		//! Lenullazza az osszes dinamikus buffer es a renderelesi sor szamlaloit.
+		virtual void	ResetCacheStats(void) = 0;
+
+		//! Be- vagy kikapcsolja a kesleltetett renderelest. Bekapcsolva a Render hivasok egy sorba kerulnek, amelyet a ForcedFlushAll (igy az EndRendering es a renderelesi allapotok valtoztatasa is) vertex tipus, atlatszosag, skin, statikus buffer es melyseg szerint rendezve renderel ki. A vilag matrix valtoztatasa nem uriti ki a sort, a sor megjegyzi minden hivas vilag matrixat.
+		/*!
+			\param [in] bDeferred true eseten a Render hivasok a sorba kerulnek, false eseten a sor kiurul es a Render hivasok azonnal vegrehajtodnak.
+		*/
+		virtual void	SetDeferred(bool bDeferred) = 0;
+
+		//! Megadja, hogy a kesleltetett rendereles be van-e kapcsolva.
+		virtual bool	IsDeferred(void) = 0;
+
+		//! Visszaadja a renderelesi sor es az allapotvaltasok szamlaloit az utolso ResetCacheStats hivas ota.
+		/*!
+			\param [out] pStats Mutato egy KPQUEUESTATS tipusu objektumra amely a szamlalokat kapja.
+		*/
+		virtual void	GetQueueStats(KPQUEUESTATS *pStats) = 0;
+
 		//! A gyorsttrban tallhat sszes buffer tartalmt a kperny?re rendereli.
 		/*!
 			\return KP_OK sikeres vgrehajts esetn.
@@ -161,7 +161,7 @@ bool KPModel::LoadFile(void)
 		m_pVertices = new VERTEX[m_numVertices];
 
 		m_numIndices= m_numVertices;
-		m_pIndices	= new WORD[m_numIndices];
+		m_pIndices	= new UINT[m_numIndices];
 
 		m_pBufferID = new UINT[m_numMaterials];
 
@@ -234,7 +234,7 @@ bool KPModel::LoadFile(void)
 	
 	for ( UINT i = 0; i < m_numMaterials; ++i )
 	{
-		if ( FAILED( m_pDevice->GetVertexManager()->CreateStaticBuffer(VID_UU, m_pSkins[i], m_numVertices,	m_numIndices, m_pVertices, m_pIndices, &m_pBufferID[i]) ) )
+		if ( FAILED( m_pDevice->GetVertexManager()->CreateStaticBuffer32(VID_UU, m_pSkins[i], m_numVertices,	m_numIndices, m_pVertices, m_pIndices, &m_pBufferID[i]) ) )
 			return false;
 	}
 
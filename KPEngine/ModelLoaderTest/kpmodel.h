@@ -12,7 +12,7 @@
 
 typedef struct STRUCT_FACE
 {
-   WORD i0, i1, i2;	// Index of the vertices that build this face
+   UINT i0, i1, i2;	// Index of the vertices that build this face
    UINT nMat;		// ID of the material applied to this face
 } TRIANGLE;
 
@@ -30,7 +30,7 @@ protected:
 	VERTEX			*m_pVertices;				// Array of vertices
 
 	UINT			m_numIndices;				// Number of triangles in the object
-	WORD			*m_pIndices;				// List of trianle IDs
+	UINT			*m_pIndices;				// List of trianle IDs, 32-bit so the groups can have more than 65536 vertices
 
 	KPRenderDevice	*m_pDevice;					// Pointer to the rendering device 
 
@@ -20,7 +20,6 @@ KPModel::KPModel(const char *filePath, KPRenderDevice *pDevice, FILE *pLog)
 	m_pSkins		= NULL;
 
 	m_numVertices	= 0;
-	m_pVertices		= NULL;
 
 	m_numIndices	= 0;
 	m_pIndices		= NULL;
@@ -33,20 +32,14 @@ KPModel::KPModel(const char *filePath, KPRenderDevice *pDevice, FILE *pLog)
 		m_bReady = true;
 		fclose(m_pFile);
 
-		fprintf(m_pLog, "Modell sikeresen betltve\n");
+		fprintf(m_pLog, "Modell sikeresen bet�ltve\n");
 	}
 	else
-		fprintf(m_pLog, "Hiba a modell betltse sorn. Rossz fjl formtum, vagy a fjl nem ltezik!\n");	
+		fprintf(m_pLog, "Hiba a modell bet�lt�se sor�n. Rossz f�jl form�tum, vagy a f�jl nem l�tezik!\n");	
 }
 
 KPModel::~KPModel(void)
 {
-	if (m_pVertices)
-	{
-		delete [] m_pVertices;
-		m_pVertices = NULL;
-	}
-
 	if (m_pIndices)
 	{
 		delete [] m_pIndices;
@@ -78,20 +71,20 @@ bool KPModel::LoadFile(void)
 	UINT	v0=0,v1=0,v2=0,vt0=0,vt1=0,vt2=0;	// temporary vetrex and vertex texture index ids
 	UINT	numVertices = 0, numTextCoords = 0; // temporary data counters
 	UINT	numGroups = 0;
-	UINT	*numFaces;							// tmp counter for faces of each group
-	VERTEX  *v  = NULL;							// tmp vertex and vertex texture coordinate buffers
-	VERTEX  *vt = NULL;
+	KPAlignedArray<UINT> numFaces;				// tmp counter for faces of each group
+	KPAlignedArray<VERTEX> v, vt;				// tmp vertex and vertex texture coordinate buffers
 	UINT	vi =0, vti = 0,	gi = 0;				// tmp indexes
-	KPVector vMin, vMax;						// Max and min coordinates of the object
 	UINT	vCount=0, iCount=0;
+	KPAlignedArray<float> pPick;				// Positions of all the face vertices, for the pick mesh
+	UINT	pi = 0;								// Index of the next pick position
 
 
 
 	if (!m_pDevice)
 		return false;
 
-	numFaces = new UINT[65534];
-	ZeroMemory(numFaces, sizeof(UINT)*65534);
+	if ( !numFaces.Resize(65534) )
+		return false;
 
 	////
 	//	First we have to load the materials and textures
@@ -152,22 +145,22 @@ bool KPModel::LoadFile(void)
 	//	Allocate memory for the arrays
 	////
 
+	if ( !v.Resize(numVertices) || !vt.Resize(numTextCoords) )
+		return false;
+
 	try
 	{
-		v			= new VERTEX[numVertices];
-		vt			= new VERTEX[numTextCoords];
 		m_pBufferID = new UINT[m_numMaterials];
 	}
 	catch (std::bad_alloc)
 	{
-		delete[] v;
-		delete[] vt;
-		v		= NULL;
-		vt		= NULL;
-
 		return false;
 	}
 
+	// Empty bounds for every material, the groups grow them
+	if ( !pPick.SetCount(iCount*3) || !m_GroupBoxes.Resize(m_numMaterials) || !m_GroupSpheres.Resize(m_numMaterials) )
+		return false;
+
 	////
 	//	Start reading the data
 	////
@@ -186,18 +179,21 @@ bool KPModel::LoadFile(void)
 		}
 		else if ( IsInString(buffer, "usemtl ") != -1 )
 		{
-			// Now we can allocate vertex and index buffers
+			// Now we can allocate vertex and index buffers, the vertex
+			// storage only grows when a group is larger than the ones before
+			m_numVertices = numFaces[gi]*3;
+			m_numIndices= m_numVertices;
+
+			if ( !m_Vertices.Resize(m_numVertices) )
+				return false;
+
 			try
 			{
-				m_numVertices = numFaces[gi]*3;
-				m_pVertices = new VERTEX[m_numVertices];
-				m_numIndices= m_numVertices;
-				m_pIndices	= new WORD[m_numIndices];
+				m_pIndices	= new UINT[m_numIndices];
 			}
 			catch (std::bad_alloc)
 			{
-				delete m_pVertices;
-				delete m_pIndices;
+				return false;
 			}
 
 			// Change the active material to the specified one
@@ -219,21 +215,38 @@ bool KPModel::LoadFile(void)
 					//
 					int idx = i*3;
 
-					memcpy(&m_pVertices[idx], &v[v0-1], sizeof(VERTEX));
-					memcpy(&m_pVertices[idx+1], &v[v1-1], sizeof(VERTEX));
-					memcpy(&m_pVertices[idx+2], &v[v2-1], sizeof(VERTEX));
+					memcpy(&m_Vertices[idx], &v[v0-1], sizeof(VERTEX));
+					memcpy(&m_Vertices[idx+1], &v[v1-1], sizeof(VERTEX));
+					memcpy(&m_Vertices[idx+2], &v[v2-1], sizeof(VERTEX));
 
 					if ( strstr(buffer, "/") )
 					{
-						m_pVertices[idx].tu = vt[vt0-1].tu;
-						m_pVertices[idx].tv = vt[vt0-1].tv;
-						m_pVertices[idx+1].tu = vt[vt1-1].tu;
-						m_pVertices[idx+1].tv = vt[vt1-1].tv;
-						m_pVertices[idx+2].tu = vt[vt2-1].tu;
-						m_pVertices[idx+2].tv = vt[vt2-1].tv;
+						m_Vertices[idx].tu = vt[vt0-1].tu;
+						m_Vertices[idx].tv = vt[vt0-1].tv;
+						m_Vertices[idx+1].tu = vt[vt1-1].tu;
+						m_Vertices[idx+1].tv = vt[vt1-1].tv;
+						m_Vertices[idx+2].tu = vt[vt2-1].tu;
+						m_Vertices[idx+2].tv = vt[vt2-1].tv;
 					}
 
-					// TODO: Vector normals for better lightning.
+					// Face normal, the edges are crossed here and the whole
+					// group is normalized at once after the faces are read
+					KPVector vcEdge1(m_Vertices[idx+1].x - m_Vertices[idx].x, m_Vertices[idx+1].y - m_Vertices[idx].y, m_Vertices[idx+1].z - m_Vertices[idx].z);
+					KPVector vcEdge2(m_Vertices[idx+2].x - m_Vertices[idx].x, m_Vertices[idx+2].y - m_Vertices[idx].y, m_Vertices[idx+2].z - m_Vertices[idx].z);
+					KPVector vcNormal;
+
+					vcNormal.Cross(vcEdge1, vcEdge2);
+
+					for ( int k = 0; k < 3; ++k )
+						memcpy(m_Vertices[idx+k].vcNormal, &vcNormal.x, sizeof(float)*3);
+
+					// Keep the positions for picking, the next group overwrites the vertices
+					for ( int k = 0; k < 3; ++k, ++pi )
+					{
+						pPick[pi*3]	  = m_Vertices[idx+k].x;
+						pPick[pi*3+1] = m_Vertices[idx+k].y;
+						pPick[pi*3+2] = m_Vertices[idx+k].z;
+					}
 
 
 					// Build the vertex index list
@@ -245,54 +258,54 @@ bool KPModel::LoadFile(void)
 				} // ! if read line
 
 			} // ! for faces
-			
+
+			KPNormalizeArray(m_Vertices[0].vcNormal, sizeof(VERTEX), m_numVertices, KPPRECISION_REFINED);
+
+			// Bounds of the group, merged in case a material is used by more groups
+			KPAabb		box;
+			KPSphere	sphere;
+			UINT		nMaterial = MapMaterial(materialName);
+
+			box.Compute(&m_Vertices[0].x, sizeof(VERTEX), m_numVertices);
+			sphere.Compute(&m_Vertices[0].x, sizeof(VERTEX), m_numVertices);
+
+			if ( nMaterial < m_numMaterials )
+			{
+				m_GroupBoxes[nMaterial].Merge(box);
+				m_GroupSpheres[nMaterial].Merge(sphere);
+			}
+
 			// Add data to the vertex cache manager
 			//
 			if ( ! m_pDevice->GetVertexManager() )
 				return false;
 
-			if ( FAILED( m_pDevice->GetVertexManager()->CreateStaticBuffer(VID_UU, m_pSkins[MapMaterial(materialName)], m_numVertices,	m_numIndices, m_pVertices, m_pIndices, &m_pBufferID[MapMaterial(materialName)]) ) )
+			if ( FAILED( m_pDevice->GetVertexManager()->CreateStaticBuffer32(VID_UU, m_pSkins[MapMaterial(materialName)], m_numVertices,	m_numIndices, m_Vertices.GetData(), m_pIndices, &m_pBufferID[MapMaterial(materialName)]) ) )
 				return false;
 			// we are done with this material group, set index to next
 			gi++;
 
-			delete m_pVertices; m_pVertices = NULL;
-			delete m_pIndices; m_pIndices = NULL;
+			delete [] m_pIndices; m_pIndices = NULL;
 			m_numVertices = m_numIndices = 0;
 		} // ! else usemtl
 	} // ! while
 
-	// Find Min and Max point of the object
-	// Find half length diameter of the bounding box
-	memcpy(&vMin, &v[0], sizeof(float)*3);
-	memcpy(&vMax, &v[0], sizeof(float)*3);
-
-	for (UINT i=1; i< numVertices; ++i)
+	// Bounds of the object, the half length is the half diagonal of the box
+	if ( numVertices > 0 )
 	{
-		if ( vMin.x > v[i].x )
-			 vMin.x = v[i].x;
-		if ( vMin.y > v[i].y )
-			 vMin.y = v[i].y;
-		if ( vMin.z > v[i].z )
-			 vMin.z = v[i].z;
-
-		if ( vMax.x < v[i].x )
-			 vMax.x = v[i].x;
-		if ( vMax.y < v[i].y )
-			 vMax.y = v[i].y;
-		if ( vMax.z < v[i].z )
-			 vMax.z = v[i].z;
+		m_Bounds.Compute(&v[0].x, sizeof(VERTEX), numVertices);
+		m_Sphere.Compute(&v[0].x, sizeof(VERTEX), numVertices);
 	}
 
-	m_vCenter = (vMax + vMin) * 0.5f;
-	m_fHalfLength = ((vMax - vMin) * 0.5f).GetLength();
+	m_vCenter = m_Bounds.GetCenter();
+	m_fHalfLength = m_Bounds.GetExtents().GetLength();
 
-	delete[] numFaces;
-	delete[] v;
-	delete[] vt;
-	v  = NULL;
-	vt = NULL;
-	numFaces = NULL;
+	// Build the packets of the ray intersection tests
+	if ( ! m_PickMesh.Create(pPick.GetData(), sizeof(float)*3, NULL, pi/3) )
+		return false;
+
+	// The data lives in the static buffers from now on
+	m_Vertices.Release();
 
 	m_numVertices = vCount;
 	m_numIndices = iCount;
@@ -405,6 +418,19 @@ void KPModel::LoadMaterials(FILE *file)
 		
 } // ! LoadMaterials
 
+// Finds the closest triangle of the model hit by a ray in model space
+bool KPModel::Pick(const KPVector &vcOrigin, const KPVector &vcDirection, KPRAYHIT *pHit) const
+{
+	if ( !m_bReady )
+		return false;
+
+	// The rays missing the bounding box skip the triangle tests
+	if ( !m_Bounds.IntersectRay(vcOrigin, vcDirection, NULL) )
+		return false;
+
+	return m_PickMesh.Intersect(vcOrigin, vcDirection, pHit);
+} // ! Pick
+
 UINT KPModel::MapMaterial(const char *mName)
 {
 	for (int i=0; i<128; ++i)
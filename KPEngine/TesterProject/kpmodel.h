@@ -5,6 +5,7 @@
 
 #include "KP.h"
 #include "KPRenderDevice.h"
+#include "../KP3D/KPMemory.h"
 
 
 #ifndef KPMODEL_H
@@ -12,7 +13,7 @@
 
 typedef struct STRUCT_FACE
 {
-   WORD i0, i1, i2;	// Index of the vertices that build this face
+   UINT i0, i1, i2;	// Index of the vertices that build this face
    UINT nMat;		// ID of the material applied to this face
 } TRIANGLE;
 
@@ -28,10 +29,10 @@ private:
 	UINT			*m_pSkins;					// Array of Skin IDs used by the model
 
 	UINT			m_numVertices;				// Number of vertices building up the model
-	VERTEX			*m_pVertices;				// Array of vertices
+	KPAlignedArray<VERTEX> m_Vertices;			// Vertices of the material group being loaded, the groups reuse the storage
 
 	UINT			m_numIndices;				// Number of triangles in the object
-	WORD			*m_pIndices;				// List of trianle IDs
+	UINT			*m_pIndices;				// List of trianle IDs, 32-bit so the groups can have more than 65536 vertices
 
 	KPRenderDevice	*m_pDevice;					// Pointer to the rendering device 
 
@@ -40,6 +41,13 @@ private:
 	KPVector		m_vCenter;					// Center of the object
 	float			m_fHalfLength;				// longest distance from center to edge
 
+	KPAabb			m_Bounds;					// Bounding box of the object
+	KPSphere		m_Sphere;					// Bounding sphere of the object
+	KPAlignedArray<KPAabb>	 m_GroupBoxes;		// Bounding box of every material group, indexed by the material ID like m_pBufferID
+	KPAlignedArray<KPSphere> m_GroupSpheres;	// Bounding sphere of every material group
+
+	KPPickMesh		m_PickMesh;					// Triangles of the model for ray intersection tests
+
 	bool	LoadFile(void);						// Reads the OBJ file and loads all the data
 	void	LoadMaterials(FILE* file);			// Loads the Material Library of an OBJ file
 	UINT	MapMaterial(const char* mName);		// Maps the material string to the ID
@@ -50,10 +58,23 @@ public:
 
 	KPVector GetCenter(void);
 	float GetHalfLength(void);
+
+	const KPAabb	&GetBounds(void) const { return m_Bounds; }
+	const KPSphere	&GetSphere(void) const { return m_Sphere; }
+
+	// Bounds of the material groups in model space, GetNumMaterials of them, the ones of
+	// the materials without faces are empty. They can be passed to KPClassifyBoxes and
+	// KPClassifySpheres once the frustum is in model space.
+	const KPAabb	*GetGroupBounds(void) const { return m_GroupBoxes.GetData(); }
+	const KPSphere	*GetGroupSpheres(void) const { return m_GroupSpheres.GetData(); }
 	UINT GetNumVertices(void);
 	UINT GetNumIndices(void);
 	UINT GetNumMaterials(void);
 	HRESULT Render(void);
+
+	// Finds the closest triangle hit by a ray, e.g. from Transform2Dto3D, given in model space
+	// returns false if the ray misses the model
+	bool Pick(const KPVector &vcOrigin, const KPVector &vcDirection, KPRAYHIT *pHit) const;
 };
 
 // Checks whether a substring is part of a string
@@ -34,7 +34,6 @@ BOOL g_bIsActive	= FALSE;	// Is our window active?
 bool g_bDone		= false;	// Stay inside the main loop?
 UINT g_setShade		= 3;		// Switch shading modes in 3d view
 UINT g_nFontID		= 0;		// Id of our font type
-UINT g_nRotate		= 0;		// Amount of rotation
 FILE *pLog			= NULL;		// Application log file
 KPCOLOR g_clrWire;
 
@@ -43,6 +42,12 @@ float g_signR = 1.0f;
 float g_signG = 1.0f;
 float g_signB = 1.0f;
 
+// Orientations of the model
+KPQuaternion g_qView;		// Side views: turned by -25 degrees and tilted by -15 degrees
+KPQuaternion g_qTilt;		// 3D view: tilted by -15 degrees after spinning
+KPQuaternion g_qSpin;		// 3D view: spinning around the Y axis
+KPQuaternion g_qSpinStep;	// 3D view: rotation of one frame
+
 // KPEngine Objects
 LPKPRENDERER		g_pRenderer	= NULL;
 LPKPRENDERDEVICE	g_pDevice	= NULL;
@@ -103,9 +108,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 	g_hWnd = hWnd;
 	g_hInst = hInstance;
 
-	// Initialize SIMD if possible
-	IsSSESupported();
-
 	// Open file dialog for the first time
 	OpenFileDialog(fileName, g_hWnd, "Wavefront OBJ (*.obj)\0*.obj\0Minden Fjl (*.*)\0*.*\0");
 
@@ -360,6 +362,19 @@ HRESULT ProgramStartup(char * chAPI)
 	g_pDevice->UseWindow(0);
 	g_pDevice->InitStage(0.8f, NULL, 0);
 
+	// Record the draws, they are rendered sorted by skin when the views end
+	g_pDevice->GetVertexManager()->SetDeferred(true);
+
+	// The orientations are only concatenated from now on, no trigonometry per frame
+	KPQuaternion qTurn;
+
+	qTurn.FromAxisAngle( KPVector(0.0f, 1.0f, 0.0f), DToRad(-25) );
+	g_qTilt.FromAxisAngle( KPVector(1.0f, 0.0f, 0.0f), DToRad(-15) );
+	g_qSpinStep.FromAxisAngle( KPVector(0.0f, 1.0f, 0.0f), DToRad(1) );
+
+	g_qView = qTurn * g_qTilt;
+	g_qSpin.Identity();
+
 	return KP_OK;
 
 } // ! ProgramStartup
@@ -403,11 +418,11 @@ HRESULT ProgramCleanup(void)
 HRESULT Tick(UINT nWID)
 {
 	KPMatrix mWorld;
-	KPMatrix mWorld2;
 	KPVector vLightPosition;
-	mWorld.Identity();
-	mWorld2.Identity();
+	KPVector vcScale(1.0f, 1.0f, 1.0f);
+	KPVector vcPosition(0.0f, 0.0f, 8.0f);
 	char strShadeMode[32] = "";
+	KPQUEUESTATS QueueStats;
 
 
 	g_pDevice->SetMode(EMD_PERSPECTIVE, 0);
@@ -481,12 +496,7 @@ HRESULT Tick(UINT nWID)
 		g_pDevice->SetShadeMode(RS_SHADE_POINTS, 0.05f, &g_clrWire);
 		g_pDevice->DrawTxt(g_nFontID, 4, 4, 255, 150, 150, 150, "Vertexek");
 
-		//mWorld.RotateX( DToRad(-90) );
-		mWorld.RotateY( DToRad(-25) );
-		mWorld2.RotateX( DToRad(-15) );
-		mWorld = mWorld* mWorld2;
-
-		mWorld.Translate(0.0f, 0.0f, 8.0f);
+		mWorld.ScaleRotateTranslate(vcScale, g_qView, vcPosition);
 		g_pDevice->SetWorldTransform(&mWorld);
 		RenderModel();
 		break;
@@ -494,11 +504,7 @@ HRESULT Tick(UINT nWID)
 		g_pDevice->SetShadeMode(RS_SHADE_LINES, 0.05f, &g_clrWire);
 		g_pDevice->DrawTxt(g_nFontID, 4, 4, 255, 150, 150, 150, "lek");
 
-		mWorld.RotateY( DToRad(-25) );
-		mWorld2.RotateX( DToRad(-15) );
-		mWorld = mWorld* mWorld2;
-
-		mWorld.Translate(0.0f, 0.0f, 8.0f);
+		mWorld.ScaleRotateTranslate(vcScale, g_qView, vcPosition);
 		g_pDevice->SetWorldTransform(&mWorld);
 		RenderModel();
 
@@ -507,30 +513,24 @@ HRESULT Tick(UINT nWID)
 		g_pDevice->SetShadeMode(RS_SHADE_TRIWIRE, 0.05f, &g_clrWire);
 		g_pDevice->DrawTxt(g_nFontID, 4, 4, 255, 150, 150, 150, "Elemek");
 
-		//mWorld.RotateY( DToRad(-90) );
-		mWorld.RotateY( DToRad(-25) );
-		mWorld2.RotateX( DToRad(-15) );
-		mWorld = mWorld* mWorld2;
-
-		mWorld.Translate(0.0f, 0.0f, 8.0f);
+		mWorld.ScaleRotateTranslate(vcScale, g_qView, vcPosition);
 		g_pDevice->SetWorldTransform(&mWorld);
 		RenderModel();
 		break;
 	case 0:
 	default:
-		g_pDevice->DrawTxt(g_nFontID, 4, 4, 255, 150, 150, 150, "3D Nzet - %s\nSPACE: kitltsi md vltsa\nESC: Kilps\n\nVertexek: %d\nIndexek: %d\nHromszgek: %d\nAnyagok: %d",
-						strShadeMode, g_pModel->GetNumVertices(), g_pModel->GetNumIndices(), g_pModel->GetNumIndices()/3, g_pModel->GetNumMaterials());
+		// State bindings of the previous frame, every view counted
+		g_pDevice->GetVertexManager()->GetQueueStats(&QueueStats);
+		g_pDevice->GetVertexManager()->ResetCacheStats();
 
-		if ( (g_nRotate%360) == 0 )
-			g_nRotate = 1;
-		else
-			++g_nRotate;
+		g_pDevice->DrawTxt(g_nFontID, 4, 4, 255, 150, 150, 150, "3D Nzet - %s\nSPACE: kitltsi md vltsa\nESC: Kilps\n\nVertexek: %d\nIndexek: %d\nHromszgek: %d\nAnyagok: %d\nSkinvltsok: %d",
+						strShadeMode, g_pModel->GetNumVertices(), g_pModel->GetNumIndices(), g_pModel->GetNumIndices()/3, g_pModel->GetNumMaterials(), QueueStats.numSkinChanges);
 
-		mWorld.RotateY( DToRad(g_nRotate) );
-		mWorld2.RotateX( DToRad(-15) );
-		mWorld = mWorld* mWorld2;
+		// Spin by one degree, renormalize against the rounding errors piling up
+		g_qSpin *= g_qSpinStep;
+		g_qSpin.Normalize();
 
-		mWorld.Translate(0.0f, 0.0f, 8.0f);
+		mWorld.ScaleRotateTranslate(vcScale, g_qSpin * g_qTilt, vcPosition);
 		g_pDevice->SetWorldTransform(&mWorld);
 		RenderModel();
 